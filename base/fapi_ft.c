@@ -41,6 +41,7 @@
 #include "gsfname.h"
 
 #include "gxfapi.h"
+#include "gxsync.h"
 
 
 /* FreeType headers */
@@ -58,12 +59,24 @@
 #include FT_TRUETYPE_DRIVER_H
 #include FT_MULTIPLE_MASTERS_H
 #include FT_TYPE1_TABLES_H
+#include FT_TRUETYPE_TABLES_H
+#include FT_TRUETYPE_TAGS_H
 
 /* Note: structure definitions here start with FF_, which stands for 'FAPI FreeType". */
 
 #define ft_emprintf(m,s) { outflush(m); emprintf(m, s); outflush(m); }
 #define ft_emprintf1(m,s,d) { outflush(m); emprintf1(m, s, d); outflush(m); }
 
+/* A glyph bitmap rendered by one of the prefetch threads. */
+typedef struct ff_raster_s
+{
+    byte *bits;
+    int width, rows, pitch;
+    int left, top;
+} ff_raster;
+
+typedef struct ff_prefetch_pool_s ff_prefetch_pool;
+
 typedef struct ff_server_s
 {
     gs_fapi_server fapi_server;
@@ -73,6 +86,12 @@ typedef struct ff_server_s
     gs_memory_t *mem;
     FT_Memory ftmemory;
     struct FT_MemoryRec_ ftmemory_rec;
+
+    /* Threads rendering glyphs ahead of time, see gs_fapi_ft_prefetch_chars. */
+    ff_prefetch_pool *prefetch;
+    /* If have_prefetched, the current glyph is here rather than in bitmap_glyph. */
+    ff_raster prefetched;
+    bool have_prefetched;
 } ff_server;
 
 
@@ -96,6 +115,16 @@ typedef struct ff_face_s
     int font_data_len;
     bool data_owned;
     ff_server *server;
+
+    /* TrueType hinting state that glyphs rendered ahead of time depend on:
+     * for each function of the font program, whether calling it may change
+     * it (NULL if we can't tell which functions do), whether any may, and
+     * whether a glyph rendered on this face may already have changed it.
+     */
+    byte *fpgm_writers;
+    int fpgm_functions;
+    bool fpgm_changes_hinting;
+    bool hinting_changed;
 } ff_face;
 
 /* Here we define the struct FT_Incremental that is used as an opaque type
@@ -125,6 +154,18 @@ static void
 delete_inc_int_info(gs_fapi_server * a_server,
                     FT_IncrementalRec * a_inc_int_info);
 
+static void
+tt_fpgm_scan(ff_server *a_server, ff_face *a_face);
+
+static bool
+tt_code_changes_hinting(const ff_face *a_face, const byte *a_code, int a_length);
+
+static bool
+tt_glyph_changes_hinting(const ff_face *a_face, const byte *a_data, int a_length);
+
+static void
+ff_prefetch_forget_face(ff_server *a_server, const ff_face *a_face);
+
 FT_CALLBACK_DEF(void *)
 FF_alloc(FT_Memory memory, long size)
 {
@@ -289,6 +330,17 @@ new_face(gs_fapi_server * a_server, FT_Face a_ft_face,
         face->data_owned = data_owned;
         face->ftstrm = ftstrm;
         face->server = (ff_server *) a_server;
+        face->fpgm_writers = NULL;
+        face->fpgm_functions = 0;
+        face->fpgm_changes_hinting = false;
+        face->hinting_changed = false;
+
+        /* Glyphs calling the font program can only be rendered out of
+         * order (see gs_fapi_ft_prefetch_chars) if the functions they
+         * call keep to the per glyph hinting state.
+         */
+        if (a_ft_inc_int && FT_IS_SFNT(a_ft_face))
+            tt_fpgm_scan(s, face);
     }
     return face;
 }
@@ -298,6 +350,9 @@ delete_face(gs_fapi_server * a_server, ff_face * a_face)
 {
     if (a_face) {
         ff_server *s = (ff_server *) a_server;
+
+        if (s->prefetch)
+            ff_prefetch_forget_face(s, a_face);
         if (a_face->ft_inc_int) {
             FT_Incremental a_info = a_face->ft_inc_int->object;
 
@@ -317,6 +372,7 @@ delete_face(gs_fapi_server * a_server, ff_face * a_face)
         if (a_face->ftstrm) {
             FF_free(s->ftmemory, a_face->ftstrm);
         }
+        FF_free(s->ftmemory, a_face->fpgm_writers);
         FF_free(s->ftmemory, a_face);
     }
 }
@@ -436,6 +492,13 @@ get_fapi_glyph_data(FT_Incremental a_info, FT_UInt a_index, FT_Data * a_data)
         a_info->glyph_data_in_use = true;
     }
 
+    /* Glyphs rendered ahead of time assume the hinting state left by
+     * the 'prep' program, which a glyph rendered here may change.
+     */
+    if (!ff->is_type1 && !face->hinting_changed)
+        face->hinting_changed =
+            tt_glyph_changes_hinting(face, a_data->pointer, length);
+
     a_data->length = length;
     return 0;
 }
@@ -540,6 +603,1093 @@ ft_to_gs_error(FT_Error a_error)
     return 0;
 }
 
+/* Work out the flags load_glyph loads a glyph with. */
+static FT_Int32
+glyph_load_flags(gs_fapi_server * a_server, gs_fapi_font * a_fapi_font)
+{
+    FT_Int32 load_flags = 0;
+
+    if (!a_fapi_font->is_mtx_skipped && !a_fapi_font->is_type1) {
+        /* grid_fit == 1 is the default - use font's native hints
+         * with freetype, 1 & 3 are, in practice, the same.
+         */
+
+        if (a_server->grid_fit == 0) {
+            load_flags = FT_LOAD_NO_HINTING | FT_LOAD_NO_AUTOHINT;
+        }
+        else if (a_server->grid_fit == 2) {
+            load_flags = FT_LOAD_FORCE_AUTOHINT;
+        }
+        load_flags |= FT_LOAD_MONOCHROME | FT_LOAD_NO_BITMAP | FT_LOAD_LINEAR_DESIGN;
+    }
+    else {
+        /* Current FreeType hinting for type 1 fonts is so poor we are actually better off without it (fewer files render incorrectly) (FT_LOAD_NO_HINTING) */
+        /* We also need to disable hinting for XL format embedded truetypes */
+        load_flags |= FT_LOAD_MONOCHROME | FT_LOAD_NO_HINTING | FT_LOAD_NO_BITMAP | FT_LOAD_LINEAR_DESIGN;
+    }
+    return load_flags;
+}
+
+/* Convert the metrics of a loaded glyph to the form FAPI returns them in. */
+static void
+glyph_metrics(gs_fapi_font * a_fapi_font, ff_face * face,
+              const FT_Glyph_Metrics * a_glyph_metrics,
+              FT_Fixed a_linear_hori_advance, FT_Fixed a_linear_vert_advance,
+              gs_fapi_metrics * a_metrics)
+{
+    FT_Face ft_face = face->ft_face;
+    FT_Long hx;
+    FT_Long hy;
+    FT_Long w;
+    FT_Long h;
+    FT_Long vadv;
+
+    /* In order to get the metrics in the form we need them, we have to remove the size scaling
+     * the resolution scaling, and convert to points.
+     */
+    hx = (FT_Long) (((double)a_glyph_metrics->horiBearingX *
+                     ft_face->units_per_EM * 72.0) /
+                    ((double)face->width * face->horz_res));
+    hy = (FT_Long) (((double)a_glyph_metrics->horiBearingY *
+                     ft_face->units_per_EM * 72.0) /
+                    ((double)face->height * face->vert_res));
+
+    w = (FT_Long) (((double)a_glyph_metrics->width *
+                    ft_face->units_per_EM * 72.0) / ((double)face->width *
+                                                     face->horz_res));
+    h = (FT_Long) (((double)a_glyph_metrics->height *
+                    ft_face->units_per_EM * 72.0) /
+                   ((double)face->height * face->vert_res));
+
+    /* Ugly. FreeType creates verticla metrics for TT fonts, normally we override them in the
+     * metrics callbacks, but those only work for incremental interface fonts, and TrueType fonts
+     * loaded as CIDFont replacements are not incrementally handled. So here, if its a CIDFont, and
+     * its not type 1 outlines, and its not a vertical mode fotn, ignore the advance.
+     */
+    if (a_fapi_font->is_type1
+       || ((a_fapi_font->full_font_buf || a_fapi_font->font_file_path)
+       && a_fapi_font->is_vertical &&  FT_HAS_VERTICAL(ft_face))) {
+
+        vadv = a_linear_vert_advance;
+    }
+    else {
+        vadv = 0;
+    }
+
+    a_metrics->bbox_x0 = hx;
+    a_metrics->bbox_y0 = hy - h;
+    a_metrics->bbox_x1 = a_metrics->bbox_x0 + w;
+    a_metrics->bbox_y1 = a_metrics->bbox_y0 + h;
+    a_metrics->escapement = a_linear_hori_advance;
+    a_metrics->v_escapement = vadv;
+    a_metrics->em_x = ft_face->units_per_EM;
+    a_metrics->em_y = ft_face->units_per_EM;
+}
+
+/*
+ * Rendering glyphs ahead of time.
+ *
+ * When a text run misses the character cache, gs_fapi_ft_prefetch_chars is
+ * given the glyphs that follow in the run and renders them on a pool of
+ * threads, each with its own FreeType library and face, while the
+ * interpreter goes on with the current character. load_glyph then picks up
+ * the bitmaps as the characters come round instead of rendering them again.
+ *
+ * This is only done for TrueType outlines loaded through the incremental
+ * interface (Type 42 and CIDFontType 2 fonts), whose glyph data can be read
+ * up front: the glyph data callbacks call into the interpreter, so they must
+ * stay on the main thread. The TrueType interpreter keeps the CVT, the
+ * storage area and the twilight zone from one glyph to the next, so a glyph
+ * program that writes to them would make the result depend on the order the
+ * glyphs are rendered in. Such glyphs are left to load_glyph, and once one
+ * has been rendered nothing more is prefetched for the face. The functions
+ * of the font program are looked at one by one (see tt_fpgm_scan), so that
+ * a glyph calling only functions that don't write can still be prefetched.
+ * This helps with fonts where a few functions write; fonts hinted with
+ * ttfautohint, which keeps its working values in the storage area, write
+ * from nearly every function and are never prefetched.
+ */
+
+/* The most glyphs (with their components) read for one batch. */
+#define FF_PREFETCH_MAX_DATA 1024
+/* The deepest nesting of composite glyphs we follow. */
+#define FF_PREFETCH_MAX_DEPTH 8
+
+/* The state of the face that a glyph was rendered in. */
+typedef struct ff_render_state_s
+{
+    const ff_face *face;
+    FT_Matrix transform;
+    FT_F26Dot6 width, height;
+    FT_UInt horz_res, vert_res;
+    FT_Int32 load_flags;
+    int max_bitmap;
+    bool is_vertical;
+    int subfont;
+} ff_render_state;
+
+/* Glyph data read from the font for the prefetch threads. */
+typedef struct ff_glyph_data_s
+{
+    FT_UInt gid;
+    byte *data;
+    int length;
+    bool usable;                /* False if the glyph (or a component) changes the hinting state */
+} ff_glyph_data;
+
+typedef enum
+{
+    FF_PREFETCH_QUEUED,
+    FF_PREFETCH_RUNNING,
+    FF_PREFETCH_DONE
+} ff_prefetch_status;
+
+typedef struct ff_prefetch_glyph_s
+{
+    FT_UInt gid;
+    ff_prefetch_status status;
+    int code;                   /* 0 if the glyph was rendered */
+    FT_Glyph_Metrics metrics;
+    FT_Fixed linear_hori_advance, linear_vert_advance;
+    ff_raster raster;
+} ff_prefetch_glyph;
+
+typedef struct ff_prefetch_worker_s
+{
+    ff_prefetch_pool *pool;
+    gs_memory_t *memory;        /* A chunk allocator of its own */
+    struct FT_MemoryRec_ ftmemory_rec;
+    FT_Library library;
+    FT_Incremental_InterfaceRec inc_int;
+    FT_Face ft_face;
+    const ff_face *face;        /* The face ft_face was opened for */
+    gx_semaphore_t *work;       /* Signalled for the thread to start a batch */
+    gp_thread_id thread;
+} ff_prefetch_worker;
+
+/* Values of ff_prefetch_pool::waiting other than a glyph number. */
+#define FF_PREFETCH_NOT_WAITING (-1)
+#define FF_PREFETCH_WAITING_IDLE (-2)
+
+struct ff_prefetch_pool_s
+{
+    gs_memory_t *memory;        /* Thread safe, for the rendered bitmaps */
+    int num_threads;
+    ff_prefetch_worker *workers;
+    gx_monitor_t *lock;         /* Protects the fields below, down to the batch */
+    gx_semaphore_t *wake;       /* Signalled for the main thread, see waiting */
+    int active;                 /* Threads that haven't finished the batch yet */
+    int waiting;                /* What the main thread waits for */
+    bool shutdown;
+
+    /* The current batch. The main thread only changes it when no thread is active. */
+    ff_render_state state;
+    ff_glyph_data *data;
+    int data_count;
+    ff_prefetch_glyph *glyphs;
+    int count;
+    int next;                   /* The next glyph to claim */
+};
+
+/* If a_op, just read from a_code, is a push instruction, step *a_pos over
+ * its data, store the values in a_values (which has room for 255) and return
+ * how many there are. Return 0 for any other instruction, or -1 if the data
+ * runs past the end of the code.
+ */
+static int
+tt_push(const byte *a_code, int a_length, byte a_op, int *a_pos, int *a_values)
+{
+    int count, size, i;
+
+    if (a_op == 0x40 || a_op == 0x41) {         /* NPUSHB, NPUSHW */
+        if (*a_pos >= a_length)
+            return -1;
+        count = a_code[(*a_pos)++];
+        size = (a_op == 0x41 ? 2 : 1);
+    }
+    else if (a_op >= 0xB0 && a_op <= 0xB7) {    /* PUSHB */
+        count = a_op - 0xAF;
+        size = 1;
+    }
+    else if (a_op >= 0xB8 && a_op <= 0xBF) {    /* PUSHW */
+        count = a_op - 0xB7;
+        size = 2;
+    }
+    else
+        return 0;
+    if (*a_pos + count * size > a_length)
+        return -1;
+    for (i = 0; i < count; i++, *a_pos += size)
+        a_values[i] = (size == 1 ? a_code[*a_pos] :
+                       (short)((a_code[*a_pos] << 8) | a_code[*a_pos + 1]));
+    return count;
+}
+
+/* What TrueType code does to the hinting state kept between glyphs. */
+#define TT_CHANGES_HINTING 1    /* It may change it */
+#define TT_CALLS_UNKNOWN 2      /* It calls functions we can't tell */
+
+/* Scan a TrueType instruction stream (a glyph program or a function body)
+ * for anything that changes the hinting state kept between glyphs. A call
+ * is only followed if the function number is pushed just before it, and
+ * the code doesn't jump (which could land on the call with another number
+ * on the stack); a_writers says which functions change the state.
+ */
+static int
+tt_code_scan(const byte *a_code, int a_length, const byte *a_writers,
+             int a_num_functions)
+{
+    int values[255];
+    int pos = 0, last = -1, result = 0, n;
+    bool jumps = false, calls = false;
+
+    while (pos < a_length) {
+        byte op = a_code[pos++];
+
+        n = tt_push(a_code, a_length, op, &pos, values);
+        if (n < 0)
+            return TT_CHANGES_HINTING;
+        if (n > 0) {
+            last = values[n - 1];
+            continue;
+        }
+        switch (op) {
+            case 0x13:          /* SZP0 */
+            case 0x14:          /* SZP1 */
+            case 0x15:          /* SZP2 */
+            case 0x16:          /* SZPS */
+            case 0x42:          /* WS */
+            case 0x44:          /* WCVTP */
+            case 0x70:          /* WCVTF */
+            case 0x73:          /* DELTAC1 */
+            case 0x74:          /* DELTAC2 */
+            case 0x75:          /* DELTAC3 */
+            case 0x2C:          /* FDEF */
+            case 0x89:          /* IDEF */
+                return TT_CHANGES_HINTING;
+            case 0x1C:          /* JMPR */
+            case 0x78:          /* JROT */
+            case 0x79:          /* JROF */
+                jumps = true;
+                break;
+            case 0x2A:          /* LOOPCALL */
+            case 0x2B:          /* CALL */
+                calls = true;
+                if (a_writers == NULL || last < 0 || last >= a_num_functions)
+                    result |= TT_CALLS_UNKNOWN;
+                else if (a_writers[last])
+                    return TT_CHANGES_HINTING;
+                break;
+        }
+        last = -1;
+    }
+    if (jumps && calls)
+        result |= TT_CALLS_UNKNOWN;
+    return result;
+}
+
+static bool
+tt_code_changes_hinting(const ff_face *a_face, const byte *a_code, int a_length)
+{
+    int r = tt_code_scan(a_code, a_length, a_face->fpgm_writers,
+                         a_face->fpgm_functions);
+
+    return (r & TT_CHANGES_HINTING) ||
+        ((r & TT_CALLS_UNKNOWN) && a_face->fpgm_changes_hinting);
+}
+
+/* The most function numbers the font program may push at once for us to
+ * follow its function definitions.
+ */
+#define TT_FPGM_MAX_STACK 1024
+
+/* Load a table of the face. Return NULL if it's empty or can't be read. */
+static byte *
+tt_load_table(ff_server *a_server, FT_Face a_ft_face, FT_ULong a_tag,
+              FT_ULong *a_length)
+{
+    byte *table;
+
+    *a_length = 0;
+    if (FT_Load_Sfnt_Table(a_ft_face, a_tag, 0, NULL, a_length) != 0
+        || *a_length == 0 || *a_length > max_int)
+        return NULL;
+    table = (byte *) FF_alloc(a_server->ftmemory, *a_length);
+    if (table != NULL
+        && FT_Load_Sfnt_Table(a_ft_face, a_tag, 0, table, a_length) != 0) {
+        FF_free(a_server->ftmemory, table);
+        table = NULL;
+    }
+    return table;
+}
+
+/* Find the function definitions in a TrueType program, which must push
+ * each function number with the push instructions before it. Store the
+ * function numbers and the starts and lengths of their bodies, and return
+ * how many there are, -1 if we can't follow the program, or -2 if it
+ * defines instructions.
+ */
+static int
+tt_find_functions(const byte *a_code, int a_length, int *a_stack,
+                  int *a_funcs, int *a_starts, int *a_lengths, int a_max)
+{
+    int values[255];
+    int pos = 0, depth = 0, count = 0, n, start;
+    byte op;
+
+    while (pos < a_length) {
+        op = a_code[pos++];
+        n = tt_push(a_code, a_length, op, &pos, values);
+        if (n < 0)
+            return -1;
+        if (depth + n > TT_FPGM_MAX_STACK)
+            depth = 0;                  /* We lose track */
+        if (n > 0) {
+            memcpy(a_stack + depth, values, n * sizeof(int));
+            depth += n;
+            continue;
+        }
+        if (op == 0x89)                 /* IDEF */
+            return -2;
+        if (op != 0x2C) {               /* FDEF */
+            /* We don't know what this does to the stack */
+            depth = 0;
+            continue;
+        }
+        if (depth == 0 || a_stack[depth - 1] < 0 || count >= a_max)
+            return -1;
+        a_funcs[count] = a_stack[--depth];
+        start = pos;
+        do {
+            if (pos >= a_length)
+                return -1;
+            op = a_code[pos++];
+            n = tt_push(a_code, a_length, op, &pos, values);
+            if (n == 0 && op == 0x89)
+                return -2;
+            if (n < 0 || (n == 0 && op == 0x2C))
+                return -1;
+        } while (n > 0 || op != 0x2D);  /* ENDF */
+        a_starts[count] = start;
+        a_lengths[count] = pos - 1 - start;
+        count++;
+    }
+    return count;
+}
+
+/* Work out which functions of the font program may change the hinting
+ * state kept between glyphs, directly or through the functions they call.
+ * If we can't, any call may, unless the font program writes nothing at all.
+ * Instructions defined by the font could be used anywhere, so if there are
+ * any nothing is rendered ahead of time for the face.
+ */
+static void
+tt_fpgm_scan(ff_server *a_server, ff_face *a_face)
+{
+    FT_ULong length, prep_length;
+    byte *fpgm = tt_load_table(a_server, a_face->ft_face, TTAG_fpgm, &length);
+    byte *prep = tt_load_table(a_server, a_face->ft_face, TTAG_prep, &prep_length);
+    int *stack = NULL, *funcs = NULL;
+    int max_defs = 0, count = -1, num_functions = 0, i;
+    bool changed;
+
+    if (fpgm == NULL) {
+        FF_free(a_server->ftmemory, prep);
+        return;
+    }
+    /* There can't be more definitions than FDEF bytes. */
+    for (i = 0; i < (int)length; i++)
+        if (fpgm[i] == 0x2C)
+            max_defs++;
+    stack = (int *) FF_alloc(a_server->ftmemory,
+                             (TT_FPGM_MAX_STACK + max_defs * 3) * sizeof(int));
+    if (stack != NULL) {
+        funcs = stack + TT_FPGM_MAX_STACK;
+        count = tt_find_functions(fpgm, length, stack, funcs, funcs + max_defs,
+                                  funcs + max_defs * 2, max_defs);
+        /* The 'prep' program could redefine the functions. */
+        if (count >= 0 && prep != NULL)
+            i = tt_find_functions(prep, prep_length, stack, NULL, NULL, NULL, 0);
+        else
+            i = 0;
+        if (i != 0)
+            count = i;
+    }
+    if (count == -2)
+        a_face->hinting_changed = true;
+    for (i = 0; i < count; i++)
+        num_functions = max(num_functions, funcs[i] + 1);
+    if (count >= 0 && num_functions > 0)
+        a_face->fpgm_writers = (byte *) FF_alloc(a_server->ftmemory, num_functions);
+    if (a_face->fpgm_writers == NULL) {
+        /* As the old scan of the whole program: any write (or anything */
+        /* we can't follow) counts. */
+        a_face->fpgm_changes_hinting =
+            tt_code_scan(fpgm, length, NULL, 0) != 0 || count < 0;
+    }
+    else {
+        memset(a_face->fpgm_writers, 0, num_functions);
+        a_face->fpgm_functions = num_functions;
+        /* Calls to functions we haven't marked yet are taken as harmless */
+        /* until we find one that isn't; repeat until nothing changes.    */
+        do {
+            changed = false;
+            for (i = 0; i < count; i++) {
+                int r;
+
+                if (a_face->fpgm_writers[funcs[i]])
+                    continue;
+                r = tt_code_scan(fpgm + funcs[max_defs + i], funcs[max_defs * 2 + i],
+                                 a_face->fpgm_writers, num_functions);
+                if ((r & TT_CHANGES_HINTING) ||
+                    ((r & TT_CALLS_UNKNOWN) && a_face->fpgm_changes_hinting)) {
+                    a_face->fpgm_writers[funcs[i]] = 1;
+                    a_face->fpgm_changes_hinting = true;
+                    changed = true;
+                }
+            }
+        } while (changed);
+    }
+    FF_free(a_server->ftmemory, stack);
+    FF_free(a_server->ftmemory, prep);
+    FF_free(a_server->ftmemory, fpgm);
+}
+
+/* Split a TrueType glyph into its instructions and, for a composite glyph,
+ * its components (unless a_components is NULL). Return the number of
+ * components or < 0 if the data is malformed.
+ */
+static int
+tt_glyph_parse(const byte *a_data, int a_length, FT_UInt *a_components,
+               int a_max_components, const byte **a_code, int *a_code_length)
+{
+    int contours, pos, flags, count = 0;
+
+    *a_code = NULL;
+    *a_code_length = 0;
+    if (a_length == 0)
+        return 0;
+    if (a_length < 10)
+        return -1;
+    contours = (short)((a_data[0] << 8) | a_data[1]);
+    if (contours >= 0) {
+        pos = 10 + 2 * contours;
+    }
+    else {
+        pos = 10;
+        do {
+            if (pos + 4 > a_length)
+                return -1;
+            flags = (a_data[pos] << 8) | a_data[pos + 1];
+            if (a_components != NULL) {
+                if (count >= a_max_components)
+                    return -1;
+                a_components[count] = (a_data[pos + 2] << 8) | a_data[pos + 3];
+            }
+            count++;
+            pos += 4 + (flags & 0x0001 ? 4 : 2);        /* ARG_1_AND_2_ARE_WORDS */
+            if (flags & 0x0008)                         /* WE_HAVE_A_SCALE */
+                pos += 2;
+            else if (flags & 0x0040)                    /* WE_HAVE_AN_X_AND_Y_SCALE */
+                pos += 4;
+            else if (flags & 0x0080)                    /* WE_HAVE_A_TWO_BY_TWO */
+                pos += 8;
+        } while (flags & 0x0020);                       /* MORE_COMPONENTS */
+        if (!(flags & 0x0100))                          /* WE_HAVE_INSTRUCTIONS */
+            return count;
+    }
+    if (pos + 2 > a_length)
+        return -1;
+    *a_code_length = (a_data[pos] << 8) | a_data[pos + 1];
+    *a_code = a_data + pos + 2;
+    if (pos + 2 + *a_code_length > a_length)
+        return -1;
+    return count;
+}
+
+static bool
+tt_glyph_changes_hinting(const ff_face *a_face, const byte *a_data, int a_length)
+{
+    const byte *code;
+    int code_length;
+
+    /* Components come through here on their own, we only need the instructions. */
+    if (tt_glyph_parse(a_data, a_length, NULL, 0, &code, &code_length) < 0)
+        return true;
+    return tt_code_changes_hinting(a_face, code, code_length);
+}
+
+static bool
+is_notdef_name(const gs_fapi_font *a_fapi_font)
+{
+    return (a_fapi_font->char_data_len == 7
+            && strncmp((const char *)a_fapi_font->char_data, ".notdef", 7) == 0)
+        || (a_fapi_font->char_data_len > 9
+            && strncmp((const char *)a_fapi_font->char_data, ".notdef~GS", 10) == 0);
+}
+
+static void
+get_render_state(gs_fapi_server * a_server, gs_fapi_font * a_fapi_font,
+                 const ff_face * a_face, int a_max_bitmap, ff_render_state * a_state)
+{
+    memset(a_state, 0, sizeof(*a_state));
+    a_state->face = a_face;
+    a_state->transform = a_face->ft_transform;
+    a_state->width = a_face->width;
+    a_state->height = a_face->height;
+    a_state->horz_res = a_face->horz_res;
+    a_state->vert_res = a_face->vert_res;
+    a_state->load_flags = glyph_load_flags(a_server, a_fapi_font);
+    a_state->max_bitmap = a_max_bitmap;
+    a_state->is_vertical = a_fapi_font->is_vertical;
+    a_state->subfont = a_fapi_font->subfont;
+}
+
+static bool
+same_render_state(const ff_render_state * a, const ff_render_state * b)
+{
+    return a->face == b->face &&
+        a->transform.xx == b->transform.xx && a->transform.xy == b->transform.xy &&
+        a->transform.yx == b->transform.yx && a->transform.yy == b->transform.yy &&
+        a->width == b->width && a->height == b->height &&
+        a->horz_res == b->horz_res && a->vert_res == b->vert_res &&
+        a->load_flags == b->load_flags && a->max_bitmap == b->max_bitmap &&
+        a->is_vertical == b->is_vertical && a->subfont == b->subfont;
+}
+
+/* The incremental interface of the prefetch threads serves the glyph data
+ * read for the batch, and the metrics from the font.
+ */
+static FT_Error
+prefetch_glyph_data(FT_Incremental a_info, FT_UInt a_index, FT_Data * a_data)
+{
+    ff_prefetch_pool *pool = ((ff_prefetch_worker *) a_info)->pool;
+    int i;
+
+    for (i = 0; i < pool->data_count; i++) {
+        if (pool->data[i].gid == a_index) {
+            a_data->pointer = pool->data[i].data;
+            a_data->length = pool->data[i].length;
+            return 0;
+        }
+    }
+    return FT_Err_Invalid_Glyph_Index;
+}
+
+static void
+prefetch_free_glyph_data(FT_Incremental a_info, FT_Data * a_data)
+{
+}
+
+static FT_Error
+prefetch_glyph_metrics(FT_Incremental a_info, FT_UInt a_glyph_index,
+                       FT_Bool bVertical,
+                       FT_Incremental_MetricsRec * a_metrics)
+{
+    /* As get_fapi_glyph_metrics, for TrueType outlines with no replaced metrics. */
+    if (bVertical)
+        a_metrics->advance = 0;
+    return 0;
+}
+
+static const FT_Incremental_FuncsRec TheFAPIPrefetchInterfaceFuncs = {
+    prefetch_glyph_data,
+    prefetch_free_glyph_data,
+    prefetch_glyph_metrics
+};
+
+/* Open (or rescale) the thread's face for the current batch. */
+static bool
+prefetch_setup_face(ff_prefetch_worker * w)
+{
+    const ff_render_state *st = &w->pool->state;
+
+    if (w->face != st->face) {
+        FT_Open_Args open_args;
+        FT_Parameter ft_param;
+
+        if (w->ft_face)
+            FT_Done_Face(w->ft_face);
+        w->ft_face = NULL;
+        w->face = NULL;
+
+        open_args.flags = FT_OPEN_MEMORY | FT_OPEN_PARAMS;
+        open_args.memory_base = st->face->font_data;
+        open_args.memory_size = st->face->font_data_len;
+        open_args.stream = NULL;
+        ft_param.tag = FT_PARAM_TAG_INCREMENTAL;
+        ft_param.data = &w->inc_int;
+        open_args.num_params = 1;
+        open_args.params = &ft_param;
+        if (FT_Open_Face(w->library, &open_args, st->subfont, &w->ft_face))
+            return false;
+        w->face = st->face;
+    }
+    if (FT_Set_Char_Size(w->ft_face, st->width, st->height,
+                         st->horz_res, st->vert_res))
+        return false;
+    FT_Set_Transform(w->ft_face, (FT_Matrix *)&st->transform, NULL);
+    return true;
+}
+
+/* Render one glyph the way load_glyph does when nothing goes wrong.
+ * Anything else is left to load_glyph.
+ */
+static void
+prefetch_render(ff_prefetch_worker * w, ff_prefetch_glyph * pg)
+{
+    const ff_render_state *st = &w->pool->state;
+    FT_GlyphSlot slot;
+    FT_BBox cbox;
+    FT_Long width, height;
+    int size;
+
+    pg->code = -1;
+    if (FT_Load_Glyph(w->ft_face, pg->gid, st->load_flags))
+        return;
+    slot = w->ft_face->glyph;
+    if (slot->format != FT_GLYPH_FORMAT_OUTLINE)
+        return;
+    pg->metrics = slot->metrics;
+    pg->linear_hori_advance = slot->linearHoriAdvance;
+    pg->linear_vert_advance = slot->linearVertAdvance;
+
+    FT_Outline_Get_CBox(&slot->outline, &cbox);
+    cbox.xMin = ((cbox.xMin) & ~63);
+    cbox.yMin = ((cbox.yMin) & ~63);
+    cbox.xMax = (((cbox.xMax) + 63) & ~63);
+    cbox.yMax = (((cbox.yMax) + 63) & ~63);
+    width = (FT_UInt) ((cbox.xMax - cbox.xMin) >> 6);
+    height = (FT_UInt) ((cbox.yMax - cbox.yMin) >> 6);
+    if ((bitmap_raster(width) * height) >= st->max_bitmap)
+        return;
+    if (FT_Render_Glyph(slot, FT_RENDER_MODE_MONO))
+        return;
+    if (slot->bitmap.pitch < 0)
+        return;
+
+    size = slot->bitmap.pitch * slot->bitmap.rows;
+    pg->raster.bits = NULL;
+    if (size > 0) {
+        pg->raster.bits = gs_alloc_bytes(w->pool->memory, size, "prefetch_render");
+        if (pg->raster.bits == NULL)
+            return;
+        memcpy(pg->raster.bits, slot->bitmap.buffer, size);
+    }
+    pg->raster.width = slot->bitmap.width;
+    pg->raster.rows = slot->bitmap.rows;
+    pg->raster.pitch = slot->bitmap.pitch;
+    pg->raster.left = slot->bitmap_left;
+    pg->raster.top = slot->bitmap_top;
+    pg->code = 0;
+}
+
+static void
+prefetch_thread(void *arg)
+{
+    ff_prefetch_worker *w = (ff_prefetch_worker *) arg;
+    ff_prefetch_pool *pool = w->pool;
+
+    for (;;) {
+        bool ok;
+        int i;
+
+        gx_semaphore_wait(w->work);
+        gx_monitor_enter(pool->lock);
+        if (pool->shutdown) {
+            gx_monitor_leave(pool->lock);
+            break;
+        }
+        gx_monitor_leave(pool->lock);
+
+        ok = prefetch_setup_face(w);
+        for (;;) {
+            gx_monitor_enter(pool->lock);
+            while (pool->next < pool->count &&
+                   pool->glyphs[pool->next].status != FF_PREFETCH_QUEUED)
+                pool->next++;
+            i = (pool->next < pool->count ? pool->next++ : -1);
+            if (i >= 0)
+                pool->glyphs[i].status = FF_PREFETCH_RUNNING;
+            gx_monitor_leave(pool->lock);
+            if (i < 0)
+                break;
+
+            if (ok)
+                prefetch_render(w, &pool->glyphs[i]);
+            else
+                pool->glyphs[i].code = -1;
+
+            gx_monitor_enter(pool->lock);
+            pool->glyphs[i].status = FF_PREFETCH_DONE;
+            if (pool->waiting == i) {
+                pool->waiting = FF_PREFETCH_NOT_WAITING;
+                gx_semaphore_signal(pool->wake);
+            }
+            gx_monitor_leave(pool->lock);
+        }
+
+        gx_monitor_enter(pool->lock);
+        if (--pool->active == 0 && pool->waiting == FF_PREFETCH_WAITING_IDLE) {
+            pool->waiting = FF_PREFETCH_NOT_WAITING;
+            gx_semaphore_signal(pool->wake);
+        }
+        gx_monitor_leave(pool->lock);
+    }
+}
+
+/* Stop the current batch and free it. */
+static void
+prefetch_end_batch(ff_server * s)
+{
+    ff_prefetch_pool *pool = s->prefetch;
+    int i;
+
+    gx_monitor_enter(pool->lock);
+    pool->next = pool->count;   /* Nothing more is started */
+    if (pool->active > 0) {
+        pool->waiting = FF_PREFETCH_WAITING_IDLE;
+        gx_monitor_leave(pool->lock);
+        gx_semaphore_wait(pool->wake);
+    }
+    else
+        gx_monitor_leave(pool->lock);
+
+    for (i = 0; i < pool->count; i++)
+        gs_free_object(pool->memory, pool->glyphs[i].raster.bits, "prefetch_end_batch");
+    for (i = 0; i < pool->data_count; i++)
+        gs_free_object(s->mem, pool->data[i].data, "prefetch_end_batch");
+    gs_free_object(s->mem, pool->glyphs, "prefetch_end_batch");
+    gs_free_object(s->mem, pool->data, "prefetch_end_batch");
+    pool->glyphs = NULL;
+    pool->data = NULL;
+    pool->count = pool->next = pool->data_count = 0;
+    pool->state.face = NULL;
+}
+
+static void
+prefetch_pool_free(ff_server * s)
+{
+    ff_prefetch_pool *pool = s->prefetch;
+    int i;
+
+    if (pool == NULL)
+        return;
+    if (pool->lock != NULL)
+        prefetch_end_batch(s);
+    if (pool->workers != NULL) {
+        gx_monitor_enter(pool->lock);
+        pool->shutdown = true;
+        gx_monitor_leave(pool->lock);
+        for (i = 0; i < pool->num_threads; i++) {
+            ff_prefetch_worker *w = &pool->workers[i];
+
+            if (w->thread != NULL) {
+                gx_semaphore_signal(w->work);
+                gp_thread_finish(w->thread);
+            }
+            if (w->work)
+                gx_semaphore_free(w->work);
+            if (w->ft_face)
+                FT_Done_Face(w->ft_face);
+            if (w->library)
+                FT_Done_Library(w->library);
+            if (w->memory)
+                gs_memory_chunk_release(w->memory);
+        }
+        gs_free_object(s->mem, pool->workers, "prefetch_pool_free");
+    }
+    if (pool->wake)
+        gx_semaphore_free(pool->wake);
+    if (pool->lock)
+        gx_monitor_free(pool->lock);
+    gs_free_object(s->mem, pool, "prefetch_pool_free");
+    s->prefetch = NULL;
+}
+
+static int
+prefetch_pool_new(ff_server * s, int num_threads)
+{
+    ff_prefetch_pool *pool;
+    FT_UInt tt_ins_version = TT_INTERPRETER_VERSION_35;
+    int i, code = 0;
+
+    pool = (ff_prefetch_pool *) gs_alloc_bytes(s->mem, sizeof(ff_prefetch_pool),
+                                              "prefetch_pool_new");
+    if (pool == NULL)
+        return_error(gs_error_VMerror);
+    memset(pool, 0, sizeof(*pool));
+    s->prefetch = pool;
+    pool->memory = s->mem->thread_safe_memory;
+    pool->num_threads = num_threads;
+    pool->waiting = FF_PREFETCH_NOT_WAITING;
+    pool->lock = gx_monitor_label(gx_monitor_alloc(pool->memory), "prefetch_lock");
+    pool->wake = gx_semaphore_label(gx_semaphore_alloc(pool->memory), "prefetch_wake");
+    pool->workers = (ff_prefetch_worker *)
+        gs_alloc_bytes(s->mem, num_threads * sizeof(ff_prefetch_worker),
+                       "prefetch_pool_new");
+    if (pool->lock == NULL || pool->wake == NULL || pool->workers == NULL) {
+        code = gs_note_error(gs_error_VMerror);
+        goto fail;
+    }
+    memset(pool->workers, 0, num_threads * sizeof(ff_prefetch_worker));
+
+    for (i = 0; i < num_threads; i++) {
+        ff_prefetch_worker *w = &pool->workers[i];
+
+        w->pool = pool;
+        w->work = gx_semaphore_label(gx_semaphore_alloc(pool->memory), "prefetch_work");
+        if (w->work == NULL) {
+            code = gs_note_error(gs_error_VMerror);
+            goto fail;
+        }
+        w->memory = pool->memory;
+        code = gs_memory_chunk_wrap(&w->memory, pool->memory);
+        if (code < 0) {
+            w->memory = NULL;
+            goto fail;
+        }
+        w->ftmemory_rec.user = w->memory;
+        w->ftmemory_rec.alloc = FF_alloc;
+        w->ftmemory_rec.free = FF_free;
+        w->ftmemory_rec.realloc = FF_realloc;
+        if (FT_New_Library(&w->ftmemory_rec, &w->library)) {
+            w->library = NULL;
+            code = gs_note_error(gs_error_VMerror);
+            goto fail;
+        }
+        FT_Add_Default_Modules(w->library);
+        FT_Property_Set(w->library, "truetype", "interpreter-version", &tt_ins_version);
+        w->inc_int.funcs = &TheFAPIPrefetchInterfaceFuncs;
+        w->inc_int.object = (FT_Incremental) w;
+    }
+    for (i = 0; i < num_threads; i++) {
+        code = gp_thread_start(prefetch_thread, &pool->workers[i],
+                               &pool->workers[i].thread);
+        if (code < 0) {
+            pool->workers[i].thread = NULL;
+            goto fail;
+        }
+    }
+    return 0;
+
+  fail:
+    prefetch_pool_free(s);
+    return code;
+}
+
+/* Called when a face is about to go: the threads must forget it too. */
+static void
+ff_prefetch_forget_face(ff_server * s, const ff_face * a_face)
+{
+    ff_prefetch_pool *pool = s->prefetch;
+    int i;
+
+    /* Once the batch has ended the threads are idle. */
+    prefetch_end_batch(s);
+    for (i = 0; i < pool->num_threads; i++) {
+        ff_prefetch_worker *w = &pool->workers[i];
+
+        if (w->face == a_face) {
+            FT_Done_Face(w->ft_face);
+            w->ft_face = NULL;
+            w->face = NULL;
+        }
+    }
+}
+
+/* Read the data of a glyph and its components for the threads. Return
+ * whether they can render the glyph.
+ */
+static int
+prefetch_read_glyph(ff_server * s, gs_fapi_font * a_fapi_font, ff_face * a_face,
+                    FT_UInt a_gid, int a_depth)
+{
+    ff_prefetch_pool *pool = s->prefetch;
+    const void *saved_char_data = a_fapi_font->char_data;
+    int saved_char_data_len = a_fapi_font->char_data_len;
+    FT_UInt components[16];
+    const byte *code;
+    int code_length, count = 0, length, i, n;
+    byte *data = NULL;
+    bool usable = false;
+
+    for (i = 0; i < pool->data_count; i++)
+        if (pool->data[i].gid == a_gid)
+            return pool->data[i].usable;
+    if (pool->data_count >= FF_PREFETCH_MAX_DATA)
+        return false;
+
+    /* As get_fapi_glyph_data, but never as the notdef (see FAPI_FF_get_glyph). */
+    a_fapi_font->need_decrypt = true;
+    a_fapi_font->char_data = NULL;
+    a_fapi_font->char_data_len = 0;
+    length = a_fapi_font->get_glyph(a_fapi_font, a_gid, NULL, 0);
+    if (length > 0 && length != gs_fapi_glyph_invalid_format
+        && length != gs_fapi_glyph_invalid_index) {
+        data = gs_alloc_bytes(s->mem, length, "prefetch_read_glyph");
+        if (data != NULL) {
+            a_fapi_font->char_data = NULL;
+            a_fapi_font->char_data_len = 0;
+            usable = (a_fapi_font->get_glyph(a_fapi_font, a_gid, data, length) == length);
+        }
+    }
+    else
+        usable = (length == 0);
+    a_fapi_font->char_data = saved_char_data;
+    a_fapi_font->char_data_len = saved_char_data_len;
+
+    if (usable) {
+        count = tt_glyph_parse(data, length, components, countof(components),
+                               &code, &code_length);
+        usable = count >= 0 &&
+            !tt_code_changes_hinting(a_face, code, code_length);
+    }
+    n = pool->data_count++;
+    pool->data[n].gid = a_gid;
+    pool->data[n].data = data;
+    pool->data[n].length = length;
+    pool->data[n].usable = usable;
+
+    if (usable && count > 0) {
+        if (a_depth >= FF_PREFETCH_MAX_DEPTH)
+            usable = false;
+        for (i = 0; i < count && usable; i++)
+            usable = prefetch_read_glyph(s, a_fapi_font, a_face, components[i], a_depth + 1);
+        pool->data[n].usable = usable;
+    }
+    return usable;
+}
+
+/* Find the glyph a_gid among the ones prefetched for a_state, waiting for it
+ * if a_take and a thread is still rendering it. Return NULL if it is left to
+ * the caller. The threads write the status and code of a glyph, so they are
+ * only read with the lock held.
+ */
+static ff_prefetch_glyph *
+prefetch_find(ff_server * s, const ff_render_state * a_state, FT_UInt a_gid,
+              bool a_take)
+{
+    ff_prefetch_pool *pool = s->prefetch;
+    ff_prefetch_glyph *pg = NULL;
+    int i, code;
+
+    if (pool == NULL || pool->count == 0 || !same_render_state(&pool->state, a_state))
+        return NULL;
+    for (i = 0; i < pool->count; i++) {
+        if (pool->glyphs[i].gid == a_gid) {
+            pg = &pool->glyphs[i];
+            break;
+        }
+    }
+    if (pg == NULL || !a_take)
+        return pg;
+
+    gx_monitor_enter(pool->lock);
+    if (pg->status == FF_PREFETCH_QUEUED) {
+        /* Not started, we may as well render it ourselves. */
+        pg->status = FF_PREFETCH_DONE;
+        pg->code = -1;
+        gx_monitor_leave(pool->lock);
+        return NULL;
+    }
+    if (pg->status == FF_PREFETCH_RUNNING) {
+        pool->waiting = i;
+        gx_monitor_leave(pool->lock);
+        gx_semaphore_wait(pool->wake);
+        gx_monitor_enter(pool->lock);
+    }
+    code = pg->code;
+    gx_monitor_leave(pool->lock);
+    return (code == 0 ? pg : NULL);
+}
+
+static void
+release_prefetched(ff_server * s)
+{
+    if (s->have_prefetched) {
+        gs_free_object(s->mem->thread_safe_memory, s->prefetched.bits,
+                       "release_prefetched");
+        s->prefetched.bits = NULL;
+        s->have_prefetched = false;
+    }
+}
+
+static gs_fapi_retcode
+gs_fapi_ft_prefetch_chars(gs_fapi_server * a_server, gs_fapi_font * a_fapi_font,
+                          const gs_fapi_char_ref * a_char_ref, const uint * gids,
+                          int count, int num_threads)
+{
+    ff_server *s = (ff_server *) a_server;
+    ff_face *face = (ff_face *) a_fapi_font->server_font_data;
+    ff_prefetch_pool *pool;
+    ff_render_state state;
+    ff_prefetch_glyph *pg;
+    int i, j, n, code;
+
+    if (face == NULL || face->ft_inc_int == NULL || a_fapi_font->is_type1
+        || a_fapi_font->metrics_only || face->hinting_changed
+        || !a_char_ref->is_glyph_index || num_threads <= 0)
+        return 0;
+    get_render_state(a_server, a_fapi_font, face, a_server->max_bitmap, &state);
+
+    pg = prefetch_find(s, &state, a_char_ref->char_codes[0], false);
+    if (gids == NULL) {
+        if (pg == NULL)
+            return 0;
+        gx_monitor_enter(s->prefetch->lock);
+        code = (pg->status != FF_PREFETCH_DONE || pg->code == 0);
+        gx_monitor_leave(s->prefetch->lock);
+        return code;
+    }
+
+    if (s->prefetch != NULL && s->prefetch->num_threads != num_threads)
+        prefetch_pool_free(s);
+    if (s->prefetch == NULL) {
+        code = prefetch_pool_new(s, num_threads);
+        if (code < 0)
+            return code;
+    }
+    pool = s->prefetch;
+    prefetch_end_batch(s);
+
+    pool->data = (ff_glyph_data *)
+        gs_alloc_bytes(s->mem, FF_PREFETCH_MAX_DATA * sizeof(ff_glyph_data),
+                       "gs_fapi_ft_prefetch_chars");
+    pool->glyphs = (ff_prefetch_glyph *)
+        gs_alloc_bytes(s->mem, count * sizeof(ff_prefetch_glyph),
+                       "gs_fapi_ft_prefetch_chars");
+    if (pool->data == NULL || pool->glyphs == NULL) {
+        prefetch_end_batch(s);
+        return_error(gs_error_VMerror);
+    }
+    for (i = n = 0; i < count; i++) {
+        if (gids[i] == a_char_ref->char_codes[0])
+            continue;
+        for (j = 0; j < n; j++)
+            if (pool->glyphs[j].gid == gids[i])
+                break;
+        if (j < n || !prefetch_read_glyph(s, a_fapi_font, face, gids[i], 0))
+            continue;
+        memset(&pool->glyphs[n], 0, sizeof(ff_prefetch_glyph));
+        pool->glyphs[n].gid = gids[i];
+        pool->glyphs[n].status = FF_PREFETCH_QUEUED;
+        pool->glyphs[n].code = -1;
+        n++;
+    }
+    if (n == 0) {
+        prefetch_end_batch(s);
+        return 0;
+    }
+    pool->state = state;
+    pool->count = n;
+    pool->next = 0;
+    pool->active = pool->num_threads;
+    for (i = 0; i < pool->num_threads; i++)
+        gx_semaphore_signal(pool->workers[i].work);
+    return 0;
+}
+
 /* Load a glyph and optionally rasterize it. Return its metrics in a_metrics.
  * If a_bitmap is true convert the glyph to a bitmap.
  */
@@ -567,6 +1717,7 @@ load_glyph(gs_fapi_server * a_server, gs_fapi_font * a_fapi_font,
     const void *saved_char_data = a_fapi_font->char_data;
     const int saved_char_data_len = a_fapi_font->char_data_len;
 
+    release_prefetched(s);
     if (s->bitmap_glyph) {
         FT_Bitmap_Done(s->freetype_library, &s->bitmap_glyph->bitmap);
         FF_free(s->ftmemory, s->bitmap_glyph);
@@ -643,30 +1794,35 @@ load_glyph(gs_fapi_server * a_server, gs_fapi_font * a_fapi_font,
         /* Make sure we don't leave this set to the last value, as we may then use inappropriate metrics values */
         face->ft_inc_int->object->glyph_metrics_index = 0xFFFFFFFF;
 
+    /* The glyph may have been rendered ahead of time. */
+    if (s->prefetch && a_bitmap && !a_fapi_font->metrics_only && !a_fapi_font->is_type1
+        && a_char_ref->is_glyph_index && a_char_ref->metrics_type == gs_fapi_metrics_notdef
+        && !face->hinting_changed && !is_notdef_name(a_fapi_font)) {
+        ff_render_state state;
+        ff_prefetch_glyph *pg;
+
+        get_render_state(a_server, a_fapi_font, face, max_bitmap, &state);
+        pg = prefetch_find(s, &state, index, true);
+        if (pg) {
+            if (a_metrics)
+                glyph_metrics(a_fapi_font, face, &pg->metrics, pg->linear_hori_advance,
+                              pg->linear_vert_advance, a_metrics);
+            s->prefetched = pg->raster;
+            s->have_prefetched = true;
+            /* The bitmap is ours now, and the glyph is rendered again if it comes round. */
+            pg->raster.bits = NULL;
+            pg->code = -1;
+            return 0;
+        }
+    }
+
     /* We have to load the glyph, scale it correctly, and render it if we need a bitmap. */
     if (!ft_error) {
         /* We disable loading bitmaps because if we allow it then FreeType invents metrics for them, which messes up our glyph positioning */
         /* Also the bitmaps tend to look somewhat different (though more readable) than FreeType's rendering. By disabling them we */
         /* maintain consistency better.  (FT_LOAD_NO_BITMAP) */
         a_fapi_font->char_data = saved_char_data;
-        if (!a_fapi_font->is_mtx_skipped && !a_fapi_font->is_type1) {
-            /* grid_fit == 1 is the default - use font's native hints
-             * with freetype, 1 & 3 are, in practice, the same.
-             */
-
-            if (a_server->grid_fit == 0) {
-                load_flags = FT_LOAD_NO_HINTING | FT_LOAD_NO_AUTOHINT;
-            }
-            else if (a_server->grid_fit == 2) {
-                load_flags = FT_LOAD_FORCE_AUTOHINT;
-            }
-            load_flags |= FT_LOAD_MONOCHROME | FT_LOAD_NO_BITMAP | FT_LOAD_LINEAR_DESIGN;
-        }
-        else {
-            /* Current FreeType hinting for type 1 fonts is so poor we are actually better off without it (fewer files render incorrectly) (FT_LOAD_NO_HINTING) */
-            /* We also need to disable hinting for XL format embedded truetypes */
-            load_flags |= FT_LOAD_MONOCHROME | FT_LOAD_NO_HINTING | FT_LOAD_NO_BITMAP | FT_LOAD_LINEAR_DESIGN;
-        }
+        load_flags = glyph_load_flags(a_server, a_fapi_font);
 
         ft_error = FT_Load_Glyph(ft_face, index, load_flags);
         if (ft_error == FT_Err_Unknown_File_Format) {
@@ -726,50 +1882,9 @@ load_glyph(gs_fapi_server * a_server, gs_fapi_font * a_fapi_font,
      * once, and work out the metrics from the scaled/hinted outline.
      */
     if ((!ft_error || !ft_error_fb) && a_metrics) {
-        FT_Long hx;
-        FT_Long hy;
-        FT_Long vadv;
-
-        /* In order to get the metrics in the form we need them, we have to remove the size scaling
-         * the resolution scaling, and convert to points.
-         */
-        hx = (FT_Long) (((double)ft_face->glyph->metrics.horiBearingX *
-                         ft_face->units_per_EM * 72.0) /
-                        ((double)face->width * face->horz_res));
-        hy = (FT_Long) (((double)ft_face->glyph->metrics.horiBearingY *
-                         ft_face->units_per_EM * 72.0) /
-                        ((double)face->height * face->vert_res));
-
-        w = (FT_Long) (((double)ft_face->glyph->metrics.width *
-                        ft_face->units_per_EM * 72.0) / ((double)face->width *
-                                                         face->horz_res));
-        h = (FT_Long) (((double)ft_face->glyph->metrics.height *
-                        ft_face->units_per_EM * 72.0) /
-                       ((double)face->height * face->vert_res));
-
-        /* Ugly. FreeType creates verticla metrics for TT fonts, normally we override them in the
-         * metrics callbacks, but those only work for incremental interface fonts, and TrueType fonts
-         * loaded as CIDFont replacements are not incrementally handled. So here, if its a CIDFont, and
-         * its not type 1 outlines, and its not a vertical mode fotn, ignore the advance.
-         */
-        if (a_fapi_font->is_type1
-           || ((a_fapi_font->full_font_buf || a_fapi_font->font_file_path)
-           && a_fapi_font->is_vertical &&  FT_HAS_VERTICAL(ft_face))) {
-
-            vadv = ft_face->glyph->linearVertAdvance;
-        }
-        else {
-            vadv = 0;
-        }
-
-        a_metrics->bbox_x0 = hx;
-        a_metrics->bbox_y0 = hy - h;
-        a_metrics->bbox_x1 = a_metrics->bbox_x0 + w;
-        a_metrics->bbox_y1 = a_metrics->bbox_y0 + h;
-        a_metrics->escapement = ft_face->glyph->linearHoriAdvance;
-        a_metrics->v_escapement = vadv;
-        a_metrics->em_x = ft_face->units_per_EM;
-        a_metrics->em_y = ft_face->units_per_EM;
+        glyph_metrics(a_fapi_font, face, &ft_face->glyph->metrics,
+                      ft_face->glyph->linearHoriAdvance,
+                      ft_face->glyph->linearVertAdvance, a_metrics);
     }
 
     if ((!ft_error || !ft_error_fb)) {
@@ -915,6 +2030,7 @@ gs_fapi_ft_ensure_open(gs_fapi_server * a_server, const char * server_param,
 {
     ff_server *s = (ff_server *) a_server;
     FT_UInt tt_ins_version = TT_INTERPRETER_VERSION_35;
+    FT_Int major, minor, patch;
     FT_Error ft_error;
 
     if (s->freetype_library)
@@ -935,6 +2051,11 @@ gs_fapi_ft_ensure_open(gs_fapi_server * a_server, const char * server_param,
     FT_Add_Default_Modules(s->freetype_library);
     FT_Property_Set( s->freetype_library, "truetype", "interpreter-version", &tt_ins_version);
 
+    /* The library actually loaded, which with SHARE_FT may not be the */
+    /* one we were compiled against. */
+    FT_Library_Version(s->freetype_library, &major, &minor, &patch);
+    a_server->version = (major * 100 + minor) * 100 + patch;
+
     return 0;
 }
 
@@ -1118,6 +2239,7 @@ gs_fapi_ft_get_scaled_font(gs_fapi_server * a_server, gs_fapi_font * a_font,
     FT_CharMap cmap = NULL;
     bool data_owned = true;
 
+    release_prefetched(s);
     if (s->bitmap_glyph) {
         FT_Bitmap_Done(s->freetype_library, &s->bitmap_glyph->bitmap);
         FF_free(s->ftmemory, s->bitmap_glyph);
@@ -1526,6 +2648,17 @@ gs_fapi_ft_get_char_raster(gs_fapi_server * a_server, gs_fapi_raster * a_raster)
 {
     ff_server *s = (ff_server *) a_server;
 
+    if (s->have_prefetched) {
+        a_raster->p = s->prefetched.bits;
+        a_raster->width = s->prefetched.width;
+        a_raster->height = s->prefetched.rows;
+        a_raster->line_step = s->prefetched.pitch;
+        a_raster->orig_x = s->prefetched.left * 16;
+        a_raster->orig_y = s->prefetched.top * 16;
+        a_raster->left_indent = a_raster->top_indent = a_raster->black_height =
+            a_raster->black_width = 0;
+        return 0;
+    }
     if (!s->bitmap_glyph)
         return(gs_error_unregistered);
     a_raster->p = s->bitmap_glyph->bitmap.buffer;
@@ -1746,6 +2879,7 @@ gs_fapi_ft_release_char_data(gs_fapi_server * a_server)
 
     s->outline_glyph = NULL;
     s->bitmap_glyph = NULL;
+    release_prefetched(s);
     return 0;
 }
 
@@ -1841,6 +2975,8 @@ static const gs_fapi_server freetypeserver = {
     gs_fapi_ft_check_cmap_for_GID,
     NULL,                        /* get_font_info */
     gs_fapi_ft_set_mm_weight_vector,
+    gs_fapi_ft_prefetch_chars,
+    0                           /* version */
 };
 
 int gs_fapi_ft_init(gs_memory_t * mem, gs_fapi_server ** server);
@@ -1882,6 +3018,8 @@ gs_fapi_freetype_destroy(gs_fapi_server ** serv)
 
     FT_Done_Glyph(&server->outline_glyph->root);
     FT_Done_Glyph(&server->bitmap_glyph->root);
+    release_prefetched(server);
+    prefetch_pool_free(server);
 
     /* As with initialization: since we're supplying memory management to
      * FT, we cannot just to use FT_Done_FreeType (), we have to use
@@ -1061,7 +1061,9 @@ gx_default_dev_spec_op(gx_device *pdev, int dev_spec_op, void *data, int size)
             if (pdev->color_info.depth != 8 * pdev->color_info.num_components)
                 return 0;
             return (dev_proc(pdev, encode_color) == gx_default_encode_color ||
-                    dev_proc(pdev, encode_color) == gx_default_rgb_map_rgb_color);
+                    dev_proc(pdev, encode_color) == gx_default_rgb_map_rgb_color ||
+                    (ARCH_SIZEOF_GX_COLOR_INDEX > 4 &&
+                     dev_proc(pdev, encode_color) == cmyk_8bit_map_cmyk_color));
     }
     return_error(gs_error_undefined);
 }
@@ -1129,11 +1129,19 @@ template_mem_transform_pixel_region_render_portrait(gx_device *dev, mem_transfor
             run += spp;
         }
         /* So we have a run of pixels from data to run that are all the same. */
-        /* This needs to be sped up */
-        for (k = 0; k < spp; k++) {
-            conc[k] = gx_color_value_from_byte(data[k]);
+        if (cmapper->direct) {
+            /* The device encoding is just the samples, most significant
+             * first, so we can skip the mapper. */
+            gx_color_index color = 0;
+            for (k = 0; k < spp; k++)
+                color = (color << 8) | data[k];
+            color_set_pure(&cmapper->devc, color);
+        } else {
+            for (k = 0; k < spp; k++) {
+                conc[k] = gx_color_value_from_byte(data[k]);
+            }
+            mapper(cmapper);
         }
-        mapper(cmapper);
         /* Fill the region between irun and fixed2int_var_rounded(pnext.x) */
         {
             int xi = irun;
@@ -1362,11 +1370,19 @@ template_mem_transform_pixel_region_render_landscape(gx_device *dev, mem_transfo
             run += spp;
         }
         /* So we have a run of pixels from data to run that are all the same. */
-        /* This needs to be sped up */
-        for (k = 0; k < spp; k++) {
-            conc[k] = gx_color_value_from_byte(data[k]);
+        if (cmapper->direct) {
+            /* The device encoding is just the samples, most significant
+             * first, so we can skip the mapper. */
+            gx_color_index color = 0;
+            for (k = 0; k < spp; k++)
+                color = (color << 8) | data[k];
+            color_set_pure(&cmapper->devc, color);
+        } else {
+            for (k = 0; k < spp; k++) {
+                conc[k] = gx_color_value_from_byte(data[k]);
+            }
+            mapper(cmapper);
         }
-        mapper(cmapper);
         /* Fill the region between irun and fixed2int_var_rounded(pnext.y) */
         {              /* 90 degree rotated rectangle */
             int yi = irun;
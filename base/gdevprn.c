@@ -271,7 +271,8 @@ open_c:
     ppdev->buf = base;
     ppdev->buffer_space = space;
     pclist_dev->common.is_printer = 1;
-    clist_init_io_procs(pclist_dev, ppdev->BLS_force_memory);
+    clist_init_io_procs(pclist_dev, ppdev->BLS_force_memory, ppdev->BLS_mmap,
+                        ppdev->BLC_lz4);
     clist_init_params(pclist_dev, base, space, target,
                       ppdev->printer_procs.buf_procs,
                       space_params->band,
@@ -661,6 +662,9 @@ gdev_prn_get_param(gx_device *dev, char *Param, void *list)
     if (strcmp(Param, "NumRenderingThreads") == 0) {
         return param_write_int(plist, "NumRenderingThreads", &ppdev->num_render_threads_requested);
     }
+    if (strcmp(Param, "BandSplitLimit") == 0) {
+        return param_write_int(plist, "BandSplitLimit", &ppdev->band_split_limit);
+    }
     if (strcmp(Param, "OpenOutputFile") == 0) {
         return param_write_bool(plist, "OpenOutputFile", &ppdev->OpenOutputFile);
     }
@@ -679,6 +683,10 @@ gdev_prn_get_param(gx_device *dev, char *Param, void *list)
             bls.data = (byte *)"memory";
             bls.size = 6;
             bls.persistent = false;
+        } else if (ppdev->BLS_mmap) {
+            bls.data = (byte *)"mmap";
+            bls.size = 4;
+            bls.persistent = false;
         } else {
             bls.data = (byte *)"file";
             bls.size = 4;
@@ -686,6 +694,19 @@ gdev_prn_get_param(gx_device *dev, char *Param, void *list)
         }
         return param_write_string(plist, "BandListStorage", &bls);
     }
+    if (strcmp(Param, "BandListCompressor") == 0) {
+        gs_param_string blc;
+
+        if (ppdev->BLC_lz4) {
+            blc.data = (byte *)"lz4";
+            blc.size = 3;
+        } else {
+            blc.data = (byte *)"default";
+            blc.size = 7;
+        }
+        blc.persistent = false;
+        return param_write_string(plist, "BandListCompressor", &blc);
+    }
     if (strcmp(Param, "OutputFile") == 0) {
         gs_param_string ofns;
 
@@ -719,6 +740,7 @@ gdev_prn_get_params(gx_device * pdev, gs_param_list * plist)
     int code = gx_default_get_params(pdev, plist);
     gs_param_string ofns;
     gs_param_string bls;
+    gs_param_string blc;
     gs_param_string saved_pages;
     bool pageneutralcolor = false;
 
@@ -730,6 +752,7 @@ gdev_prn_get_params(gx_device * pdev, gs_param_list * plist)
                   param_write_bool(plist, "Duplex", &ppdev->Duplex) :
                   param_write_null(plist, "Duplex"))) < 0) ||
         (code = param_write_int(plist, "NumRenderingThreads", &ppdev->num_render_threads_requested)) < 0 ||
+        (code = param_write_int(plist, "BandSplitLimit", &ppdev->band_split_limit)) < 0 ||
         (code = param_write_bool(plist, "OpenOutputFile", &ppdev->OpenOutputFile)) < 0 ||
         (code = param_write_bool(plist, "BGPrint", &ppdev->bg_print_requested)) < 0 ||
         (code = param_write_bool(plist, "ReopenPerPage", &ppdev->ReopenPerPage)) < 0 ||
@@ -744,6 +767,10 @@ gdev_prn_get_params(gx_device * pdev, gs_param_list * plist)
         bls.data = (byte *)"memory";
         bls.size = 6;
         bls.persistent = false;
+    } else if (ppdev->BLS_mmap) {
+        bls.data = (byte *)"mmap";
+        bls.size = 4;
+        bls.persistent = false;
     } else {
         bls.data = (byte *)"file";
         bls.size = 4;
@@ -751,6 +778,16 @@ gdev_prn_get_params(gx_device * pdev, gs_param_list * plist)
     }
     if( (code = param_write_string(plist, "BandListStorage", &bls)) < 0 )
         return code;
+    if (ppdev->BLC_lz4) {
+        blc.data = (byte *)"lz4";
+        blc.size = 3;
+    } else {
+        blc.data = (byte *)"default";
+        blc.size = 7;
+    }
+    blc.persistent = false;
+    if ((code = param_write_string(plist, "BandListCompressor", &blc)) < 0)
+        return code;
 
     ofns.data = (const byte *)ppdev->fname,
         ofns.size = strlen(ppdev->fname),
@@ -795,9 +832,11 @@ gdev_prn_put_params(gx_device * pdev, gs_param_list * plist)
     int width = pdev->width;
     int height = pdev->height;
     int nthreads = ppdev->num_render_threads_requested;
+    int band_split_limit = ppdev->band_split_limit;
     gdev_prn_space_params save_sp;
     gs_param_string ofs;
     gs_param_string bls;
+    gs_param_string blc;
     gs_param_dict mdict;
     gs_param_string saved_pages;
     bool pageneutralcolor = false;
@@ -841,8 +880,11 @@ gdev_prn_put_params(gx_device * pdev, gs_param_list * plist)
         }
     switch (code = param_read_string(plist, (param_name = "BandListStorage"), &bls)) {
         case 0:
-            /* Only accept 'file' if the file procs are include in the build */
-            if ((bls.size > 1) && (bls.data[0] == 'm' ||
+            /* Only accept 'file' or 'mmap' if the procs are included in the build */
+            if (bls.size == 4 && !memcmp(bls.data, "mmap", 4)) {
+                if (clist_io_procs_mmap_global != NULL)
+                    break;
+            } else if ((bls.size > 1) && (bls.data[0] == 'm' ||
                  (clist_io_procs_file_global != NULL && bls.data[0] == 'f')))
                 break;
             /* fall through */
@@ -855,6 +897,23 @@ gdev_prn_put_params(gx_device * pdev, gs_param_list * plist)
             break;
     }
 
+    switch (code = param_read_string(plist, (param_name = "BandListCompressor"), &blc)) {
+        case 0:
+            /* lz4 is only used for memory band lists, but is always accepted */
+            if ((blc.size == 3 && !memcmp(blc.data, "lz4", 3)) ||
+                (blc.size == 7 && !memcmp(blc.data, "default", 7)))
+                break;
+            code = gs_note_error(gs_error_rangecheck);
+            /* fall through */
+        default:
+            ecode = code;
+            param_signal_error(plist, param_name, ecode);
+            /* fall through */
+        case 1:
+            blc.data = 0;
+            break;
+    }
+
     switch (code = param_read_string(plist, (param_name = "OutputFile"), &ofs)) {
         case 0:
             if (pdev->LockSafetyParams &&
@@ -903,6 +962,17 @@ gdev_prn_put_params(gx_device * pdev, gs_param_list * plist)
         case 1:
             ;
     }
+    switch (code = param_read_int(plist, (param_name = "BandSplitLimit"), &band_split_limit)) {
+        case 0:
+            if (band_split_limit >= 0)
+                break;
+            code = gs_error_rangecheck;
+        default:
+            ecode = code;
+            param_signal_error(plist, param_name, ecode);
+        case 1:
+            ;
+    }
     switch (code = param_read_bool(plist, (param_name = "BGPrint"),
                                                         &bg_print_requested)) {
         default:
@@ -955,9 +1025,13 @@ gdev_prn_put_params(gx_device * pdev, gs_param_list * plist)
         ppdev->Duplex_set = duplex_set;
     }
     ppdev->num_render_threads_requested = nthreads;
+    ppdev->band_split_limit = band_split_limit;
     if (bls.data != 0) {
-        ppdev->BLS_force_memory = (bls.data[0] == 'm');
+        ppdev->BLS_mmap = (bls.size == 4 && !memcmp(bls.data, "mmap", 4));
+        ppdev->BLS_force_memory = (bls.data[0] == 'm' && !ppdev->BLS_mmap);
     }
+    if (blc.data != 0)
+        ppdev->BLC_lz4 = (blc.size == 3);
 
     /* If necessary, free and reallocate the printer memory. */
     /* Formerly, would not reallocate if device is not open: */
@@ -1097,6 +1171,7 @@ gdev_prn_output_page_aux(gx_device * pdev, int num_copies, int flush, bool seeka
                 npdev = (gx_device_printer *)ndev;
                 npdev->bg_print_requested = 0;
                 npdev->num_render_threads_requested = ppdev->num_render_threads_requested;
+                npdev->band_split_limit = ppdev->band_split_limit;
 
                 /* Now start the thread to print the page */
                 if ((code = gp_thread_start(prn_print_page_in_background,
@@ -150,6 +150,9 @@ typedef struct bg_print_s {
         bool bg_print_requested;	/* request background printing of page from clist */\
         bg_print_t bg_print;            /* background printing data shared with thread */\
         int num_render_threads_requested;	/* for multiple band rendering threads */\
+        int band_split_limit;		/* max sub-bands for a costly band (threads only) */\
+        bool BLS_mmap;			/* BandListStorage=mmap: map clist files to read */\
+        bool BLC_lz4;			/* BandListCompressor=lz4: for memory band lists */\
         gx_saved_pages_list *saved_pages_list;	/* list when we are saving pages instead of printing */\
         gx_device_procs save_procs_while_delaying_erasepage;	/* save device procs while delaying erasepage. */\
         gx_device_procs orig_procs	/* original (std_)procs */
@@ -324,6 +327,9 @@ extern const gx_device_procs prn_bg_procs;
         0/*false*/,	/* bg_print_requested */\
         {  0/*sema*/, 0/*device*/, 0/*thread_id*/, 0/*num_copies*/, 0/*return_code*/ }, /* bg_print */\
         0, 		/* num_render_threads_requested */\
+        0, 		/* band_split_limit */\
+        0/*false*/,	/* BLS_mmap */\
+        0/*false*/,	/* BLC_lz4 */\
         0,              /* saved_pages_list */\
         { 0 },	/* save_procs_while_delaying_erasepage */\
         { 0 }	/* ... orig_procs */
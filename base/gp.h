@@ -252,6 +252,13 @@ int gp_fpread(char *buf, uint count, int64_t offset, FILE *f);
 /* Write to a specified offset within a FILE from a buffer */
 int gp_fpwrite(char *buf, uint count, int64_t offset, FILE *f);
 
+/* Map the first 'size' bytes of a FILE into memory, read only. Returns */
+/* NULL if this isn't possible, in which case the caller must read it.  */
+void *gp_fmap(FILE *f, int64_t size);
+
+/* Release a mapping made by gp_fmap */
+void gp_funmap(void *addr, int64_t size);
+
 /* Force given file into binary mode (no eol translations, etc) */
 /* if 2nd param true, text mode if 2nd param false */
 int gp_setmode_binary(FILE * pfile, bool mode);
@@ -812,6 +812,30 @@ int gp_fpwrite(char *buf, uint count, int64_t offset, FILE *f)
     return ret;
 }
 
+/* Map the start of a FILE into memory, read only */
+void *gp_fmap(FILE *f, int64_t size)
+{
+    HANDLE hnd = (HANDLE)_get_osfhandle(fileno(f));
+    HANDLE map;
+    void *addr;
+
+    if (hnd == INVALID_HANDLE_VALUE || size <= 0 || (SIZE_T)size != size)
+        return NULL;
+    map = CreateFileMapping(hnd, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (map == NULL)
+        return NULL;
+    addr = MapViewOfFile(map, FILE_MAP_READ, 0, 0, (SIZE_T)size);
+    /* The view keeps the mapping object alive */
+    CloseHandle(map);
+    return addr;
+}
+
+/* Release a mapping made by gp_fmap */
+void gp_funmap(void *addr, int64_t size)
+{
+    UnmapViewOfFile(addr);
+}
+
 /* ------ Font enumeration ------ */
 
  /* This is used to query the native os for a list of font names and
@@ -295,6 +295,15 @@ int gp_fpwrite(char *buf, uint count, int64_t offset, FILE *f)
     return -1;
 }
 
+void *gp_fmap(FILE *f, int64_t size)
+{
+    return NULL;
+}
+
+void gp_funmap(void *addr, int64_t size)
+{
+}
+
 /* -------------- Helpers for gp_file_name_combine_generic ------------- */
 
 uint gp_file_name_root(const char *fname, uint len)
@@ -32,6 +32,9 @@
 #include "dirent_.h"
 #include "unistd_.h"
 #include <stdlib.h>             /* for mkstemp/mktemp */
+#if defined(HAVE_MMAP) && HAVE_MMAP == 1
+#include <sys/mman.h>
+#endif
 
 #if !defined(HAVE_FSEEKO)
 #define ftello ftell
@@ -246,6 +249,27 @@ int gp_fpwrite(char *buf, uint count, int64_t offset, FILE *f)
 #endif
 }
 
+void *gp_fmap(FILE *f, int64_t size)
+{
+#if defined(HAVE_MMAP) && HAVE_MMAP == 1 && !defined(GS_NO_FILESYSTEM)
+    void *addr;
+
+    if (size <= 0 || (size_t)size != size)
+        return NULL;
+    addr = mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED, fileno(f), 0);
+    return addr == MAP_FAILED ? NULL : addr;
+#else
+    return NULL;
+#endif
+}
+
+void gp_funmap(void *addr, int64_t size)
+{
+#if defined(HAVE_MMAP) && HAVE_MMAP == 1 && !defined(GS_NO_FILESYSTEM)
+    munmap(addr, (size_t)size);
+#endif
+}
+
 /* Set a file into binary or text mode. */
 int
 gp_setmode_binary(FILE * pfile, bool mode)
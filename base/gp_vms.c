@@ -303,6 +303,15 @@ int gp_fpwrite(char *buf, uint count, int64_t offset, FILE *f)
     return -1;
 }
 
+void *gp_fmap(FILE *f, int64_t size)
+{
+    return NULL;
+}
+
+void gp_funmap(void *addr, int64_t size)
+{
+}
+
 /* Set a file into binary or text mode. */
 int
 gp_setmode_binary(FILE * pfile, bool binary)
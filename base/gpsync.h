@@ -28,7 +28,7 @@
 /* Maximum number of threads, although render threads assume a main instance */
 /* so each main instance (rare) could have MAX_THREADS-2 render threads      */
 #ifndef MAX_THREADS
-#  define MAX_THREADS 50	/* Arbitrary, but does affect ICC_CACHE_MAXLINKS */
+#  define MAX_THREADS 50	/* Arbitrary */
 #endif
 
 /* -------- Synchronization primitives ------- */
@@ -29,6 +29,7 @@
 #include "gxcmap.h"
 #include "gzstate.h"
 #include "gsicc.h"
+#include "gsicc_cache.h"
 
 /*
  * Define whether to optimize the CIE mapping process by combining steps.
@@ -1473,7 +1474,7 @@ gx_cie_to_xyz_free(gs_gstate *pgs)
 
     /* Free up the ICC objects if created */		/* FIXME: does this need to be thread safe */
     if (pgs->icc_link_cache != NULL) {
-        rc_decrement(pgs->icc_link_cache,"gx_cie_to_xyz_free");
+        gsicc_cache_release(pgs->icc_link_cache,"gx_cie_to_xyz_free");
     }
     if (pgs->icc_manager != NULL) {
         rc_decrement(pgs->icc_manager,"gx_cie_to_xyz_free");
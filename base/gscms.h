@@ -439,21 +439,36 @@ struct gsicc_link_s {
     gsicc_colorbuffer_t data_cs; /* needed for begin_monitor after end_monitor */
     int num_input;  /* Need so we can monitor properly */
     int num_output; /* Need so we can monitor properly */
+    size_t size;    /* estimate of the memory used, counted by the cache */
+    uint64_t last_use;  /* cache use_count when the link was last found */
 };
 
-/* ICC Cache. The size of the cache is limited by max_memory_size.
- * Links are added if there is sufficient memory and if the number
- * of links does not exceed a (soft) limit.
+/* ICC Cache. The cache may be shared by several threads, so the links are
+ * spread over ICC_CACHE_BUCKETS lists by their hash, each list with its own
+ * lock, and threads looking up different links rarely wait for each other.
+ * The cache lock protects only the reference count of the cache itself and
+ * the totals below. The size of the cache is limited by max_memory, using
+ * an estimate of the memory each link uses. Unused links are freed, least
+ * recently used first, to keep within the limit; links in use are never
+ * freed, so the limit is exceeded if they need more.
  */
 
+#define ICC_CACHE_BUCKETS 16	/* must be a power of 2 */
+
+typedef struct gsicc_link_bucket_s {
+    gsicc_link_t *head;		/* most recently found first */
+    gx_monitor_t *lock;		/* lock for the list and the ref_counts */
+} gsicc_link_bucket_t;
+
 typedef struct gsicc_link_cache_s {
-    gsicc_link_t *head;
+    gsicc_link_bucket_t bucket[ICC_CACHE_BUCKETS];
     int num_links;
+    size_t memory_used;		/* sum of the size of the links */
+    size_t max_memory;
+    uint64_t use_count;		/* clock for last_use, need not be exact */
     rc_header rc;
     gs_memory_t *memory;
     gx_monitor_t *lock;		/* handle for the monitor */
-    bool cache_full;		/* flag that some thread needs a cache slot */
-    gx_semaphore_t *full_wait;	/* semaphore for waiting when the cache is full */
 } gsicc_link_cache_t;
 
 /* A linked list structure to keep DeviceN ICC profiles
@@ -17,6 +17,7 @@
 /* Font operators for Ghostscript library */
 #include "gx.h"
 #include "memory_.h"
+#include "string_.h"
 #include "gserrors.h"
 #include "gsstruct.h"
 #include "gsutil.h"
@@ -267,6 +268,7 @@ gs_font_dir_alloc2_limits(gs_memory_t * struct_mem, gs_memory_t * bits_mem,
     pdir->align_to_pixels = false;
     pdir->glyph_to_unicode_table = NULL;
     pdir->grid_fit_tt = 1;
+    pdir->glyph_rendering_threads = 0;
     pdir->memory = struct_mem;
     pdir->tti = 0;
     pdir->ttm = 0;
@@ -289,6 +291,9 @@ gs_font_dir_finalize(const gs_memory_t *cmem, void *vptr)
     }
 
     /* free character cache machinery */
+    gx_char_file_release_all(pdir);
+    gs_free_object(pdir->memory->non_gc_memory, pdir->glyph_cache_dir,
+                   "gs_font_dir_finalize");
     gs_free_object(pdir->memory, pdir->fmcache.mdata, "gs_font_dir_finalize");
     gs_free_object(pdir->memory, pdir->ccache.table, "gs_font_dir_finalize");
 
@@ -690,6 +695,7 @@ gs_setcachesize(gs_gstate * pgs, gs_font_dir * pdir, uint size)
 
     /* now free the cache structures and rebuild everything with the
        new cache size */
+    gx_char_file_release_all(pdir);
     gs_free_object(stable_mem, pdir->fmcache.mdata, "gs_setcachesize(mdata)");
     gs_free_object(stable_mem, pdir->ccache.table, "gs_setcachesize(table)");
     pdir->ccache.bmax = size;
@@ -722,6 +728,38 @@ gs_setgridfittt(gs_font_dir * pdir, uint v)
     pdir->grid_fit_tt = v;
     return 0;
 }
+int
+gs_setglyphrenderingthreads(gs_font_dir * pdir, uint v)
+{
+    pdir->glyph_rendering_threads = v;
+    return 0;
+}
+/* Set the directory for the shared character cache.  An empty name */
+/* turns the sharing off. */
+int
+gs_setglyphcachedir(gs_font_dir * pdir, const byte *name, uint size)
+{
+    gs_memory_t *mem = pdir->memory->non_gc_memory;
+    char *dir = NULL;
+
+    /* setuserparams is run again at every save level; keep the files. */
+    if (pdir->glyph_cache_dir == NULL ? size == 0 :
+        strlen(pdir->glyph_cache_dir) == size &&
+        !memcmp(pdir->glyph_cache_dir, name, size))
+        return 0;
+    if (size > 0) {
+        dir = (char *)gs_alloc_bytes(mem, size + 1, "gs_setglyphcachedir");
+        if (dir == NULL)
+            return_error(gs_error_VMerror);
+        memcpy(dir, name, size);
+        dir[size] = 0;
+    }
+    /* Pairs look for their files again in the new directory. */
+    gx_char_file_release_all(pdir);
+    gs_free_object(mem, pdir->glyph_cache_dir, "gs_setglyphcachedir");
+    pdir->glyph_cache_dir = dir;
+    return 0;
+}
 
 /* currentcacheparams */
 uint
@@ -749,6 +787,16 @@ gs_currentgridfittt(const gs_font_dir * pdir)
 {
     return pdir->grid_fit_tt;
 }
+uint
+gs_currentglyphrenderingthreads(const gs_font_dir * pdir)
+{
+    return pdir->glyph_rendering_threads;
+}
+const char *
+gs_currentglyphcachedir(const gs_font_dir * pdir)
+{
+    return pdir->glyph_cache_dir;
+}
 
 /* Purge a font from all font- and character-related tables. */
 /* This is only used by restore (and, someday, the GC). */
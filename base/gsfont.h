@@ -83,5 +83,9 @@ uint gs_currentaligntopixels(const gs_font_dir *);
 int gs_setaligntopixels(gs_font_dir *, uint);
 uint gs_currentgridfittt(const gs_font_dir *);
 int gs_setgridfittt(gs_font_dir *, uint);
+uint gs_currentglyphrenderingthreads(const gs_font_dir *);
+int gs_setglyphrenderingthreads(gs_font_dir *, uint);
+const char *gs_currentglyphcachedir(const gs_font_dir *);
+int gs_setglyphcachedir(gs_font_dir *, const byte *, uint);
 
 #endif /* gsfont_INCLUDED */
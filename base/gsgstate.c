@@ -183,7 +183,7 @@ gs_gstate_copied(gs_gstate * pgs)
     rc_increment(pgs->cie_joint_caches_alt);
     rc_increment(pgs->devicergb_cs);
     rc_increment(pgs->devicecmyk_cs);
-    rc_increment(pgs->icc_link_cache);
+    gsicc_cache_addref(pgs->icc_link_cache);
     rc_increment(pgs->icc_profile_cache);
     rc_increment(pgs->icc_manager);
 }
@@ -210,7 +210,12 @@ gs_gstate_pre_assign(gs_gstate *pto, const gs_gstate *pfrom)
     RCCOPY(halftone);
     RCCOPY(devicergb_cs);
     RCCOPY(devicecmyk_cs);
-    RCCOPY(icc_link_cache);
+    /* The link cache may be shared with rendering threads, so its count */
+    /* only changes under the cache lock. */
+    if (pto->icc_link_cache != pfrom->icc_link_cache) {
+        gsicc_cache_addref(pfrom->icc_link_cache);
+        gsicc_cache_release(pto->icc_link_cache, cname);
+    }
     RCCOPY(icc_profile_cache);
     RCCOPY(icc_manager);
 #undef RCCOPY
@@ -246,7 +251,8 @@ gs_gstate_release(gs_gstate * pgs)
     RCDECR(halftone);
     RCDECR(devicergb_cs);
     RCDECR(devicecmyk_cs);
-    RCDECR(icc_link_cache);
+    gsicc_cache_release(pgs->icc_link_cache, cname);
+    pgs->icc_link_cache = NULL;
     RCDECR(icc_profile_cache);
     RCDECR(icc_manager);
 #undef RCDECR
@@ -22,7 +22,6 @@
 #include "gsstruct.h"
 #include "scommon.h"
 #include "gx.h"
-#include "gpsync.h"	/* for MAX_THREADS */
 #include "gxgstate.h"
 #include "smd5.h"
 #include "gscms.h"
@@ -35,18 +34,26 @@
 #include "gxsync.h"
 #include "gzstate.h"
 #include "stdint_.h"
+#include "gp.h"
+#include "gslibctx.h"
         /*
          *  Note that the the external memory used to maintain
          *  links in the CMS is generally not visible to GS.
          *  For most CMS's the  links are 33x33x33x33x4 bytes at worst
          *  for a CMYK to CMYK MLUT which is about 4.5Mb per link.
          *  If the link were matrix based it would be much much smaller.
-         *  We will likely want to do at least have an estimate of the
-         *  memory used based upon how the CMS is configured.
-         *  This will be done later.  For now, just limit the number
-         *  of links.
+         *  So the cache is limited by an estimate of the memory used
+         *  (see gsicc_link_size), not by the number of links.
          */
-#define ICC_CACHE_MAXLINKS (MAX_THREADS*2)	/* allow up to two active links per thread */
+#ifndef ICC_CACHE_MAXMEMORY
+#  define ICC_CACHE_MAXMEMORY (32*1024*1024)
+#endif
+/* Memory used by a link other than the CMS table: curves, the */
+/* transform itself and our own structures. */
+#define ICC_LINK_OVERHEAD 16384
+
+#define ICC_CACHE_BUCKET(cache, hashcode)\
+  (&(cache)->bucket[((hashcode) ^ ((hashcode) >> 32)) & (ICC_CACHE_BUCKETS - 1)])
 
 /* Static prototypes */
 
@@ -63,6 +70,8 @@ static int gsicc_compute_linkhash(gsicc_manager_t *icc_manager, gx_device *dev,
 
 static void gsicc_remove_link(gsicc_link_t *link, const gs_memory_t *memory);
 
+static void gsicc_cache_trim(gsicc_link_cache_t *icc_link_cache);
+
 static void gsicc_get_buff_hash(unsigned char *data, int64_t *hash, unsigned int num_bytes);
 
 static void rc_gsicc_link_cache_free(gs_memory_t * mem, void *ptr_in, client_name_t cname);
@@ -77,9 +86,35 @@ gs_private_st_ptrs3_final(st_icc_link, gsicc_link_t, "gsiccmanage_link",
 
 struct_proc_finalize(icc_linkcache_finalize);
 
-gs_private_st_ptrs3_final(st_icc_linkcache, gsicc_link_cache_t, "gsiccmanage_linkcache",
-                    icc_linkcache_enum_ptrs, icc_linkcache_reloc_ptrs, icc_linkcache_finalize,
-                    head, lock, full_wait);
+gs_private_st_composite_use_final(st_icc_linkcache, gsicc_link_cache_t,
+                    "gsiccmanage_linkcache", icc_linkcache_enum_ptrs,
+                    icc_linkcache_reloc_ptrs, icc_linkcache_finalize);
+
+/* The cache lock, then the head and the lock of each bucket */
+static
+ENUM_PTRS_WITH(icc_linkcache_enum_ptrs, gsicc_link_cache_t *link_cache)
+{
+    index--;
+    if (index < ICC_CACHE_BUCKETS)
+        ENUM_RETURN(link_cache->bucket[index].head);
+    index -= ICC_CACHE_BUCKETS;
+    if (index < ICC_CACHE_BUCKETS)
+        ENUM_RETURN(link_cache->bucket[index].lock);
+    return 0;
+}
+ENUM_PTR(0, gsicc_link_cache_t, lock);
+ENUM_PTRS_END
+static RELOC_PTRS_WITH(icc_linkcache_reloc_ptrs, gsicc_link_cache_t *link_cache)
+{
+    int k;
+
+    for (k = 0; k < ICC_CACHE_BUCKETS; k++) {
+        RELOC_VAR(link_cache->bucket[k].head);
+        RELOC_VAR(link_cache->bucket[k].lock);
+    }
+    RELOC_VAR(link_cache->lock);
+}
+RELOC_PTRS_END
 
 /* These are used to construct a hash for the ICC link based upon the
    render parameters */
@@ -97,6 +132,7 @@ gsicc_link_cache_t *
 gsicc_cache_new(gs_memory_t *memory)
 {
     gsicc_link_cache_t *result;
+    int k;
 
     /* We want this to be maintained in stable_memory.  It should be be effected by the
        save and restores */
@@ -104,27 +140,35 @@ gsicc_cache_new(gs_memory_t *memory)
                              "gsicc_cache_new");
     if ( result == NULL )
         return(NULL);
-#ifdef MEMENTO_SQUEEZE_BUILD
     result->lock = NULL;
-#else
+    for (k = 0; k < ICC_CACHE_BUCKETS; k++) {
+        result->bucket[k].head = NULL;
+        result->bucket[k].lock = NULL;
+    }
+#ifndef MEMENTO_SQUEEZE_BUILD
     result->lock = gx_monitor_label(gx_monitor_alloc(memory->stable_memory),
                                     "gsicc_cache_new");
-    if (result->lock == NULL) {
-        gs_free_object(memory->stable_memory, result, "gsicc_cache_new");
-        return(NULL);
+    for (k = 0; k < ICC_CACHE_BUCKETS && result->lock != NULL; k++) {
+        result->bucket[k].lock =
+            gx_monitor_label(gx_monitor_alloc(memory->stable_memory),
+                             "gsicc_cache_new(bucket)");
+        if (result->bucket[k].lock == NULL)
+            break;
     }
-    result->full_wait = gx_semaphore_label(gx_semaphore_alloc(memory->stable_memory),
-                                    "gsicc_cache_new");
-    if (result->full_wait == NULL) {
-        gx_monitor_free(result->lock);
+    if (k < ICC_CACHE_BUCKETS) {
+        while (--k >= 0)
+            gx_monitor_free(result->bucket[k].lock);
+        if (result->lock != NULL)
+            gx_monitor_free(result->lock);
         gs_free_object(memory->stable_memory, result, "gsicc_cache_new");
         return(NULL);
     }
 #endif
     rc_init_free(result, memory->stable_memory, 1, rc_gsicc_link_cache_free);
-    result->head = NULL;
     result->num_links = 0;
-    result->cache_full = false;
+    result->memory_used = 0;
+    result->max_memory = ICC_CACHE_MAXMEMORY;
+    result->use_count = 0;
     result->memory = memory->stable_memory;
     if_debug2m(gs_debug_flag_icc, memory,
                "[icc] Allocating link cache = 0x%p memory = 0x%p\n",
@@ -145,19 +189,60 @@ rc_gsicc_link_cache_free(gs_memory_t * mem, void *ptr_in, client_name_t cname)
     gs_free_object(mem->stable_memory, link_cache, "rc_gsicc_link_cache_free");
 }
 
-/* release the monitor of the link_cache when it is freed */
+/* Take another reference to a cache that may be shared between threads */
+void
+gsicc_cache_addref(gsicc_link_cache_t *icc_link_cache)
+{
+    if (icc_link_cache == NULL)
+        return;
+#ifndef MEMENTO_SQUEEZE_BUILD
+    gx_monitor_enter(icc_link_cache->lock);
+#endif
+    rc_increment(icc_link_cache);
+#ifndef MEMENTO_SQUEEZE_BUILD
+    gx_monitor_leave(icc_link_cache->lock);
+#endif
+}
+
+/* Drop a reference taken by gsicc_cache_addref or gsicc_cache_new.  Only */
+/* the last reference frees the cache, and by then no other thread can   */
+/* be using it, so the cache lock is not held while freeing.             */
+void
+gsicc_cache_release(gsicc_link_cache_t *icc_link_cache, client_name_t cname)
+{
+    if (icc_link_cache == NULL)
+        return;
+#ifndef MEMENTO_SQUEEZE_BUILD
+    gx_monitor_enter(icc_link_cache->lock);
+    if (icc_link_cache->rc.ref_count > 1) {
+        icc_link_cache->rc.ref_count--;
+        gx_monitor_leave(icc_link_cache->lock);
+        return;
+    }
+    gx_monitor_leave(icc_link_cache->lock);
+#endif
+    rc_decrement(icc_link_cache, cname);
+}
+
+/* release the monitors of the link_cache when it is freed */
 void
 icc_linkcache_finalize(const gs_memory_t *mem, void *ptr)
 {
     gsicc_link_cache_t *link_cache = (gsicc_link_cache_t * ) ptr;
+    gsicc_link_t *link;
+    int k;
 
-    while (link_cache->head != NULL) {
-        if (link_cache->head->ref_count != 0) {
-            emprintf2(mem, "link at 0x%p being removed, but has ref_count = %d\n",
-                      link_cache->head, link_cache->head->ref_count);
-            link_cache->head->ref_count = 0;	/* force removal */
+    for (k = 0; k < ICC_CACHE_BUCKETS; k++) {
+        while ((link = link_cache->bucket[k].head) != NULL) {
+            if (link->ref_count != 0) {
+                emprintf2(mem, "link at 0x%p being removed, but has ref_count = %d\n",
+                          link, link->ref_count);
+            }
+            link_cache->bucket[k].head = link->next;
+            link_cache->num_links--;
+            link_cache->memory_used -= link->size;
+            gsicc_link_free(link, mem);
         }
-        gsicc_remove_link(link_cache->head, mem);
     }
 #ifdef DEBUG
     if (link_cache->num_links != 0) {
@@ -166,10 +251,12 @@ icc_linkcache_finalize(const gs_memory_t *mem, void *ptr)
 #endif
     if (link_cache->rc.ref_count == 0) {
 #ifndef MEMENTO_SQUEEZE_BUILD
+        for (k = 0; k < ICC_CACHE_BUCKETS; k++) {
+            gx_monitor_free(link_cache->bucket[k].lock);
+            link_cache->bucket[k].lock = NULL;
+        }
         gx_monitor_free(link_cache->lock);
         link_cache->lock = NULL;
-        gx_semaphore_free(link_cache->full_wait);
-        link_cache->full_wait = 0;
 #endif
     }
 }
@@ -221,6 +308,8 @@ gsicc_alloc_link_dev(gs_memory_t *memory, cmm_profile_t *src_profile,
     result->is_identity = false;
     result->valid = true;
     result->memory = memory->stable_memory;
+    result->size = sizeof(gsicc_link_t);
+    result->last_use = 0;
 
     if_debug1m('^', result->memory, "[^]icclink 0x%p init = 1\n",
                result);
@@ -312,20 +401,46 @@ gsicc_alloc_link(gs_memory_t *memory, gsicc_hashlink_t hashcode)
     result->is_identity = false;
     result->valid = false;		/* not yet complete */
     result->memory = memory->stable_memory;
+    result->size = sizeof(gsicc_link_t);
+    result->last_use = 0;
 
     if_debug1m('^', result->memory, "[^]icclink 0x%p init = 1\n",
                result);
     return result;
 }
 
+/* Estimate the memory used by a link.  The CMS doesn't tell us, but for */
+/* a table based transform it is dominated by the table, which lcms      */
+/* makes with 33 grid points for up to 3 inputs, 17 for 4 and 7 for more, */
+/* 16 bits per output.                                                    */
+static size_t
+gsicc_link_size(int num_input, int num_output)
+{
+    size_t size = sizeof(gsicc_link_t) + ICC_LINK_OVERHEAD;
+    size_t table = num_output * 2;
+    int grid = num_input > 4 ? 7 : (num_input == 4 ? 17 : 33);
+    int k;
+
+    if (num_input <= 0 || num_input > GS_CLIENT_COLOR_MAX_COMPONENTS ||
+        num_output <= 0)
+        return size;
+    for (k = 0; k < num_input; k++)
+        table *= grid;
+    return size + table;
+}
+
 static void
 gsicc_set_link_data(gsicc_link_t *icc_link, void *link_handle,
-                    gsicc_hashlink_t hashcode, gx_monitor_t *lock,
+                    gsicc_hashlink_t hashcode, gsicc_link_cache_t *icc_link_cache,
                     bool includes_softproof, bool includes_devlink,
                     bool pageneutralcolor, gsicc_colorbuffer_t data_cs)
 {
+    gsicc_link_bucket_t *bucket = ICC_CACHE_BUCKET(icc_link_cache,
+                                                   hashcode.link_hashcode);
+    size_t size;
+
 #ifndef MEMENTO_SQUEEZE_BUILD
-    gx_monitor_enter(lock);		/* lock the cache while changing data */
+    gx_monitor_enter(bucket->lock);	/* lock the bucket while changing data */
 #endif
     icc_link->link_handle = link_handle;
     gscms_get_link_dim(link_handle, &(icc_link->num_input), &(icc_link->num_output),
@@ -347,11 +462,22 @@ gsicc_set_link_data(gsicc_link_t *icc_link, void *link_handle,
     if (pageneutralcolor)
         gsicc_mcm_set_link(icc_link);
 
+    /* Now that we know what it is, count the memory it uses */
+    size = gsicc_link_size(icc_link->num_input, icc_link->num_output);
+#ifndef MEMENTO_SQUEEZE_BUILD
+    gx_monitor_enter(icc_link_cache->lock);
+#endif
+    icc_link_cache->memory_used += size - icc_link->size;
+    icc_link->size = size;
+#ifndef MEMENTO_SQUEEZE_BUILD
+    gx_monitor_leave(icc_link_cache->lock);
+#endif
+
     /* release the lock of the link so it can now be used */
     icc_link->valid = true;
 #ifndef MEMENTO_SQUEEZE_BUILD
     gx_monitor_leave(icc_link->lock);
-    gx_monitor_leave(lock);	/* done with updating, let everyone run */
+    gx_monitor_leave(bucket->lock);	/* done with updating, let everyone run */
 #endif
 }
 
@@ -506,21 +632,18 @@ gsicc_get_cspace_hash(gsicc_manager_t *icc_manager, gx_device *dev,
     return 0;
 }
 
-gsicc_link_t*
-gsicc_findcachelink(gsicc_hashlink_t hash, gsicc_link_cache_t *icc_link_cache,
-                    bool includes_proof, bool includes_devlink)
+/* Find a link in a bucket, which must be locked.  If found, take a */
+/* reference to it, but it may not be valid yet.                     */
+static gsicc_link_t *
+gsicc_find_in_bucket(gsicc_link_cache_t *icc_link_cache,
+                     gsicc_link_bucket_t *bucket, int64_t hashcode,
+                     bool includes_proof, bool includes_devlink)
 {
     gsicc_link_t *curr, *prev;
-    int64_t hashcode = hash.link_hashcode;
-
-    /* Look through the cache for the hashcode */
-#ifndef MEMENTO_SQUEEZE_BUILD
-    gx_monitor_enter(icc_link_cache->lock);
-#endif
 
     /* List scanning is fast, so we scan the entire list, this includes   */
     /* links that are currently unused, but still in the cache (zero_ref) */
-    curr = icc_link_cache->head;
+    curr = bucket->head;
     prev = NULL;
 
     while (curr != NULL ) {
@@ -532,91 +655,184 @@ gsicc_findcachelink(gsicc_hashlink_t hash, gsicc_link_cache_t *icc_link_cache,
             if (prev != NULL) {
                 /* if prev == NULL, curr is already the head */
                 prev->next = curr->next;
-                curr->next = icc_link_cache->head;
-                icc_link_cache->head = curr;
+                curr->next = bucket->head;
+                bucket->head = curr;
             }
             /* bump the ref_count since we will be using this one */
             curr->ref_count++;
+            /* use_count isn't locked: it only needs to be roughly right */
+            curr->last_use = ++icc_link_cache->use_count;
             if_debug3m('^', curr->memory, "[^]%s 0x%p ++ => %ld\n",
                        "icclink", curr, curr->ref_count);
-            while (curr->valid == false) {
+            return curr;
+        }
+        prev = curr;
+        curr = curr->next;
+    }
+    return NULL;
+}
+
+/* Wait for another thread to finish building a link we have found.  */
+/* If it failed, drop our reference and return NULL.                 */
+static gsicc_link_t *
+gsicc_wait_for_link(gsicc_link_t *link)
+{
 #ifndef MEMENTO_SQUEEZE_BUILD
-                gx_monitor_leave(icc_link_cache->lock); /* exit to let other threads run briefly */
-                gx_monitor_enter(curr->lock);			/* wait until we can acquire the lock */
-                gx_monitor_leave(curr->lock);			/* it _should be valid now */
-                /* If it is still not valid, but we were able to lock, it means that the thread	*/
-                /* that was building it failed to be able to complete building it		*/
-                /* this is probably a fatal error. MV ???					*/
-                if (curr->valid == false) {
-		  emprintf1(curr->memory, "link 0x%p lock released, but still not valid.\n", curr);	/* Breakpoint here */
-                }
-                gx_monitor_enter(icc_link_cache->lock);	/* re-enter to loop and check */
+    if (link->valid == false) {
+        gx_monitor_enter(link->lock);	/* wait until we can acquire the lock */
+        gx_monitor_leave(link->lock);	/* it _should be valid now */
+        if (link->valid == false) {
+            /* The thread that was building it couldn't, and has taken */
+            /* it out of the cache, the last reference will free it.   */
+            gsicc_release_link(link);
+            return NULL;
+        }
+    }
 #endif
-            }
+    return link;
+}
+
+gsicc_link_t*
+gsicc_findcachelink(gsicc_hashlink_t hash, gsicc_link_cache_t *icc_link_cache,
+                    bool includes_proof, bool includes_devlink)
+{
+    gsicc_link_bucket_t *bucket = ICC_CACHE_BUCKET(icc_link_cache,
+                                                   hash.link_hashcode);
+    gsicc_link_t *curr;
+
+    /* Look through the bucket for the hashcode */
 #ifndef MEMENTO_SQUEEZE_BUILD
-            gx_monitor_leave(icc_link_cache->lock);
+    gx_monitor_enter(bucket->lock);
 #endif
-            return(curr);	/* success */
-        }
+    curr = gsicc_find_in_bucket(icc_link_cache, bucket, hash.link_hashcode,
+                                includes_proof, includes_devlink);
+#ifndef MEMENTO_SQUEEZE_BUILD
+    gx_monitor_leave(bucket->lock);
+#endif
+    if (curr == NULL)
+        return NULL;
+    return gsicc_wait_for_link(curr);
+}
+
+/* Take a link out of its bucket, which must be locked, and out of the */
+/* cache totals.  Return false if it isn't there (any more).           */
+static bool
+gsicc_unlink_from_bucket(gsicc_link_cache_t *icc_link_cache,
+                         gsicc_link_bucket_t *bucket, gsicc_link_t *link)
+{
+    gsicc_link_t *curr, *prev;
+
+    /* Compare pointers only, link may have been freed by another thread */
+    curr = bucket->head;
+    prev = NULL;
+    while (curr != NULL && curr != link) {
         prev = curr;
         curr = curr->next;
     }
+    if (curr == NULL)
+        return false;
+    if (prev == NULL)
+        bucket->head = curr->next;
+    else
+        prev->next = curr->next;
+    curr->next = NULL;
+#ifndef MEMENTO_SQUEEZE_BUILD
+    gx_monitor_enter(icc_link_cache->lock);
+#endif
+    icc_link_cache->num_links--;	/* no longer in the cache */
+    icc_link_cache->memory_used -= curr->size;
 #ifndef MEMENTO_SQUEEZE_BUILD
     gx_monitor_leave(icc_link_cache->lock);
 #endif
-    return NULL;
+    return true;
 }
 
-/* Remove link from cache.  Notify CMS and free */
+/* Remove a link that this thread failed to build from the cache. The */
+/* thread owns the link lock and a reference.  Other threads may be   */
+/* waiting for the link, if so the last of them will free it.         */
 static void
 gsicc_remove_link(gsicc_link_t *link, const gs_memory_t *memory)
 {
-    gsicc_link_t *curr, *prev;
     gsicc_link_cache_t *icc_link_cache = link->icc_link_cache;
+    gsicc_link_bucket_t *bucket = ICC_CACHE_BUCKET(icc_link_cache,
+                                                   link->hashcode.link_hashcode);
+    bool unused;
 
     if_debug2m(gs_debug_flag_icc, memory,
                "[icc] Removing link = 0x%p memory = 0x%p\n", link,
                memory->stable_memory);
-    /* NOTE: link->ref_count must be 0: assert ? */
 #ifndef MEMENTO_SQUEEZE_BUILD
-    gx_monitor_enter(icc_link_cache->lock);
+    gx_monitor_enter(bucket->lock);
 #endif
-    if (link->ref_count != 0) {
-      emprintf2(memory, "link at 0x%p being removed, but has ref_count = %d\n", link, link->ref_count);
-    }
-    curr = icc_link_cache->head;
-    prev = NULL;
-
-    while (curr != NULL ) {
-        /* don't get rid of it if another thread has decided to use it */
-        if (curr == link && link->ref_count == 0) {
-            /* remove this one from the list */
-            if (prev == NULL)
-                icc_link_cache->head = curr->next;
-            else
-                prev->next = curr->next;
-            break;
-        }
-        prev = curr;
-        curr = curr->next;
-    }
-    /* if curr != link we didn't find it or another thread may have decided to */
-    /* use it (ref_count > 0). Skip freeing it if so.                          */
-    if (curr == link && link->ref_count == 0) {
-        icc_link_cache->num_links--;	/* no longer in the cache */
+    gsicc_unlink_from_bucket(icc_link_cache, bucket, link);
+    unused = --(link->ref_count) == 0;
 #ifndef MEMENTO_SQUEEZE_BUILD
-        if (icc_link_cache->cache_full) {
-            icc_link_cache->cache_full = false;
-            gx_semaphore_signal(icc_link_cache->full_wait);	/* let a waiting thread run */
-        }
-        gx_monitor_leave(icc_link_cache->lock);
+    gx_monitor_leave(bucket->lock);
+    gx_monitor_leave(link->lock);	/* let any waiting threads see it failed */
 #endif
+    if (unused)
         gsicc_link_free(link, memory);	/* outside link cache now. */
-    } else {
-        /* even if we didn't find the link to remove, unlock the cache */
+}
+
+/* Free unused links, least recently used first, until the cache is   */
+/* within its memory limit or there are no more unused links.         */
+static void
+gsicc_cache_trim(gsicc_link_cache_t *icc_link_cache)
+{
+    gsicc_link_t *link, *oldest;
+    gsicc_link_bucket_t *bucket, *oldest_bucket;
+    bool full, removed;
+    int k;
+
+    for (;;) {
+#ifndef MEMENTO_SQUEEZE_BUILD
+        gx_monitor_enter(icc_link_cache->lock);
+#endif
+        full = icc_link_cache->memory_used > icc_link_cache->max_memory;
 #ifndef MEMENTO_SQUEEZE_BUILD
         gx_monitor_leave(icc_link_cache->lock);
 #endif
+        if (!full)
+            return;
+        oldest = NULL;
+        oldest_bucket = NULL;
+        for (k = 0; k < ICC_CACHE_BUCKETS; k++) {
+            bucket = &icc_link_cache->bucket[k];
+#ifndef MEMENTO_SQUEEZE_BUILD
+            gx_monitor_enter(bucket->lock);
+#endif
+            for (link = bucket->head; link != NULL; link = link->next) {
+                if (link->ref_count == 0 && link->valid &&
+                    (oldest == NULL || link->last_use < oldest->last_use)) {
+                    oldest = link;
+                    oldest_bucket = bucket;
+                }
+            }
+#ifndef MEMENTO_SQUEEZE_BUILD
+            gx_monitor_leave(bucket->lock);
+#endif
+        }
+        if (oldest == NULL)
+            return;		/* all in use, let the cache grow */
+        /* Another thread may have started using or removed the link */
+        /* since we looked at it, so check again.                    */
+#ifndef MEMENTO_SQUEEZE_BUILD
+        gx_monitor_enter(oldest_bucket->lock);
+#endif
+        for (link = oldest_bucket->head; link != NULL; link = link->next)
+            if (link == oldest)
+                break;
+        removed = link != NULL && link->ref_count == 0 &&
+            gsicc_unlink_from_bucket(icc_link_cache, oldest_bucket, link);
+#ifndef MEMENTO_SQUEEZE_BUILD
+        gx_monitor_leave(oldest_bucket->lock);
+#endif
+        if (removed) {
+            if_debug2m(gs_debug_flag_icc, icc_link_cache->memory,
+                       "[icc] Evicting link = 0x%p size = %ld\n",
+                       link, (long)link->size);
+            gsicc_link_free(link, icc_link_cache->memory);
+        }
     }
 }
 
@@ -869,58 +1085,31 @@ gsicc_alloc_link_entry(gsicc_link_cache_t *icc_link_cache,
                        bool include_softproof, bool include_devlink)
 {
     gs_memory_t *cache_mem = icc_link_cache->memory;
+    gsicc_link_bucket_t *bucket = ICC_CACHE_BUCKET(icc_link_cache,
+                                                   hash.link_hashcode);
     gsicc_link_t *link;
 
     *ret_link = NULL;
-    /* First see if we can add a link */
-    /* TODO: this should be based on memory usage, not just num_links */
-#ifndef MEMENTO_SQUEEZE_BUILD
-    gx_monitor_enter(icc_link_cache->lock);
-#endif
-    while (icc_link_cache->num_links >= ICC_CACHE_MAXLINKS) {
-        /* Look through the cache for first zero ref count to re-use that entry.
-           When ref counts go to zero, the icc_link will have been moved to
-           the end of the list, so the first we find is the 'oldest'.
-           If we get to the last entry we release the lock, set the cache_full
-           flag and wait on full_wait for some other thread to let this thread
-           run again after releasing a cache slot. Release the cache lock to
-           let other threads run and finish with (release) a cache entry.
-        */
-        link = icc_link_cache->head;
-        while (link != NULL ) {
-            if (link->ref_count == 0) {
-                /* we will use this one */
-                if_debug3m('^', cache_mem, "[^]%s 0x%lx ++ => %ld\n",
-                           "icclink", link, link->ref_count);
-                break;
-            }
-            link = link->next;
-        }
-        if (link == NULL) {
+    /* First make room for the new link, if we can */
+    gsicc_cache_trim(icc_link_cache);
+    for (;;) {
 #ifndef MEMENTO_SQUEEZE_BUILD
-            icc_link_cache->cache_full = true;
-            /* unlock while waiting for a link to come available */
-            gx_monitor_leave(icc_link_cache->lock);
-            gx_semaphore_wait(icc_link_cache->full_wait);
+        gx_monitor_enter(bucket->lock);
 #endif
-            /* repeat the findcachelink to see if some other thread has	*/
-            /* already started building the link we need		*/
-            *ret_link = gsicc_findcachelink(hash, icc_link_cache,
-                                            include_softproof, include_devlink);
-            /* Got a hit, return link. ref_count for the link was already bumped */
-            if (*ret_link != NULL)
-                return true;
-
+        /* See if some other thread has already started building the	*/
+        /* link we need since we looked					*/
+        link = gsicc_find_in_bucket(icc_link_cache, bucket, hash.link_hashcode,
+                                    include_softproof, include_devlink);
+        if (link == NULL)
+            break;
 #ifndef MEMENTO_SQUEEZE_BUILD
-            gx_monitor_enter(icc_link_cache->lock);	    /* restore the lock */
+        gx_monitor_leave(bucket->lock);
 #endif
-        } else {
-            /* Remove the zero ref_count link profile we found.		*/
-            /* Even if we remove this link, we may still be maxed out so*/
-            /* the outermost 'while' will check to make sure some other	*/
-            /* thread did not grab the one we remove.			*/
-            gsicc_remove_link(link, cache_mem);
-        }
+        /* Got a hit, return link. ref_count for the link was already bumped */
+        *ret_link = gsicc_wait_for_link(link);
+        if (*ret_link != NULL)
+            return true;
+        /* The other thread failed to build it, so try ourselves */
     }
     /* insert an empty link that we will reserve so we can unlock while	*/
     /* building the link contents. If successful, the entry will set	*/
@@ -930,17 +1119,186 @@ gsicc_alloc_link_entry(gsicc_link_cache_t *icc_link_cache,
     /* the lock will be released when the link becomes valid.           */
     if (*ret_link) {
         (*ret_link)->icc_link_cache = icc_link_cache;
-        (*ret_link)->next = icc_link_cache->head;
-        icc_link_cache->head = *ret_link;
+        (*ret_link)->last_use = ++icc_link_cache->use_count;
+        (*ret_link)->next = bucket->head;
+        bucket->head = *ret_link;
+#ifndef MEMENTO_SQUEEZE_BUILD
+        gx_monitor_enter(icc_link_cache->lock);
+#endif
         icc_link_cache->num_links++;
+        icc_link_cache->memory_used += (*ret_link)->size;
+#ifndef MEMENTO_SQUEEZE_BUILD
+        gx_monitor_leave(icc_link_cache->lock);
+#endif
     }
 #ifndef MEMENTO_SQUEEZE_BUILD
     /* unlock before returning */
-    gx_monitor_leave(icc_link_cache->lock);
+    gx_monitor_leave(bucket->lock);
 #endif
     return false;	/* we didn't find it, but return a link to be filled */
 }
 
+/* ------ Persistent link cache ------ */
+
+/*
+ * If ICCLinkCacheDir is set, plain source to destination links are also
+ * kept on disk, so that they don't have to be built again by the next job.
+ * The CMS writes the optimized transform of the link as a device link
+ * profile, and the file name holds everything that went into the link: the
+ * hashes of the two color spaces and of the rendering parameters, the CMS
+ * flags and the color accuracy.  A file that can't be read, or has the wrong
+ * number of channels, is simply ignored and the link is built as usual.
+ */
+/* Make the file name for a link, and optionally the prefix for scratch */
+/* files in the same directory.                                         */
+static int
+gsicc_link_file_name(const char *dir, const gsicc_hashlink_t *hash,
+                     int cms_flags, uint accuracy, char *fname, char *prefix)
+{
+    int len = strlen(dir);
+    const char *sep = gp_file_name_separator();
+    int seplen = strlen(sep);
+
+    if (len + seplen + 80 >= gp_file_name_sizeof)
+        return_error(gs_error_limitcheck);
+    if (len >= seplen && !strcmp(dir + len - seplen, sep))
+        sep = "";
+    /* gs_snprintf can't print 64 bit values portably, so use halves */
+    gs_snprintf(fname, gp_file_name_sizeof,
+                "%s%sgs_icl_%08x%08x_%08x%08x_%08x%08x_%x_%x.icc", dir, sep,
+                (uint)(hash->src_hash >> 32), (uint)hash->src_hash,
+                (uint)(hash->des_hash >> 32), (uint)hash->des_hash,
+                (uint)(hash->rend_hash >> 32), (uint)hash->rend_hash,
+                cms_flags, accuracy);
+    if (prefix != NULL)
+        gs_snprintf(prefix, gp_file_name_sizeof, "%s%sgs_icl", dir, sep);
+    return 0;
+}
+
+/* Make a link from a device link profile written by */
+/* gscms_get_devicelink_buffer.                       */
+static gcmmhlink_t
+gsicc_link_from_buffer(unsigned char *data, int size, int cms_flags,
+                       int num_in, int num_out, gs_memory_t *memory)
+{
+    gcmmhprofile_t devlink;
+    gcmmhlink_t link_handle = NULL;
+    gsicc_rendering_param_t params;
+
+    /* The CMS takes a copy of the data */
+    devlink = gsicc_get_profile_handle_buffer(data, size, memory);
+    if (devlink == NULL)
+        return NULL;
+    if (gscms_is_device_link(devlink, memory) &&
+        gscms_get_input_channel_count(devlink, memory) == num_in &&
+        gscms_get_output_channel_count(devlink, memory) == num_out) {
+        /* The rendering parameters are already applied in the transform */
+        params.black_point_comp = gsBLACKPTCOMP_OFF;
+        params.preserve_black = gsBLACKPRESERVE_OFF;
+        params.rendering_intent = gsPERCEPTUAL;
+        params.graphics_type_tag = GS_UNKNOWN_TAG;
+        params.override_icc = false;
+        params.cmm = gsCMM_DEFAULT;
+        link_handle = gscms_get_link(devlink, NULL, &params,
+                                     cms_flags | gscms_saved_link_flag(memory),
+                                     memory);
+    }
+    gscms_release_profile(devlink, memory);
+    return link_handle;
+}
+
+/* Try to make the link from a file in the cache directory */
+static gcmmhlink_t
+gsicc_read_link_file(const char *dir, const gsicc_hashlink_t *hash,
+                     int cms_flags, int num_in, int num_out,
+                     gs_memory_t *memory)
+{
+    char fname[gp_file_name_sizeof];
+    FILE *f;
+    int64_t size;
+    unsigned char *data = NULL;
+    unsigned char *buffer = NULL;
+    gcmmhlink_t link_handle = NULL;
+
+    if (gsicc_link_file_name(dir, hash, cms_flags,
+                             memory->gs_lib_ctx->icc_color_accuracy, fname,
+                             NULL) < 0)
+        return NULL;
+    f = gp_fopen(fname, "rb");
+    if (f == NULL)
+        return NULL;
+    if (gp_fseek_64(f, 0, SEEK_END) == 0)
+        size = gp_ftell_64(f);
+    else
+        size = -1;
+    if (size > 0 && size <= max_int) {
+        data = gp_fmap(f, size);
+        if (data == NULL) {
+            /* No mapping on this platform, read it instead */
+            buffer = gs_alloc_bytes(memory, size, "gsicc_read_link_file");
+            if (buffer != NULL && gp_fseek_64(f, 0, SEEK_SET) == 0 &&
+                fread(buffer, 1, size, f) == size)
+                data = buffer;
+        }
+        if (data != NULL)
+            link_handle = gsicc_link_from_buffer(data, (int)size, cms_flags,
+                                                 num_in, num_out, memory);
+        if (data != NULL && data != buffer)
+            gp_funmap(data, size);
+        gs_free_object(memory, buffer, "gsicc_read_link_file");
+    }
+    fclose(f);
+    if_debug2m(gs_debug_flag_icc, memory, "[icc] %s link file %s\n",
+               link_handle != NULL ? "Read" : "Ignored", fname);
+    return link_handle;
+}
+
+/* Save a new link in the cache directory.  The file is written under a */
+/* temporary name and renamed, so readers never see a partial file.    */
+/* The link that was just built is replaced by one made from the saved  */
+/* data, exactly as a later job will make it, so that a job gives the   */
+/* same colors whether or not it found the file.  Returns the link to   */
+/* use.                                                                 */
+static gcmmhlink_t
+gsicc_write_link_file(const char *dir, const gsicc_hashlink_t *hash,
+                      int cms_flags, gcmmhlink_t link_handle,
+                      int num_in, int num_out, gs_memory_t *memory)
+{
+    char fname[gp_file_name_sizeof];
+    char tmpname[gp_file_name_sizeof];
+    char prefix[gp_file_name_sizeof];
+    unsigned char *buffer;
+    int size, ok;
+    FILE *f;
+    gcmmhlink_t saved_handle;
+    gsicc_link_t old_link;
+
+    if (gsicc_link_file_name(dir, hash, cms_flags,
+                             memory->gs_lib_ctx->icc_color_accuracy, fname,
+                             prefix) < 0)
+        return link_handle;
+    if (gscms_get_devicelink_buffer(link_handle, &buffer, &size, memory) < 0)
+        return link_handle;
+    saved_handle = gsicc_link_from_buffer(buffer, size, cms_flags, num_in,
+                                          num_out, memory);
+    if (saved_handle != NULL) {
+        /* Only write links that a later job will be able to use */
+        f = gp_open_scratch_file(memory, prefix, tmpname, "wb");
+        if (f != NULL) {
+            ok = fwrite(buffer, 1, size, f) == size;
+            ok = (fclose(f) == 0) && ok;
+            if (!ok || rename(tmpname, fname) != 0)
+                unlink(tmpname);
+        }
+        old_link.memory = memory;
+        old_link.link_handle = link_handle;
+        gscms_release_link(&old_link);
+        link_handle = saved_handle;
+    }
+    gs_free_object(memory, buffer, "gsicc_write_link_file");
+    return link_handle;
+}
+
 /* This is the main function called to obtain a linked transform from the ICC
    cache If the cache has the link ready, it will return it.  If not, it will
    request one from the CMS and then return it.  We may need to do some cache
@@ -974,6 +1332,7 @@ gsicc_get_link_profile(const gs_gstate *pgs, gx_device *dev,
     bool src_dev_link = gs_input_profile->isdevlink;
     bool pageneutralcolor = false;
     int cms_flags = 0;
+    const char *link_dir = memory->gs_lib_ctx->icc_link_cache_dir;
 
     /* Determine if we are using a soft proof or device link profile */
     if (dev != NULL ) {
@@ -1225,6 +1584,7 @@ gsicc_get_link_profile(const gs_gstate *pgs, gx_device *dev,
         /* Turn off bp compensation in this case as there is a bug in lcms */
         rendering_params->black_point_comp = false;
         cms_flags = 0;  /* Turn off any flag setting */
+        link_dir = NULL;  /* Not worth keeping */
     }
     /* Get the link with the proof and or device link profile */
     if (include_softproof || include_devicelink || src_dev_link) {
@@ -1246,9 +1606,22 @@ gsicc_get_link_profile(const gs_gstate *pgs, gx_device *dev,
     }
 #endif
     } else {
-        link_handle = gscms_get_link(cms_input_profile, cms_output_profile,
-                                     rendering_params, cms_flags,
-                                     cache_mem->non_gc_memory);
+        if (link_dir != NULL)
+            link_handle = gsicc_read_link_file(link_dir, &hash, cms_flags,
+                                               gs_input_profile->num_comps,
+                                               gs_output_profile->num_comps,
+                                               cache_mem->non_gc_memory);
+        if (link_handle == NULL) {
+            link_handle = gscms_get_link(cms_input_profile, cms_output_profile,
+                                         rendering_params, cms_flags,
+                                         cache_mem->non_gc_memory);
+            if (link_handle != NULL && link_dir != NULL)
+                link_handle = gsicc_write_link_file(link_dir, &hash, cms_flags,
+                                                    link_handle,
+                                                    gs_input_profile->num_comps,
+                                                    gs_output_profile->num_comps,
+                                                    cache_mem->non_gc_memory);
+        }
     }
 #if !defined(MEMENTO_SQUEEZE_BUILD)
     if (!gscms_is_threadsafe()) {
@@ -1262,7 +1635,7 @@ gsicc_get_link_profile(const gs_gstate *pgs, gx_device *dev,
         if (gs_input_profile->data_cs == gsGRAY)
             pageneutralcolor = false;
 
-        gsicc_set_link_data(link, link_handle, hash, icc_link_cache->lock,
+        gsicc_set_link_data(link, link_handle, hash, icc_link_cache,
                             include_softproof, include_devicelink, pageneutralcolor,
                             gs_input_profile->data_cs);
         if_debug2m(gs_debug_flag_icc, cache_mem,
@@ -1277,20 +1650,8 @@ gsicc_get_link_profile(const gs_gstate *pgs, gx_device *dev,
                    gs_output_profile->num_comps,
                    (long long)gs_output_profile->hashcode);
     } else {
-        /* If other threads are waiting, we won't have set link->valid true.	*/
-        /* This could result in an infinite loop if other threads are waiting	*/
-        /* for it to be made valid. (see gsicc_findcachelink).			*/
-        link->ref_count--;	/* this thread no longer using this link entry	*/
-        if_debug2m('^', link->memory, "[^]icclink 0x%p -- => %ld\n",
-                   link, link->ref_count);
-
-#ifndef MEMENTO_SQUEEZE_BUILD
-        if (icc_link_cache->cache_full) {
-            icc_link_cache->cache_full = false;
-            gx_semaphore_signal(icc_link_cache->full_wait);	/* let a waiting thread run */
-        }
-        gx_monitor_leave(link->lock);
-#endif
+        /* Other threads may be waiting for it to be made valid, */
+        /* gsicc_remove_link lets them know it failed.            */
         gsicc_remove_link(link, cache_mem);
         return NULL;
     }
@@ -1660,68 +2021,33 @@ gsicc_transform_named_color(const float tint_values[],
 }
 
 /* Used by gs to notify the ICC manager that we are done with this link for now */
-/* This may release elements waiting on an icc_link_cache slot */
+/* Unused links stay in the cache until gsicc_cache_trim needs the memory, */
+/* unless the link failed to build, in which case it is no longer in the   */
+/* cache and the last user frees it.                                       */
 void
 gsicc_release_link(gsicc_link_t *icclink)
 {
-    gsicc_link_cache_t *icc_link_cache;
-    
+    gsicc_link_bucket_t *bucket;
+    bool failed;
+
     if (icclink == NULL)
         return;
 
-    icc_link_cache = icclink->icc_link_cache;
+    bucket = ICC_CACHE_BUCKET(icclink->icc_link_cache,
+                              icclink->hashcode.link_hashcode);
 
 #ifndef MEMENTO_SQUEEZE_BUILD
-    gx_monitor_enter(icc_link_cache->lock);
+    gx_monitor_enter(bucket->lock);
 #endif
     if_debug2m('^', icclink->memory, "[^]icclink 0x%p -- => %ld\n",
                icclink, icclink->ref_count - 1);
     /* Decrement the reference count */
-    if (--(icclink->ref_count) == 0) {
-
-        gsicc_link_t *curr, *prev;
-
-        /* Find link in cache, and move it to the end of the list.  */
-        /* This way zero ref_count links are found LRU first	*/
-        curr = icc_link_cache->head;
-        prev = NULL;
-        while (curr != icclink) {
-            prev = curr;
-            curr = curr->next;
-        };
-        if (prev == NULL) {
-            /* this link was the head */
-            icc_link_cache->head = curr->next;
-        } else {
-            prev->next = curr->next;		/* de-link this one */
-        }
-        /* Find the first zero-ref entry on the list */
-        curr = icc_link_cache->head;
-        prev = NULL;
-        while (curr != NULL && curr->ref_count > 0) {
-            prev = curr;
-            curr = curr->next;
-        }
-        /* Found where to link this one into the tail of the list */
-        if (prev == NULL) {
-            icc_link_cache->head = icclink;
-            icclink->next = icc_link_cache->head->next;
-        } else {
-            /* link this one in here */
-            prev->next = icclink;
-            icclink->next = curr;
-        }
-#ifndef MEMENTO_SQUEEZE_BUILD
-        /* Finally, if some thread was waiting because the cache was full, let it run */
-        if (icc_link_cache->cache_full) {
-            icc_link_cache->cache_full = false;
-            gx_semaphore_signal(icc_link_cache->full_wait);	/* let a waiting thread run */
-        }
-#endif
-    }
+    failed = --(icclink->ref_count) == 0 && !icclink->valid;
 #ifndef MEMENTO_SQUEEZE_BUILD
-    gx_monitor_leave(icc_link_cache->lock);
+    gx_monitor_leave(bucket->lock);
 #endif
+    if (failed)
+        gsicc_link_free(icclink, icclink->memory);
 }
 
 /* Used to initialize the buffer description prior to color conversion */
@@ -30,6 +30,8 @@ typedef struct gsicc_namedcolor_s {
 } gsicc_namedcolor_t;
 
 gsicc_link_cache_t* gsicc_cache_new(gs_memory_t *memory);
+void gsicc_cache_addref(gsicc_link_cache_t *icc_link_cache);
+void gsicc_cache_release(gsicc_link_cache_t *icc_link_cache, client_name_t cname);
 gsicc_link_t* gsicc_findcachelink(gsicc_hashlink_t hashcode,
                                   gsicc_link_cache_t *icc_link_cache,
                                   bool includes_proof, bool includes_devlink);
@@ -491,6 +491,15 @@ gscms_avoid_white_fix_flag(gs_memory_t *memory)
     return cmsFLAGS_NOWHITEONWHITEFIXUP;
 }
 
+/* Get the flag to use the pipeline of a device link profile as it is, for
+   links that were saved by gscms_get_devicelink_buffer and are already
+   optimized */
+int
+gscms_saved_link_flag(gs_memory_t *memory)
+{
+    return cmsFLAGS_NOOPTIMIZE;
+}
+
 void
 gscms_get_link_dim(gcmmhlink_t link, int *num_inputs, int *num_outputs,
     gs_memory_t *memory)
@@ -499,6 +508,41 @@ gscms_get_link_dim(gcmmhlink_t link, int *num_inputs, int *num_outputs,
     *num_outputs = T_CHANNELS(cmsGetTransformOutputFormat(link));
 }
 
+/* Write the (optimized) transform of a link as a device link profile, */
+/* which gscms_get_link can make the same link from.  The buffer is     */
+/* allocated in memory, the caller frees it.                            */
+int
+gscms_get_devicelink_buffer(gcmmhlink_t link, unsigned char **buffer,
+                            int *size, gs_memory_t *memory)
+{
+    cmsHPROFILE devlink;
+    cmsUInt32Number bytes;
+    int code = 0;
+
+    *buffer = NULL;
+    *size = 0;
+    devlink = cmsTransform2DeviceLink(link, 4.3, 0);
+    if (devlink == NULL)
+        return_error(gs_error_rangecheck);
+    if (!cmsSaveProfileToMem(devlink, NULL, &bytes))
+        code = gs_note_error(gs_error_rangecheck);
+    if (code == 0) {
+        *buffer = gs_alloc_bytes(memory, bytes, "gscms_get_devicelink_buffer");
+        if (*buffer == NULL)
+            code = gs_note_error(gs_error_VMerror);
+    }
+    if (code == 0 && !cmsSaveProfileToMem(devlink, *buffer, &bytes))
+        code = gs_note_error(gs_error_rangecheck);
+    cmsCloseProfile(devlink);
+    if (code < 0) {
+        gs_free_object(memory, *buffer, "gscms_get_devicelink_buffer");
+        *buffer = NULL;
+        return code;
+    }
+    *size = bytes;
+    return 0;
+}
+
 /* Get the link from the CMS. TODO:  Add error checking */
 gcmmhlink_t
 gscms_get_link(gcmmhprofile_t  lcms_srchandle,
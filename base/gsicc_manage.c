@@ -2998,6 +2998,31 @@ gs_seticcdirectory(const gs_gstate * pgs, gs_param_string * pval)
     return 0;
 }
 
+void
+gs_currenticclinkcachedir(const gs_gstate * pgs, gs_param_string * pval)
+{
+    const gs_lib_ctx_t *lib_ctx = pgs->memory->gs_lib_ctx;
+
+    if (lib_ctx->icc_link_cache_dir == NULL) {
+        pval->data = (const byte *)"";
+        pval->size = 0;
+        pval->persistent = true;
+    } else {
+        pval->data = (const byte *)(lib_ctx->icc_link_cache_dir);
+        pval->size = strlen(lib_ctx->icc_link_cache_dir);
+        pval->persistent = false;
+    }
+}
+
+int
+gs_seticclinkcachedir(const gs_gstate * pgs, gs_param_string * pval)
+{
+    if (gs_lib_ctx_set_icc_link_cache_dir(pgs->memory, (const char *)pval->data,
+                                          pval->size) < 0)
+        return_error(gs_error_VMerror);
+    return 0;
+}
+
 void
 gs_currentsrcgtagicc(const gs_gstate * pgs, gs_param_string * pval)
 {
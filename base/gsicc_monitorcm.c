@@ -410,9 +410,8 @@ gsicc_mcm_set_link(gsicc_link_t* link)
 int
 gsicc_mcm_end_monitor(gsicc_link_cache_t *cache, gx_device *dev)
 {
-    gx_monitor_t *lock = cache->lock;
     gsicc_link_t *curr;
-    int code;
+    int code, k;
     cmm_dev_profile_t *dev_profile;
 
 
@@ -428,21 +427,25 @@ gsicc_mcm_end_monitor(gsicc_link_cache_t *cache, gx_device *dev)
         gs_pdf14_device_color_mon_set(dev, false);
     }
 
-    /* Lock the cache as we remove monitoring from the links */
-    gx_monitor_enter(lock);
-    curr = cache->head;
-    while (curr != NULL ) {
-        if (curr->is_monitored) {
-            curr->procs = curr->orig_procs;
-            if (curr->hashcode.des_hash == curr->hashcode.src_hash)
-                curr->is_identity = true;
-            curr->is_monitored = false;
+    /* Lock each bucket of the cache as we remove monitoring from the links */
+    for (k = 0; k < ICC_CACHE_BUCKETS; k++) {
+        gx_monitor_t *lock = cache->bucket[k].lock;
+
+        gx_monitor_enter(lock);
+        curr = cache->bucket[k].head;
+        while (curr != NULL ) {
+            if (curr->is_monitored) {
+                curr->procs = curr->orig_procs;
+                if (curr->hashcode.des_hash == curr->hashcode.src_hash)
+                    curr->is_identity = true;
+                curr->is_monitored = false;
+            }
+            /* Now release any tasks/threads waiting for these contents */
+            gx_monitor_leave(curr->lock);
+            curr = curr->next;
         }
-        /* Now release any tasks/threads waiting for these contents */
-        gx_monitor_leave(curr->lock);
-        curr = curr->next;
+        gx_monitor_leave(lock);	/* done with updating, let everyone run */
     }
-    gx_monitor_leave(lock);	/* done with updating, let everyone run */
     return 0;
 }
 
@@ -452,9 +455,8 @@ gsicc_mcm_end_monitor(gsicc_link_cache_t *cache, gx_device *dev)
 int
 gsicc_mcm_begin_monitor(gsicc_link_cache_t *cache, gx_device *dev)
 {
-    gx_monitor_t *lock = cache->lock;
     gsicc_link_t *curr;
-    int code;
+    int code, k;
     cmm_dev_profile_t *dev_profile;
 
     /* Get the device profile */
@@ -469,18 +471,21 @@ gsicc_mcm_begin_monitor(gsicc_link_cache_t *cache, gx_device *dev)
         gs_pdf14_device_color_mon_set(dev, true);
     }
 
-    /* Lock the cache as we remove monitoring from the links */
-    gx_monitor_enter(lock);
-
-    curr = cache->head;
-    while (curr != NULL ) {
-        if (curr->data_cs != gsGRAY) {
-            gsicc_mcm_set_link(curr);
-            /* Now release any tasks/threads waiting for these contents */
-            gx_monitor_leave(curr->lock);
+    /* Lock each bucket of the cache as we restore monitoring of the links */
+    for (k = 0; k < ICC_CACHE_BUCKETS; k++) {
+        gx_monitor_t *lock = cache->bucket[k].lock;
+
+        gx_monitor_enter(lock);
+        curr = cache->bucket[k].head;
+        while (curr != NULL ) {
+            if (curr->data_cs != gsGRAY) {
+                gsicc_mcm_set_link(curr);
+                /* Now release any tasks/threads waiting for these contents */
+                gx_monitor_leave(curr->lock);
+            }
+            curr = curr->next;
         }
-        curr = curr->next;
+        gx_monitor_leave(lock);	/* done with updating, let everyone run */
     }
-    gx_monitor_leave(lock);	/* done with updating, let everyone run */
     return 0;
 }
@@ -86,6 +86,31 @@ gs_lib_ctx_set_icc_directory(const gs_memory_t *mem_gc, const char* pname,
     return 0;
 }
 
+/*  This sets the directory in which ICC links are saved, so that later runs
+    can use them rather than building them again.  An empty name turns the
+    saving off. */
+int
+gs_lib_ctx_set_icc_link_cache_dir(const gs_memory_t *mem, const char* pname,
+                                  int dir_namelen)
+{
+    char *result = NULL;
+    gs_lib_ctx_t *p_ctx = mem->gs_lib_ctx;
+    gs_memory_t *p_ctx_mem = p_ctx->memory;
+
+    if (dir_namelen > 0) {
+        result = (char*) gs_alloc_bytes(p_ctx_mem, dir_namelen+1,
+                                        "gs_lib_ctx_set_icc_link_cache_dir");
+        if (result == NULL)
+            return -1;
+        memcpy(result, pname, dir_namelen);
+        result[dir_namelen] = 0;
+    }
+    gs_free_object(p_ctx_mem, p_ctx->icc_link_cache_dir,
+                   "gs_lib_ctx_set_icc_link_cache_dir");
+    p_ctx->icc_link_cache_dir = result;
+    return 0;
+}
+
 /* Sets/Gets the string containing the list of default devices we should try */
 int
 gs_lib_ctx_set_default_device_list(const gs_memory_t *mem, const char* dev_list_str,
@@ -214,6 +239,7 @@ int gs_lib_ctx_init(gs_lib_ctx_t *ctx, gs_memory_t *mem)
     /* Initialize our default ICCProfilesDir */
     pio->profiledir = NULL;
     pio->profiledir_len = 0;
+    pio->icc_link_cache_dir = NULL;
     pio->icc_color_accuracy = MAX_COLOR_ACCURACY;
     if (gs_lib_ctx_set_icc_directory(mem, DEFAULT_DIR_ICC, strlen(DEFAULT_DIR_ICC)) < 0)
       goto Failure;
@@ -276,6 +302,8 @@ void gs_lib_ctx_fin(gs_memory_t *mem)
     gscms_destroy(ctx_mem);
     gs_free_object(ctx_mem, ctx->profiledir,
         "gs_lib_ctx_fin");
+    gs_free_object(ctx_mem, ctx->icc_link_cache_dir,
+        "gs_lib_ctx_fin");
 
     gs_free_object(ctx_mem, ctx->default_device_list,
                 "gs_lib_ctx_fin");
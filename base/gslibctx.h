@@ -100,6 +100,7 @@ typedef struct gs_lib_ctx_s
      * and one in the device */
     char *profiledir;               /* Directory used in searching for ICC profiles */
     int profiledir_len;             /* length of directory name (allows for Unicode) */
+    char *icc_link_cache_dir;       /* Directory for saved ICC links, or NULL */
     void *cms_context;  /* Opaque context pointer from underlying CMS in use */
     gs_fapi_server **fapi_servers;
     char *default_device_list;
@@ -142,6 +143,8 @@ gs_memory_t * gs_lib_ctx_get_non_gc_memory_t(void);
 
 int gs_lib_ctx_set_icc_directory(const gs_memory_t *mem_gc, const char* pname,
                                  int dir_namelen);
+int gs_lib_ctx_set_icc_link_cache_dir(const gs_memory_t *mem, const char* pname,
+                                      int dir_namelen);
 
 
 /* Sets/Gets the string containing the list of device names we should search
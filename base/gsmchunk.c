@@ -161,6 +161,18 @@ typedef struct chunk_slab_s {
     struct chunk_slab_s *next;
 } chunk_slab_t;
 
+/*
+ * Freed blocks of the commonest small sizes are kept on one list per size,
+ * rather than being merged back into the free trees, so that the next
+ * allocation of the same size (paths, clip lists, device colors and so on)
+ * need not search and splay the trees. A chunk allocator is only used by one
+ * thread at a time (each clist render thread has its own), so these lists
+ * need no locking. The size class of a block is its size in units of
+ * SIZEOF_ROUND_ALIGN(chunk_obj_node_t), which all block sizes are rounded to.
+ */
+#define CHUNK_QUICK_CLASSES 32	/* classes 1 .. CHUNK_QUICK_CLASSES-1 */
+#define CHUNK_QUICK_MAX 64	/* max # of blocks kept per class */
+
 typedef struct gs_memory_chunk_s {
     gs_memory_common;           /* interface outside world sees */
     gs_memory_t *target;        /* base allocator */
@@ -169,6 +181,11 @@ typedef struct gs_memory_chunk_s {
     chunk_free_node_t *free_loc; /* free tree */
     chunk_obj_node_t *defer_finalize_list;
     chunk_obj_node_t *defer_free_list;
+    chunk_obj_node_t *quick[CHUNK_QUICK_CLASSES]; /* size class lists */
+    uint quick_count[CHUNK_QUICK_CLASSES];
+    unsigned long quick_bytes;  /* size of the blocks on the lists */
+    unsigned long quick_hits;   /* allocations taken from the lists */
+    unsigned long quick_misses; /* small allocations that were not */
     unsigned long used;
     unsigned long max_used;
     unsigned long total_free;
@@ -211,6 +228,11 @@ gs_memory_chunk_wrap(gs_memory_t **wrapped,      /* chunk allocator init */
     cmem->used = 0;
     cmem->max_used = 0;
     cmem->total_free = 0;
+    memset(cmem->quick, 0, sizeof(cmem->quick));
+    memset(cmem->quick_count, 0, sizeof(cmem->quick_count));
+    cmem->quick_bytes = 0;
+    cmem->quick_hits = 0;
+    cmem->quick_misses = 0;
 #ifdef DEBUG_SEQ
     cmem->sequence = 0;
 #endif
@@ -286,6 +308,9 @@ chunk_mem_node_free_all_slabs(gs_memory_chunk_t *cmem)
     cmem->free_loc = NULL;
     cmem->total_free = 0;
     cmem->used = 0;
+    memset(cmem->quick, 0, sizeof(cmem->quick));
+    memset(cmem->quick_count, 0, sizeof(cmem->quick_count));
+    cmem->quick_bytes = 0;
 }
 
 static void
@@ -294,6 +319,9 @@ chunk_free_all(gs_memory_t * mem, uint free_mask, client_name_t cname)
     gs_memory_chunk_t * const cmem = (gs_memory_chunk_t *)mem;
     gs_memory_t * const target = cmem->target;
 
+    if (free_mask & FREE_ALL_ALLOCATOR)
+        if_debug3m('a', target, "[a]chunk_free_all(%s) size class cache: %lu hits, %lu misses\n",
+                   client_name_string(cname), cmem->quick_hits, cmem->quick_misses);
     if (free_mask & FREE_ALL_DATA)
         chunk_mem_node_free_all_slabs(cmem);
     /* Only free the structures and the allocator itself. */
@@ -784,12 +812,28 @@ chunk_obj_alloc(gs_memory_t *mem, uint size, gs_memory_type_ptr_t type, client_n
 #endif
 #endif
 
+    /* Small blocks come from the size class lists if possible */
+    if (newsize % SIZEOF_ROUND_ALIGN(chunk_obj_node_t) == 0 &&
+        newsize < CHUNK_QUICK_CLASSES * SIZEOF_ROUND_ALIGN(chunk_obj_node_t)) {
+        uint qi = newsize / SIZEOF_ROUND_ALIGN(chunk_obj_node_t);
+
+        obj = cmem->quick[qi];
+        if (obj != NULL) {
+            cmem->quick[qi] = obj->defer_next;
+            cmem->quick_count[qi]--;
+            cmem->quick_bytes -= newsize;
+            cmem->quick_hits++;
+        } else
+            cmem->quick_misses++;
+    }
+
     /* Large blocks are allocated directly */
-    if (SINGLE_OBJECT_CHUNK(newsize)) {
+    if (obj == NULL && SINGLE_OBJECT_CHUNK(newsize)) {
         obj = (chunk_obj_node_t *)gs_alloc_bytes_immovable(cmem->target, newsize, cname);
         if (obj == NULL)
             return NULL;
-    } else {
+        cmem->used += newsize;
+    } else if (obj == NULL) {
         /* Find the smallest free block that's large enough */
         /* okp points to the parent pointer to the block we pick */
         ap = &cmem->free_size;
@@ -911,6 +955,7 @@ chunk_obj_alloc(gs_memory_t *mem, uint size, gs_memory_type_ptr_t type, client_n
                 return NULL;
             slab->next = cmem->slabs;
             cmem->slabs = slab;
+            cmem->used += slab_size;
 
             obj = (chunk_obj_node_t *)(((byte *)slab) + SIZEOF_ROUND_ALIGN(chunk_slab_t));
             if (slab_size != newsize + SIZEOF_ROUND_ALIGN(chunk_slab_t)) {
@@ -940,6 +985,8 @@ chunk_obj_alloc(gs_memory_t *mem, uint size, gs_memory_type_ptr_t type, client_n
         memset((byte *)(obj) + SIZEOF_ROUND_ALIGN(chunk_obj_node_t), 0xac, size);
     }
 
+    if (cmem->used > cmem->max_used)
+        cmem->max_used = cmem->used;
     obj->size = newsize; /* actual size */
     obj->padding = newsize - size; /* actual size - client requested size */
     obj->type = type;    /* and client desired type */
@@ -1089,6 +1136,7 @@ chunk_free_object(gs_memory_t *mem, void *ptr, client_name_t cname)
                client_name_string(cname), (ulong) ptr, obj->size);
 
     if (SINGLE_OBJECT_CHUNK(obj->size - obj->padding)) {
+        cmem->used -= obj->size;
         gs_free_object(cmem->target, obj, "chunk_free_object(single object)");
 #ifdef DEBUG_CHUNK
         gs_memory_chunk_dump_memory(cmem);
@@ -1096,6 +1144,22 @@ chunk_free_object(gs_memory_t *mem, void *ptr, client_name_t cname)
         return;
     }
 
+    /* Keep small blocks on their size class list, if it isn't full */
+    if (obj->size % SIZEOF_ROUND_ALIGN(chunk_obj_node_t) == 0 &&
+        obj->size < CHUNK_QUICK_CLASSES * SIZEOF_ROUND_ALIGN(chunk_obj_node_t)) {
+        uint qi = obj->size / SIZEOF_ROUND_ALIGN(chunk_obj_node_t);
+
+        if (cmem->quick_count[qi] < CHUNK_QUICK_MAX) {
+            if (gs_alloc_debug)
+                memset(ptr, 0x9c, obj->size - obj_node_size);
+            obj->defer_next = cmem->quick[qi];
+            cmem->quick[qi] = obj;
+            cmem->quick_count[qi]++;
+            cmem->quick_bytes += obj->size;
+            return;
+        }
+    }
+
     /* We want to find where to insert this free entry into our free tree. We need to know
      * both the point to the left of it, and the point to the right of it, in order to see
      * if we can merge the free entries. Accordingly, we search from the top of the tree
@@ -1330,7 +1394,8 @@ chunk_status(gs_memory_t * mem, gs_memory_status_t * pstat)
     gs_memory_chunk_t *cmem = (gs_memory_chunk_t *)mem;
 
     pstat->allocated = cmem->used;
-    pstat->used = cmem->used - cmem->total_free;
+    /* Blocks on the size class lists are free too */
+    pstat->used = cmem->used - cmem->total_free - cmem->quick_bytes;
     pstat->max_used = cmem->max_used;
     pstat->is_thread_safe = false;	/* this allocator does not have an internal mutex */
 }
@@ -1387,9 +1452,28 @@ static void chunk_defer_frees(gs_memory_t *mem, int defer)
     }
 }
 
+/* Return the blocks on the size class lists to the free trees */
 static void
 chunk_consolidate_free(gs_memory_t *mem)
 {
+    gs_memory_chunk_t *cmem = (gs_memory_chunk_t *)mem;
+    chunk_obj_node_t *obj;
+    int i;
+
+    for (i = 1; i < CHUNK_QUICK_CLASSES; i++) {
+        /* Mark the list as full, so chunk_free_object doesn't put the
+         * blocks straight back on it. */
+        cmem->quick_count[i] = CHUNK_QUICK_MAX;
+        while ((obj = cmem->quick[i]) != NULL) {
+            cmem->quick[i] = obj->defer_next;
+            cmem->quick_bytes -= obj->size;
+            obj->type = NULL; /* already finalized */
+            obj->defer_next = NULL;
+            chunk_free_object(mem, ((byte *)obj) + SIZEOF_ROUND_ALIGN(chunk_obj_node_t),
+                              "chunk_consolidate_free");
+        }
+        cmem->quick_count[i] = 0;
+    }
 }
 
 /* accessors to get size and type given the pointer returned to the client */
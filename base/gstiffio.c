@@ -169,6 +169,142 @@ tiff_from_filep(gx_device_printer *dev,  const char *name, FILE *filep, int big_
     return t;
 }
 
+/* An in-memory TIFF, into which the strips of one band are encoded. The
+ * i/o structure starts with a tifs_io_private (with a NULL FILE *), so that
+ * the message handlers below can find the device.
+ */
+typedef struct tifs_mem_io_private_t
+{
+    tifs_io_private io;
+    gs_memory_t *memory;
+    byte *data;
+    uint64_t size;
+    uint64_t alloc;
+    uint64_t pos;
+} tifs_mem_io_private;
+
+static size_t
+gs_tifsMemReadProc(thandle_t fd, void* buf, size_t size)
+{
+    tifs_mem_io_private *mio = (tifs_mem_io_private *)fd;
+
+    if (mio->pos >= mio->size)
+        return 0;
+    if (size > mio->size - mio->pos)
+        size = (size_t)(mio->size - mio->pos);
+    memcpy(buf, mio->data + mio->pos, size);
+    mio->pos += size;
+    return size;
+}
+
+static size_t
+gs_tifsMemWriteProc(thandle_t fd, void* buf, size_t size)
+{
+    tifs_mem_io_private *mio = (tifs_mem_io_private *)fd;
+    uint64_t end = mio->pos + size;
+
+    if (end > mio->alloc) {
+        uint64_t alloc = (mio->alloc < 4096 ? 4096 : mio->alloc);
+        byte *data;
+
+        while (alloc < end)
+            alloc <<= 1;
+        if ((size_t)alloc != alloc)
+            return (size_t) -1;
+        data = gs_alloc_bytes(mio->memory, (size_t)alloc, "gs_tifsMemWriteProc");
+        if (data == NULL)
+            return (size_t) -1;
+        if (mio->size > 0)
+            memcpy(data, mio->data, (size_t)mio->size);
+        gs_free_object(mio->memory, mio->data, "gs_tifsMemWriteProc");
+        mio->data = data;
+        mio->alloc = alloc;
+    }
+    if (mio->pos > mio->size)
+        memset(mio->data + mio->size, 0, (size_t)(mio->pos - mio->size));
+    memcpy(mio->data + mio->pos, buf, size);
+    mio->pos = end;
+    if (end > mio->size)
+        mio->size = end;
+    return size;
+}
+
+static uint64_t
+gs_tifsMemSeekProc(thandle_t fd, uint64_t off, int whence)
+{
+    tifs_mem_io_private *mio = (tifs_mem_io_private *)fd;
+
+    switch (whence) {
+        case SEEK_SET: mio->pos = off; break;
+        case SEEK_CUR: mio->pos += off; break;
+        case SEEK_END: mio->pos = mio->size + off; break;
+        default: return (uint64_t) -1;
+    }
+    return mio->pos;
+}
+
+static int
+gs_tifsMemCloseProc(thandle_t fd)
+{
+    (void) fd;
+    return 0;
+}
+
+static uint64_t
+gs_tifsMemSizeProc(thandle_t fd)
+{
+    return ((tifs_mem_io_private *)fd)->size;
+}
+
+TIFF *
+tiff_to_memory(gx_device_printer *dev, gs_memory_t *mem, const char *name, int big_endian)
+{
+    tifs_mem_io_private *mio;
+    TIFF *t;
+
+    mio = (tifs_mem_io_private *)gs_alloc_bytes(mem, sizeof(tifs_mem_io_private), "tiff_to_memory");
+    if (!mio) {
+        return NULL;
+    }
+    mio->io.f = NULL;
+    mio->io.pdev = dev;
+    mio->memory = mem;
+    mio->data = NULL;
+    mio->size = mio->alloc = mio->pos = 0;
+
+    t = TIFFClientOpen(name, big_endian ? "wb" : "wl",
+        (thandle_t) mio, (TIFFReadWriteProc)gs_tifsMemReadProc,
+        (TIFFReadWriteProc)gs_tifsMemWriteProc, (TIFFSeekProc)gs_tifsMemSeekProc,
+        gs_tifsMemCloseProc, (TIFFSizeProc)gs_tifsMemSizeProc, gs_tifsDummyMapProc,
+        gs_tifsDummyUnmapProc);
+    if (t == NULL) {
+        gs_free_object(mem, mio->data, "tiff_to_memory");
+        gs_free_object(mem, mio, "tiff_to_memory");
+    }
+    return t;
+}
+
+const byte *
+tiff_memory_data(TIFF *t, toff_t *size)
+{
+    tifs_mem_io_private *mio = (tifs_mem_io_private *)TIFFClientdata(t);
+
+    *size = mio->size;
+    return mio->data;
+}
+
+void
+tiff_memory_free(TIFF *t)
+{
+    tifs_mem_io_private *mio = (tifs_mem_io_private *)TIFFClientdata(t);
+    gs_memory_t *mem = mio->memory;
+
+    /* Discard the TIFF without writing a directory for it. */
+    TIFFCleanup(t);
+    gs_free_object(mem, mio->data, "tiff_memory_free");
+    gs_free_object(mem, mio, "tiff_memory_free");
+}
+
 static void
 gs_tifsWarningHandlerEx(thandle_t client_data, const char* module, const char* fmt, va_list ap)
 {
@@ -22,6 +22,14 @@
 
 TIFF *
 tiff_from_filep(gx_device_printer *dev,  const char *name, FILE *filep, int big_endian, bool usebigtiff);
+
+/* A TIFF written to a growable buffer in 'mem', rather than to a file;
+ * dispose of it with tiff_memory_free (not TIFFClose).
+ */
+TIFF *
+tiff_to_memory(gx_device_printer *dev, gs_memory_t *mem, const char *name, int big_endian);
+const byte *tiff_memory_data(TIFF *t, toff_t *size);
+void tiff_memory_free(TIFF *t);
 void tiff_set_handlers (void);
 
 #endif /* gstiffio_INCLUDED */
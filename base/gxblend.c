@@ -27,6 +27,27 @@
 #include "gsrect.h"		/* for rect_merge */
 #include "math_.h"		/* for ceil, floor */
 
+/* The AVX2 versions of the Normal compositing kernels are picked at run
+ * time, as in gxht_thresh.c: gcc and clang builds compile them alongside
+ * the SSE2 ones, other compilers only when targeting AVX2 throughout. */
+#if defined(HAVE_SSE2) && defined(__AVX2__)
+#define GX_BLEND_AVX2
+#define GX_BLEND_AVX2_TARGET
+#define gx_blend_have_avx2() 1
+#elif defined(HAVE_SSE2) && (defined(__clang__) || (defined(__GNUC__) && \
+                             (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define GX_BLEND_AVX2
+#define GX_BLEND_AVX2_TARGET __attribute__((target("avx2")))
+#define gx_blend_have_avx2() __builtin_cpu_supports("avx2")
+#endif
+
+#ifdef HAVE_SSE2
+#include <emmintrin.h>
+#ifdef GX_BLEND_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
 typedef int art_s32;
 
 #if RAW_DUMP
@@ -1239,6 +1260,85 @@ art_blend_pixel_8(byte *gs_restrict dst, const byte *gs_restrict backdrop,
                              pblend_procs, p14dev);
 }
 
+#ifdef HAVE_SSE2
+/* SSE2 helpers for 16 bit data, 4 values at a time in 32 bit lanes. The
+ * arithmetic matches the scalar code, including the wrapping of 32 bit
+ * intermediate products. */
+
+/* Load 4 uint16_t into 32 bit lanes. */
+static forceinline __m128i
+load_4x16_sse2(const uint16_t *p)
+{
+    return _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)p), _mm_setzero_si128());
+}
+
+/* Store the low 16 bits of 4 32 bit lanes. */
+static forceinline void
+store_4x16_sse2(uint16_t *p, __m128i v)
+{
+    v = _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+    _mm_storel_epi64((__m128i *)p, _mm_packs_epi32(v, v));
+}
+
+/* The low 32 bits of the products of 4 pairs of 32 bit lanes. */
+static forceinline __m128i
+mullo_32_sse2(__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+/* The separable blend modes of art_blend_pixel_16 for 4 colorants. */
+static forceinline bool
+art_blend_4x16_sse2(uint16_t *gs_restrict dst, const uint16_t *gs_restrict backdrop,
+                    const uint16_t *gs_restrict src, gs_blend_mode_t blend_mode)
+{
+    __m128i b = load_4x16_sse2(backdrop);
+    __m128i s = load_4x16_sse2(src);
+    __m128i ffff = _mm_set1_epi32(0xffff);
+    __m128i round = _mm_set1_epi32(0x8000);
+    __m128i t;
+
+    switch (blend_mode) {
+        case BLEND_MODE_Multiply:
+            t = _mm_add_epi32(b, _mm_srli_epi32(b, 15));
+            t = _mm_add_epi32(mullo_32_sse2(t, s), round);
+            t = _mm_srli_epi32(t, 16);
+            break;
+        case BLEND_MODE_Screen:
+            t = _mm_add_epi32(b, _mm_srli_epi32(b, 15));
+            t = mullo_32_sse2(_mm_sub_epi32(_mm_set1_epi32(0x10000), t), _mm_sub_epi32(ffff, s));
+            t = _mm_sub_epi32(ffff, _mm_srli_epi32(_mm_add_epi32(t, round), 16));
+            break;
+        case BLEND_MODE_Darken:
+            t = _mm_cmplt_epi32(b, s);
+            t = _mm_or_si128(_mm_and_si128(t, b), _mm_andnot_si128(t, s));
+            break;
+        case BLEND_MODE_Lighten:
+            t = _mm_cmpgt_epi32(b, s);
+            t = _mm_or_si128(_mm_and_si128(t, b), _mm_andnot_si128(t, s));
+            break;
+        case BLEND_MODE_Difference:
+            t = _mm_sub_epi32(b, s);
+            t = _mm_sub_epi32(_mm_xor_si128(t, _mm_srai_epi32(t, 31)), _mm_srai_epi32(t, 31));
+            break;
+        case BLEND_MODE_Exclusion:
+            b = _mm_add_epi32(b, _mm_srli_epi32(b, 15));
+            t = _mm_add_epi32(mullo_32_sse2(_mm_sub_epi32(_mm_set1_epi32(0x10000), b), s),
+                              mullo_32_sse2(b, _mm_sub_epi32(ffff, s)));
+            t = _mm_srli_epi32(_mm_add_epi32(t, round), 16);
+            break;
+        default:
+            return false;
+    }
+    store_4x16_sse2(dst, t);
+    return true;
+}
+#endif
+
 static forceinline void
 art_blend_pixel_16_inline(uint16_t *gs_restrict dst, const uint16_t *gs_restrict backdrop,
                   const uint16_t *gs_restrict src, int n_chan, gs_blend_mode_t blend_mode,
@@ -1249,6 +1349,24 @@ art_blend_pixel_16_inline(uint16_t *gs_restrict dst, const uint16_t *gs_restrict
     int b, s;
     bits32 t;
 
+#ifdef HAVE_SSE2
+    if (n_chan >= 4) {
+        /* Do what we can 4 colorants at a time, the rest below. */
+        for (i = 0; i + 4 <= n_chan; i += 4) {
+            if (!art_blend_4x16_sse2(dst + i, backdrop + i, src + i, blend_mode))
+                break;
+        }
+        if (i == n_chan)
+            return;
+        if (i > 0) {
+            dst += i;
+            backdrop += i;
+            src += i;
+            n_chan -= i;
+        }
+    }
+#endif
+
     switch (blend_mode) {
         case BLEND_MODE_Normal:
         case BLEND_MODE_Compatible:	/* todo */
@@ -1555,8 +1673,7 @@ art_pdf_knockout_composite_pixel_alpha_16(uint16_t *gs_restrict backdrop, uint16
 
     /* Result alpha is Union of backdrop and source alpha */
     a_b += a_b>>15;
-    tmp = (0x10000 - a_b) * (0xffff - a_s) + 0x8000;
-    a_r = 0xffff - (tmp >> 16);
+    a_r = 0xffff - (((0x10000u - a_b) * (0xffffu - a_s) + 0x8000) >> 16);
     /* todo: verify that a_r is nonzero in all cases */
 
     /* Compute a_s / a_r in 16.16 format */
@@ -1583,8 +1700,8 @@ art_pdf_knockout_composite_pixel_alpha_16(uint16_t *gs_restrict backdrop, uint16
             c_s = src[i];
             c_b = backdrop[i];
             c_bl = blend[i];
-            tmp = a_b * (c_bl - c_s) + 0x8000;
-            c_mix = c_s + (tmp >> 16);
+            tmp = (a_b >> 1) * (c_bl - c_s) + 0x4000;
+            c_mix = c_s + (tmp >> 15);
             tmp = src_scale * (c_mix - c_b) + 0x8000;
             dst[i] = c_b + (tmp >> 16);
         }
@@ -1694,8 +1811,8 @@ art_pdf_composite_pixel_alpha_16(uint16_t *gs_restrict dst, const uint16_t *gs_r
     }
 
     /* Result alpha is Union of backdrop and source alpha */
-    tmp = (0xffff - a_b) * (0xffff - a_s) + 0x8000;
-    a_r = 0xffff - (((tmp >> 16) + tmp) >> 16);
+    a_b += a_b>>15; /* a_b in 0...0x10000 range */
+    a_r = 0xffff - (((0x10000u - a_b) * (0xffffu - a_s) + 0x8000) >> 16);
     /* todo: verify that a_r is nonzero in all cases */
 
     /* Compute a_s / a_r in 16.16 format */
@@ -1713,8 +1830,8 @@ art_pdf_composite_pixel_alpha_16(uint16_t *gs_restrict dst, const uint16_t *gs_r
             c_s = src[i];
             c_b = dst[i];
             c_bl = blend[i];
-            tmp = a_b * (c_bl - ((int)c_s)) + 0x8000;
-            c_mix = c_s + (((tmp >> 16) + tmp) >> 16);
+            tmp = (a_b >> 1) * (c_bl - ((int)c_s)) + 0x4000;
+            c_mix = c_s + (tmp >> 15);
             tmp = (c_b << 16) + src_scale * (c_mix - c_b) + 0x8000;
             dst[i] = tmp >> 16;
         }
@@ -1813,7 +1930,6 @@ art_pdf_composite_pixel_alpha_16_inline(uint16_t *gs_restrict dst, uint16_t *gs_
 {
     int a_b, a_s;
     unsigned int a_r;
-    int tmp;
     int src_scale;
     int c_b, c_s;
     int i;
@@ -1834,8 +1950,7 @@ art_pdf_composite_pixel_alpha_16_inline(uint16_t *gs_restrict dst, uint16_t *gs_
 
     /* Result alpha is Union of backdrop and source alpha */
     a_b += a_b>>15; /* a_b in 0...0x10000 range */
-    tmp = (0x10000 - a_b) * (0xffff - a_s) + 0x8000;
-    a_r = 0xffff - (((unsigned int)tmp) >> 16); /* a_r in 0...0xffff range */
+    a_r = 0xffff - (((0x10000u - a_b) * (0xffffu - a_s) + 0x8000) >> 16); /* a_r in 0...0xffff range */
     /* todo: verify that a_r is nonzero in all cases */
 
     /* Compute a_s / a_r in 16.16 format */
@@ -1852,7 +1967,7 @@ art_pdf_composite_pixel_alpha_16_inline(uint16_t *gs_restrict dst, uint16_t *gs_
             c_s = src[i];
             c_b = dst[i];
             c_bl = blend[i];
-            c_s += (a_b * (c_bl - c_s) + 0x8000)>>16;
+            c_s += ((a_b >> 1) * (c_bl - c_s) + 0x4000)>>15;
             c_b += (src_scale * (c_s - c_b) + 0x8000)>>16;
             dst[i] = c_b;
         }
@@ -1944,8 +2059,7 @@ art_pdf_composite_pixel_alpha_16_fast_mono(uint16_t *gs_restrict dst, const uint
     a_b += a_b>>15;
 
     /* Result alpha is Union of backdrop and source alpha */
-    tmp = (0x10000 - a_b) * (0xffff - a_s) + 0x8000;
-    a_r = 0xffff - (tmp >> 16);
+    a_r = 0xffff - (((0x10000u - a_b) * (0xffffu - a_s) + 0x8000) >> 16);
     /* todo: verify that a_r is nonzero in all cases */
 
     /* Compute a_s / a_r in 16.16 format */
@@ -1959,8 +2073,8 @@ art_pdf_composite_pixel_alpha_16_fast_mono(uint16_t *gs_restrict dst, const uint
         c_s = src[0];
         c_b = dst[0];
         c_bl = blend[0];
-        tmp = a_b * (c_bl - c_s) + 0x8000;
-        c_s += (tmp>>16);
+        tmp = (a_b >> 1) * (c_bl - c_s) + 0x4000;
+        c_s += (tmp>>15);
         dst[0] = c_b + ((src_scale * (c_s - c_b) + 0x8000)>>16);
     }
     dst[stride] = a_r;
@@ -2079,10 +2193,9 @@ art_pdf_recomposite_group_16(uint16_t *gs_restrict *dstp, uint16_t *gs_restrict
            operation should be optimized away at a higher level. */
 
         if (dst_alpha_g != NULL) {
-            int d = *dst_alpha_g;
+            unsigned int d = *dst_alpha_g;
             d += d>>15;
-            tmp = (0x10000 - d) * (0xffff - src_alpha_g) + 0x8000;
-            *dst_alpha_g = 0xffff - (tmp>>16);
+            *dst_alpha_g = 0xffff - (((0x10000u - d) * (0xffffu - src_alpha_g) + 0x8000)>>16);
         }
         *dstp = src;
         return 0;
@@ -2092,15 +2205,18 @@ art_pdf_recomposite_group_16(uint16_t *gs_restrict *dstp, uint16_t *gs_restrict
         if (src_alpha_g != 65535 && dst_alpha != 0) {
             /* Uncomposite the color. In other words, solve
                "src = (src, src_alpha_g) over dst" for src */
-            scale = (dst_alpha * 65535 + (src_alpha_g>>1)) / src_alpha_g -
+            /* scale is not a 16.16 value: with a small src_alpha_g it
+               runs far past 0x10000, so the product needs 64 bits. */
+            scale = (dst_alpha * 65535u + (src_alpha_g>>1)) / src_alpha_g -
                 dst_alpha;
             for (i = 0; i < n_chan; i++) {
                 int si, di;
+                int64_t tmp64;
 
                 si = src[i];
                 di = dst[i];
-                tmp = (si - di) * scale + 0x8000;
-                tmp = si + (tmp >> 16);
+                tmp64 = (int64_t)(si - di) * scale + 0x8000;
+                tmp = si + (int)(tmp64 >> 16);
 
                 /* todo: it should be possible to optimize these cond branches */
                 if (tmp < 0)
@@ -2112,13 +2228,12 @@ art_pdf_recomposite_group_16(uint16_t *gs_restrict *dstp, uint16_t *gs_restrict
         }
 
         tmp = alpha + (alpha>>15);
-        tmp = (src_alpha_g * tmp + 0x8000)>>16;
+        tmp = (src_alpha_g * (unsigned int)tmp + 0x8000)>>16;
         src[n_chan] = tmp;
         if (dst_alpha_g != NULL) {
-            int d = *dst_alpha_g;
+            unsigned int d = *dst_alpha_g;
             d += d>>15;
-            tmp = (0x10000 - d) * (0xffff - tmp) + 0x8000;
-            *dst_alpha_g = 0xffff - (tmp >> 16);
+            *dst_alpha_g = 0xffff - (((0x10000u - d) * (0xffffu - tmp) + 0x8000) >> 16);
         }
     }
     return 1;
@@ -2185,8 +2300,8 @@ art_pdf_composite_knockout_group_16(uint16_t *gs_restrict backdrop, uint16_t tos
         const pdf14_nonseparable_blending_procs_t * pblend_procs,
         pdf14_device *p14dev, bool has_mask)
 {
-    int src_alpha;		/* $\alpha g_n$ */
-    int tmp;
+    unsigned int src_alpha;		/* $\alpha g_n$ */
+    unsigned int tmp;
 
     if (tos_shape == 0) {
         /* If a softmask was present pass it along Bug 693548 */
@@ -2208,7 +2323,7 @@ art_pdf_composite_knockout_group_16(uint16_t *gs_restrict backdrop, uint16_t tos
     if (dst_alpha_g != NULL) {
         tmp = *dst_alpha_g;
         tmp += tmp>>15;
-        tmp = (0x10000 - tmp) * (0xffff - src[n_chan]) + 0x8000;
+        tmp = (0x10000u - tmp) * (0xffffu - src[n_chan]) + 0x8000;
         *dst_alpha_g = 0xffff - (tmp >> 16);
     }
     art_pdf_knockout_composite_pixel_alpha_16(backdrop, tos_shape, dst, src,
@@ -2270,13 +2385,13 @@ art_pdf_composite_group_16(uint16_t *gs_restrict dst, uint16_t *gs_restrict dst_
 
     if (alpha != 65535) {
         int tmp = alpha + (alpha>>15);
-        src[n_chan] = (src_alpha * tmp + 0x8000)>>16;
+        src[n_chan] = (src_alpha * (unsigned int)tmp + 0x8000)>>16;
     }
 
     if (dst_alpha_g != NULL) {
-        int tmp = *dst_alpha_g;
+        unsigned int tmp = *dst_alpha_g;
         tmp += tmp>>15;
-        tmp = (0x10000 - tmp) * (0xffff - src[n_chan]) + 0x8000;
+        tmp = (0x10000u - tmp) * (0xffffu - src[n_chan]) + 0x8000;
         *dst_alpha_g = 0xffff - (tmp >> 16);
     }
 
@@ -2383,7 +2498,9 @@ art_pdf_composite_knockout_8(byte *gs_restrict dst,
                        inner loop is a single interpolation */
                     tmp = dst[i] * dst_alpha * (255 - src_shape) +
                         ((int)src[i]) * 255 * src_shape + (result_alpha << 7);
-                    dst[i] = tmp / (result_alpha * 255);
+                    tmp /= result_alpha * 255;
+                    /* result_alpha is rounded, so this can reach 256 */
+                    dst[i] = tmp > 255 ? 255 : tmp;
                 }
             dst[n_chan] = result_alpha;
         }
@@ -2431,7 +2548,7 @@ art_pdf_composite_knockout_16(uint16_t *gs_restrict dst,
                               const pdf14_nonseparable_blending_procs_t * pblend_procs,
                               pdf14_device *p14dev)
 {
-    byte src_shape = src[n_chan];
+    uint16_t src_shape = src[n_chan];
     int i, tmp;
 
     if (blend_mode == BLEND_MODE_Normal) {
@@ -2446,17 +2563,20 @@ art_pdf_composite_knockout_16(uint16_t *gs_restrict dst,
                between dst and (src, opacity). */
             int dst_alpha = dst[n_chan];
             uint16_t result_alpha;
+            unsigned int ua;
 
-            tmp = (65535 - dst_alpha) * src_shape + 0x8000;
-            result_alpha = dst_alpha + ((tmp + (tmp >> 16)) >> 16);
+            ua = (65535u - dst_alpha) * src_shape + 0x8000;
+            result_alpha = dst_alpha + ((ua + (ua >> 16)) >> 16);
 
             if (result_alpha != 0)
                 for (i = 0; i < n_chan; i++) {
                     /* todo: optimize this - can strength-reduce so that
                        inner loop is a single interpolation */
-                    tmp = dst[i] * dst_alpha * (65535 - src_shape) +
-                        ((int)src[i]) * 65535 * src_shape + (result_alpha << 15);
-                    dst[i] = tmp / (result_alpha * 65535);
+                    /* The products here need 48 bits. */
+                    int64_t tmp64 = (int64_t)dst[i] * dst_alpha * (65535 - src_shape) +
+                        (int64_t)src[i] * 65535 * src_shape + (result_alpha << 15);
+                    tmp64 /= (int64_t)result_alpha * 65535;
+                    dst[i] = tmp64 > 65535 ? 65535 : (uint16_t)tmp64;
                 }
             dst[n_chan] = result_alpha;
         }
@@ -2472,8 +2592,7 @@ art_pdf_composite_knockout_16(uint16_t *gs_restrict dst,
         a_b = dst[n_chan];
 
         /* Result alpha is Union of backdrop and source alpha */
-        tmp = (0xffff - a_b) * (0xffff - a_s) + 0x8000;
-        a_r = 0xffff - (((tmp >> 16) + tmp) >> 16);
+        a_r = 0xffff - (((0x10000u - (a_b + (a_b>>15))) * (0xffffu - a_s) + 0x8000) >> 16);
         /* todo: verify that a_r is nonzero in all cases */
 
         /* Compute a_s / a_r in 16.16 format */
@@ -2487,8 +2606,8 @@ art_pdf_composite_knockout_16(uint16_t *gs_restrict dst,
             c_s = src[i];
             c_b = dst[i];
             c_bl = blend[i];
-            tmp = a_b * (c_bl - ((int)c_s)) + 0x8000;
-            c_mix = c_s + (((tmp >> 16) + tmp) >> 16);
+            tmp = ((a_b + (a_b>>15)) >> 1) * (c_bl - ((int)c_s)) + 0x4000;
+            c_mix = c_s + (tmp >> 15);
             tmp = (c_b << 16) + src_scale * (c_mix - c_b) + 0x8000;
             dst[i] = tmp >> 16;
         }
@@ -2656,6 +2775,345 @@ dump_raw_buffer_be(int num_rows, int width, int n_chan,
 }
 #endif
 
+#ifdef HAVE_SSE2
+/* SSE2 versions of the Normal blend mode compositing used by the fast
+ * paths below.  These work on 8 pixels at a time (one 8 byte load per
+ * plane, widened to 16 bit lanes), and give results identical to the
+ * scalar code: the 16.16 src_scale division is done in single precision,
+ * which is exact for the range of values involved, and the 65536 scale
+ * of an opaque result is clamped to 65535, which rounds to the same
+ * value. */
+
+/* Load 8 bytes into 16 bit lanes. */
+static forceinline __m128i
+load_8_sse2(const byte *p)
+{
+    return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)p), _mm_setzero_si128());
+}
+
+/* Store 8 16 bit lanes (all in 0..255) as bytes. */
+static forceinline void
+store_8_sse2(byte *p, __m128i v)
+{
+    _mm_storel_epi64((__m128i *)p, _mm_packus_epi16(v, v));
+}
+
+/* a * b / 255, rounded exactly as (tmp + (tmp >> 8)) >> 8 */
+static forceinline __m128i
+mul_8_sse2(__m128i a, __m128i b)
+{
+    __m128i tmp = _mm_add_epi16(_mm_mullo_epi16(a, b), _mm_set1_epi16(0x80));
+
+    return _mm_srli_epi16(_mm_add_epi16(tmp, _mm_srli_epi16(tmp, 8)), 8);
+}
+
+/* Result alpha is Union of backdrop and source alpha */
+static forceinline __m128i
+union_alpha_8_sse2(__m128i a_b, __m128i a_s)
+{
+    __m128i ff = _mm_set1_epi16(0xff);
+
+    return _mm_sub_epi16(ff, mul_8_sse2(_mm_sub_epi16(ff, a_b), _mm_sub_epi16(ff, a_s)));
+}
+
+/* Compute a_s / a_r in 16.16 format, clamped to 0xffff. Lanes with
+ * a_r == 0 (and hence a_s == 0) give 0. */
+static forceinline __m128i
+src_scale_8_sse2(__m128i a_s, __m128i a_r)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i div = _mm_or_si128(a_r, _mm_and_si128(_mm_cmpeq_epi16(a_r, zero),
+                                                  _mm_set1_epi16(1)));
+    __m128i half = _mm_srli_epi16(a_r, 1);
+    __m128i bias = _mm_set1_epi32(0x8000);
+    __m128i lo, hi;
+
+    lo = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(half, a_s)),
+                                     _mm_cvtepi32_ps(_mm_unpacklo_epi16(div, zero))));
+    hi = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(half, a_s)),
+                                     _mm_cvtepi32_ps(_mm_unpackhi_epi16(div, zero))));
+    /* Saturating pack of the unsigned values, biased to signed and back */
+    return _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(lo, bias), _mm_sub_epi32(hi, bias)),
+                         _mm_set1_epi16((short)0x8000));
+}
+
+/* (c_b << 16) + src_scale * (c_s - c_b) + 0x8000) >> 16 */
+static forceinline __m128i
+blend_normal_8_sse2(__m128i c_b, __m128i c_s, __m128i src_scale)
+{
+    __m128i diff = _mm_sub_epi16(c_s, c_b);
+    __m128i lo = _mm_mullo_epi16(src_scale, diff);
+    /* mulhi is signed; correct for src_scale >= 0x8000 */
+    __m128i hi = _mm_add_epi16(_mm_mulhi_epi16(src_scale, diff),
+                               _mm_and_si128(_mm_srai_epi16(src_scale, 15), diff));
+
+    return _mm_add_epi16(c_b, _mm_add_epi16(hi, _mm_srli_epi16(lo, 15)));
+}
+
+static forceinline __m128i
+select_sse2(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+/* Composite 8 pixels of an isolated, Normal blend mode group onto its
+ * backdrop, with the group alpha for each pixel given in pix_alpha.  If
+ * copy_if_clear, pixels with a zero backdrop alpha take the source color
+ * and scaled alpha, and only pixels with a zero (unscaled) source alpha
+ * are left alone (as compose_group_nonknockout_nonblend_isolated_allmask_common).
+ * Otherwise pixels whose scaled source alpha is zero are left alone (as
+ * art_pdf_composite_group_8). */
+static forceinline void
+compose_group_normal_8_sse2(const byte *gs_restrict tos_ptr, int tos_planestride,
+                            byte *gs_restrict nos_ptr, int nos_planestride,
+                            int n_chan, __m128i pix_alpha, bool copy_if_clear)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i src_alpha = load_8_sse2(tos_ptr + n_chan * tos_planestride);
+    __m128i a_b = load_8_sse2(nos_ptr + n_chan * nos_planestride);
+    __m128i a_s = mul_8_sse2(src_alpha, pix_alpha);
+    __m128i a_r = union_alpha_8_sse2(a_b, a_s);
+    __m128i src_scale = src_scale_8_sse2(a_s, a_r);
+    __m128i keep, copy;
+    int i;
+
+    if (copy_if_clear) {
+        keep = _mm_cmpeq_epi16(src_alpha, zero);
+        copy = _mm_cmpeq_epi16(a_b, zero);
+    } else {
+        keep = _mm_cmpeq_epi16(a_s, zero);
+        copy = zero;
+    }
+    for (i = 0; i < n_chan; i++) {
+        byte *nos = nos_ptr + i * nos_planestride;
+        __m128i c_s = load_8_sse2(tos_ptr + i * tos_planestride);
+        __m128i c_b = load_8_sse2(nos);
+        __m128i c_r = blend_normal_8_sse2(c_b, c_s, src_scale);
+
+        c_r = select_sse2(copy, c_s, c_r);
+        store_8_sse2(nos, select_sse2(keep, c_b, c_r));
+    }
+    /* Where a_b is 0, a_r is a_s, so no need to select for copy. */
+    store_8_sse2(nos_ptr + n_chan * nos_planestride, select_sse2(keep, a_b, a_r));
+}
+
+#ifdef GX_BLEND_AVX2
+/* AVX2 versions of the above, 16 pixels at a time in 16 bit lanes. The
+ * results are the same. The loops over a row are done here too, so that
+ * no 256 bit value is passed to or from code built without AVX2. */
+
+static forceinline GX_BLEND_AVX2_TARGET __m256i
+load_16_avx2(const byte *p)
+{
+    return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)p));
+}
+
+static forceinline GX_BLEND_AVX2_TARGET void
+store_16_avx2(byte *p, __m256i v)
+{
+    _mm_storeu_si128((__m128i *)p, _mm_packus_epi16(_mm256_castsi256_si128(v),
+                                                    _mm256_extracti128_si256(v, 1)));
+}
+
+static forceinline GX_BLEND_AVX2_TARGET __m256i
+mul_8_avx2(__m256i a, __m256i b)
+{
+    __m256i tmp = _mm256_add_epi16(_mm256_mullo_epi16(a, b), _mm256_set1_epi16(0x80));
+
+    return _mm256_srli_epi16(_mm256_add_epi16(tmp, _mm256_srli_epi16(tmp, 8)), 8);
+}
+
+static forceinline GX_BLEND_AVX2_TARGET __m256i
+union_alpha_8_avx2(__m256i a_b, __m256i a_s)
+{
+    __m256i ff = _mm256_set1_epi16(0xff);
+
+    return _mm256_sub_epi16(ff, mul_8_avx2(_mm256_sub_epi16(ff, a_b), _mm256_sub_epi16(ff, a_s)));
+}
+
+/* The unpacks and the pack work within each 128 bit half, so the lanes
+ * come back in their original order. */
+static forceinline GX_BLEND_AVX2_TARGET __m256i
+src_scale_8_avx2(__m256i a_s, __m256i a_r)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i div = _mm256_or_si256(a_r, _mm256_and_si256(_mm256_cmpeq_epi16(a_r, zero),
+                                                        _mm256_set1_epi16(1)));
+    __m256i half = _mm256_srli_epi16(a_r, 1);
+    __m256i bias = _mm256_set1_epi32(0x8000);
+    __m256i lo, hi;
+
+    lo = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(_mm256_unpacklo_epi16(half, a_s)),
+                                           _mm256_cvtepi32_ps(_mm256_unpacklo_epi16(div, zero))));
+    hi = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(_mm256_unpackhi_epi16(half, a_s)),
+                                           _mm256_cvtepi32_ps(_mm256_unpackhi_epi16(div, zero))));
+    return _mm256_xor_si256(_mm256_packs_epi32(_mm256_sub_epi32(lo, bias), _mm256_sub_epi32(hi, bias)),
+                            _mm256_set1_epi16((short)0x8000));
+}
+
+static forceinline GX_BLEND_AVX2_TARGET __m256i
+blend_normal_8_avx2(__m256i c_b, __m256i c_s, __m256i src_scale)
+{
+    __m256i diff = _mm256_sub_epi16(c_s, c_b);
+    __m256i lo = _mm256_mullo_epi16(src_scale, diff);
+    __m256i hi = _mm256_add_epi16(_mm256_mulhi_epi16(src_scale, diff),
+                                  _mm256_and_si256(_mm256_srai_epi16(src_scale, 15), diff));
+
+    return _mm256_add_epi16(c_b, _mm256_add_epi16(hi, _mm256_srli_epi16(lo, 15)));
+}
+
+static forceinline GX_BLEND_AVX2_TARGET __m256i
+select_avx2(__m256i mask, __m256i a, __m256i b)
+{
+    return _mm256_blendv_epi8(b, a, mask);
+}
+
+/* As compose_group_normal_8_sse2, for 16 pixels. */
+static forceinline GX_BLEND_AVX2_TARGET void
+compose_group_normal_16_avx2(const byte *gs_restrict tos_ptr, int tos_planestride,
+                             byte *gs_restrict nos_ptr, int nos_planestride,
+                             int n_chan, __m256i pix_alpha, bool copy_if_clear)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i src_alpha = load_16_avx2(tos_ptr + n_chan * tos_planestride);
+    __m256i a_b = load_16_avx2(nos_ptr + n_chan * nos_planestride);
+    __m256i a_s = mul_8_avx2(src_alpha, pix_alpha);
+    __m256i a_r = union_alpha_8_avx2(a_b, a_s);
+    __m256i src_scale = src_scale_8_avx2(a_s, a_r);
+    __m256i keep, copy;
+    int i;
+
+    if (copy_if_clear) {
+        keep = _mm256_cmpeq_epi16(src_alpha, zero);
+        copy = _mm256_cmpeq_epi16(a_b, zero);
+    } else {
+        keep = _mm256_cmpeq_epi16(a_s, zero);
+        copy = zero;
+    }
+    for (i = 0; i < n_chan; i++) {
+        byte *nos = nos_ptr + i * nos_planestride;
+        __m256i c_s = load_16_avx2(tos_ptr + i * tos_planestride);
+        __m256i c_b = load_16_avx2(nos);
+        __m256i c_r = blend_normal_8_avx2(c_b, c_s, src_scale);
+
+        c_r = select_avx2(copy, c_s, c_r);
+        store_16_avx2(nos, select_avx2(keep, c_b, c_r));
+    }
+    store_16_avx2(nos_ptr + n_chan * nos_planestride, select_avx2(keep, a_b, a_r));
+}
+
+/* Composite the leftmost width & ~15 pixels of one row of an isolated,
+ * Normal blend mode group, and return the number done. If mask_ptr is not
+ * NULL, the group alpha is scaled by the soft mask values it points to,
+ * through mask_tr_fn (the allmask case). */
+static GX_BLEND_AVX2_TARGET int
+compose_group_normal_row_avx2(const byte *gs_restrict tos_ptr, int tos_planestride,
+                              byte *gs_restrict nos_ptr, int nos_planestride, int n_chan,
+                              int width, byte alpha, const byte *gs_restrict mask_ptr,
+                              const byte *gs_restrict mask_tr_fn)
+{
+    int w16 = width & ~15;
+    __m256i v_alpha = _mm256_set1_epi16(alpha);
+    int x, i;
+
+    for (x = 0; x < w16; x += 16) {
+        if (mask_ptr != NULL) {
+            short m[16];
+
+            for (i = 0; i < 16; i++)
+                m[i] = mask_tr_fn[mask_ptr[x + i]];
+            compose_group_normal_16_avx2(tos_ptr + x, tos_planestride, nos_ptr + x, nos_planestride,
+                                         n_chan,
+                                         mul_8_avx2(v_alpha, _mm256_loadu_si256((const __m256i *)m)),
+                                         true);
+        } else
+            compose_group_normal_16_avx2(tos_ptr + x, tos_planestride, nos_ptr + x, nos_planestride,
+                                         n_chan, v_alpha, false);
+    }
+    return w16;
+}
+
+/* As mark_fill_rect_normal_sse2, for the leftmost w & ~15 columns. */
+static GX_BLEND_AVX2_TARGET int
+mark_fill_rect_normal_avx2(int w, int h, byte *gs_restrict dst_ptr, const byte *gs_restrict src,
+                           int num_comp, byte a_s, int rowstride, int planestride,
+                           bool subtractive)
+{
+    int w16 = w & ~15;
+    __m256i v_a_s = _mm256_set1_epi16(a_s);
+    __m256i invert = _mm256_set1_epi16(subtractive ? 0xff : 0);
+    __m256i c_s[PDF14_MAX_PLANES];
+    int i, j, k;
+
+    for (k = 0; k < num_comp; k++)
+        c_s[k] = _mm256_set1_epi16(src[k]);
+    for (j = h; j > 0; --j) {
+        for (i = 0; i < w16; i += 16) {
+            byte *dst = dst_ptr + i;
+            __m256i a_r = union_alpha_8_avx2(load_16_avx2(dst + num_comp * planestride), v_a_s);
+            __m256i src_scale = src_scale_8_avx2(v_a_s, a_r);
+
+            for (k = 0; k < num_comp; k++) {
+                __m256i c_b = _mm256_xor_si256(load_16_avx2(dst + k * planestride), invert);
+
+                store_16_avx2(dst + k * planestride,
+                              _mm256_xor_si256(blend_normal_8_avx2(c_b, c_s[k], src_scale), invert));
+            }
+            store_16_avx2(dst + num_comp * planestride, a_r);
+        }
+        dst_ptr += w + rowstride;
+    }
+    return w16;
+}
+#endif
+
+/* Fill the leftmost w & ~7 columns of an h row rectangle with a Normal
+ * blend mode constant color of num_comp colorants and alpha a_s != 0 (as
+ * mark_fill_rect_add3_common and friends).  If subtractive, the
+ * destination colors are stored complemented.  Return the number of
+ * columns done. */
+static int
+mark_fill_rect_normal_sse2(int w, int h, byte *gs_restrict dst_ptr, const byte *gs_restrict src,
+                           int num_comp, byte a_s, int rowstride, int planestride,
+                           bool subtractive)
+{
+    int w8 = w & ~7;
+    int done = 0;
+    __m128i v_a_s = _mm_set1_epi16(a_s);
+    __m128i invert = _mm_set1_epi16(subtractive ? 0xff : 0);
+    __m128i c_s[PDF14_MAX_PLANES];
+    int i, j, k;
+
+#ifdef GX_BLEND_AVX2
+    if (w >= 16 && gx_blend_have_avx2()) {
+        done = mark_fill_rect_normal_avx2(w, h, dst_ptr, src, num_comp, a_s, rowstride,
+                                          planestride, subtractive);
+        if (done == w8)
+            return w8;
+    }
+#endif
+    for (k = 0; k < num_comp; k++)
+        c_s[k] = _mm_set1_epi16(src[k]);
+    for (j = h; j > 0; --j) {
+        for (i = done; i < w8; i += 8) {
+            byte *dst = dst_ptr + i;
+            __m128i a_r = union_alpha_8_sse2(load_8_sse2(dst + num_comp * planestride), v_a_s);
+            __m128i src_scale = src_scale_8_sse2(v_a_s, a_r);
+
+            for (k = 0; k < num_comp; k++) {
+                __m128i c_b = _mm_xor_si128(load_8_sse2(dst + k * planestride), invert);
+
+                store_8_sse2(dst + k * planestride,
+                             _mm_xor_si128(blend_normal_8_sse2(c_b, c_s[k], src_scale), invert));
+            }
+            store_8_sse2(dst + num_comp * planestride, a_r);
+        }
+        dst_ptr += w + rowstride;
+    }
+    return w8;
+}
+#endif
+
 typedef void (*art_pdf_compose_group_fn)(byte *tos_ptr, bool tos_isolated, int tos_planestride, int tos_rowstride,
                                          byte alpha, byte shape, gs_blend_mode_t blend_mode, bool tos_has_shape,
                                          int tos_shape_offset, int tos_alpha_g_offset, int tos_tag_offset, bool tos_has_tag,
@@ -2961,7 +3419,31 @@ compose_group_nonknockout_nonblend_isolated_allmask_common(byte *tos_ptr, bool t
 
     for (y = y1 - y0; y > 0; --y) {
         byte *gs_restrict mask_curr_ptr = mask_row_ptr;
-        for (x = 0; x < width; x++) {
+        x = 0;
+#ifdef GX_BLEND_AVX2
+        if (width >= 16 && gx_blend_have_avx2()) {
+            x = compose_group_normal_row_avx2(tos_ptr, tos_planestride, nos_ptr, nos_planestride,
+                                              n_chan, width, alpha, mask_curr_ptr, mask_tr_fn);
+            tos_ptr += x;
+            nos_ptr += x;
+            mask_curr_ptr += x;
+        }
+#endif
+#ifdef HAVE_SSE2
+        for (; x + 8 <= width; x += 8) {
+            __m128i mask = _mm_setr_epi16(mask_tr_fn[mask_curr_ptr[0]], mask_tr_fn[mask_curr_ptr[1]],
+                                          mask_tr_fn[mask_curr_ptr[2]], mask_tr_fn[mask_curr_ptr[3]],
+                                          mask_tr_fn[mask_curr_ptr[4]], mask_tr_fn[mask_curr_ptr[5]],
+                                          mask_tr_fn[mask_curr_ptr[6]], mask_tr_fn[mask_curr_ptr[7]]);
+
+            compose_group_normal_8_sse2(tos_ptr, tos_planestride, nos_ptr, nos_planestride, n_chan,
+                                        mul_8_sse2(_mm_set1_epi16(alpha), mask), true);
+            tos_ptr += 8;
+            nos_ptr += 8;
+            mask_curr_ptr += 8;
+        }
+#endif
+        for (; x < width; x++) {
             byte mask = mask_tr_fn[*mask_curr_ptr++];
             byte src_alpha = tos_ptr[n_chan * tos_planestride];
             if (src_alpha != 0) {
@@ -3110,6 +3592,39 @@ compose_group_nonknockout_nonblend_isolated_nomask_common(byte *tos_ptr, bool to
               bool has_matte, int n_chan, bool additive, int num_spots, bool overprint, gx_color_index drawn_comps, int x0, int y0, int x1, int y1,
               const pdf14_nonseparable_blending_procs_t *pblend_procs, pdf14_device *pdev)
 {
+#ifdef HAVE_SSE2
+    int width = x1 - x0;
+    int w8 = width & ~7;
+
+    if (w8 > 0) {
+        __m128i pix_alpha = _mm_set1_epi16(alpha);
+        byte *tos_row = tos_ptr;
+        byte *nos_row = nos_ptr;
+        int x, y;
+
+        for (y = y1 - y0; y > 0; --y) {
+            x = 0;
+#ifdef GX_BLEND_AVX2
+            if (w8 >= 16 && gx_blend_have_avx2())
+                x = compose_group_normal_row_avx2(tos_row, tos_planestride, nos_row, nos_planestride,
+                                                  n_chan, w8, alpha, NULL, NULL);
+#endif
+            for (; x < w8; x += 8)
+                compose_group_normal_8_sse2(tos_row + x, tos_planestride, nos_row + x, nos_planestride,
+                                            n_chan, pix_alpha, false);
+            tos_row += tos_rowstride;
+            nos_row += nos_rowstride;
+        }
+        if (w8 == width)
+            return;
+        /* Leave the remaining columns to the generic code. */
+        tos_ptr += w8;
+        nos_ptr += w8;
+        if (mask_row_ptr != NULL)
+            mask_row_ptr += w8;
+        x0 += w8;
+    }
+#endif
     template_compose_group(tos_ptr, /*tos_isolated*/1, tos_planestride, tos_rowstride, alpha, shape, BLEND_MODE_Normal, /*tos_has_shape*/0,
         tos_shape_offset, tos_alpha_g_offset, tos_tag_offset, /*tos_has_tag*/0,
         nos_ptr, /*nos_isolated*/0, nos_planestride, nos_rowstride, /*nos_alpha_g_ptr*/0, /* nos_knockout = */0,
@@ -3390,6 +3905,309 @@ typedef void (*art_pdf_compose_group16_fn)(uint16_t *tos_ptr, bool tos_isolated,
                                          gx_color_index drawn_comps, int x0, int y0, int x1, int y1,
                                          const pdf14_nonseparable_blending_procs_t *pblend_procs, pdf14_device *pdev);
 
+#ifdef HAVE_SSE2
+/* 16 bit versions of the Normal blend mode compositing, 4 pixels at a
+ * time. As for the 8 bit versions, the results are identical to the
+ * scalar code. */
+
+/* Compute a_s / a_r in 16.16 format. The numerator needs 33 bits, so this
+ * is done in double precision (which is exact here). Lanes with a_r == 0
+ * give 0. */
+static forceinline __m128i
+src_scale_4x16_sse2(__m128i a_s, __m128i a_r)
+{
+    __m128i div = _mm_or_si128(a_r, _mm_and_si128(_mm_cmpeq_epi32(a_r, _mm_setzero_si128()),
+                                                  _mm_set1_epi32(1)));
+    __m128i half = _mm_srli_epi32(a_r, 1);
+    __m128d k = _mm_set1_pd(65536.0);
+    __m128d lo, hi;
+
+    lo = _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(a_s), k), _mm_cvtepi32_pd(half));
+    lo = _mm_div_pd(lo, _mm_cvtepi32_pd(div));
+    hi = _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(a_s, 8)), k),
+                    _mm_cvtepi32_pd(_mm_srli_si128(half, 8)));
+    hi = _mm_div_pd(hi, _mm_cvtepi32_pd(_mm_srli_si128(div, 8)));
+    return _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi));
+}
+
+/* Result alpha is Union of backdrop and source alpha, computed as in
+ * art_pdf_composite_pixel_alpha_16. */
+static forceinline __m128i
+union_alpha_4x16_sse2(__m128i a_b, __m128i a_s)
+{
+    __m128i ffff = _mm_set1_epi32(0xffff);
+    __m128i tmp = _mm_add_epi32(a_b, _mm_srli_epi32(a_b, 15));
+
+    tmp = mullo_32_sse2(_mm_sub_epi32(_mm_set1_epi32(0x10000), tmp), _mm_sub_epi32(ffff, a_s));
+    return _mm_sub_epi32(ffff, _mm_srli_epi32(_mm_add_epi32(tmp, _mm_set1_epi32(0x8000)), 16));
+}
+
+/* c_b + ((src_scale * (c_s - c_b) + 0x8000) >> 16) */
+static forceinline __m128i
+blend_normal_4x16_sse2(__m128i c_b, __m128i c_s, __m128i src_scale)
+{
+    __m128i tmp = mullo_32_sse2(src_scale, _mm_sub_epi32(c_s, c_b));
+
+    return _mm_add_epi32(c_b, _mm_srai_epi32(_mm_add_epi32(tmp, _mm_set1_epi32(0x8000)), 16));
+}
+
+/* Composite 4 pixels of an isolated, Normal blend mode group onto its
+ * backdrop, with the group alpha for each pixel given in pix_alpha.  If
+ * allmask, this does exactly what
+ * compose_group16_nonknockout_nonblend_isolated_allmask_common does,
+ * otherwise what art_pdf_composite_group_16 followed by
+ * art_pdf_composite_pixel_alpha_16 does. */
+static forceinline void
+compose_group16_normal_4_sse2(const uint16_t *gs_restrict tos_ptr, int tos_planestride,
+                              uint16_t *gs_restrict nos_ptr, int nos_planestride,
+                              int n_chan, __m128i pix_alpha, bool allmask)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i ffff = _mm_set1_epi32(0xffff);
+    __m128i src_alpha = load_4x16_sse2(tos_ptr + n_chan * tos_planestride);
+    __m128i a_b = load_4x16_sse2(nos_ptr + n_chan * nos_planestride);
+    __m128i a_s, a_r, src_scale, keep, copy;
+    int i;
+
+    a_s = mullo_32_sse2(src_alpha, _mm_add_epi32(pix_alpha, _mm_srli_epi32(pix_alpha, 15)));
+    a_s = _mm_srli_epi32(_mm_add_epi32(a_s, _mm_set1_epi32(0x8000)), 16);
+    a_s = select_sse2(_mm_cmpeq_epi32(pix_alpha, ffff), src_alpha, a_s);
+    if (allmask) {
+        __m128i tmp = mullo_32_sse2(_mm_sub_epi32(ffff, a_b), _mm_sub_epi32(ffff, a_s));
+
+        tmp = _mm_add_epi32(tmp, _mm_set1_epi32(0x8000));
+        tmp = _mm_add_epi32(tmp, _mm_srli_epi32(tmp, 16));
+        a_r = _mm_sub_epi32(ffff, _mm_srli_epi32(tmp, 16));
+        keep = _mm_cmpeq_epi32(src_alpha, zero);
+    } else {
+        a_r = union_alpha_4x16_sse2(a_b, a_s);
+        keep = _mm_cmpeq_epi32(a_s, zero);
+    }
+    copy = _mm_cmpeq_epi32(a_b, zero);
+    src_scale = src_scale_4x16_sse2(a_s, a_r);
+    for (i = 0; i < n_chan; i++) {
+        uint16_t *nos = nos_ptr + i * nos_planestride;
+        __m128i c_s = load_4x16_sse2(tos_ptr + i * tos_planestride);
+        __m128i c_b = load_4x16_sse2(nos);
+        __m128i c_r = blend_normal_4x16_sse2(c_b, c_s, src_scale);
+
+        c_r = select_sse2(copy, c_s, c_r);
+        store_4x16_sse2(nos, select_sse2(keep, c_b, c_r));
+    }
+    a_r = select_sse2(copy, a_s, a_r);
+    store_4x16_sse2(nos_ptr + n_chan * nos_planestride, select_sse2(keep, a_b, a_r));
+}
+
+#ifdef GX_BLEND_AVX2
+/* AVX2 versions of the 16 bit kernels, 8 pixels at a time. AVX2 has a 32
+ * bit multiply, so these need no mullo_32_sse2 emulation. */
+
+static forceinline GX_BLEND_AVX2_TARGET __m256i
+load_8x16_avx2(const uint16_t *p)
+{
+    return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)p));
+}
+
+/* Store the low 16 bits of 8 32 bit lanes. */
+static forceinline GX_BLEND_AVX2_TARGET void
+store_8x16_avx2(uint16_t *p, __m256i v)
+{
+    v = _mm256_and_si256(v, _mm256_set1_epi32(0xffff));
+    v = _mm256_permute4x64_epi64(_mm256_packus_epi32(v, v), _MM_SHUFFLE(3, 1, 2, 0));
+    _mm_storeu_si128((__m128i *)p, _mm256_castsi256_si128(v));
+}
+
+static forceinline GX_BLEND_AVX2_TARGET __m256i
+src_scale_8x16_avx2(__m256i a_s, __m256i a_r)
+{
+    __m256i div = _mm256_or_si256(a_r, _mm256_and_si256(_mm256_cmpeq_epi32(a_r, _mm256_setzero_si256()),
+                                                        _mm256_set1_epi32(1)));
+    __m256i half = _mm256_srli_epi32(a_r, 1);
+    __m256d k = _mm256_set1_pd(65536.0);
+    __m256d lo, hi;
+
+    lo = _mm256_add_pd(_mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(a_s)), k),
+                       _mm256_cvtepi32_pd(_mm256_castsi256_si128(half)));
+    lo = _mm256_div_pd(lo, _mm256_cvtepi32_pd(_mm256_castsi256_si128(div)));
+    hi = _mm256_add_pd(_mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(a_s, 1)), k),
+                       _mm256_cvtepi32_pd(_mm256_extracti128_si256(half, 1)));
+    hi = _mm256_div_pd(hi, _mm256_cvtepi32_pd(_mm256_extracti128_si256(div, 1)));
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm256_cvttpd_epi32(lo)),
+                                   _mm256_cvttpd_epi32(hi), 1);
+}
+
+static forceinline GX_BLEND_AVX2_TARGET __m256i
+union_alpha_8x16_avx2(__m256i a_b, __m256i a_s)
+{
+    __m256i ffff = _mm256_set1_epi32(0xffff);
+    __m256i tmp = _mm256_add_epi32(a_b, _mm256_srli_epi32(a_b, 15));
+
+    tmp = _mm256_mullo_epi32(_mm256_sub_epi32(_mm256_set1_epi32(0x10000), tmp),
+                             _mm256_sub_epi32(ffff, a_s));
+    return _mm256_sub_epi32(ffff, _mm256_srli_epi32(_mm256_add_epi32(tmp, _mm256_set1_epi32(0x8000)), 16));
+}
+
+static forceinline GX_BLEND_AVX2_TARGET __m256i
+blend_normal_8x16_avx2(__m256i c_b, __m256i c_s, __m256i src_scale)
+{
+    __m256i tmp = _mm256_mullo_epi32(src_scale, _mm256_sub_epi32(c_s, c_b));
+
+    return _mm256_add_epi32(c_b, _mm256_srai_epi32(_mm256_add_epi32(tmp, _mm256_set1_epi32(0x8000)), 16));
+}
+
+/* As compose_group16_normal_4_sse2, for 8 pixels. */
+static forceinline GX_BLEND_AVX2_TARGET void
+compose_group16_normal_8_avx2(const uint16_t *gs_restrict tos_ptr, int tos_planestride,
+                              uint16_t *gs_restrict nos_ptr, int nos_planestride,
+                              int n_chan, __m256i pix_alpha, bool allmask)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i ffff = _mm256_set1_epi32(0xffff);
+    __m256i src_alpha = load_8x16_avx2(tos_ptr + n_chan * tos_planestride);
+    __m256i a_b = load_8x16_avx2(nos_ptr + n_chan * nos_planestride);
+    __m256i a_s, a_r, src_scale, keep, copy;
+    int i;
+
+    a_s = _mm256_mullo_epi32(src_alpha, _mm256_add_epi32(pix_alpha, _mm256_srli_epi32(pix_alpha, 15)));
+    a_s = _mm256_srli_epi32(_mm256_add_epi32(a_s, _mm256_set1_epi32(0x8000)), 16);
+    a_s = select_avx2(_mm256_cmpeq_epi32(pix_alpha, ffff), src_alpha, a_s);
+    if (allmask) {
+        __m256i tmp = _mm256_mullo_epi32(_mm256_sub_epi32(ffff, a_b), _mm256_sub_epi32(ffff, a_s));
+
+        tmp = _mm256_add_epi32(tmp, _mm256_set1_epi32(0x8000));
+        tmp = _mm256_add_epi32(tmp, _mm256_srli_epi32(tmp, 16));
+        a_r = _mm256_sub_epi32(ffff, _mm256_srli_epi32(tmp, 16));
+        keep = _mm256_cmpeq_epi32(src_alpha, zero);
+    } else {
+        a_r = union_alpha_8x16_avx2(a_b, a_s);
+        keep = _mm256_cmpeq_epi32(a_s, zero);
+    }
+    copy = _mm256_cmpeq_epi32(a_b, zero);
+    src_scale = src_scale_8x16_avx2(a_s, a_r);
+    for (i = 0; i < n_chan; i++) {
+        uint16_t *nos = nos_ptr + i * nos_planestride;
+        __m256i c_s = load_8x16_avx2(tos_ptr + i * tos_planestride);
+        __m256i c_b = load_8x16_avx2(nos);
+        __m256i c_r = blend_normal_8x16_avx2(c_b, c_s, src_scale);
+
+        c_r = select_avx2(copy, c_s, c_r);
+        store_8x16_avx2(nos, select_avx2(keep, c_b, c_r));
+    }
+    a_r = select_avx2(copy, a_s, a_r);
+    store_8x16_avx2(nos_ptr + n_chan * nos_planestride, select_avx2(keep, a_b, a_r));
+}
+
+/* As compose_group_normal_row_avx2, for 16 bit buffers, doing the
+ * leftmost width & ~7 pixels. */
+static GX_BLEND_AVX2_TARGET int
+compose_group16_normal_row_avx2(const uint16_t *gs_restrict tos_ptr, int tos_planestride,
+                                uint16_t *gs_restrict nos_ptr, int nos_planestride, int n_chan,
+                                int width, uint16_t alpha, const uint16_t *gs_restrict mask_ptr,
+                                const byte *gs_restrict mask_tr_fn)
+{
+    int w8 = width & ~7;
+    __m256i v_alpha = _mm256_set1_epi32(alpha);
+    int x, i;
+
+    for (x = 0; x < w8; x += 8) {
+        if (mask_ptr != NULL) {
+            int m[8];
+            __m256i mask, pix_alpha;
+
+            for (i = 0; i < 8; i++)
+                m[i] = mask_tr_fn[mask_ptr[x + i]>>8];
+            mask = _mm256_loadu_si256((const __m256i *)m);
+            mask = _mm256_or_si256(mask, _mm256_slli_epi32(mask, 8));
+            mask = _mm256_add_epi32(mask, _mm256_srli_epi32(mask, 15));
+            pix_alpha = _mm256_mullo_epi32(v_alpha, mask);
+            pix_alpha = _mm256_srli_epi32(_mm256_add_epi32(pix_alpha, _mm256_set1_epi32(0x8000)), 16);
+            compose_group16_normal_8_avx2(tos_ptr + x, tos_planestride, nos_ptr + x, nos_planestride,
+                                          n_chan, pix_alpha, true);
+        } else
+            compose_group16_normal_8_avx2(tos_ptr + x, tos_planestride, nos_ptr + x, nos_planestride,
+                                          n_chan, v_alpha, false);
+    }
+    return w8;
+}
+
+/* As mark_fill_rect16_normal_sse2, for the leftmost w & ~7 columns. */
+static GX_BLEND_AVX2_TARGET int
+mark_fill_rect16_normal_avx2(int w, int h, uint16_t *gs_restrict dst_ptr, const uint16_t *gs_restrict src,
+                             int num_comp, uint16_t a_s, int rowstride, int planestride,
+                             bool subtractive)
+{
+    int w8 = w & ~7;
+    __m256i v_a_s = _mm256_set1_epi32(a_s);
+    __m256i invert = _mm256_set1_epi32(subtractive ? 0xffff : 0);
+    __m256i c_s[PDF14_MAX_PLANES];
+    int i, j, k;
+
+    for (k = 0; k < num_comp; k++)
+        c_s[k] = _mm256_set1_epi32(src[k]);
+    for (j = h; j > 0; --j) {
+        for (i = 0; i < w8; i += 8) {
+            uint16_t *dst = dst_ptr + i;
+            __m256i a_r = union_alpha_8x16_avx2(load_8x16_avx2(dst + num_comp * planestride), v_a_s);
+            __m256i src_scale = src_scale_8x16_avx2(v_a_s, a_r);
+
+            for (k = 0; k < num_comp; k++) {
+                __m256i c_b = _mm256_xor_si256(load_8x16_avx2(dst + k * planestride), invert);
+
+                store_8x16_avx2(dst + k * planestride,
+                                _mm256_xor_si256(blend_normal_8x16_avx2(c_b, c_s[k], src_scale), invert));
+            }
+            store_8x16_avx2(dst + num_comp * planestride, a_r);
+        }
+        dst_ptr += w + rowstride;
+    }
+    return w8;
+}
+#endif
+
+/* As mark_fill_rect_normal_sse2, for 16 bit buffers, doing the leftmost
+ * w & ~3 columns. */
+static int
+mark_fill_rect16_normal_sse2(int w, int h, uint16_t *gs_restrict dst_ptr, const uint16_t *gs_restrict src,
+                             int num_comp, uint16_t a_s, int rowstride, int planestride,
+                             bool subtractive)
+{
+    int w4 = w & ~3;
+    int done = 0;
+    __m128i v_a_s = _mm_set1_epi32(a_s);
+    __m128i invert = _mm_set1_epi32(subtractive ? 0xffff : 0);
+    __m128i c_s[PDF14_MAX_PLANES];
+    int i, j, k;
+
+#ifdef GX_BLEND_AVX2
+    if (w >= 8 && gx_blend_have_avx2()) {
+        done = mark_fill_rect16_normal_avx2(w, h, dst_ptr, src, num_comp, a_s, rowstride,
+                                            planestride, subtractive);
+        if (done == w4)
+            return w4;
+    }
+#endif
+    for (k = 0; k < num_comp; k++)
+        c_s[k] = _mm_set1_epi32(src[k]);
+    for (j = h; j > 0; --j) {
+        for (i = done; i < w4; i += 4) {
+            uint16_t *dst = dst_ptr + i;
+            __m128i a_r = union_alpha_4x16_sse2(load_4x16_sse2(dst + num_comp * planestride), v_a_s);
+            __m128i src_scale = src_scale_4x16_sse2(v_a_s, a_r);
+
+            for (k = 0; k < num_comp; k++) {
+                __m128i c_b = _mm_xor_si128(load_4x16_sse2(dst + k * planestride), invert);
+
+                store_4x16_sse2(dst + k * planestride,
+                                _mm_xor_si128(blend_normal_4x16_sse2(c_b, c_s[k], src_scale), invert));
+            }
+            store_4x16_sse2(dst + num_comp * planestride, a_r);
+        }
+        dst_ptr += w + rowstride;
+    }
+    return w4;
+}
+#endif
+
 static forceinline void
 template_compose_group16(uint16_t *gs_restrict tos_ptr, bool tos_isolated,
                          int tos_planestride, int tos_rowstride,
@@ -3699,7 +4517,34 @@ compose_group16_nonknockout_nonblend_isolated_allmask_common(uint16_t *tos_ptr,
 
     for (y = y1 - y0; y > 0; --y) {
         uint16_t *gs_restrict mask_curr_ptr = mask_row_ptr;
-        for (x = 0; x < width; x++) {
+        x = 0;
+#ifdef GX_BLEND_AVX2
+        if (width >= 8 && gx_blend_have_avx2()) {
+            x = compose_group16_normal_row_avx2(tos_ptr, tos_planestride, nos_ptr, nos_planestride,
+                                                n_chan, width, alpha, mask_curr_ptr, mask_tr_fn);
+            tos_ptr += x;
+            nos_ptr += x;
+            mask_curr_ptr += x;
+        }
+#endif
+#ifdef HAVE_SSE2
+        for (; x + 4 <= width; x += 4) {
+            __m128i mask = _mm_setr_epi32(mask_tr_fn[mask_curr_ptr[0]>>8], mask_tr_fn[mask_curr_ptr[1]>>8],
+                                          mask_tr_fn[mask_curr_ptr[2]>>8], mask_tr_fn[mask_curr_ptr[3]>>8]);
+            __m128i pix_alpha;
+
+            mask = _mm_or_si128(mask, _mm_slli_epi32(mask, 8));
+            mask = _mm_add_epi32(mask, _mm_srli_epi32(mask, 15));
+            pix_alpha = mullo_32_sse2(_mm_set1_epi32(alpha), mask);
+            pix_alpha = _mm_srli_epi32(_mm_add_epi32(pix_alpha, _mm_set1_epi32(0x8000)), 16);
+            compose_group16_normal_4_sse2(tos_ptr, tos_planestride, nos_ptr, nos_planestride, n_chan,
+                                          pix_alpha, true);
+            tos_ptr += 4;
+            nos_ptr += 4;
+            mask_curr_ptr += 4;
+        }
+#endif
+        for (; x < width; x++) {
             /* FIXME: Not ideal */
             int mask = mask_tr_fn[(*mask_curr_ptr++)>>8] * 0x101;
             uint16_t src_alpha = tos_ptr[n_chan * tos_planestride];
@@ -3708,11 +4553,11 @@ compose_group16_nonknockout_nonblend_isolated_allmask_common(uint16_t *tos_ptr,
                 int pix_alpha;
 
                 mask += mask>>15;
-                pix_alpha = (alpha * mask + 0x8000)>>16;
+                pix_alpha = (alpha * (unsigned int)mask + 0x8000)>>16;
 
                 if (pix_alpha != 0xffff) {
                     pix_alpha += pix_alpha>>15;
-                    src_alpha = (src_alpha * pix_alpha + 0x8000)>>16;
+                    src_alpha = (src_alpha * (unsigned int)pix_alpha + 0x8000)>>16;
                 }
 
                 a_b = nos_ptr[n_chan * nos_planestride];
@@ -3794,7 +4639,7 @@ compose_group16_nonknockout_nonblend_isolated_mask_common(uint16_t *tos_ptr, boo
                     /* FIXME: Not ideal */
                     int mask = mask_tr_fn[(*mask_curr_ptr++)>>8] * 0x101;
                     mask += mask>>15;
-                    pix_alpha = (pix_alpha * mask + 0x8000)>>16;
+                    pix_alpha = (pix_alpha * (unsigned int)mask + 0x8000)>>16;
                 } else {
                     mask_curr_ptr++;
                 }
@@ -3806,7 +4651,7 @@ compose_group16_nonknockout_nonblend_isolated_mask_common(uint16_t *tos_ptr, boo
 
                 if (pix_alpha != 65535) {
                     pix_alpha += pix_alpha>>15;
-                    src_alpha = (src_alpha * pix_alpha + 0x8000)>>16;
+                    src_alpha = (src_alpha * (unsigned int)pix_alpha + 0x8000)>>16;
                 }
 
                 a_b = nos_ptr[n_chan * nos_planestride];
@@ -3859,6 +4704,39 @@ compose_group16_nonknockout_nonblend_isolated_nomask_common(uint16_t *tos_ptr, b
               bool has_matte, int n_chan, bool additive, int num_spots, bool overprint, gx_color_index drawn_comps, int x0, int y0, int x1, int y1,
               const pdf14_nonseparable_blending_procs_t *pblend_procs, pdf14_device *pdev)
 {
+#ifdef HAVE_SSE2
+    int width = x1 - x0;
+    int w4 = width & ~3;
+
+    if (w4 > 0) {
+        __m128i pix_alpha = _mm_set1_epi32(alpha);
+        uint16_t *tos_row = tos_ptr;
+        uint16_t *nos_row = nos_ptr;
+        int x, y;
+
+        for (y = y1 - y0; y > 0; --y) {
+            x = 0;
+#ifdef GX_BLEND_AVX2
+            if (w4 >= 8 && gx_blend_have_avx2())
+                x = compose_group16_normal_row_avx2(tos_row, tos_planestride, nos_row, nos_planestride,
+                                                    n_chan, w4, alpha, NULL, NULL);
+#endif
+            for (; x < w4; x += 4)
+                compose_group16_normal_4_sse2(tos_row + x, tos_planestride, nos_row + x, nos_planestride,
+                                              n_chan, pix_alpha, false);
+            tos_row += tos_rowstride;
+            nos_row += nos_rowstride;
+        }
+        if (w4 == width)
+            return;
+        /* Leave the remaining columns to the generic code. */
+        tos_ptr += w4;
+        nos_ptr += w4;
+        if (mask_row_ptr != NULL)
+            mask_row_ptr += w4;
+        x0 += w4;
+    }
+#endif
     template_compose_group16(tos_ptr, /*tos_isolated*/1, tos_planestride, tos_rowstride, alpha, shape, BLEND_MODE_Normal, /*tos_has_shape*/0,
         tos_shape_offset, tos_alpha_g_offset, tos_tag_offset, /*tos_has_tag*/0,
         nos_ptr, /*nos_isolated*/0, nos_planestride, nos_rowstride, /*nos_alpha_g_ptr*/0, /* nos_knockout = */0,
@@ -4581,6 +5459,18 @@ mark_fill_rect_sub4_fast(int w, int h, byte *gs_restrict dst_ptr, byte *gs_restr
 {
     int i, j, k;
 
+#ifdef HAVE_SSE2
+    if (w >= 8) {
+        int w8 = mark_fill_rect_normal_sse2(w, h, dst_ptr, src, 4, src[4], rowstride, planestride, 1);
+
+        if (w8 == w)
+            return;
+        /* Do the remaining columns below. */
+        dst_ptr += w8;
+        rowstride += w8;
+        w -= w8;
+    }
+#endif
     for (j = h; j > 0; --j) {
         for (i = w; i > 0; --i) {
             byte a_s = src[4];
@@ -4661,6 +5551,18 @@ mark_fill_rect_add3_common(int w, int h, byte *gs_restrict dst_ptr, byte *gs_res
 {
     int i, j, k;
 
+#ifdef HAVE_SSE2
+    if (w >= 8) {
+        int w8 = mark_fill_rect_normal_sse2(w, h, dst_ptr, src, 3, src[3], rowstride, planestride, 0);
+
+        if (w8 == w)
+            return;
+        /* Do the remaining columns below. */
+        dst_ptr += w8;
+        rowstride += w8;
+        w -= w8;
+    }
+#endif
     for (j = h; j > 0; --j) {
         for (i = w; i > 0; --i) {
             byte a_s = src[3];
@@ -4802,6 +5704,18 @@ mark_fill_rect_add1_no_spots_fast(int w, int h, byte *gs_restrict dst_ptr, byte
 {
     int i;
 
+#ifdef HAVE_SSE2
+    if (w >= 8) {
+        int w8 = mark_fill_rect_normal_sse2(w, h, dst_ptr, src, 1, src[1], rowstride, planestride, 0);
+
+        if (w8 == w)
+            return;
+        /* Do the remaining columns below. */
+        dst_ptr += w8;
+        rowstride += w8;
+        w -= w8;
+    }
+#endif
     for (; h > 0; --h) {
         for (i = w; i > 0; --i) {
             /* background empty, nothing to change, or solid source */
@@ -5146,6 +6060,18 @@ mark_fill_rect16_sub4_fast(int w, int h, uint16_t *gs_restrict dst_ptr, uint16_t
 {
     int i, j, k;
 
+#ifdef HAVE_SSE2
+    if (w >= 4) {
+        int w4 = mark_fill_rect16_normal_sse2(w, h, dst_ptr, src, 4, src[4], rowstride, planestride, 1);
+
+        if (w4 == w)
+            return;
+        /* Do the remaining columns below. */
+        dst_ptr += w4;
+        rowstride += w4;
+        w -= w4;
+    }
+#endif
     for (j = h; j > 0; --j) {
         for (i = w; i > 0; --i) {
             uint16_t a_s = src[4];
@@ -5164,8 +6090,7 @@ mark_fill_rect16_sub4_fast(int w, int h, uint16_t *gs_restrict dst_ptr, uint16_t
                 unsigned int a_r;
                 
                 a_b += a_b>>15;
-                tmp = (0x10000 - a_b) * (0xffff - a_s) + 0x8000;
-                a_r = 0xffff - (tmp >> 16);
+                a_r = 0xffff - (((0x10000u - a_b) * (0xffffu - a_s) + 0x8000) >> 16);
 
                 /* Compute a_s / a_r in 16.16 format */
                 src_scale = ((a_s << 16) + (a_r >> 1)) / a_r;
@@ -5230,6 +6155,18 @@ mark_fill_rect16_add3_common(int w, int h, uint16_t *gs_restrict dst_ptr, uint16
 {
     int i, j, k;
 
+#ifdef HAVE_SSE2
+    if (w >= 4) {
+        int w4 = mark_fill_rect16_normal_sse2(w, h, dst_ptr, src, 3, src[3], rowstride, planestride, 0);
+
+        if (w4 == w)
+            return;
+        /* Do the remaining columns below. */
+        dst_ptr += w4;
+        rowstride += w4;
+        w -= w4;
+    }
+#endif
     for (j = h; j > 0; --j) {
         for (i = w; i > 0; --i) {
             uint16_t a_s = src[3];
@@ -5248,8 +6185,7 @@ mark_fill_rect16_add3_common(int w, int h, uint16_t *gs_restrict dst_ptr, uint16
 
                 a_b += a_b >> 15;
                 /* Result alpha is Union of backdrop and source alpha */
-                tmp = (0x10000 - a_b) * (0xffff - a_s) + 0x8000;
-                a_r = 0xffff - (tmp >> 16);
+                a_r = 0xffff - (((0x10000u - a_b) * (0xffffu - a_s) + 0x8000) >> 16);
                 /* todo: verify that a_r is nonzero in all cases */
 
                 /* Compute a_s / a_r in 16.16 format */
@@ -5345,8 +6281,7 @@ mark_fill_rect16_add1_no_spots_normal(int w, int h, uint16_t *gs_restrict dst_pt
                 unsigned int a_r;
 
                 a_b += a_b>>15;
-                tmp = (0x10000 - a_b) * (0xffff - a_s) + 0x8000;
-                a_r = 0xffff - (tmp >> 16);
+                a_r = 0xffff - (((0x10000u - a_b) * (0xffffu - a_s) + 0x8000) >> 16);
 
                 /* Compute a_s / a_r in 16.16 format */
                 src_scale = ((a_s << 16) + (a_r >> 1)) / a_r;
@@ -5389,6 +6324,18 @@ mark_fill_rect16_add1_no_spots_fast(int w, int h, uint16_t *gs_restrict dst_ptr,
 {
     int i;
 
+#ifdef HAVE_SSE2
+    if (w >= 4) {
+        int w4 = mark_fill_rect16_normal_sse2(w, h, dst_ptr, src, 1, src[1], rowstride, planestride, 0);
+
+        if (w4 == w)
+            return;
+        /* Do the remaining columns below. */
+        dst_ptr += w4;
+        rowstride += w4;
+        w -= w4;
+    }
+#endif
     for (; h > 0; --h) {
         for (i = w; i > 0; --i) {
             /* background empty, nothing to change, or solid source */
@@ -5403,8 +6350,7 @@ mark_fill_rect16_add1_no_spots_fast(int w, int h, uint16_t *gs_restrict dst_ptr,
                 unsigned int a_r;
 
                 a_b += a_b>>15;
-                tmp = (0x10000 - a_b) * (0xffff - a_s) + 0x8000;
-                a_r = 0xffff - (tmp >> 16);
+                a_r = 0xffff - (((0x10000u - a_b) * (0xffffu - a_s) + 0x8000) >> 16);
 
                 /* Compute a_s / a_r in 16.16 format */
                 src_scale = ((a_s << 16) + (a_r >> 1)) / a_r;
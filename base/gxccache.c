@@ -166,6 +166,13 @@ gx_lookup_cached_char(const gs_font * pfont, const cached_fm_pair * pair,
     }
     if_debug3m('K', pfont->memory, "[K]not found: glyph=0x%lx, wmode=%d, depth=%d\n",
               (ulong) glyph, wmode, depth);
+    if (dir->glyph_cache_dir != NULL) {
+        /* Another process may already have rendered it.  The pair is */
+        /* only const here to protect the key.                        */
+        return gx_char_file_lookup(dir, (gs_font *)pfont,
+                                   (cached_fm_pair *)pair, glyph, wmode,
+                                   depth, subpix_origin);
+    }
     return 0;
 }
 
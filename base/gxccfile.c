@@ -0,0 +1,755 @@
+/* Copyright (C) 2001-2019 Artifex Software, Inc.
+   All Rights Reserved.
+
+   This software is provided AS-IS with no warranty, either express or
+   implied.
+
+   This software is distributed under license and may not be copied,
+   modified or distributed except as expressly authorized under the terms
+   of the license contained in the file LICENSE in this distribution.
+
+   Refer to licensing information at http://www.artifex.com or contact
+   Artifex Software, Inc.,  1305 Grant Avenue - Suite 200, Novato,
+   CA 94945, U.S.A., +1(415)492-9861, for further information.
+*/
+
+
+/* Character cache shared between processes through files */
+#include "memory_.h"
+#include "stdint_.h"
+#include "gx.h"
+#include "gp.h"
+#include "gserrors.h"
+#include "gsmd5.h"
+#include "gscdefs.h"		/* for gs_revision */
+#include "gsutil.h"		/* for gs_next_ids */
+#include "gxarith.h"		/* for ilog2 */
+#include "gxfixed.h"
+#include "gxmatrix.h"
+#include "gzstate.h"
+#include "gxdevice.h"
+#include "gxdevmem.h"
+#include "gxchar.h"
+#include "gxfont.h"
+#include "gxfont1.h"
+#include "gxfont42.h"
+#include "gxfcache.h"
+#include "gxfapi.h"
+
+/*
+ * If the GlyphCacheDir user parameter is set, rendered characters are also
+ * appended to files in that directory, one file per font/matrix pair, and
+ * a character missing from the cache is looked for in these files before
+ * it is rendered.  The files are memory mapped, so processes rendering with
+ * the same fonts share both the rendering work and the memory for the bits,
+ * and a new process starts with a warm cache.
+ *
+ * We can't key the files by UniqueID or XUID: most fonts have neither, and
+ * the PDF interpreter makes XUIDs up from the file name and object number.
+ * Instead a pair's file is named after a digest of everything that goes
+ * into rendering its characters apart from the glyphs themselves: the font
+ * type, the font name without any subset prefix, the hinting data and
+ * Subrs (or for TrueType fonts the cvt, fpgm and prep tables), the matrix,
+ * the AlignToPixels and GridFitTT parameters, and the FAPI renderer and
+ * its version (a FreeType update can change the rasters).  Each character record
+ * in the file is keyed by a digest of the glyph name or index, the glyph's
+ * outline data and that of its seac or composite pieces, its widths, and
+ * the writing mode, depth and subpixel origin.  Only Type 1, CFF, TrueType
+ * and CIDFontType 2 fonts with PaintType 0 are shared.
+ *
+ * Records are only ever appended, each with a single write, so processes
+ * can share a file without locking.  The file is opened once, when the
+ * pair first needs it, and kept open for appending until the pair goes.
+ * A writer that dies or runs out of disk space mid-record leaves a torn
+ * record that later ones follow, so when a file is read, a record that
+ * fails its checks is skipped by looking for the next good one.  A torn
+ * record can have any length, so after one the records may start at any
+ * offset, and are copied rather than accessed in place.  We can't truncate
+ * the file instead, since another process may have appended to it since
+ * we looked at its size.
+ *
+ * A file stops growing once it reaches CHAR_FILE_MAX_SIZE: a process that
+ * finds it that big when it opens it, or takes it past that size with a
+ * write, appends nothing more to it.  Characters missing from a full file
+ * are rendered as usual.  Nothing is ever removed from the files, so it is
+ * up to the user to prune the directory (see GlyphCacheDir in Use.htm).
+ */
+
+#define CHAR_FILE_MAGIC 0x52434347	/* "GCCR" */
+#define CHAR_FILE_VERSION 1
+#define CHAR_FILE_MAX_PIECES 16
+#define CHAR_FILE_MAX_TABLE 0x100000	/* max TrueType table to hash */
+#ifndef CHAR_FILE_MAX_SIZE
+#  define CHAR_FILE_MAX_SIZE 0x4000000	/* stop appending at 64Mb */
+#endif
+
+/* A character record.  The bits follow, and the size is rounded up to */
+/* a multiple of 8. */
+typedef struct char_file_record_s {
+    uint32_t magic;
+    uint32_t size;		/* of the whole record */
+    byte key[16];		/* digest of the glyph key */
+    int32_t wx, wy;		/* cc->wxy */
+    int32_t ox, oy;		/* cc->offset */
+    uint32_t raster;
+    uint16_t width, height;
+    uint16_t depth, pad;
+    uint32_t check;		/* checksum of the rest of the record */
+} char_file_record;
+
+/* The index of the records in a file.  offset is the record's offset */
+/* plus 1, 0 for an empty slot, or CHAR_FILE_WRITTEN for a character */
+/* that we appended after reading the file. */
+typedef struct char_file_entry_s {
+    byte key[16];
+    uint32_t offset;
+} char_file_entry;
+#define CHAR_FILE_WRITTEN 0xffffffff
+
+struct gx_char_file_s {
+    gs_memory_t *memory;
+    char *fname;
+    FILE *file;			/* open for appending, 0 if read only */
+    const byte *data;		/* the file as it was when opened */
+    int64_t size;
+    bool mapped;		/* data is mapped rather than read */
+    char_file_entry *table;	/* hash table, 0 if no entries yet */
+    uint table_mask;
+    uint count;			/* # of entries in table */
+    uint hits, misses, writes;
+};
+
+/* ------ Digests ------ */
+
+static void
+md5_int(gs_md5_state_t *md5, int v)
+{
+    gs_md5_append(md5, (const gs_md5_byte_t *)&v, sizeof(v));
+}
+
+static void
+md5_floats(gs_md5_state_t *md5, const float *values, int count, int max)
+{
+    if (count < 0 || count > max)
+        count = max;
+    md5_int(md5, count);
+    gs_md5_append(md5, (const gs_md5_byte_t *)values, count * sizeof(float));
+}
+/* count is the number of values, even in the zone tables. */
+#define md5_table(md5, t)\
+  md5_floats(md5, (t).values, (t).count, countof((t).values))
+
+/* Hash the Private dictionary values and the Subrs of a Type 1 font. */
+static void
+char_file_hash_type1(gs_md5_state_t *md5, gs_font_type1 *pfont)
+{
+    const gs_type1_data *pdata = &pfont->data;
+    gs_glyph_data_t gdata;
+    int global, i, code;
+
+    md5_int(md5, pdata->lenIV);
+    md5_int(md5, pdata->subroutineNumberBias);
+    md5_int(md5, pdata->gsubrNumberBias);
+    /* Only CFF fonts set these. */
+    if (pfont->FontType == ft_encrypted2) {
+        md5_int(md5, pdata->defaultWidthX);
+        md5_int(md5, pdata->nominalWidthX);
+    }
+    md5_int(md5, pdata->BlueFuzz);
+    md5_floats(md5, &pdata->BlueScale, 1, 1);
+    md5_floats(md5, &pdata->BlueShift, 1, 1);
+    md5_table(md5, pdata->BlueValues);
+    md5_floats(md5, &pdata->ExpansionFactor, 1, 1);
+    md5_int(md5, pdata->ForceBold);
+    md5_table(md5, pdata->FamilyBlues);
+    md5_table(md5, pdata->FamilyOtherBlues);
+    md5_int(md5, pdata->LanguageGroup);
+    md5_table(md5, pdata->OtherBlues);
+    md5_int(md5, pdata->RndStemUp);
+    md5_table(md5, pdata->StdHW);
+    md5_table(md5, pdata->StdVW);
+    md5_table(md5, pdata->StemSnapH);
+    md5_table(md5, pdata->StemSnapV);
+    md5_table(md5, pdata->WeightVector);
+    /* As in hash_subrs (gxfcopy.c), rangecheck means the end of the */
+    /* Subrs and typecheck means a null Subr. */
+    gdata.memory = pfont->memory;
+    for (global = 0; global < 2; global++) {
+        for (i = 0; i < 65536; i++) {
+            code = pdata->procs.subr_data(pfont, i, global != 0, &gdata);
+            if (code == gs_error_typecheck)
+                continue;
+            if (code < 0)
+                break;
+            md5_int(md5, i);
+            gs_md5_append(md5, gdata.bits.data, gdata.bits.size);
+            gs_glyph_data_free(&gdata, "char_file_hash_type1");
+        }
+        md5_int(md5, i);
+    }
+}
+
+/* Hash the hinting tables of a TrueType font.  Return false if we can't. */
+static bool
+char_file_hash_type42(gs_md5_state_t *md5, gs_font_type42 *pfont)
+{
+    byte head[12], entry[16];
+    uint num_tables, i;
+    byte *buf;
+    ulong offset, length;
+
+    if (gs_type42_read_data(pfont, 0, 12, head) < 0)
+        return false;
+    if (!memcmp(head, "ttcf", 4))
+        return false;		/* we don't know the subfont here */
+    md5_int(md5, pfont->data.unitsPerEm);
+    num_tables = (head[4] << 8) + head[5];
+    for (i = 0; i < num_tables; i++) {
+        if (gs_type42_read_data(pfont, 12 + i * 16, 16, entry) < 0)
+            return false;
+        if (memcmp(entry, "cvt ", 4) && memcmp(entry, "fpgm", 4) &&
+            memcmp(entry, "prep", 4))
+            continue;
+        offset = ((ulong)entry[8] << 24) + (entry[9] << 16) +
+            (entry[10] << 8) + entry[11];
+        length = ((ulong)entry[12] << 24) + (entry[13] << 16) +
+            (entry[14] << 8) + entry[15];
+        if (length > CHAR_FILE_MAX_TABLE)
+            return false;
+        gs_md5_append(md5, entry, 4);
+        md5_int(md5, (int)length);
+        if (length == 0)
+            continue;
+        buf = gs_alloc_bytes(pfont->memory, length, "char_file_hash_type42");
+        if (buf == NULL)
+            return false;
+        if (gs_type42_read_data(pfont, offset, length, buf) < 0) {
+            gs_free_object(pfont->memory, buf, "char_file_hash_type42");
+            return false;
+        }
+        gs_md5_append(md5, buf, length);
+        gs_free_object(pfont->memory, buf, "char_file_hash_type42");
+    }
+    return true;
+}
+
+/* Compute the digest that names the file for a pair. */
+/* Return false if the pair's characters can't be shared. */
+static bool
+char_file_pair_digest(gs_font_dir *dir, gs_font *font,
+                      const cached_fm_pair *pair, byte digest[16])
+{
+    gs_md5_state_t md5;
+    const byte *name = font->font_name.chars;
+    uint size = min(font->font_name.size, gs_font_name_max);
+    float matrix[4];
+    bool ok;
+
+    if (font->PaintType != 0)
+        return false;
+    switch (font->FontType) {
+        case ft_encrypted:
+        case ft_encrypted2:
+        case ft_TrueType:
+        case ft_CID_TrueType:
+            break;
+        default:
+            return false;
+    }
+    gs_md5_init(&md5);
+    md5_int(&md5, CHAR_FILE_VERSION);
+    md5_int(&md5, (int)gs_revision);
+    md5_int(&md5, font->FontType);
+    if (((gs_font_base *)font)->FAPI != NULL) {
+        gs_fapi_server *I = ((gs_font_base *)font)->FAPI;
+
+        md5_int(&md5, strlen(I->ig.d->subtype));
+        gs_md5_append(&md5, (const gs_md5_byte_t *)I->ig.d->subtype,
+                      strlen(I->ig.d->subtype));
+        md5_int(&md5, I->version);
+    } else
+        md5_int(&md5, 0);
+    md5_int(&md5, dir->align_to_pixels);
+    md5_int(&md5, dir->grid_fit_tt);
+    md5_int(&md5, pair->design_grid);
+    matrix[0] = pair->mxx, matrix[1] = pair->mxy;
+    matrix[2] = pair->myx, matrix[3] = pair->myy;
+    md5_floats(&md5, matrix, 4, 4);
+    /* Skip the prefix of a subset font's name, so that subsets of the */
+    /* same font can share characters. */
+    if (size > 7 && name[6] == '+') {
+        uint i;
+
+        for (i = 0; i < 6 && name[i] >= 'A' && name[i] <= 'Z'; i++)
+            DO_NOTHING;
+        if (i == 6)
+            name += 7, size -= 7;
+    }
+    md5_int(&md5, size);
+    gs_md5_append(&md5, name, size);
+    if (font->FontType == ft_encrypted || font->FontType == ft_encrypted2) {
+        char_file_hash_type1(&md5, (gs_font_type1 *)font);
+        ok = true;
+    } else
+        ok = char_file_hash_type42(&md5, (gs_font_type42 *)font);
+    gs_md5_finish(&md5, digest);
+    return ok;
+}
+
+/* Hash the outline data of a glyph (but not of its pieces). */
+static int
+char_file_hash_outline(gs_md5_state_t *md5, gs_font *font, gs_glyph glyph,
+                       int wmode)
+{
+    gs_glyph_data_t gdata;
+    int code;
+
+    gdata.memory = font->memory;
+    if (font->FontType == ft_encrypted || font->FontType == ft_encrypted2) {
+        gs_font_type1 *const pfont = (gs_font_type1 *)font;
+
+        code = pfont->data.procs.glyph_data(pfont, glyph, &gdata);
+    } else {
+        gs_font_type42 *const pfont = (gs_font_type42 *)font;
+        uint glyph_index;
+
+        if (glyph >= GS_MIN_GLYPH_INDEX)
+            glyph_index = glyph - GS_MIN_GLYPH_INDEX;
+        else {
+            glyph_index = pfont->data.get_glyph_index(pfont, glyph);
+            if (wmode && pfont->data.substitute_glyph_index_vertical)
+                glyph_index = pfont->data.substitute_glyph_index_vertical
+                                (pfont, glyph_index, wmode, glyph);
+        }
+        md5_int(md5, glyph_index);
+        code = pfont->data.get_outline(pfont, glyph_index, &gdata);
+    }
+    if (code < 0)
+        return code;
+    md5_int(md5, gdata.bits.size);
+    gs_md5_append(md5, gdata.bits.data, gdata.bits.size);
+    gs_glyph_data_free(&gdata, "char_file_hash_outline");
+    return 0;
+}
+
+/* Compute the key of a character record. */
+static int
+char_file_char_key(gs_font *font, gs_glyph glyph, int wmode, int depth,
+                   const gs_fixed_point *subpix_origin, byte key[16])
+{
+    gs_md5_state_t md5;
+    gs_glyph_info_t info;
+    gs_glyph pieces[CHAR_FILE_MAX_PIECES];
+    gs_const_string gstr;
+    int members = (GLYPH_INFO_WIDTH0 << wmode) |
+        (wmode ? GLYPH_INFO_VVECTOR1 : 0);
+    int code, i;
+
+    gs_md5_init(&md5);
+    if (glyph < GS_MIN_CID_GLYPH) {
+        /* Name indices differ between processes; the names don't. */
+        code = font->procs.glyph_name(font, glyph, &gstr);
+        if (code < 0)
+            return code;
+        md5_int(&md5, gstr.size);
+        gs_md5_append(&md5, gstr.data, gstr.size);
+    } else
+        gs_md5_append(&md5, (const gs_md5_byte_t *)&glyph, sizeof(glyph));
+    /* The widths catch Metrics and CDevProc overrides. */
+    memset(&info, 0, sizeof(info));
+    code = font->procs.glyph_info(font, glyph, NULL,
+                                  members | GLYPH_INFO_NUM_PIECES, &info);
+    if (code < 0)
+        return code;
+    if ((info.members & members) != members ||
+        info.num_pieces > CHAR_FILE_MAX_PIECES)
+        return_error(gs_error_rangecheck);
+    gs_md5_append(&md5, (const gs_md5_byte_t *)&info.width[wmode],
+                  sizeof(info.width[wmode]));
+    if (wmode)
+        gs_md5_append(&md5, (const gs_md5_byte_t *)&info.v, sizeof(info.v));
+    code = char_file_hash_outline(&md5, font, glyph, wmode);
+    if (code < 0)
+        return code;
+    if (info.num_pieces > 0) {
+        info.pieces = pieces;
+        code = font->procs.glyph_info(font, glyph, NULL,
+                                      GLYPH_INFO_NUM_PIECES |
+                                      GLYPH_INFO_PIECES, &info);
+        if (code < 0)
+            return code;
+        md5_int(&md5, info.num_pieces);
+        for (i = 0; i < info.num_pieces; i++) {
+            code = char_file_hash_outline(&md5, font, pieces[i], 0);
+            if (code < 0)
+                return code;
+        }
+    }
+    md5_int(&md5, wmode);
+    md5_int(&md5, depth);
+    md5_int(&md5, subpix_origin->x);
+    md5_int(&md5, subpix_origin->y);
+    gs_md5_finish(&md5, key);
+    return 0;
+}
+
+/* Checksum a record of the given size, which may not be aligned. */
+static uint32_t
+char_file_checksum(const byte *p, uint size)
+{
+    uint32_t a = 1, b = 0;
+    uint i, n, end;
+
+    /* Adler-32, skipping the check field itself.  Taking the sums */
+    /* modulo 65521 every 5552 bytes is enough to keep b in range. */
+    for (i = 0; i < size;) {
+        if (i == offset_of(char_file_record, check))
+            i += sizeof(uint32_t);
+        end = (i < offset_of(char_file_record, check) ?
+               offset_of(char_file_record, check) : size);
+        n = min(end - i, 5552);
+        for (end = i + n; i < end; i++) {
+            a += p[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+/* ------ The index ------ */
+
+static char_file_entry *
+char_file_find(const gx_char_file *cf, const byte key[16])
+{
+    uint i;
+
+    if (cf->table == NULL)
+        return NULL;
+    i = ((key[0] << 24) + (key[1] << 16) + (key[2] << 8) + key[3]) &
+        cf->table_mask;
+    for (;; i = (i + 1) & cf->table_mask) {
+        char_file_entry *e = &cf->table[i];
+
+        if (e->offset == 0 || !memcmp(e->key, key, 16))
+            return e;
+    }
+}
+
+/* Add an entry, growing the table as needed.  Existing keys are kept. */
+static int
+char_file_insert(gx_char_file *cf, const byte key[16], uint32_t offset)
+{
+    char_file_entry *e;
+
+    if (cf->table == NULL || (cf->count + 1) * 2 > cf->table_mask + 1) {
+        uint size = (cf->table == NULL ? 64 : (cf->table_mask + 1) * 2);
+        char_file_entry *old = cf->table;
+        uint old_size = (old == NULL ? 0 : cf->table_mask + 1);
+        uint i;
+
+        cf->table = (char_file_entry *)
+            gs_alloc_byte_array(cf->memory, size, sizeof(char_file_entry),
+                                "char_file_insert");
+        if (cf->table == NULL) {
+            cf->table = old;
+            return_error(gs_error_VMerror);
+        }
+        memset(cf->table, 0, size * sizeof(char_file_entry));
+        cf->table_mask = size - 1;
+        for (i = 0; i < old_size; i++)
+            if (old[i].offset != 0)
+                *char_file_find(cf, old[i].key) = old[i];
+        gs_free_object(cf->memory, old, "char_file_insert");
+    }
+    e = char_file_find(cf, key);
+    if (e->offset == 0) {
+        memcpy(e->key, key, 16);
+        e->offset = offset;
+        cf->count++;
+    }
+    return 0;
+}
+
+/* ------ Opening and closing ------ */
+
+/* Make the file name for a pair. */
+static int
+char_file_name(const char *dir, const byte digest[16], char *fname)
+{
+    int len = strlen(dir);
+    const char *sep = gp_file_name_separator();
+    int seplen = strlen(sep);
+    int i;
+
+    if (len + seplen + 48 >= gp_file_name_sizeof)
+        return_error(gs_error_limitcheck);
+    if (len >= seplen && !strcmp(dir + len - seplen, sep))
+        sep = "";
+    gs_snprintf(fname, gp_file_name_sizeof, "%s%sgs_glc_", dir, sep);
+    len = strlen(fname);
+    for (i = 0; i < 16; i++)
+        gs_snprintf(fname + len + i * 2, 3, "%02x", digest[i]);
+    strcat(fname, ".dat");
+    return 0;
+}
+
+/* Copy the header of the record at pos and check the record, */
+/* including its checksum. */
+static bool
+char_file_record_ok(const byte *data, int64_t size, int64_t pos,
+                    char_file_record *rec)
+{
+    memcpy(rec, data + pos, sizeof(*rec));
+    return rec->magic == CHAR_FILE_MAGIC &&
+        rec->size >= sizeof(char_file_record) && (rec->size & 7) == 0 &&
+        rec->size <= size - pos &&
+        char_file_checksum(data + pos, rec->size) == rec->check;
+}
+
+/* Open the file, creating it if need be, and read its records into */
+/* the index.  If we can't write to it, read it anyway. */
+static void
+char_file_load(gx_char_file *cf)
+{
+    FILE *f = gp_fopen(cf->fname, "a+b");
+    int64_t size = -1, pos, skipped = 0;
+    byte *buffer = NULL;
+    const byte *data = NULL;
+
+    if (f != NULL) {
+        /* Unbuffered, so that each record goes out in a single write. */
+        /* This must come before any other operation on the stream.    */
+        setvbuf(f, NULL, _IONBF, 0);
+        cf->file = f;
+    } else {
+        f = gp_fopen(cf->fname, "rb");
+        if (f == NULL)
+            return;
+    }
+    if (gp_fseek_64(f, 0, SEEK_END) == 0)
+        size = gp_ftell_64(f);
+    /* Offsets in the index are 32 bits. */
+    if (size > 0 && size < max_int) {
+        data = gp_fmap(f, size);
+        if (data == NULL) {
+            /* No mapping on this platform, read it instead */
+            buffer = gs_alloc_bytes(cf->memory, size, "char_file_load");
+            if (buffer != NULL && gp_fseek_64(f, 0, SEEK_SET) == 0 &&
+                fread(buffer, 1, size, f) == size)
+                data = buffer;
+            else
+                gs_free_object(cf->memory, buffer, "char_file_load");
+        } else
+            cf->mapped = true;
+    }
+    if (cf->file == NULL)
+        fclose(f);
+    else if (size < 0 || size >= CHAR_FILE_MAX_SIZE ||
+             gp_fseek_64(f, 0, SEEK_END) != 0) {
+        /* We have to seek between reading and writing.  A full file */
+        /* (or one we can't size) is only read.                      */
+        fclose(f);
+        cf->file = NULL;
+    }
+    if (data == NULL)
+        return;
+    cf->data = data;
+    cf->size = size;
+    for (pos = 0; pos + (int64_t)sizeof(char_file_record) <= size;) {
+        char_file_record rec;
+
+        if (!char_file_record_ok(data, size, pos, &rec)) {
+            pos++;
+            skipped++;
+            continue;
+        }
+        if (char_file_insert(cf, rec.key, (uint32_t)pos + 1) < 0)
+            break;
+        pos += rec.size;
+    }
+    if_debug4m('K', cf->memory, "[K]read %u chars (%ld bytes, %ld skipped) from %s\n",
+               cf->count, (long)pos, (long)skipped, cf->fname);
+}
+
+/* Find or set up the file for a pair.  Return 0 if there is none. */
+static gx_char_file *
+char_file_open(gs_font_dir *dir, gs_font *font, cached_fm_pair *pair)
+{
+    gs_memory_t *mem = dir->memory->non_gc_memory;
+    char fname[gp_file_name_sizeof];
+    byte digest[16];
+    gx_char_file *cf;
+
+    if (pair->cfile_tried)
+        return pair->cfile;
+    pair->cfile_tried = true;
+    if (!char_file_pair_digest(dir, font, pair, digest) ||
+        char_file_name(dir->glyph_cache_dir, digest, fname) < 0)
+        return 0;
+    cf = (gx_char_file *)gs_alloc_bytes(mem, sizeof(*cf), "char_file_open");
+    if (cf == NULL)
+        return 0;
+    memset(cf, 0, sizeof(*cf));
+    cf->memory = mem;
+    cf->fname = (char *)gs_alloc_bytes(mem, strlen(fname) + 1,
+                                       "char_file_open(fname)");
+    if (cf->fname == NULL) {
+        gs_free_object(mem, cf, "char_file_open");
+        return 0;
+    }
+    strcpy(cf->fname, fname);
+    char_file_load(cf);
+    pair->cfile = cf;
+    return cf;
+}
+
+/* Release the file of a pair, if any. */
+void
+gx_char_file_release(gs_font_dir *dir, cached_fm_pair *pair)
+{
+    gx_char_file *cf = pair->cfile;
+
+    pair->cfile = 0;
+    pair->cfile_tried = false;
+    if (cf == 0)
+        return;
+    if_debug4m('K', cf->memory, "[K]char file %s: %u hits, %u misses, %u writes\n",
+               cf->fname, cf->hits, cf->misses, cf->writes);
+    if (cf->file != NULL)
+        fclose(cf->file);
+    if (cf->mapped)
+        gp_funmap((void *)cf->data, cf->size);
+    else
+        gs_free_object(cf->memory, (byte *)cf->data, "gx_char_file_release");
+    gs_free_object(cf->memory, cf->table, "gx_char_file_release");
+    gs_free_object(cf->memory, cf->fname, "gx_char_file_release");
+    gs_free_object(cf->memory, cf, "gx_char_file_release");
+}
+
+/* Release the files of all the pairs of a font directory. */
+void
+gx_char_file_release_all(gs_font_dir *dir)
+{
+    uint i;
+
+    if (dir->fmcache.mdata == NULL)
+        return;
+    for (i = 0; i < dir->fmcache.mmax; i++)
+        gx_char_file_release(dir, dir->fmcache.mdata + i);
+}
+
+/* ------ Lookup and addition ------ */
+
+/* Look for a character that isn't in the cache in the pair's file. */
+/* If it's there, add it to the cache and return it, otherwise return 0. */
+cached_char *
+gx_char_file_lookup(gs_font_dir *dir, gs_font *font, cached_fm_pair *pair,
+                    gs_glyph glyph, int wmode, int depth,
+                    const gs_fixed_point *subpix_origin)
+{
+    static const gs_log2_scale_point no_scale = {0, 0};
+    gx_char_file *cf = char_file_open(dir, font, pair);
+    char_file_record rec;
+    const char_file_entry *e;
+    cached_char *cc;
+    byte key[16];
+
+    if (cf == 0 || cf->table == NULL)
+        return 0;
+    if (char_file_char_key(font, glyph, wmode, depth, subpix_origin, key) < 0)
+        return 0;
+    e = char_file_find(cf, key);
+    if (e == NULL || e->offset == 0 || e->offset == CHAR_FILE_WRITTEN) {
+        cf->misses++;
+        return 0;
+    }
+    memcpy(&rec, cf->data + e->offset - 1, sizeof(rec));
+    /* Only accept bits laid out the way this build lays them out. */
+    if (rec.depth != depth ||
+        rec.raster != bitmap_raster(rec.width << ilog2(depth)) ||
+        rec.size < sizeof(rec) + (ulong)rec.raster * rec.height)
+        return 0;
+    if (gx_alloc_cached_char(dir, rec.width, rec.height, rec.raster,
+                             depth, &cc) < 0 || cc == 0)
+        return 0;
+    memcpy(cc_bits(cc), cf->data + e->offset - 1 + sizeof(rec),
+           rec.raster * rec.height);
+    cc->code = glyph;
+    cc->wmode = wmode;
+    cc->subpix_origin = *subpix_origin;
+    cc->wxy.x = rec.wx;
+    cc->wxy.y = rec.wy;
+    cc->offset.x = rec.ox;
+    cc->offset.y = rec.oy;
+    cc->id = gs_next_ids(dir->memory, 1);
+    if (gx_add_cached_char(dir, NULL, cc, pair, &no_scale) < 0) {
+        gx_free_cached_char(dir, cc);
+        return 0;
+    }
+    cf->hits++;
+    if_debug3m('K', dir->memory, "[K]read glyph=0x%lx, wmode=%d, depth=%d\n",
+               (ulong)glyph, wmode, depth);
+    return cc;
+}
+
+/* Append a newly rendered character to its pair's file. */
+void
+gx_char_file_add(gs_font_dir *dir, cached_char *cc, cached_fm_pair *pair)
+{
+    gx_char_file *cf;
+    char_file_record *rec;
+    char_file_entry *e;
+    uint bsize = cc_raster(cc) * cc->height;
+    uint size = ROUND_UP(sizeof(*rec) + bsize, 8);
+    byte key[16];
+
+    if (pair->font == 0)
+        return;
+    cf = char_file_open(dir, pair->font, pair);
+    if (cf == 0 || cf->file == NULL || cc->width > max_ushort || cc->height > max_ushort ||
+        cc->wxy.x != (int32_t)cc->wxy.x || cc->wxy.y != (int32_t)cc->wxy.y ||
+        cc->offset.x != (int32_t)cc->offset.x ||
+        cc->offset.y != (int32_t)cc->offset.y)
+        return;
+    if (char_file_char_key(pair->font, cc->code, cc->wmode, cc_depth(cc),
+                           &cc->subpix_origin, key) < 0)
+        return;
+    /* Don't write a character again if it was evicted from the cache. */
+    e = char_file_find(cf, key);
+    if (e != NULL && e->offset != 0)
+        return;
+    if (char_file_insert(cf, key, CHAR_FILE_WRITTEN) < 0)
+        return;
+    rec = (char_file_record *)gs_alloc_bytes(cf->memory, size,
+                                             "gx_char_file_add");
+    if (rec == NULL)
+        return;
+    memset(rec, 0, size);
+    rec->magic = CHAR_FILE_MAGIC;
+    rec->size = size;
+    memcpy(rec->key, key, 16);
+    rec->wx = cc->wxy.x;
+    rec->wy = cc->wxy.y;
+    rec->ox = cc->offset.x;
+    rec->oy = cc->offset.y;
+    rec->raster = cc_raster(cc);
+    rec->width = cc->width;
+    rec->height = cc->height;
+    rec->depth = cc_depth(cc);
+    memcpy(rec + 1, cc_const_bits(cc), bsize);
+    rec->check = char_file_checksum((const byte *)rec, size);
+    /* The file is unbuffered and opened for appending, so the record */
+    /* goes out in one write that concurrent writers don't overlap.  */
+    if (fwrite(rec, 1, size, cf->file) == size)
+        cf->writes++;
+    gs_free_object(cf->memory, rec, "gx_char_file_add");
+    /* The position is the end of the file, including what other */
+    /* processes have appended since we opened it.               */
+    if (gp_ftell_64(cf->file) >= CHAR_FILE_MAX_SIZE) {
+        if_debug1m('K', cf->memory, "[K]char file %s is full\n", cf->fname);
+        fclose(cf->file);
+        cf->file = NULL;
+    }
+}
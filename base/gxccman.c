@@ -349,6 +349,8 @@ gx_add_fm_pair(register gs_font_dir * dir, gs_font * font, const gs_uid * puid,
     pair->xfont = 0;
     pair->ttf = 0;
     pair->ttr = 0;
+    pair->cfile = 0;
+    pair->cfile_tried = false;
     pair->design_grid = false;
     if (does_font_need_tt_interpreter(font)) {
             code = gx_attach_tt_interpreter(dir, (gs_font_type42 *)font, pair,
@@ -446,6 +448,7 @@ gs_purge_fm_pair(gs_font_dir * dir, cached_fm_pair * pair, int xfont_only)
             gs_free_object(dir->memory->stable_memory, pair->UID.xvalues, "gs_purge_fm_pair");
             pair->UID.xvalues = 0;
         }
+        gx_char_file_release(dir, pair);
         fm_pair_set_free(pair);
         code = fm_pair_remove_from_list(dir, pair, &dir->fmcache.used);
         if (code < 0)
@@ -632,6 +635,39 @@ gx_alloc_char_bits(gs_font_dir * dir, gx_device_memory * dev,
     return 0;
 }
 
+/*
+ * Allocate storage for a character whose bits are already known, such as
+ * one read back from the shared character file.  The caller fills in the
+ * bits and the rest of the entry.  Return the cached_char if OK, 0 if it
+ * is too big or there is no room.
+ */
+int
+gx_alloc_cached_char(gs_font_dir * dir, uint width, uint height, uint raster,
+                     int depth, cached_char **pcc)
+{
+    cached_char *cc;
+    int code;
+
+    *pcc = 0;
+    if (raster != 0 && height > dir->ccache.upper / raster)
+        return 0;		/* too big */
+    code = alloc_char(dir, (ulong)raster * height + sizeof_cached_char, &cc);
+    if (code < 0 || cc == 0)
+        return code;
+    cc_set_depth(cc, depth);
+    cc->xglyph = gx_no_xglyph;
+    cc->width = width;
+    cc->height = height;
+    cc->shift = 0;
+    cc_set_raster(cc, raster);
+    cc_set_pair_only(cc, 0);	/* not linked in yet */
+    cc->id = gx_no_bitmap_id;
+    cc->subpix_origin.x = cc->subpix_origin.y = 0;
+    cc->linked = false;
+    *pcc = cc;
+    return 0;
+}
+
 /* Open the cache device. */
 void
 gx_open_cache_device(gx_device_memory * dev, cached_char * cc)
@@ -668,7 +704,7 @@ int
 gx_add_cached_char(gs_font_dir * dir, gx_device_memory * dev,
 cached_char * cc, cached_fm_pair * pair, const gs_log2_scale_point * pscale)
 {
-    if_debug5m('k', dev->memory,
+    if_debug5m('k', dir->memory,
                "[k]chaining char 0x%lx: pair=0x%lx, glyph=0x%lx, wmode=%d, depth=%d\n",
                (ulong) cc, (ulong) pair, (ulong) cc->code,
                cc->wmode, cc_depth(cc));
@@ -708,6 +744,9 @@ cached_char * cc, cached_fm_pair * pair, const gs_log2_scale_point * pscale)
         cc_set_pair(cc, pair);
         pair->num_chars++;
     }
+    /* Share newly rendered characters with other processes. */
+    if (dev != NULL && dir->glyph_cache_dir != NULL && cc_has_bits(cc))
+        gx_char_file_add(dir, cc, pair);
     return 0;
 }
 
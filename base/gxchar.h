@@ -37,6 +37,7 @@ struct gs_show_enum_s {
 int gx_current_char(const gs_text_enum_t * pte);
 
 int  gx_alloc_char_bits(gs_font_dir *, gx_device_memory *, gx_device_memory *, ushort, ushort, const gs_log2_scale_point *, int, cached_char **);
+int  gx_alloc_cached_char(gs_font_dir *, uint, uint, uint, int, cached_char **);
 void gx_open_cache_device(gx_device_memory *, cached_char *);
 void gx_free_cached_char(gs_font_dir *, cached_char *);
 int  gx_add_cached_char(gs_font_dir *, gx_device_memory *, cached_char *, cached_fm_pair *, const gs_log2_scale_point *);
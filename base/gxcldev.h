@@ -684,6 +684,7 @@ int clist_writer_pop_cropping(gx_device_clist_writer *cdev);
 int clist_writer_check_empty_cropping_stack(gx_device_clist_writer *cdev);
 int clist_read_icctable(gx_device_clist_reader *crdev);
 int clist_read_color_usage_array(gx_device_clist_reader *crdev);
+int clist_read_band_cmd_sizes(gx_device_clist_reader *crdev, int64_t *sizes);
 
 /* Special write out for the serialized icc profile table */
 
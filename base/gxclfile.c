@@ -36,6 +36,7 @@
 #define CL_CACHE_SLOT_EMPTY (-1)
 
 static clist_io_procs_t clist_io_procs_file;
+static clist_io_procs_t clist_io_procs_mmap;
 
 typedef struct
 {
@@ -229,6 +230,11 @@ typedef struct
     int64_t pos;
     int64_t filesize;		/* filesize maintained by clist_fwrite */
     CL_CACHE *cache;
+    bool use_map;		/* opened through clist_io_procs_mmap */
+    bool map_failed;		/* don't try mapping again until rewritten */
+    bool map_owned;		/* false if map is borrowed from the writer's IFILE */
+    byte *map;			/* read only mapping of the file, or NULL */
+    int64_t map_size;
 } IFILE;
 
 static void
@@ -262,13 +268,51 @@ static IFILE *wrap_file(gs_memory_t *mem, FILE *f, const char *fmode)
     ifile->pos = 0;
     ifile->filesize = 0;
     ifile->cache = cl_cache_alloc(ifile->mem);
+    ifile->use_map = false;
+    ifile->map_failed = false;
+    ifile->map_owned = false;
+    ifile->map = NULL;
+    ifile->map_size = 0;
     return ifile;
 }
 
+/* Map the file for reading if it isn't already. Returns false if it   */
+/* can't be mapped, in which case the caller must read it normally.    */
+/* We rely on pread/pwrite (gp_can_share_fdesc) so that pos and        */
+/* filesize are maintained by us and the data is never in stdio.       */
+static bool
+map_file(IFILE *ifile)
+{
+    if (ifile->map != NULL)
+        return true;
+    if (ifile->map_failed || ifile->filesize == 0 || !gp_can_share_fdesc())
+        return false;
+    ifile->map = gp_fmap(ifile->f, ifile->filesize);
+    if (ifile->map == NULL) {
+        ifile->map_failed = true;
+        return false;
+    }
+    ifile->map_size = ifile->filesize;
+    ifile->map_owned = true;
+    return true;
+}
+
+static void
+unmap_file(IFILE *ifile)
+{
+    if (ifile->map != NULL && ifile->map_owned)
+        gp_funmap(ifile->map, ifile->map_size);
+    ifile->map = NULL;
+    ifile->map_size = 0;
+    ifile->map_owned = false;
+    ifile->map_failed = false;
+}
+
 static int close_file(IFILE *ifile)
 {
     int res = 0;
     if (ifile) {
+        unmap_file(ifile);
         res = fclose(ifile->f);
         if (ifile->cache != NULL)
             cl_cache_destroy(ifile->cache);
@@ -321,6 +365,36 @@ clist_fopen(char fname[gp_file_name_sizeof], const char *fmode,
     return 0;
 }
 
+/*
+ * The mmap variant reads the file through a read only mapping instead of
+ * pread and the slot cache. A reader opened on the writer's file (that
+ * is, by a rendering thread) shares the writer's mapping, so all of the
+ * threads read from the same pages. The mapping is made here, by the
+ * thread setting up the readers, before any of them can use it.
+ */
+static int
+clist_fopen_mmap(char fname[gp_file_name_sizeof], const char *fmode,
+                 clist_file_ptr * pcf, gs_memory_t * mem, gs_memory_t *data_mem,
+                 bool ok_to_compress)
+{
+    int code = clist_fopen(fname, fmode, pcf, mem, data_mem, ok_to_compress);
+    IFILE *icf, *ocf;
+
+    if (code < 0)
+        return code;
+    icf = (IFILE *)*pcf;
+    icf->use_map = true;
+    if (fmode[0] == 'r') {
+        ocf = (IFILE *)fake_path_to_file(fname);
+        if (ocf != NULL && ocf != icf && ocf->use_map && map_file(ocf)) {
+            icf->map = ocf->map;
+            icf->map_size = ocf->map_size;
+            icf->map_owned = false;
+        }
+    }
+    return 0;
+}
+
 static int
 clist_unlink(const char *fname)
 {
@@ -367,6 +441,7 @@ clist_fwrite_chars(const void *data, uint len, clist_file_ptr cf)
     if (res >= 0)
         icf->pos += len;
     icf->filesize = icf->pos;	/* write truncates file */
+    unmap_file(icf);		/* and any mapping */
     if (!CL_CACHE_NEEDS_INIT(icf->cache)) {
         /* writing invalidates the read cache */
         cl_cache_destroy(icf->cache);
@@ -386,6 +461,17 @@ clist_fread_chars(void *data, uint len, clist_file_ptr cf)
         IFILE *icf = (IFILE *)cf;
         byte *dp = data;
 
+        if (icf->use_map && map_file(icf)) {
+            /* Copy straight from the mapping, no cache needed */
+            if (icf->pos < icf->map_size) {
+                nread = len;
+                if (nread > icf->map_size - icf->pos)
+                    nread = (int)(icf->map_size - icf->pos);
+                memcpy(data, icf->map + icf->pos, nread);
+                icf->pos += nread;
+            }
+            return nread;
+        }
         /* if we have a cache, check if it needs init, and do it */
         if (CL_CACHE_NEEDS_INIT(icf->cache)) {
             icf->cache = cl_cache_read_init(icf->cache, CL_CACHE_NSLOTS, 1<<CL_CACHE_SLOT_SIZE_LOG2, icf->filesize);
@@ -483,6 +569,7 @@ clist_rewind(clist_file_ptr cf, bool discard_data, const char *fname)
             /* fname is an encoded ifile pointer. We can use an entirely
              * new scratch file. */
             char tfname[gp_file_name_sizeof];
+            unmap_file(ocf);
             fclose(ocf->f);
             ocf->f = gp_open_scratch_file_rm(NULL, gp_scratch_file_name_prefix, tfname, fmode);
             /* if there was a cache, get rid of it an get a new (empty) one */
@@ -504,6 +591,7 @@ clist_rewind(clist_file_ptr cf, bool discard_data, const char *fname)
              */
 
             /* Opening with "w" mode deletes the contents when closing. */
+            unmap_file((IFILE *)cf);
             f = freopen(fname, gp_fmode_wb, f);
             ((IFILE *)cf)->f = freopen(fname, fmode, f);
             ((IFILE *)cf)->pos = 0;
@@ -554,13 +642,28 @@ static clist_io_procs_t clist_io_procs_file = {
     clist_fseek,
 };
 
+static clist_io_procs_t clist_io_procs_mmap = {
+    clist_fopen_mmap,
+    clist_fclose,
+    clist_unlink,
+    clist_fwrite_chars,
+    clist_fread_chars,
+    clist_set_memory_warning,
+    clist_ferror_code,
+    clist_ftell,
+    clist_rewind,
+    clist_fseek,
+};
+
 init_proc(gs_gxclfile_init);
 int
 gs_gxclfile_init(gs_memory_t *mem)
 {
 #ifdef PACIFY_VALGRIND
     VALGRIND_HG_DISABLE_CHECKING(&clist_io_procs_file_global, sizeof(clist_io_procs_file_global));
+    VALGRIND_HG_DISABLE_CHECKING(&clist_io_procs_mmap_global, sizeof(clist_io_procs_mmap_global));
 #endif
     clist_io_procs_file_global = &clist_io_procs_file;
+    clist_io_procs_mmap_global = &clist_io_procs_mmap;
     return 0;
 }
@@ -212,18 +212,27 @@ const gx_device_procs gs_clist_device_procs = {
  */
 const clist_io_procs_t *clist_io_procs_file_global = NULL;
 const clist_io_procs_t *clist_io_procs_memory_global = NULL;
+const clist_io_procs_t *clist_io_procs_mmap_global = NULL;
+const clist_io_procs_t *clist_io_procs_memory_lz4_global = NULL;
 
 void
-clist_init_io_procs(gx_device_clist *pclist_dev, bool in_memory)
+clist_init_io_procs(gx_device_clist *pclist_dev, bool in_memory, bool mapped,
+                    bool lz4)
 {
 #ifdef PACIFY_VALGRIND
     VALGRIND_HG_DISABLE_CHECKING(&clist_io_procs_file_global, sizeof(clist_io_procs_file_global));
     VALGRIND_HG_DISABLE_CHECKING(&clist_io_procs_memory_global, sizeof(clist_io_procs_memory_global));
+    VALGRIND_HG_DISABLE_CHECKING(&clist_io_procs_mmap_global, sizeof(clist_io_procs_mmap_global));
+    VALGRIND_HG_DISABLE_CHECKING(&clist_io_procs_memory_lz4_global, sizeof(clist_io_procs_memory_lz4_global));
 #endif
     /* if clist_io_procs_file_global is NULL, then BAND_LIST_STORAGE=memory */
     /* was specified in the build, and "file" is not available */
     if (in_memory || clist_io_procs_file_global == NULL)
-        pclist_dev->common.page_info.io_procs = clist_io_procs_memory_global;
+        pclist_dev->common.page_info.io_procs =
+            (lz4 && clist_io_procs_memory_lz4_global != NULL ?
+             clist_io_procs_memory_lz4_global : clist_io_procs_memory_global);
+    else if (mapped && clist_io_procs_mmap_global != NULL)
+        pclist_dev->common.page_info.io_procs = clist_io_procs_mmap_global;
     else
         pclist_dev->common.page_info.io_procs = clist_io_procs_file_global;
 }
@@ -1368,7 +1377,7 @@ clist_make_accum_device(gx_device *target, const char *dname, void *base, int sp
         cwdev->procs = gs_clist_device_procs;
         gx_device_copy_color_params((gx_device *)cwdev, target);
         rc_assign(cwdev->target, target, "clist_make_accum_device");
-        clist_init_io_procs(cdev, use_memory_clist);
+        clist_init_io_procs(cdev, use_memory_clist, false, false);
         cwdev->data = base;
         cwdev->data_size = space;
         memcpy (&(cwdev->buf_procs), buf_procs, sizeof(gx_device_buf_procs_t));
@@ -378,6 +378,7 @@ struct gx_device_clist_writer_s {
 #define clist_disable_copy_alpha (1 << 6) /* target does not support copy_alpha */
 
 typedef struct clist_render_thread_control_s clist_render_thread_control_t;
+typedef struct clist_render_band_slot_s clist_render_band_slot_t;
 
 /* Define the state of a band list when reading. */
 /* For normal rasterizing, pages and num_pages are both 0. */
@@ -392,9 +393,15 @@ typedef struct gx_device_clist_reader_s {
     int num_render_threads;		/* number of threads being used */
     clist_render_thread_control_t *render_threads;	/* array of threads */
     byte *main_thread_data;		/* saved data pointer of main thread */
-    int curr_render_thread;		/* index into array */
+    int num_band_slots;			/* size of the completion buffer */
+    clist_render_band_slot_t *band_slots;	/* rendered bands waiting to be consumed */
+    struct gx_semaphore_s *sema_band_done; /* signalled by a thread as each band completes */
     int thread_lookahead_direction;	/* +1 or -1 */
     int next_band;			/* may be < 0 or >= num bands when no more remain to render */
+    int num_render_units;		/* bands handed to the threads (more if bands are split) */
+    int *render_unit_y;			/* first line of each unit (+ end), NULL if not split */
+    byte *prerendered_bits;		/* band buffers rendered ahead by a page thread, */
+                                        /* page_line_ptrs_offset bytes per band, or NULL */
 
 } gx_device_clist_reader;
 
@@ -432,7 +439,8 @@ extern_st(st_device_clist);
 /* The device template itself is never used, only the procedures. */
 extern const gx_device_procs gs_clist_device_procs;
 
-void clist_init_io_procs(gx_device_clist *pclist_dev, bool in_memory);
+void clist_init_io_procs(gx_device_clist *pclist_dev, bool in_memory, bool mapped,
+                         bool lz4);
 
 /* Reset (or prepare to append to) the command list after printing a page. */
 int clist_finish_page(gx_device * dev, bool flush);
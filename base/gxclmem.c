@@ -20,6 +20,8 @@
 #include "gserrors.h"
 #include "gxclmem.h"
 #include "gssprintf.h"
+#include "strimpl.h"
+#include "slz4x.h"
 
 #include "valgrind.h"
 
@@ -170,6 +172,41 @@ static int memfile_set_memory_warning(clist_file_ptr cf, int bytes_left);
 static int memfile_fclose(clist_file_ptr cf, const char *fname, bool delete);
 static int memfile_get_pdata(MEMFILE * f);
 
+/*
+ * Files opened through clist_io_procs_memory_lz4 compress with the LZ4 block
+ * filters instead of the BAND_LIST_COMPRESSOR ones chosen at build time.
+ * Reader instances inherit the choice from the file that was written.
+ */
+static const stream_template *
+memfile_compressor_template(const MEMFILE *f)
+{
+    return (f->use_lz4 ? &s_LZ4E_template : clist_compressor_template());
+}
+
+static const stream_template *
+memfile_decompressor_template(const MEMFILE *f)
+{
+    return (f->use_lz4 ? &s_LZ4D_template : clist_decompressor_template());
+}
+
+static void
+memfile_compressor_init(const MEMFILE *f, stream_state *state)
+{
+    if (f->use_lz4)
+        state->templat = &s_LZ4E_template;
+    else
+        clist_compressor_init(state);
+}
+
+static void
+memfile_decompressor_init(const MEMFILE *f, stream_state *state)
+{
+    if (f->use_lz4)
+        state->templat = &s_LZ4D_template;
+    else
+        clist_decompressor_init(state);
+}
+
 /************************************************/
 /*   #define DEBUG      /- force statistics -/  */
 /************************************************/
@@ -236,9 +273,9 @@ allocateWithReserve(
 /* ---------------- Open/close/unlink ---------------- */
 
 static int
-memfile_fopen(char fname[gp_file_name_sizeof], const char *fmode,
-              clist_file_ptr /*MEMFILE * */  * pf,
-              gs_memory_t *mem, gs_memory_t *data_mem, bool ok_to_compress)
+memfile_open(char fname[gp_file_name_sizeof], const char *fmode,
+             clist_file_ptr /*MEMFILE * */  * pf,
+             gs_memory_t *mem, gs_memory_t *data_mem, bool use_lz4)
 {
     MEMFILE *f = NULL;
     int code = 0;
@@ -279,6 +316,7 @@ memfile_fopen(char fname[gp_file_name_sizeof], const char *fmode,
             f->data_memory = data_mem;
             f->compress_state = 0;              /* Not used by reader instance */
             f->decompress_state = 0;    /* make clean for GC, or alloc'n failure */
+            f->compressor_initialized = false;
             f->reservePhysBlockChain = NULL;
             f->reservePhysBlockCount = 0;
             f->reserveLogBlockChain = NULL;
@@ -297,7 +335,7 @@ memfile_fopen(char fname[gp_file_name_sizeof], const char *fmode,
                 LOG_MEMFILE_BLK *log_block, *new_log_block;
                 int i;
                 int num_log_blocks = (f->log_length + MEMFILE_DATA_SIZE - 1) / MEMFILE_DATA_SIZE;
-                const stream_template *decompress_template = clist_decompressor_template();
+                const stream_template *decompress_template = memfile_decompressor_template(f);
 
                 new_log_block = MALLOC(f, num_log_blocks * sizeof(LOG_MEMFILE_BLK), "memfile_fopen" );
                 if (new_log_block == NULL) {
@@ -325,7 +363,7 @@ memfile_fopen(char fname[gp_file_name_sizeof], const char *fmode,
                     code = gs_note_error(gs_error_VMerror);
                     goto finish;
                 }
-                clist_decompressor_init(f->decompress_state);
+                memfile_decompressor_init(f, f->decompress_state);
                 f->decompress_state->memory = mem;
                 if (decompress_template->set_defaults)
                     (*decompress_template->set_defaults) (f->decompress_state);
@@ -348,6 +386,7 @@ memfile_fopen(char fname[gp_file_name_sizeof], const char *fmode,
     }
     f->memory = mem;
     f->data_memory = data_mem;
+    f->use_lz4 = use_lz4;
     /* init an empty file, BEFORE allocating de/compress state */
     f->compress_state = 0;      /* make clean for GC, or alloc'n failure */
     f->decompress_state = 0;
@@ -371,8 +410,8 @@ memfile_fopen(char fname[gp_file_name_sizeof], const char *fmode,
     f->compress_state = 0;      /* make clean for GC */
     f->decompress_state = 0;
     if (f->ok_to_compress) {
-        const stream_template *compress_template = clist_compressor_template();
-        const stream_template *decompress_template = clist_decompressor_template();
+        const stream_template *compress_template = memfile_compressor_template(f);
+        const stream_template *decompress_template = memfile_decompressor_template(f);
 
         f->compress_state =
             gs_alloc_struct(mem, stream_state, compress_template->stype,
@@ -387,8 +426,8 @@ memfile_fopen(char fname[gp_file_name_sizeof], const char *fmode,
             code = gs_note_error(gs_error_VMerror);
             goto finish;
         }
-        clist_compressor_init(f->compress_state);
-        clist_decompressor_init(f->decompress_state);
+        memfile_compressor_init(f, f->compress_state);
+        memfile_decompressor_init(f, f->decompress_state);
         f->compress_state->memory = mem;
         f->decompress_state->memory = mem;
         if (compress_template->set_defaults)
@@ -426,6 +465,22 @@ finish:
     return code;
 }
 
+static int
+memfile_fopen(char fname[gp_file_name_sizeof], const char *fmode,
+              clist_file_ptr /*MEMFILE * */  * pf,
+              gs_memory_t *mem, gs_memory_t *data_mem, bool ok_to_compress)
+{
+    return memfile_open(fname, fmode, pf, mem, data_mem, false);
+}
+
+static int
+memfile_fopen_lz4(char fname[gp_file_name_sizeof], const char *fmode,
+                  clist_file_ptr /*MEMFILE * */  * pf,
+                  gs_memory_t *mem, gs_memory_t *data_mem, bool ok_to_compress)
+{
+    return memfile_open(fname, fmode, pf, mem, data_mem, true);
+}
+
 static int
 memfile_fclose(clist_file_ptr cf, const char *fname, bool delete)
 {
@@ -454,22 +509,19 @@ memfile_fclose(clist_file_ptr cf, const char *fname, bool delete)
             /* If the file is compressed, free the logical blocks, but not */
             /* the phys_blk info (that is still used by the base memfile   */
             if (f->log_head->phys_blk->data_limit != NULL) {
-                LOG_MEMFILE_BLK *tmpbp, *bp = f->log_head;
-
-                while (bp != NULL) {
-                    tmpbp = bp->link;
-                    FREE(f, bp, "memfile_free_mem(log_blk)");
-                    bp = tmpbp;
-                }
+                /* The logical blocks were copied to a single array. */
+                gs_free_object(f->data_memory, f->log_head, "memfile_free_mem(log_blk)");
                 f->log_head = NULL;
 
-                /* Free any internal compressor state. */
-                if (f->compressor_initialized) {
-                    if (f->decompress_state->templat->release != 0)
+                /* Free the decompressor state. Reader instances have no  */
+                /* compressor, the decompressor was initialized when the  */
+                /* raw buffers were allocated.                            */
+                if (f->decompress_state != NULL) {
+                    if (f->raw_head != NULL && f->decompress_state->templat->release != 0)
                         (*f->decompress_state->templat->release) (f->decompress_state);
-                    if (f->compress_state->templat->release != 0)
-                        (*f->compress_state->templat->release) (f->compress_state);
-                    f->compressor_initialized = false;
+                    gs_free_object(f->memory, f->decompress_state,
+                                   "memfile_fclose(decompress_state)");
+                    f->decompress_state = NULL;
                 }
                 /* free the raw buffers                                           */
                 while (f->raw_head != NULL) {
@@ -550,13 +602,14 @@ memfile_set_memory_warning(clist_file_ptr cf, int bytes_left)
      * Determine req'd memory block count from bytes_left.
      * Allocate enough phys & log blocks to hold bytes_left
      * + 1 phys blk for compress_log_blk + 1 phys blk for decompress.
+     * A stored LZ4 block may need a second phys blk in compress_log_blk.
      */
     int logNeeded =
         (bytes_left + MEMFILE_DATA_SIZE - 1) / MEMFILE_DATA_SIZE;
     int physNeeded = logNeeded;
 
     if (bytes_left > 0)
-        ++physNeeded;
+        physNeeded += (f->use_lz4 ? 2 : 1);
     if (f->raw_head == NULL)
         ++physNeeded;   /* have yet to allocate read buffers */
 
@@ -631,9 +684,14 @@ compress_log_blk(MEMFILE * f, LOG_MEMFILE_BLK * bp)
                                                     &(f->rd), &(f->wt), true);
     bp->phys_blk->data_limit = (char *)(f->wt.ptr);
 
-    if (status == 1) {          /* More output space needed (see strimpl.h) */
+    /*
+     * Normally 1 src block is split across at most 2 dest blocks, but a
+     * block that doesn't compress (LZ4 stores it with a small header) can
+     * spill into a third if it starts at the very end of a dest block.
+     */
+    while (status == 1) {          /* More output space needed (see strimpl.h) */
         /* allocate another physical block, then compress remainder       */
-        compressed_size = f->wt.limit - start_ptr;
+        compressed_size += f->wt.limit - start_ptr;
         newphys =
             allocateWithReserve(f, sizeof(*newphys), &code, "memfile newphys",
                         "compress_log_blk : MALLOC for 'newphys' failed\n");
@@ -641,7 +699,7 @@ compress_log_blk(MEMFILE * f, LOG_MEMFILE_BLK * bp)
             return code;
         ecode |= code;  /* accumulate any low-memory warnings */
         newphys->link = NULL;
-        bp->phys_blk->link = newphys;
+        f->phys_curr->link = newphys;
         f->phys_curr = newphys;
         f->wt.ptr = (byte *) (newphys->data) - 1;
         f->wt.limit = f->wt.ptr + MEMFILE_DATA_SIZE;
@@ -650,20 +708,11 @@ compress_log_blk(MEMFILE * f, LOG_MEMFILE_BLK * bp)
         status =
             (*f->compress_state->templat->process)(f->compress_state,
                                                    &(f->rd), &(f->wt), true);
-        if (status != 0) {
-            /*
-             * You'd think the above line is a bug, but in real life 1 src
-             * block never ends up getting split across 3 dest blocks.
-             */
-            /* CHANGE memfile_set_memory_warning if this assumption changes. */
-            emprintf(f->memory,
-                     "Compression required more than one full block!\n");
-            return_error(gs_error_Fatal);
-        }
         newphys->data_limit = (char *)(f->wt.ptr);
     }
     compressed_size += f->wt.ptr - start_ptr;
-    if (compressed_size > MEMFILE_DATA_SIZE) {
+    /* LZ4 stores blocks that don't compress, that is not worth a message. */
+    if (compressed_size > MEMFILE_DATA_SIZE && !f->use_lz4) {
         emprintf2(f->memory,
                   "\nCompression didn't - raw=%d, compressed=%ld\n",
                   MEMFILE_DATA_SIZE,
@@ -843,6 +892,7 @@ memfile_get_pdata(MEMFILE * f)
 {
     int code, i, num_raw_buffers, status;
     LOG_MEMFILE_BLK *bp = f->log_curr_blk;
+    PHYS_MEMFILE_BLK *phys;
 
     if (bp->phys_blk->data_limit == NULL) {
         /* Not compressed, return this data pointer                       */
@@ -941,18 +991,25 @@ memfile_get_pdata(MEMFILE * f)
 #endif
             status = (*f->decompress_state->templat->process)
                 (f->decompress_state, &(f->rd), &(f->wt), true);
-            if (status == 0) {  /* More input data needed */
+            phys = bp->phys_blk;
+            while (status == 0) {  /* More input data needed */
                 /* switch to next block and continue decompress             */
                 int back_up = 0;        /* adjust pointer backwards     */
 
+                phys = phys->link;
+                if (phys == NULL) {
+                    emprintf(f->memory,
+                             "Decompression ran out of compressed data!\n");
+                    return_error(gs_error_Fatal);
+                }
                 if (f->rd.ptr != f->rd.limit) {
                     /* transfer remainder bytes from the previous block      */
                     back_up = f->rd.limit - f->rd.ptr;
                     for (i = 0; i < back_up; i++)
-                        *(bp->phys_blk->link->data - back_up + i) = *++f->rd.ptr;
+                        *(phys->data - back_up + i) = *++f->rd.ptr;
                 }
-                f->rd.ptr = (const byte *)bp->phys_blk->link->data - back_up - 1;
-                f->rd.limit = (const byte *)bp->phys_blk->link->data_limit;
+                f->rd.ptr = (const byte *)phys->data - back_up - 1;
+                f->rd.limit = (const byte *)phys->data_limit;
 #ifdef DEBUG
                 decomp_wt_ptr1 = f->wt.ptr;
                 decomp_wt_limit1 = f->wt.limit;
@@ -961,11 +1018,6 @@ memfile_get_pdata(MEMFILE * f)
 #endif
                 status = (*f->decompress_state->templat->process)
                     (f->decompress_state, &(f->rd), &(f->wt), true);
-                if (status == 0) {
-                    emprintf(f->memory,
-                             "Decompression required more than one full block!\n");
-                    return_error(gs_error_Fatal);
-                }
             }
             bp->raw_block = f->raw_head;        /* point to raw block           */
         }
@@ -1261,13 +1313,28 @@ clist_io_procs_t clist_io_procs_memory = {
     memfile_fseek,
 };
 
+clist_io_procs_t clist_io_procs_memory_lz4 = {
+    memfile_fopen_lz4,
+    memfile_fclose,
+    memfile_unlink,
+    memfile_fwrite_chars,
+    memfile_fread_chars,
+    memfile_set_memory_warning,
+    memfile_ferror_code,
+    memfile_ftell,
+    memfile_rewind,
+    memfile_fseek,
+};
+
 init_proc(gs_gxclmem_init);
 int
 gs_gxclmem_init(gs_memory_t *mem)
 {
 #ifdef PACIFY_VALGRIND
     VALGRIND_HG_DISABLE_CHECKING(&clist_io_procs_memory_global, sizeof(clist_io_procs_memory_global));
+    VALGRIND_HG_DISABLE_CHECKING(&clist_io_procs_memory_lz4_global, sizeof(clist_io_procs_memory_lz4_global));
 #endif
     clist_io_procs_memory_global = &clist_io_procs_memory;
+    clist_io_procs_memory_lz4_global = &clist_io_procs_memory_lz4;
     return 0;
 }
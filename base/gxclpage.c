@@ -15,11 +15,16 @@
 
 
 /* Page object management */
+#include "memory_.h"
+#include "gp.h"
 #include "gdevprn.h"
 #include "gdevdevn.h"
 #include "gxcldev.h"
 #include "gxclpage.h"
+#include "gxsync.h"
+#include "gxclthrd.h"
 #include "gsicc_cache.h"
+#include "gsicc_cms.h"	/* for gscms_is_threadsafe */
 #include "gsparams.h"
 #include "string_.h"
 #include <ctype.h>	/* for isalpha, etc. */
@@ -213,6 +218,7 @@ gx_saved_pages_list_new(gx_device_printer *pdev)
     newlist->mem = non_gc_mem;
     newlist->PageCount = pdev->PageCount;	/* PageCount when list created */
     newlist->collated_copies = 1;
+    newlist->render_memory = SAVED_PAGES_RENDER_MEMORY;
     return newlist;
 }
 
@@ -306,6 +312,8 @@ typedef enum {
     PARAM_EVEN,
     PARAM_EVEN0PAD,
     PARAM_ODD,
+    PARAM_THREADS,
+    PARAM_THREADMEMORY,
     /* any new keywords precede these */
     PARAM_NUMBER,
     PARAM_DASH,
@@ -317,7 +325,8 @@ param_find_key(byte *token, int token_size)
 {
     int i;
     static const char *saved_pages_keys[] = {
-        "begin", "end", "flush", "print", "copies", "normal", "reverse", "even", "even0pad", "odd"
+        "begin", "end", "flush", "print", "copies", "normal", "reverse", "even", "even0pad", "odd",
+        "threads", "threadmemory"
     };
     saved_pages_key_enum found = PARAM_UNKNOWN;
 
@@ -455,6 +464,9 @@ do_page_load(gx_device_printer *pdev, gx_saved_page *page, clist_file_ptr *save_
     crdev->num_pages = 1;		/* single page at a time */
     crdev->offset_map = NULL;
     crdev->render_threads = NULL;
+    crdev->band_slots = NULL;
+    crdev->render_unit_y = NULL;
+    crdev->prerendered_bits = NULL;
     crdev->ymin = crdev->ymax = 0;      /* invalidate buffer contents to force rasterizing */
 
     /* We probably don't need to copy in the filenames, but do it in case something expects it */
@@ -492,12 +504,16 @@ gx_saved_page_load(gx_device_printer *pdev, gx_saved_page *page)
     return code;
 }
 
+/* Output one saved page. If 'bits' is not NULL, it holds the page's bands */
+/* already rendered by a page thread (see gx_print_saved_pages_parallel).    */
 static int
-gx_output_saved_page(gx_device_printer *pdev, gx_saved_page *page)
+gx_output_saved_page(gx_device_printer *pdev, gx_saved_page *page,
+                     byte *bits, size_t bits_size)
 {
     int code, ecode;
     /* Note that banding_type is NOT a device parameter handled in the paramlist */
     gdev_banding_type save_banding_type = pdev->space_params.banding_type;
+    int save_render_threads = pdev->num_render_threads_requested;
     gx_device_clist_reader *crdev = (gx_device_clist_reader *)pdev;
 
     pdev->space_params.banding_type = BandingAlways;
@@ -521,10 +537,18 @@ gx_output_saved_page(gx_device_printer *pdev, gx_saved_page *page)
     /* After setting params, make sure bg_printing is off */
     pdev->bg_print_requested = false;
 
+    /* Bands are copied from the prerendered page, so no band threads. */
+    if (bits != NULL &&
+        bits_size == (size_t)crdev->nbands * crdev->page_line_ptrs_offset) {
+        crdev->prerendered_bits = bits;
+        pdev->num_render_threads_requested = 0;
+    }
+
     /* Note: we never flush pages allowing for re-printing from the list */
     /* data (files) will be deleted when the list is flushed or freed.   */
     code = (*dev_proc(pdev, output_page)) ((gx_device *) pdev,
                (pdev->IgnoreNumCopies || pdev->NumCopies_set <= 0) ? 1 : pdev->NumCopies, false);
+    crdev->prerendered_bits = NULL;
 
     clist_free_icc_table(crdev->icc_table, crdev->memory);
     crdev->icc_table = NULL;
@@ -545,9 +569,266 @@ gx_output_saved_page(gx_device_printer *pdev, gx_saved_page *page)
 
 out:
     pdev->space_params.banding_type = save_banding_type;
+    pdev->num_render_threads_requested = save_render_threads;
+    return code;
+}
+
+/* A saved page rendered ahead of output by a page thread */
+typedef struct saved_page_render_s {
+    gx_saved_page *page;
+    gx_device *dev;		/* reader device for the thread, NULL if none */
+    gp_thread_id thread;
+    byte *bits;			/* the rendered bands, NULL to render on output */
+    size_t bits_size;
+    int code;			/* set by the thread */
+} saved_page_render_t;
+
+/* Render all of the bands of a page into render->bits */
+static void
+saved_page_render_thread(void *data)
+{
+    saved_page_render_t *render = (saved_page_render_t *)data;
+    gx_device *dev = render->dev;
+    gx_device_clist *cldev = (gx_device_clist *)dev;
+    gx_device_clist_common *cdev = (gx_device_clist_common *)dev;
+    gx_device_clist_reader *crdev = &cldev->reader;
+    int band_height = crdev->page_band_height;
+    uint bits_size = crdev->page_line_ptrs_offset;
+    uint raster = gx_device_raster_plane(dev, NULL);
+    byte *mdata = crdev->data + crdev->page_tile_cache_size;
+    byte *mlines = (crdev->page_line_ptrs_offset == 0 ? NULL : mdata + crdev->page_line_ptrs_offset);
+    gx_device *bdev;
+    gs_int_rect band_rect;
+    int y, code = 0;
+
+    for (y = 0; y < dev->height && code >= 0; y += band_height) {
+        int band = y / band_height;
+        int band_num_lines = min(band_height, dev->height - y);
+
+        code = gdev_create_buf_device(cdev->buf_procs.create_buf_device,
+                                      &bdev, cdev->target, y, NULL,
+                                      dev->memory, &(crdev->color_usage_array[band]));
+        if (code < 0)
+            break;
+        code = crdev->buf_procs.setup_buf_device
+            (bdev, mdata, raster, (byte **)mlines, 0, band_num_lines, band_num_lines);
+        band_rect.p.x = 0;
+        band_rect.p.y = y;
+        band_rect.q.x = dev->width;
+        band_rect.q.y = y + band_num_lines;
+        if (code >= 0)
+            code = clist_render_rectangle(cldev, &band_rect, bdev, NULL, true);
+        crdev->ymin = y;
+        crdev->ymax = y + band_num_lines;
+        crdev->offset_map = NULL;
+        cdev->buf_procs.destroy_buf_device(bdev);
+        if (code >= 0)
+            memcpy(render->bits + (size_t)band * bits_size, mdata, bits_size);
+    }
+    render->code = code;
+}
+
+/* Set up a reader device for a saved page and start a thread rendering */
+/* it. On failure the page is left to be rendered when it is output.    */
+/* The thread uses cache if it isn't NULL, otherwise its own.           */
+static int
+saved_page_start_render(gx_device_printer *pdev, gx_saved_page *page,
+                        saved_page_render_t *render, gsicc_link_cache_t *cache)
+{
+    gx_device_clist_reader *crdev = (gx_device_clist_reader *)pdev;
+    gs_memory_t *mem = pdev->memory->non_gc_memory;
+    gdev_banding_type save_banding_type = pdev->space_params.banding_type;
+    gsicc_link_cache_t *save_cache;
+    gx_device_clist_reader *ncrdev;
+    int code;
+
+    render->page = page;
+    render->dev = NULL;
+    render->thread = NULL;
+    render->bits = NULL;
+    render->bits_size = 0;
+    render->code = 0;
+
+    pdev->space_params.banding_type = BandingAlways;
+    code = gx_saved_page_load(pdev, page);
+    /* The thread device reads its own icc_table, see setup_device_and_mem_for_thread */
+    if (code >= 0)
+        code = clist_read_icctable(crdev);
+    if (code >= 0) {
+        /* Don't let the thread device share a link cache with us, */
+        /* only with the other page threads.                       */
+        save_cache = crdev->icc_cache_cl;
+        crdev->icc_cache_cl = cache;
+        render->dev = setup_device_and_mem_for_thread(pdev->memory->thread_safe_memory,
+                                                      (gx_device *)pdev, true, NULL);
+        crdev->icc_cache_cl = save_cache;
+        if (render->dev == NULL)
+            code = gs_note_error(gs_error_VMerror);
+    }
+    clist_free_icc_table(crdev->icc_table, crdev->memory);
+    crdev->icc_table = NULL;
+    /* The thread device has its own handles on the clist files */
+    if (crdev->page_info.cfile != NULL)
+        crdev->page_info.io_procs->fclose(crdev->page_info.cfile, crdev->page_info.cfname, false);
+    if (crdev->page_info.bfile != NULL)
+        crdev->page_info.io_procs->fclose(crdev->page_info.bfile, crdev->page_info.bfname, false);
+    crdev->page_info.cfile = crdev->page_info.bfile = NULL;
+    pdev->space_params.banding_type = save_banding_type;
+    if (code < 0)
+        return code;
+
+    ncrdev = (gx_device_clist_reader *)render->dev;
+    if (ncrdev->icc_cache_cl == NULL &&
+        (ncrdev->icc_cache_cl = gsicc_cache_new(ncrdev->memory)) == NULL)
+        code = gs_note_error(gs_error_VMerror);
+    if (code >= 0) {
+        render->bits_size = (size_t)ncrdev->nbands * ncrdev->page_line_ptrs_offset;
+        render->bits = gs_alloc_bytes(mem, render->bits_size, "saved_page_start_render");
+        if (render->bits == NULL)
+            code = gs_note_error(gs_error_VMerror);
+    }
+    if (code >= 0 &&
+        (code = gp_thread_start(saved_page_render_thread, (void *)render,
+                                &render->thread)) >= 0) {
+        gp_thread_label(render->thread, "Page");
+        return 0;
+    }
+    render->thread = NULL;
+    teardown_device_and_mem_for_thread(render->dev, NULL, true);
+    render->dev = NULL;
+    gs_free_object(mem, render->bits, "saved_page_start_render");
+    render->bits = NULL;
+    return code;
+}
+
+/*
+ * Print saved pages in order, with up to num_threads of the following
+ * pages being rendered at the same time by page threads. Each thread has
+ * its own reader device. If the CMS is thread safe the threads share a
+ * link cache, so that the links are only built once, otherwise each has
+ * its own. The output itself (print_page) is done on this thread, copying
+ * the bands the page thread rendered. Pages waiting to be output hold a
+ * full page raster each, so no more are started than fit in max_memory
+ * (going by the size of the last page started), but there is always at
+ * least one.
+ */
+static int
+gx_print_saved_pages_parallel(gx_device_printer *pdev, gx_saved_page **pages,
+                              int count, int num_threads, size_t max_memory)
+{
+    gs_memory_t *mem = pdev->memory->non_gc_memory;
+    saved_page_render_t *renders, *render;
+    gsicc_link_cache_t *cache = NULL;
+    int started = 0, printed = 0, i;
+    size_t held, page_size = 0;
+    bool use_threads = true;
+    int code = 0;
+
+    if (num_threads > count)
+        num_threads = count;
+    renders = (saved_page_render_t *)gs_alloc_bytes(mem,
+                                num_threads * sizeof(saved_page_render_t),
+                                "gx_print_saved_pages_parallel");
+    if (renders == NULL)
+        return_error(gs_error_VMerror);
+    if (gs_debug[':'] != 0)
+        dmprintf2(pdev->memory, "%% Printing %d saved pages with %d page threads\n",
+                  count, num_threads);
+    /* If this fails, each thread makes its own */
+    if (gscms_is_threadsafe())
+        cache = gsicc_cache_new(pdev->memory->thread_safe_memory);
+
+    while (printed < count) {
+        while (started < count && started - printed < num_threads) {
+            for (i = printed, held = 0; i < started; i++)
+                if (renders[i % num_threads].bits != NULL)
+                    held += renders[i % num_threads].bits_size;
+            if (held > 0 && held + page_size > max_memory) {
+                if (gs_debug[':'] != 0)
+                    dmprintf1(pdev->memory, "%% Page threads limited to %d pages by threadmemory\n",
+                              started - printed);
+                break;
+            }
+            render = &renders[started % num_threads];
+            if (!use_threads ||
+                saved_page_start_render(pdev, pages[started], render, cache) < 0) {
+                /* Don't retry, rendering will be done as pages are output */
+                render->page = pages[started];
+                render->dev = NULL;
+                render->bits = NULL;
+                if (use_threads && gs_debug[':'] != 0)
+                    dmprintf(pdev->memory, "%% Page threads not started, printing sequentially\n");
+                use_threads = false;
+            }
+            if (render->bits != NULL)
+                page_size = render->bits_size;
+            started++;
+        }
+        render = &renders[printed % num_threads];
+        if (render->dev != NULL) {
+            /* Waits for the thread to finish */
+            teardown_device_and_mem_for_thread(render->dev, render->thread, true);
+            render->dev = NULL;
+            if (render->code < 0) {
+                /* Render it again on output so that the error gets reported */
+                gs_free_object(mem, render->bits, "gx_print_saved_pages_parallel");
+                render->bits = NULL;
+            }
+        }
+        code = gx_output_saved_page(pdev, render->page, render->bits, render->bits_size);
+        gs_free_object(mem, render->bits, "gx_print_saved_pages_parallel");
+        render->bits = NULL;
+        printed++;
+        if (code < 0)
+            break;
+    }
+    /* After an error, wait for any threads still rendering */
+    for (; printed < started; printed++) {
+        render = &renders[printed % num_threads];
+        if (render->dev != NULL)
+            teardown_device_and_mem_for_thread(render->dev, render->thread, true);
+        gs_free_object(mem, render->bits, "gx_print_saved_pages_parallel");
+    }
+    gs_free_object(mem, renders, "gx_print_saved_pages_parallel");
+    gsicc_cache_release(cache, "gx_print_saved_pages_parallel");
     return code;
 }
 
+/* Pages selected by a 'print' action, collected when they will be */
+/* printed by gx_print_saved_pages_parallel.                        */
+typedef struct saved_pages_print_queue_s {
+    gs_memory_t *mem;
+    gx_saved_page **pages;
+    int count;
+    int size;
+} saved_pages_print_queue;
+
+/* Print a selected page now, or add it to the queue if there is one */
+static int
+gx_print_saved_page(gx_device_printer *pdev, saved_pages_print_queue *queue,
+                    gx_saved_page *page)
+{
+    if (queue == NULL)
+        return gx_output_saved_page(pdev, page, NULL, 0);
+    if (queue->count == queue->size) {
+        int new_size = queue->size == 0 ? 16 : queue->size * 2;
+        gx_saved_page **new_pages =
+            (gx_saved_page **)gs_alloc_bytes(queue->mem,
+                                             new_size * sizeof(gx_saved_page *),
+                                             "gx_print_saved_page");
+
+        if (new_pages == NULL)
+            return_error(gs_error_VMerror);
+        if (queue->count > 0)
+            memcpy(new_pages, queue->pages, queue->count * sizeof(gx_saved_page *));
+        gs_free_object(queue->mem, queue->pages, "gx_print_saved_page");
+        queue->pages = new_pages;
+        queue->size = new_size;
+    }
+    queue->pages[queue->count++] = page;
+    return 0;
+}
+
 /*
  * Print selected pages from the list to on the selected device. The
  * saved_pages_list is NOT modified, allowing for reprint / recovery
@@ -617,6 +898,14 @@ gx_saved_pages_list_print(gx_device_printer *pdev, gx_saved_pages_list *list,
     bool save_bandfile_open_close = false;      /* arbitrary, silence warning */
     gx_saved_page saved_page;
     clist_file_ptr saved_files[2];
+    saved_pages_print_queue print_queue;
+    saved_pages_print_queue *queue = NULL;	/* NULL prints each page as it is selected */
+
+    print_queue.mem = pdev->memory->non_gc_memory;
+    print_queue.pages = NULL;
+    print_queue.count = print_queue.size = 0;
+    if (list->render_threads > 0)
+        queue = &print_queue;
 
     /* save the current (empty) page while we print  */
     if ((code = do_page_save(pdev, &saved_page, saved_files)) < 0) {
@@ -740,6 +1029,8 @@ gx_saved_pages_list_print(gx_device_printer *pdev, gx_saved_pages_list *list,
               case PARAM_END:
               case PARAM_FLUSH:
               case PARAM_PRINT:
+              case PARAM_THREADS:
+              case PARAM_THREADMEMORY:
                 token_size = 0;			/* non-print range token seen */
             }
             if (end_page > 0) {
@@ -763,7 +1054,7 @@ gx_saved_pages_list_print(gx_device_printer *pdev, gx_saved_pages_list *list,
 
                     /* print the saved page from the current curr_elem */
 
-                    if ((code = gx_output_saved_page(pdev, curr_elem->page)) < 0)
+                    if ((code = gx_print_saved_page(pdev, queue, curr_elem->page)) < 0)
                         goto out;
 
                     curr_page += page_skip;
@@ -793,7 +1084,7 @@ gx_saved_pages_list_print(gx_device_printer *pdev, gx_saved_pages_list *list,
                 if (do_blank_page_pad) {
                     /* print the empty page we had upon entry */
                     /* FIXME: Note that the page size may not match the last odd page */
-                    if ((code = gx_output_saved_page(pdev, &saved_page)) < 0)
+                    if ((code = gx_print_saved_page(pdev, queue, &saved_page)) < 0)
                         goto out;
                 }
 
@@ -811,6 +1102,17 @@ gx_saved_pages_list_print(gx_device_printer *pdev, gx_saved_pages_list *list,
         }
     }
 out:
+    /* Print the queued pages (those selected before any error) */
+    if (queue != NULL && queue->count > 0) {
+        int pcode = gx_print_saved_pages_parallel(pdev, queue->pages, queue->count,
+                                                  list->render_threads,
+                                                  (size_t)list->render_memory << 20);
+
+        if (code >= 0)
+            code = pcode;
+    }
+    gs_free_object(print_queue.mem, print_queue.pages, "gx_saved_pages_list_print");
+
     /* restore the device parameters saved upon entry */
     *printed_count = pdev->PageCount - list->PageCount;
     list->PageCount = pdev->PageCount;		/* retain for subsequent print action */
@@ -838,7 +1140,8 @@ gx_saved_pages_param_process(gx_device_printer *pdev, byte *param, int param_siz
     byte *param_scan = param;
     int param_left = param_size;
     byte *token;
-    int token_size, code, printed_count, collated_copies = 1;
+    int token_size, code, printed_count, collated_copies = 1, render_threads = 0;
+    int render_memory = SAVED_PAGES_RENDER_MEMORY;
     int tmp_num;			/* during token scanning loop */
     int erasepage_needed = 0;
 
@@ -881,6 +1184,8 @@ gx_saved_pages_param_process(gx_device_printer *pdev, byte *param, int param_siz
             if (pdev->saved_pages_list != NULL) {
                 /* Save the collated copy count so the list we return will have it */
                 collated_copies = pdev->saved_pages_list->collated_copies;
+                render_threads = pdev->saved_pages_list->render_threads;
+                render_memory = pdev->saved_pages_list->render_memory;
                 gx_saved_pages_list_free(pdev->saved_pages_list);
             }
             /* Always return with an empty list, even if we weren't saving previously */
@@ -889,6 +1194,48 @@ gx_saved_pages_param_process(gx_device_printer *pdev, byte *param, int param_siz
             pdev->finalize = gdev_prn_finalize;	/* set to make sure the list gets freed */
             /* restore the original count */
             pdev->saved_pages_list->collated_copies = collated_copies;
+            pdev->saved_pages_list->render_threads = render_threads;
+            pdev->saved_pages_list->render_memory = render_memory;
+            break;
+
+          case PARAM_THREADS:			/* threads requires a number next */
+            if (pdev->saved_pages_list == NULL) {
+                return_error(gs_error_rangecheck);	/* threads not allowed before a 'begin' */
+            }
+            /* Move to past 'threads' token */
+            param_left -= token - param_scan + token_size;
+            param_scan = token + token_size;
+
+            if ((token = param_parse_token(param_scan, param_left, &token_size)) == NULL ||
+                 param_find_key(token, token_size) != PARAM_NUMBER) {
+                emprintf(pdev->memory, "gx_saved_pages_param_process: threads not followed by number.\n");
+                return_error(gs_error_typecheck);
+            }
+            if (sscanf((const char *)token, "%d", &tmp_num) != 1 || tmp_num < 0) {
+                emprintf1(pdev->memory, "gx_saved_pages_param_process: Number format error '%s'\n", token);
+                return_error(gs_error_rangecheck);
+            }
+            pdev->saved_pages_list->render_threads = tmp_num;
+            break;
+
+          case PARAM_THREADMEMORY:		/* threadmemory requires a number next */
+            if (pdev->saved_pages_list == NULL) {
+                return_error(gs_error_rangecheck);	/* threadmemory not allowed before a 'begin' */
+            }
+            /* Move to past 'threadmemory' token */
+            param_left -= token - param_scan + token_size;
+            param_scan = token + token_size;
+
+            if ((token = param_parse_token(param_scan, param_left, &token_size)) == NULL ||
+                 param_find_key(token, token_size) != PARAM_NUMBER) {
+                emprintf(pdev->memory, "gx_saved_pages_param_process: threadmemory not followed by number.\n");
+                return_error(gs_error_typecheck);
+            }
+            if (sscanf((const char *)token, "%d", &tmp_num) != 1 || tmp_num < 0) {
+                emprintf1(pdev->memory, "gx_saved_pages_param_process: Number format error '%s'\n", token);
+                return_error(gs_error_rangecheck);
+            }
+            pdev->saved_pages_list->render_memory = tmp_num;
             break;
 
           case PARAM_COPIES:			/* copies requires a number next */
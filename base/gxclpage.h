@@ -22,6 +22,12 @@
 
 #include "gxclist.h"		/* for gx_saved_page struct */
 
+/* Default limit (in Mb) on the rendered pages waiting to be printed when */
+/* the 'threads' keyword is used, see gx_print_saved_pages_parallel.      */
+#ifndef SAVED_PAGES_RENDER_MEMORY
+#  define SAVED_PAGES_RENDER_MEMORY 256
+#endif
+
 typedef struct gx_saved_pages_list_element_s gx_saved_pages_list_element;
 
 struct gx_saved_pages_list_element_s {
@@ -35,6 +41,8 @@ typedef struct gx_saved_pages_list_s {
     int PageCount;		        /* Page Count to start with on next 'print' action */
     int count;				/* number of pages in the list */
     int collated_copies;		/* how many copies of the job to print */
+    int render_threads;			/* pages 'print' rasterizes at once, 0 = one at a time */
+    int render_memory;			/* Mb of rendered pages 'print' may hold */
     int save_banding_type;		/* to restore when we "end" */
     gx_saved_pages_list_element *head;
     gx_saved_pages_list_element *tail;
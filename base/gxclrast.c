@@ -55,6 +55,7 @@
 #include "gxshade.h"
 #include "gxshade4.h"
 #include "gsicc_manage.h"
+#include "gsicc_cache.h"
 #include "gsicc.h"
 
 extern_gx_device_halftone_list();
@@ -612,12 +613,10 @@ in:                             /* Initialize for a new page. */
     code = gs_gstate_initialize(&gs_gstate, mem);
     /* Remove the ICC link cache and replace with the device link cache
        so that we share the cache across bands */
-    rc_decrement(gs_gstate.icc_link_cache,"clist_playback_band");
+    gsicc_cache_release(gs_gstate.icc_link_cache, "clist_playback_band");
     gs_gstate.icc_link_cache = cdev->icc_cache_cl;
-    /* Need to lock during the increment of the link cache */
-    gx_monitor_enter(cdev->icc_cache_cl->lock);
-    rc_increment(cdev->icc_cache_cl);
-    gx_monitor_leave(cdev->icc_cache_cl->lock); /* let everyone run */
+    /* The cache may be shared with other threads */
+    gsicc_cache_addref(cdev->icc_cache_cl);
     if (code < 0)
         goto out;
 
@@ -469,6 +469,42 @@ clist_read_color_usage_array(gx_device_clist_reader *crdev)
     return code;
 }
 
+/* Total up the number of command bytes that will be read for each band.  */
+/* Commands written for a band range count against every band in it.     */
+/* This gives a cheap estimate of the rendering cost of each band.       */
+int
+clist_read_band_cmd_sizes(gx_device_clist_reader *crdev, int64_t *sizes)
+{
+    gx_band_page_info_t *page_info = &(crdev->page_info);
+    clist_file_ptr bfile = page_info->bfile;
+    int64_t save_pos;
+    cmd_block cb, next;
+    int band;
+
+    memset(sizes, 0, crdev->nbands * sizeof(int64_t));
+    if (bfile == NULL)
+        return_error(gs_error_ioerror);
+    save_pos = page_info->io_procs->ftell(bfile);
+    page_info->io_procs->rewind(bfile, false, page_info->bfname);
+    if (page_info->io_procs->fread_chars(&cb, sizeof(cb), bfile) < sizeof(cb)) {
+        page_info->io_procs->fseek(bfile, save_pos, SEEK_SET, page_info->bfname);
+        return_error(gs_error_ioerror);
+    }
+    while (page_info->io_procs->ftell(bfile) < page_info->bfile_end_pos &&
+           page_info->io_procs->fread_chars(&next, sizeof(next), bfile) == sizeof(next)) {
+        /* Skip the end of page blocks and the pseudo bands */
+        if (cb.band_min >= 0 && cb.band_min < crdev->nbands) {
+            int band_max = min(cb.band_max, crdev->nbands - 1);
+
+            for (band = cb.band_min; band <= band_max; band++)
+                sizes[band] += next.pos - cb.pos;
+        }
+        cb = next;
+    }
+    page_info->io_procs->fseek(bfile, save_pos, SEEK_SET, page_info->bfname);
+    return 0;
+}
+
 /* Unserialize the icc table information stored in the cfile and
    place it in the reader device */
 static int
@@ -566,6 +602,9 @@ clist_render_init(gx_device_clist *dev)
     crdev->icc_table = NULL;
     crdev->color_usage_array = NULL;
     crdev->render_threads = NULL;
+    crdev->band_slots = NULL;
+    crdev->render_unit_y = NULL;
+    crdev->prerendered_bits = NULL;
 
     return 0;
 }
@@ -740,9 +779,16 @@ clist_rasterize_lines(gx_device *dev, int y, int line_count,
         band_rect.p.y = band_begin_line;
         band_rect.q.x = dev->width;
         band_rect.q.y = band_end_line;
-        if (code >= 0)
-            code = clist_render_rectangle(cldev, &band_rect, bdev, render_plane,
-                                          true);
+        if (code >= 0) {
+            /* A page thread may already have rendered the whole page. */
+            if (crdev->prerendered_bits != NULL && plane_index < 0)
+                memcpy(mdata, crdev->prerendered_bits +
+                              (size_t)band * crdev->page_line_ptrs_offset,
+                       crdev->page_line_ptrs_offset);
+            else
+                code = clist_render_rectangle(cldev, &band_rect, bdev, render_plane,
+                                              true);
+        }
         /* Reset the band boundaries now, so that we don't get */
         /* an infinite loop. */
         crdev->ymin = band_begin_line;
@@ -27,6 +27,7 @@
 #include "gdevprn.h"            /* must precede gxcldev.h */
 #include "gxcldev.h"
 #include "gxgetbit.h"
+#include "gzcpath.h"
 #include "gdevplnx.h"
 #include "gdevppla.h"
 #include "gsmemory.h"
@@ -38,9 +39,20 @@
 #include "gstrans.h"
 #include "gzht.h"		/* for gx_ht_cache_default_bits_size */
 
+/* The completion buffer holds this many bands per rendering thread. This */
+/* bounds how far ahead of the consumer the threads may run, so that one   */
+/* slow band doesn't leave the other threads idle.                          */
+#define CLIST_BAND_SLOTS_PER_THREAD 2
+
+/* When BandSplitLimit is set, bands are split according to their cost,    */
+/* estimated from the size of their command lists. Pieces are never made  */
+/* smaller than CLIST_MIN_SPLIT_LINES.                                      */
+#define CLIST_MIN_SPLIT_LINES 16
+
 /* Forward reference prototypes */
 static int clist_start_render_thread(gx_device *dev, int thread_index, int band);
 static void clist_render_thread(void *param);
+static int clist_dispatch_render_threads(gx_device *dev);
 
 /* clone a device and set params and its chunk memory                   */
 /* The chunk_base_mem MUST be thread safe                               */
@@ -222,7 +234,7 @@ setup_device_and_mem_for_thread(gs_memory_t *chunk_base_mem, gx_device *dev, boo
     if (gscms_is_threadsafe()) {
     /* safe to share the link cache */
         ncdev->icc_cache_cl = cdev->icc_cache_cl;
-        rc_increment(cdev->icc_cache_cl);		/* FIXME: needs to be incdemented safely */
+        gsicc_cache_addref(cdev->icc_cache_cl);
     } else {
         /* each thread needs its own link cache */
         if (cachep != NULL) {
@@ -281,6 +293,187 @@ out_cleanup:
     return NULL;
 }
 
+/* The lines covered by a render unit: a band, or part of one if split */
+static int
+clist_unit_begin_line(const gx_device_clist_reader *crdev, int unit)
+{
+    if (crdev->render_unit_y != NULL)
+        return crdev->render_unit_y[unit];
+    return unit * crdev->page_info.band_params.BandHeight;
+}
+
+static int
+clist_unit_end_line(const gx_device_clist_reader *crdev, int unit)
+{
+    int end_line;
+
+    if (crdev->render_unit_y != NULL)
+        return crdev->render_unit_y[unit + 1];
+    end_line = (unit + 1) * crdev->page_info.band_params.BandHeight;
+    return min(end_line, crdev->height);
+}
+
+/* Find the render unit that contains line y */
+static int
+clist_unit_of_line(const gx_device_clist_reader *crdev, int y)
+{
+    int lo = 0, hi = crdev->num_render_units - 1;
+
+    if (crdev->render_unit_y == NULL)
+        return y / crdev->page_info.band_params.BandHeight;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) >> 1;
+
+        if (crdev->render_unit_y[mid] <= y)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+/*
+ * Decide how the bands are handed out to the threads. Normally each band
+ * is one unit, but with BandSplitLimit > 1 a band that is N times more
+ * costly than the average band is split into N units (within the limit),
+ * each rendered by playing back the whole band clipped to its lines (see
+ * clist_render_band_piece). This spreads a dense band across threads that
+ * would otherwise be idle, but it is not free: every piece reads and
+ * rebuilds all of the band's commands, and only the drawing is limited to
+ * its lines, so the total CPU time goes up. The pixels along the piece
+ * boundaries may also differ slightly, as they do with another BandHeight.
+ * That is why splitting is off unless BandSplitLimit asks for it.
+ */
+static int
+clist_split_render_units(gx_device *dev)
+{
+    gx_device_printer *pdev = (gx_device_printer *)dev;
+    gx_device_clist_reader *crdev = &((gx_device_clist *)dev)->reader;
+    gs_memory_t *mem = crdev->bandlist_memory;
+    int band_height = crdev->page_info.band_params.BandHeight;
+    int nbands = crdev->nbands;
+    int64_t *cost;
+    int64_t total = 0, mean;
+    int band, piece, num_units, unit;
+    int code;
+
+    crdev->num_render_units = nbands;
+    crdev->render_unit_y = NULL;
+    /* Pieces are moved within the band buffer after they are rendered, */
+    /* which needs the standard buffer layout.                         */
+    if (pdev->band_split_limit < 2 || nbands < 2 ||
+        crdev->buf_procs.setup_buf_device != gx_default_setup_buf_device)
+        return 0;
+
+    cost = (int64_t *)gs_alloc_byte_array(mem, nbands, sizeof(int64_t),
+                                          "clist_split_render_units");
+    if (cost == NULL)
+        return_error(gs_error_VMerror);
+    code = clist_read_band_cmd_sizes(crdev, cost);
+    if (code < 0)
+        goto out;
+    for (band = 0; band < nbands; band++)
+        total += cost[band];
+    mean = total / nbands;
+
+    /* Replace each cost with the number of pieces for the band */
+    num_units = 0;
+    for (band = 0; band < nbands; band++) {
+        int lines = min(band_height, crdev->height - band * band_height);
+        int64_t pieces = (mean > 0 ? cost[band] / mean : 1);
+
+        if (pieces > pdev->band_split_limit)
+            pieces = pdev->band_split_limit;
+        if (pieces > lines / CLIST_MIN_SPLIT_LINES)
+            pieces = lines / CLIST_MIN_SPLIT_LINES;
+        /* The pdf14 compositor draws to the band buffer directly, so each */
+        /* piece of a transparent band would render all of it: don't.      */
+        if (crdev->color_usage_array != NULL &&
+            crdev->color_usage_array[band].trans_bbox.p.y <=
+            crdev->color_usage_array[band].trans_bbox.q.y)
+            pieces = 1;
+        if (pieces < 1)
+            pieces = 1;
+        cost[band] = pieces;
+        num_units += (int)pieces;
+    }
+    if (num_units == nbands)
+        goto out;               /* nothing worth splitting */
+
+    crdev->render_unit_y = (int *)gs_alloc_byte_array(mem, num_units + 1, sizeof(int),
+                                                      "clist_split_render_units");
+    if (crdev->render_unit_y == NULL) {
+        code = gs_note_error(gs_error_VMerror);
+        goto out;
+    }
+    for (band = 0, unit = 0; band < nbands; band++) {
+        int lines = min(band_height, crdev->height - band * band_height);
+
+        for (piece = 0; piece < cost[band]; piece++)
+            crdev->render_unit_y[unit++] = band * band_height +
+                                           (int)(piece * lines / cost[band]);
+    }
+    crdev->render_unit_y[num_units] = crdev->height;
+    crdev->num_render_units = num_units;
+
+    if (gs_debug[':'] != 0)
+        dmprintf2(mem, "%% Bands split by cost: %d bands rendered as %d units\n",
+                  nbands, num_units);
+out:
+    gs_free_object(mem, cost, "clist_split_render_units");
+    return code;
+}
+
+/* Allocate the completion buffer slots that belong to a thread. The data  */
+/* areas are the same size as the thread's own, since they are swapped.    */
+static int
+clist_alloc_band_slots(gx_device *dev, int thread_index, gx_process_page_options_t *options)
+{
+    gx_device_clist_reader *crdev = &((gx_device_clist *)dev)->reader;
+    gs_memory_t *mem = crdev->bandlist_memory->thread_safe_memory;
+    gx_device_clist_common *thread_cdev =
+                (gx_device_clist_common *)crdev->render_threads[thread_index].cdev;
+    int i, code;
+
+    for (i = 0; i < CLIST_BAND_SLOTS_PER_THREAD; i++) {
+        clist_render_band_slot_t *slot =
+                &(crdev->band_slots[thread_index * CLIST_BAND_SLOTS_PER_THREAD + i]);
+
+        slot->band = -1;
+        slot->alloc = slot->data = gs_alloc_bytes(mem, thread_cdev->data_size,
+                                                  "clist_alloc_band_slots");
+        if (slot->alloc == NULL)
+            return_error(gs_error_VMerror);
+        if (options && options->init_buffer_fn) {
+            code = options->init_buffer_fn(options->arg, dev, mem, dev->width,
+                                           crdev->page_info.band_params.BandHeight,
+                                           &slot->buffer);
+            if (code < 0)
+                return code;
+        }
+    }
+    return 0;
+}
+
+static void
+clist_free_band_slots(gx_device *dev, int first, int count, gx_process_page_options_t *options)
+{
+    gx_device_clist_reader *crdev = &((gx_device_clist *)dev)->reader;
+    gs_memory_t *mem = crdev->bandlist_memory->thread_safe_memory;
+    int i;
+
+    for (i = first; i < first + count; i++) {
+        clist_render_band_slot_t *slot = &(crdev->band_slots[i]);
+
+        if (slot->buffer != NULL && options && options->free_buffer_fn)
+            options->free_buffer_fn(options->arg, dev, mem, slot->buffer);
+        slot->buffer = NULL;
+        gs_free_object(mem, slot->alloc, "clist_free_band_slots");
+        slot->alloc = slot->data = NULL;
+        slot->band = -1;
+    }
+}
+
 /* Set up and start the render threads */
 static int
 clist_setup_render_threads(gx_device *dev, int y, gx_process_page_options_t *options)
@@ -292,7 +485,7 @@ clist_setup_render_threads(gx_device *dev, int y, gx_process_page_options_t *opt
     gs_memory_t *mem = cdev->bandlist_memory;
     gs_memory_t *chunk_base_mem = mem->thread_safe_memory;
     gs_memory_status_t mem_status;
-    int i, j, band;
+    int i, j, band, first_band;
     int code = 0;
     int band_count = cdev->nbands;
     int band_height = crdev->page_info.band_params.BandHeight;
@@ -353,12 +546,10 @@ clist_setup_render_threads(gx_device *dev, int y, gx_process_page_options_t *opt
     memset(reserve_memory_array, 0, crdev->num_render_threads * sizeof(void *));
     memset(crdev->render_threads, 0, crdev->num_render_threads *
             sizeof(clist_render_thread_control_t));
-
     crdev->main_thread_data = cdev->data;               /* save data area */
     /* Based on the line number requested, decide the order of band rendering */
     /* Almost all devices go in increasing line order (except the bmp* devices ) */
     crdev->thread_lookahead_direction = (y < (cdev->height - 1)) ? 1 : -1;
-    band = y / band_height;
 
     /* If the 'mem' is not thread safe, we need to wrap it in a locking memory */
     gs_memory_status(chunk_base_mem, &mem_status);
@@ -384,6 +575,37 @@ clist_setup_render_threads(gx_device *dev, int y, gx_process_page_options_t *opt
         gs_free_object(mem, old, "clist_render_setup_threads");
     }
 
+    /* Bands are only split when the caller is reading lines with get_bits; */
+    /* process_page clients expect to be handed whole bands.                */
+    crdev->num_render_units = band_count;
+    crdev->render_unit_y = NULL;
+    if (options == NULL && clist_split_render_units(dev) < 0)
+        crdev->num_render_units = band_count;   /* just render whole bands */
+    band_count = crdev->num_render_units;
+    first_band = band = clist_unit_of_line(crdev, y);
+
+    /* The completion buffer, and the semaphore the threads signal when done */
+    crdev->band_slots = (clist_render_band_slot_t *)
+              gs_alloc_byte_array(mem, crdev->num_render_threads * CLIST_BAND_SLOTS_PER_THREAD,
+                                  sizeof(clist_render_band_slot_t),
+                                  "clist_setup_render_threads");
+    crdev->sema_band_done = gx_semaphore_label(gx_semaphore_alloc(chunk_base_mem), "BandDone");
+    if (crdev->band_slots == NULL || crdev->sema_band_done == NULL) {
+        gx_semaphore_free(crdev->sema_band_done);
+        crdev->sema_band_done = NULL;
+        gs_free_object(mem, crdev->band_slots, "clist_setup_render_threads");
+        crdev->band_slots = NULL;
+        gs_free_object(mem, crdev->render_unit_y, "clist_setup_render_threads");
+        crdev->render_unit_y = NULL;
+        gs_free_object(mem, reserve_memory_array, "clist_setup_render_threads");
+        gs_free_object(mem, crdev->render_threads, "clist_setup_render_threads");
+        crdev->render_threads = NULL;
+        emprintf(mem, " VMerror prevented threads from starting.\n");
+        return_error(gs_error_VMerror);
+    }
+    memset(crdev->band_slots, 0, crdev->num_render_threads * CLIST_BAND_SLOTS_PER_THREAD *
+            sizeof(clist_render_band_slot_t));
+
     /* Loop creating the devices and semaphores for each thread, then start them */
     for (i=0; (i < crdev->num_render_threads) && (band >= 0) && (band < band_count);
             i++, band += crdev->thread_lookahead_direction) {
@@ -409,33 +631,36 @@ clist_setup_render_threads(gx_device *dev, int y, gx_process_page_options_t *opt
         thread->band = -1;              /* a value that won't match any valid band */
         thread->options = options;
         thread->buffer = NULL;
+        /* The buffers move between threads and the completion buffer, so */
+        /* they all come from the (thread safe) base memory.               */
         if (options && options->init_buffer_fn) {
-            code = options->init_buffer_fn(options->arg, dev, thread->memory, dev->width, band_height, &thread->buffer);
+            code = options->init_buffer_fn(options->arg, dev, chunk_base_mem, dev->width, band_height, &thread->buffer);
             if (code < 0)
                 break;
         }
+        if ((code = clist_alloc_band_slots(dev, i, options)) < 0)
+            break;
 
         /* create the buf device for this thread, and allocate the semaphores */
         if ((code = gdev_create_buf_device(cdev->buf_procs.create_buf_device,
                                 &(thread->bdev), ndev,
-                                band*crdev->page_band_height, NULL,
+                                clist_unit_begin_line(crdev, band), NULL,
                                 thread->memory, &(crdev->color_usage_array[0])) < 0))
             break;
-        if ((thread->sema_this = gx_semaphore_label(gx_semaphore_alloc(thread->memory), "Band")) == NULL ||
-            (thread->sema_group = gx_semaphore_label(gx_semaphore_alloc(thread->memory), "Group")) == NULL) {
+        if ((thread->sema_this = gx_semaphore_label(gx_semaphore_alloc(thread->memory), "Band")) == NULL) {
             code = gs_error_VMerror;
             break;
         }
+        thread->sema_group = crdev->sema_band_done;
         /* We don't start the threads yet until we  free up the */
         /* reserve memory we have allocated for that band. */
-        thread->band = band;
     }
     /* If the code < 0, the last thread creation failed -- clean it up */
     if (code < 0) {
         /* NB: 'band' will be the one that failed, so will be the next_band needed to start */
         /* the following relies on 'free' ignoring NULL pointers */
-        gx_semaphore_free(crdev->render_threads[i].sema_group);
         gx_semaphore_free(crdev->render_threads[i].sema_this);
+        clist_free_band_slots(dev, i * CLIST_BAND_SLOTS_PER_THREAD, CLIST_BAND_SLOTS_PER_THREAD, options);
         if (crdev->render_threads[i].bdev != NULL)
             cdev->buf_procs.destroy_buf_device(crdev->render_threads[i].bdev);
         if (crdev->render_threads[i].cdev != NULL) {
@@ -451,7 +676,7 @@ clist_setup_render_threads(gx_device *dev, int y, gx_process_page_options_t *opt
             "clist_setup_render_threads");
         }
         if (crdev->render_threads[i].buffer != NULL && options && options->free_buffer_fn != NULL) {
-            options->free_buffer_fn(options->arg, dev, crdev->render_threads[i].memory, crdev->render_threads[i].buffer);
+            options->free_buffer_fn(options->arg, dev, chunk_base_mem, crdev->render_threads[i].buffer);
             crdev->render_threads[i].buffer = NULL;
         }
         if (crdev->render_threads[i].memory != NULL) {
@@ -469,6 +694,12 @@ clist_setup_render_threads(gx_device *dev, int y, gx_process_page_options_t *opt
                 gs_free_object(mem, chunk_base_mem, "clist_setup_render_threads(locked allocator)");
             }
         }
+        gx_semaphore_free(crdev->sema_band_done);
+        crdev->sema_band_done = NULL;
+        gs_free_object(mem, crdev->band_slots, "clist_setup_render_threads");
+        crdev->band_slots = NULL;
+        gs_free_object(mem, crdev->render_unit_y, "clist_setup_render_threads");
+        crdev->render_unit_y = NULL;
         gs_free_object(mem, crdev->render_threads, "clist_setup_render_threads");
         crdev->render_threads = NULL;
         /* restore the file pointers */
@@ -491,15 +722,13 @@ clist_setup_render_threads(gx_device *dev, int y, gx_process_page_options_t *opt
      * threads since we deferred that in the thread setup loop above.
      * We know if we get here we can start at least 1 thread.
      */
-    for (j=0, code = 0; j<crdev->num_render_threads; j++) {
+    for (j=0; j<crdev->num_render_threads; j++)
         gs_free_object(mem, reserve_memory_array[j], "clist_setup_render_threads");
-        if (code == 0 && j < i)
-            code = clist_start_render_thread(dev, j, crdev->render_threads[j].band);
-    }
     gs_free_object(mem, reserve_memory_array, "clist_setup_render_threads");
     crdev->num_render_threads = i;
-    crdev->curr_render_thread = 0;
-    crdev->next_band = band;
+    crdev->num_band_slots = i * CLIST_BAND_SLOTS_PER_THREAD;
+    crdev->next_band = first_band;
+    code = clist_dispatch_render_threads(dev);
 
     if(gs_debug[':'] != 0)
         dmprintf1(mem, "%% Using %d rendering threads\n", i);
@@ -537,7 +766,7 @@ teardown_device_and_mem_for_thread(gx_device *dev, gp_thread_id thread_id, bool
          */
         thread_crdev->icc_table = NULL;
     }
-    rc_decrement(thread_crdev->icc_cache_cl, "teardown_render_thread");
+    gsicc_cache_release(thread_crdev->icc_cache_cl, "teardown_render_thread");
     thread_crdev->icc_cache_cl = NULL;
     /*
      * Free the BufferSpace, close the band files, optionally unlinking them.
@@ -587,20 +816,38 @@ clist_teardown_render_threads(gx_device *dev)
             if (thread->status == THREAD_BUSY)
                 gx_semaphore_wait(thread->sema_this);
         }
+        /* The main thread's data area may be waiting in the completion */
+        /* buffer, so get it back before freeing the slots.              */
+        for (i = 0; i < crdev->num_band_slots; i++) {
+            clist_render_band_slot_t *slot = &(crdev->band_slots[i]);
+
+            if (slot->data == crdev->main_thread_data) {
+                slot->data = cdev->data;
+                cdev->data = crdev->main_thread_data;
+            }
+        }
+        clist_free_band_slots(dev, 0, crdev->num_band_slots, crdev->render_threads[0].options);
+        gs_free_object(mem, crdev->band_slots, "clist_teardown_render_threads");
+        crdev->band_slots = NULL;
+        crdev->num_band_slots = 0;
+        gx_semaphore_free(crdev->sema_band_done);
+        crdev->sema_band_done = NULL;
+        gs_free_object(mem, crdev->render_unit_y, "clist_teardown_render_threads");
+        crdev->render_unit_y = NULL;
+
         /* then free each thread's memory */
         for (i = (crdev->num_render_threads - 1); i >= 0; i--) {
             clist_render_thread_control_t *thread = &(crdev->render_threads[i]);
             gx_device_clist_common *thread_cdev = (gx_device_clist_common *)thread->cdev;
 
-            /* Free control semaphores */
-            gx_semaphore_free(thread->sema_group);
+            /* Free control semaphore (sema_group is shared, freed above) */
             gx_semaphore_free(thread->sema_this);
             /* destroy the thread's buffer device */
             thread_cdev->buf_procs.destroy_buf_device(thread->bdev);
 
             if (thread->options) {
                 if (thread->options->free_buffer_fn && thread->buffer) {
-                    thread->options->free_buffer_fn(thread->options->arg, dev, thread->memory, thread->buffer);
+                    thread->options->free_buffer_fn(thread->options->arg, dev, mem->thread_safe_memory, thread->buffer);
                     thread->buffer = NULL;
                 }
                 thread->options = NULL;
@@ -645,6 +892,8 @@ clist_start_render_thread(gx_device *dev, int thread_index, int band)
     int code;
 
     crdev->render_threads[thread_index].band = band;
+    crdev->render_threads[thread_index].ymin = clist_unit_begin_line(crdev, band);
+    crdev->render_threads[thread_index].ymax = clist_unit_end_line(crdev, band);
     crdev->render_threads[thread_index].status = THREAD_BUSY;
 
     /* Finally, fire it up */
@@ -656,6 +905,68 @@ clist_start_render_thread(gx_device *dev, int thread_index, int band)
     return code;
 }
 
+/*
+ * Render a render unit that may be part of a split band. The whole band is
+ * played back, as it would be if it were not split, but through a
+ * clipping device that only passes its lines. Playing back just the lines
+ * of the piece would translate the band's commands differently, and give
+ * different pixels for some of them (images, for one). The lines are then
+ * moved to the start of the buffer, where the reader expects them.
+ */
+static int
+clist_render_band_piece(gx_device_clist *cldev, gx_device *bdev, byte *mdata,
+                        uint raster, byte *mlines, int begin_line, int end_line)
+{
+    gx_device_clist_reader *crdev = &cldev->reader;
+    int band_height = crdev->page_band_height;
+    int band_begin_line = begin_line - begin_line % band_height;
+    int band_num_lines = min(band_height, crdev->height - band_begin_line);
+    int num_lines = end_line - begin_line;
+    gx_device_memory *mdev = (gx_device_memory *)bdev;
+    gx_device_clip clipdev;
+    gx_clip_path cpath;
+    gs_fixed_rect clip_box;
+    gs_int_rect band_rect;
+    int num_planes, pi;
+    int code;
+
+    code = crdev->buf_procs.setup_buf_device
+            (bdev, mdata, raster, (byte **)mlines, 0, band_num_lines, band_num_lines);
+    if (code < 0)
+        return code;
+    band_rect.p.x = 0;
+    band_rect.p.y = band_begin_line;
+    band_rect.q.x = crdev->width;
+    band_rect.q.y = band_begin_line + band_num_lines;
+    if (num_lines == band_num_lines)
+        return clist_render_rectangle(cldev, &band_rect, bdev, NULL, true);
+
+    gx_cpath_init_local(&cpath, bdev->memory);
+    clip_box.p.x = 0;
+    clip_box.p.y = int2fixed(begin_line - band_begin_line);
+    clip_box.q.x = int2fixed(bdev->width);
+    clip_box.q.y = int2fixed(end_line - band_begin_line);
+    code = gx_cpath_from_rectangle(&cpath, &clip_box);
+    if (code >= 0) {
+        gx_make_clip_device_on_stack(&clipdev, &cpath, bdev);
+        clipdev.width = bdev->width;
+        clipdev.height = bdev->height;
+        code = clist_render_rectangle(cldev, &band_rect, (gx_device *)&clipdev, NULL, true);
+        gx_destroy_clip_device_on_stack(&clipdev);
+    }
+    gx_cpath_free(&cpath, "clist_render_band_piece");
+    if (code < 0)
+        return code;
+
+    /* Only split when the buffer has the default layout, see below */
+    num_planes = (mdev->is_planar ? mdev->color_info.num_components : 1);
+    for (pi = 0; pi < num_planes; pi++)
+        memmove(mdev->line_ptrs[0] + (size_t)pi * mdev->raster * num_lines,
+                mdev->line_ptrs[pi * band_num_lines + begin_line - band_begin_line],
+                (size_t)mdev->raster * num_lines);
+    return 0;
+}
+
 static void
 clist_render_thread(void *data)
 {
@@ -669,28 +980,28 @@ clist_render_thread(void *data)
     byte *mlines = (crdev->page_line_ptrs_offset == 0 ? NULL : mdata + crdev->page_line_ptrs_offset);
     uint raster = gx_device_raster_plane(dev, NULL);
     int code;
-    int band_height = crdev->page_band_height;
-    int band = thread->band;
-    int band_begin_line = band * band_height;
-    int band_end_line = band_begin_line + band_height;
-    int band_num_lines;
+    int band_begin_line = thread->ymin;
+    int band_end_line = thread->ymax;
+    int band_num_lines = band_end_line - band_begin_line;
 #ifdef DEBUG
     long starttime[2], endtime[2];
 
     gp_get_usertime(starttime); /* thread start time */
 #endif
-    if (band_end_line > dev->height)
-        band_end_line = dev->height;
-    band_num_lines = band_end_line - band_begin_line;
 
-    code = crdev->buf_procs.setup_buf_device
-            (bdev, mdata, raster, (byte **)mlines, 0, band_num_lines, band_num_lines);
-    band_rect.p.x = 0;
-    band_rect.p.y = band_begin_line;
-    band_rect.q.x = dev->width;
-    band_rect.q.y = band_end_line;
-    if (code >= 0)
-        code = clist_render_rectangle(cldev, &band_rect, bdev, NULL, true);
+    if (crdev->render_unit_y != NULL)
+        code = clist_render_band_piece(cldev, bdev, mdata, raster, mlines,
+                                       band_begin_line, band_end_line);
+    else {
+        code = crdev->buf_procs.setup_buf_device
+                (bdev, mdata, raster, (byte **)mlines, 0, band_num_lines, band_num_lines);
+        band_rect.p.x = 0;
+        band_rect.p.y = band_begin_line;
+        band_rect.q.x = dev->width;
+        band_rect.q.y = band_end_line;
+        if (code >= 0)
+            code = clist_render_rectangle(cldev, &band_rect, bdev, NULL, true);
+    }
 
     if (code >= 0 && thread->options && thread->options->process_fn)
         code = thread->options->process_fn(thread->options->arg, dev, bdev, &band_rect, thread->buffer);
@@ -718,13 +1029,123 @@ clist_render_thread(void *data)
     gx_semaphore_signal(thread->sema_this);
 }
 
+/* Return the completion buffer slot holding 'band', or NULL */
+static clist_render_band_slot_t *
+clist_find_band_slot(gx_device_clist_reader *crdev, int band)
+{
+    int i;
+
+    for (i = 0; i < crdev->num_band_slots; i++)
+        if (crdev->band_slots[i].band == band)
+            return &(crdev->band_slots[i]);
+    return NULL;
+}
+
+/* Return the thread currently rendering 'band', or NULL */
+static clist_render_thread_control_t *
+clist_find_band_thread(gx_device_clist_reader *crdev, int band)
+{
+    int i;
+
+    for (i = 0; i < crdev->num_render_threads; i++)
+        if (crdev->render_threads[i].band == band)
+            return &(crdev->render_threads[i]);
+    return NULL;
+}
+
+/*
+ * Hand out the next unrendered bands (in the lookahead direction) to any
+ * idle threads. The number of bands being rendered plus the number that
+ * are waiting in the completion buffer never exceeds the number of slots,
+ * so a thread that completes is always able to park its band.
+ */
+static int
+clist_dispatch_render_threads(gx_device *dev)
+{
+    gx_device_clist *cldev = (gx_device_clist *)dev;
+    gx_device_clist_reader *crdev = &cldev->reader;
+    int band_count = crdev->num_render_units;
+    int i, in_use = 0;
+    int code = 0;
+
+    for (i = 0; i < crdev->num_render_threads; i++)
+        if (crdev->render_threads[i].band >= 0)
+            in_use++;
+    for (i = 0; i < crdev->num_band_slots; i++)
+        if (crdev->band_slots[i].band >= 0)
+            in_use++;
+
+    for (i = 0; i < crdev->num_render_threads && code >= 0; i++) {
+        if (crdev->next_band < 0 || crdev->next_band >= band_count ||
+            in_use >= crdev->num_band_slots)
+            break;
+        if (crdev->render_threads[i].band >= 0)
+            continue;           /* busy, or finished but not yet collected */
+        code = clist_start_render_thread(dev, i, crdev->next_band);
+        crdev->next_band += crdev->thread_lookahead_direction;
+        in_use++;
+    }
+    return code;
+}
+
 /*
- * Copy the raster data from the completed thread to the caller's
- * device (the main thread)
+ * Wait for any thread to complete its band, then move the result into a
+ * free slot of the completion buffer (by swapping the data areas, so no
+ * copy is needed). The thread is then idle and can take the next band.
+ * Each completion signals sema_band_done once, so each wait here is
+ * matched with exactly one thread being collected.
+ */
+static int
+clist_collect_render_thread(gx_device_clist_reader *crdev)
+{
+    clist_render_thread_control_t *thread = NULL;
+    clist_render_band_slot_t *slot;
+    gx_device_clist_common *thread_cdev;
+    byte *tmp;
+    void *tmp_buffer;
+    int i;
+
+    gx_semaphore_wait(crdev->sema_band_done);
+    /* The status is set before the semaphores are signalled, so we will */
+    /* find at least one finished thread (not necessarily the signaller) */
+    for (i = 0; i < crdev->num_render_threads; i++) {
+        if (crdev->render_threads[i].band >= 0 &&
+            crdev->render_threads[i].status != THREAD_BUSY) {
+            thread = &(crdev->render_threads[i]);
+            break;
+        }
+    }
+    if (thread == NULL)
+        return_error(gs_error_unknownerror);    /* shouldn't happen */
+
+    gx_semaphore_wait(thread->sema_this);
+    gp_thread_finish(thread->thread);
+    thread->thread = NULL;
+    if (thread->status == THREAD_ERROR)
+        return_error(gs_error_unknownerror);          /* FAIL */
+
+    slot = clist_find_band_slot(crdev, -1);
+    if (slot == NULL)
+        return_error(gs_error_unknownerror);    /* dispatch guarantees a free slot */
+    thread_cdev = (gx_device_clist_common *)thread->cdev;
+    tmp = slot->data;
+    slot->data = thread_cdev->data;
+    thread_cdev->data = tmp;
+    tmp_buffer = slot->buffer;
+    slot->buffer = thread->buffer;
+    thread->buffer = tmp_buffer;
+    slot->band = thread->band;
+
+    thread->status = THREAD_IDLE;
+    thread->band = -1;
+    return 0;
+}
+
+/*
+ * Copy the raster data for the band needed from the completion buffer to
+ * the caller's device (the main thread), collecting completed threads and
+ * handing out further bands until it is available.
  * Return 0 if OK, < 0 is the error code from the thread
- *
- * After swapping the pointers, start up the completed thread with the
- * next band remaining to do (if any)
  */
 static int
 clist_get_band_from_thread(gx_device *dev, int band_needed, gx_process_page_options_t *options)
@@ -733,87 +1154,72 @@ clist_get_band_from_thread(gx_device *dev, int band_needed, gx_process_page_opti
     gx_device_clist_common *cdev = (gx_device_clist_common *)dev;
     gx_device_clist_reader *crdev = &cldev->reader;
     int i, code = 0;
-    int thread_index = crdev->curr_render_thread;
-    clist_render_thread_control_t *thread = &(crdev->render_threads[thread_index]);
-    gx_device_clist_common *thread_cdev = (gx_device_clist_common *)thread->cdev;
-    int band_height = crdev->page_info.band_params.BandHeight;
-    int band_count = cdev->nbands;
+    int band_count = crdev->num_render_units;
+    clist_render_band_slot_t *slot;
     byte *tmp;                  /* for swapping data areas */
 
-    /* We expect that the thread needed will be the 'current' thread */
-    if (thread->band != band_needed) {
-        int band = band_needed;
-
-        emprintf3(thread->memory,
-                  "thread->band = %d, band_needed = %d, direction = %d, ",
-                  thread->band, band_needed, crdev->thread_lookahead_direction);
+    slot = clist_find_band_slot(crdev, band_needed);
+    if (slot == NULL && clist_find_band_thread(crdev, band_needed) == NULL) {
+        emprintf3(crdev->memory,
+                  "next_band = %d, band_needed = %d, direction = %d, ",
+                  crdev->next_band, band_needed, crdev->thread_lookahead_direction);
 
         /* Probably we went in the wrong direction, so let the threads */
         /* all complete, then restart them in the opposite direction   */
         /* If the caller is 'bouncing around' we may end up back here, */
         /* but that is a VERY rare case (we haven't seen it yet).      */
-        for (i=0; i < crdev->num_render_threads; i++) {
-            clist_render_thread_control_t *thread = &(crdev->render_threads[i]);
-
-            if (thread->status == THREAD_BUSY)
-                gx_semaphore_wait(thread->sema_this);
+        for (;;) {
+            for (i = 0; i < crdev->num_render_threads; i++)
+                if (crdev->render_threads[i].band >= 0)
+                    break;
+            if (i == crdev->num_render_threads)
+                break;          /* no threads left running */
+            if ((code = clist_collect_render_thread(crdev)) < 0)
+                return code;
         }
+        for (i = 0; i < crdev->num_band_slots; i++)
+            crdev->band_slots[i].band = -1;     /* discard the lookahead */
+
         crdev->thread_lookahead_direction *= -1;      /* reverse direction (but may be overruled below) */
         if (band_needed == band_count-1)
             crdev->thread_lookahead_direction = -1;   /* assume backwards if we are asking for the last band */
         if (band_needed == 0)
             crdev->thread_lookahead_direction = 1;    /* force forward if we are looking for band 0 */
 
-        dmprintf1(thread->memory, "new_direction = %d\n", crdev->thread_lookahead_direction);
+        dmprintf1(crdev->memory, "new_direction = %d\n", crdev->thread_lookahead_direction);
 
-        /* Loop starting the threads in the new lookahead_direction */
-        for (i=0; (i < crdev->num_render_threads) && (band >= 0) && (band < band_count);
-                i++, band += crdev->thread_lookahead_direction) {
-            thread = &(crdev->render_threads[i]);
-            thread->band = -1;          /* a value that won't match any valid band */
-            /* Start thread 'i' to do band */
-            if ((code = clist_start_render_thread(dev, i, band)) < 0)
-                break;
-        }
-        crdev->next_band = i;			/* may be < 0 or == band_count, but that is handled later */
-        crdev->curr_render_thread = thread_index = 0;
-        thread = &(crdev->render_threads[0]);
-        thread_cdev = (gx_device_clist_common *)thread->cdev;
+        /* Start the threads in the new lookahead_direction */
+        crdev->next_band = band_needed;
+        if ((code = clist_dispatch_render_threads(dev)) < 0)
+            return code;
+    }
+    /* Collect finished threads (keeping the idle ones busy) until the */
+    /* band we want has arrived in the completion buffer.             */
+    while (slot == NULL) {
+        if ((code = clist_collect_render_thread(crdev)) < 0)
+            return code;
+        if ((code = clist_dispatch_render_threads(dev)) < 0)
+            return code;
+        slot = clist_find_band_slot(crdev, band_needed);
     }
-    /* Wait for this thread */
-    gx_semaphore_wait(thread->sema_this);
-    gp_thread_finish(thread->thread);
-    thread->thread = NULL;
-    if (thread->status == THREAD_ERROR)
-        return_error(gs_error_unknownerror);          /* FAIL */
 
     if (options && options->output_fn) {
-        code = options->output_fn(options->arg, dev, thread->buffer);
+        code = options->output_fn(options->arg, dev, slot->buffer);
         if (code < 0)
             return code;
     }
 
     /* Swap the data areas to avoid the copy */
     tmp = cdev->data;
-    cdev->data = thread_cdev->data;
-    thread_cdev->data = tmp;
-    thread->status = THREAD_IDLE;        /* the data is no longer valid */
-    thread->band = -1;
+    cdev->data = slot->data;
+    slot->data = tmp;
+    slot->band = -1;            /* the slot is free again */
     /* Update the bounds for this band */
-    cdev->ymin =  band_needed * band_height;
-    cdev->ymax =  cdev->ymin + band_height;
-    if (cdev->ymax > dev->height)
-        cdev->ymax = dev->height;
+    cdev->ymin = clist_unit_begin_line(crdev, band_needed);
+    cdev->ymax = clist_unit_end_line(crdev, band_needed);
 
-    if (crdev->next_band >= 0 && crdev->next_band < band_count) {
-        code = clist_start_render_thread(dev, thread_index, crdev->next_band);
-        crdev->next_band += crdev->thread_lookahead_direction;
-    }
-    /* bump the 'curr' to the next thread */
-    crdev->curr_render_thread = crdev->curr_render_thread == crdev->num_render_threads - 1 ?
-                0 : crdev->curr_render_thread + 1;
-
-    return code;
+    /* A slot is now free, so another band can be started */
+    return clist_dispatch_render_threads(dev);
 }
 
 /* Copy a rasterized rectangle to the client, rasterizing if needed. */
@@ -872,7 +1278,7 @@ clist_get_bits_rect_mt(gx_device *dev, const gs_int_rect * prect,
     }
     /* If we already have the band's data, just return it */
     if (y < crdev->ymin || end_y > crdev->ymax)
-        code = clist_get_band_from_thread(dev, band, NULL);
+        code = clist_get_band_from_thread(dev, clist_unit_of_line(crdev, y), NULL);
     if (code < 0)
         goto free_thread_out;
     mdata = crdev->data + crdev->page_tile_cache_size;
@@ -883,7 +1289,7 @@ clist_get_bits_rect_mt(gx_device *dev, const gs_int_rect * prect,
                             y - crdev->ymin, line_count, crdev->ymax - crdev->ymin)) < 0)
         goto free_thread_out;
 
-    lines_rasterized = min(band_height, line_count);
+    lines_rasterized = min(crdev->ymax - y, line_count);
     /* Return as much of the rectangle as falls within the rasterized lines. */
     band_rect = *prect;
     band_rect.p.y = 0;
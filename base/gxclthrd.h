@@ -51,10 +51,11 @@ struct clist_render_thread_control_s {
                                 /* values allow waiting until status < 2 */
     gs_memory_t *memory;	/* thread's 'chunk' memory allocator */
     gx_semaphore_t *sema_this;
-    gx_semaphore_t *sema_group;
+    gx_semaphore_t *sema_group;	/* shared by all threads: the reader's sema_band_done */
     gx_device *cdev;	/* clist device copy */
     gx_device *bdev;	/* this thread's buffer device */
-    int band;
+    int band;		/* render unit: a band, or part of one if bands are split */
+    int ymin, ymax;	/* lines of the page to render for 'band' */
     gp_thread_id thread;
 
     /* For process_page mode */
@@ -65,4 +66,14 @@ struct clist_render_thread_control_s {
 #endif
 };
 
+/* Completion buffer entry. A thread that finishes a band swaps its data */
+/* area (and process_page buffer) into a free slot and can then start on */
+/* the next band at once. The consumer takes the slots in band order.    */
+struct clist_render_band_slot_s {
+    int band;		/* band held by this slot, -1 if free */
+    byte *data;		/* band data area, swapped with thread/device data */
+    byte *alloc;	/* data area allocated for this slot (freed at teardown) */
+    void *buffer;	/* process_page buffer, swapped with the thread buffer */
+};
+
 #endif /* gxclthrd_INCLUDED */
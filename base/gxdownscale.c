@@ -21,11 +21,34 @@
 #include "assert_.h"
 #include "ets.h"
 
+#ifdef HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+/* The AVX2 versions of the 8 bit cores are picked at run time, as in
+ * gxht_thresh.c: gcc and clang builds compile them alongside the SSE2
+ * ones, other compilers only when targeting AVX2 throughout. */
+#if defined(HAVE_SSE2) && defined(__AVX2__)
+#define GX_DOWN_AVX2
+#define GX_DOWN_AVX2_TARGET
+#define gx_down_have_avx2() 1
+#elif defined(HAVE_SSE2) && (defined(__clang__) || (defined(__GNUC__) && \
+                             (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define GX_DOWN_AVX2
+#define GX_DOWN_AVX2_TARGET __attribute__((target("avx2")))
+#define gx_down_have_avx2() __builtin_cpu_supports("avx2")
+#endif
+#ifdef GX_DOWN_AVX2
+#include <immintrin.h>
+#endif
+
 /* Nasty inline declaration, as gxht_thresh.h requires penum */
 void gx_ht_threshold_row_bit_sub(byte *contone,  byte *threshold_strip,
                              int contone_stride, byte *halftone,
                              int dithered_stride, int width, int num_rows,
                              int offset_bits);
+void gx_ht_threshold_row_levels(byte *contone, byte *thresh, byte *halftone,
+                                int width, int bpc);
 
 enum
 {
@@ -880,12 +903,14 @@ static void down_core4(gx_downscaler_t *ds,
     pack_8to1(out_buffer, outp, awidth*4);
 }
 
-static void down_core4_ht(gx_downscaler_t *ds,
-                          byte            *out_buffer, /* Guaranteed aligned */
-                          byte            *in_buffer,  /* Not guaranteed aligned */
-                          int              row,
-                          int              plane /* unused */,
-                          int              span)
+/* Threshold array halftoning, to 1, 2 or 4 bits per component, for
+ * any number of chunky components. */
+static void down_core_ht(gx_downscaler_t *ds,
+                         byte            *out_buffer, /* Guaranteed aligned */
+                         byte            *in_buffer,  /* Not guaranteed aligned */
+                         int              row,
+                         int              plane /* unused */,
+                         int              span)
 {
     int pad_white, y;
     int factor = ds->factor;
@@ -893,13 +918,13 @@ static void down_core4_ht(gx_downscaler_t *ds,
     int nc = ds->early_cm ? ds->post_cm_num_comps : ds->num_comps;
     byte *downscaled_data = ds->inbuf;
 
-    pad_white = (ds->awidth - ds->width) * factor * 4;
+    pad_white = (ds->awidth - ds->width) * factor * nc;
     if (pad_white < 0)
         pad_white = 0;
 
     if (pad_white)
     {
-        unsigned char *inp = in_buffer + ds->width * factor * 4;
+        unsigned char *inp = in_buffer + ds->width * factor * nc;
         for (y = factor; y > 0; y--)
         {
             memset(inp, 0xFF, pad_white);
@@ -950,9 +975,13 @@ static void down_core4_ht(gx_downscaler_t *ds,
     }
 
     /* Do the halftone */
-    gx_ht_threshold_row_bit_sub(downscaled_data, ds->htrow, 0,
-                                out_buffer, 0,
-                                ds->width * nc, 1, 0);
+    if (ds->dst_bpc == 1)
+        gx_ht_threshold_row_bit_sub(downscaled_data, ds->htrow, 0,
+                                    out_buffer, 0,
+                                    ds->width * nc, 1, 0);
+    else
+        gx_ht_threshold_row_levels(downscaled_data, ds->htrow, out_buffer,
+                                   ds->width * nc, ds->dst_bpc);
 }
 
 static void down_core4_ets(gx_downscaler_t *ds,
@@ -1173,6 +1202,467 @@ static void down_core4_mfs(gx_downscaler_t *ds,
 }
 
 /* Grey (or planar) downscale code */
+
+#ifdef HAVE_SSE2
+/* SSE2 versions of the 8 bit box filter cores. Each of these handles the
+ * output pixels in groups of 16, returning the number done, and leaves the
+ * rest of the line to the scalar code. The results are identical to those
+ * of the scalar loops. As with the scalar code, the output may overwrite
+ * the start of the input (the ets and halftone cores rely on this), so all
+ * the input for a group is read before any of its output is written. */
+
+/* Sum each adjacent pair of bytes in v into a 16 bit lane. */
+static inline __m128i
+pair_sum_8_sse2(__m128i v)
+{
+    const __m128i lo_mask = _mm_set1_epi16(0xff);
+
+    return _mm_add_epi16(_mm_and_si128(v, lo_mask), _mm_srli_epi16(v, 8));
+}
+
+static int
+down_core8_2_sse2(byte *outp, const byte *inp, int awidth, int span)
+{
+    const __m128i round = _mm_set1_epi16(2);
+    int x;
+
+    for (x = awidth >> 4; x > 0; x--)
+    {
+        __m128i a0 = _mm_loadu_si128((const __m128i *)inp);
+        __m128i a1 = _mm_loadu_si128((const __m128i *)(inp + 16));
+        __m128i b0 = _mm_loadu_si128((const __m128i *)(inp + span));
+        __m128i b1 = _mm_loadu_si128((const __m128i *)(inp + span + 16));
+        __m128i s0 = _mm_add_epi16(pair_sum_8_sse2(a0), pair_sum_8_sse2(b0));
+        __m128i s1 = _mm_add_epi16(pair_sum_8_sse2(a1), pair_sum_8_sse2(b1));
+
+        s0 = _mm_srli_epi16(_mm_add_epi16(s0, round), 2);
+        s1 = _mm_srli_epi16(_mm_add_epi16(s1, round), 2);
+        _mm_storeu_si128((__m128i *)outp, _mm_packus_epi16(s0, s1));
+        outp += 16;
+        inp += 32;
+    }
+    return awidth & ~15;
+}
+
+/* Pick out lanes 0, 3, 6, ... 21 of the 24 16 bit lanes in a, b and c. */
+static inline __m128i
+every_third_16_sse2(__m128i a, __m128i b, __m128i c)
+{
+    const __m128i m0 = _mm_set_epi16(0, 0, 0, 0, 0, -1, -1, -1);
+    const __m128i m1 = _mm_set_epi16(0, 0, -1, -1, -1, 0, 0, 0);
+    const __m128i m2 = _mm_set_epi16(-1, -1, 0, 0, 0, 0, 0, 0);
+
+    /* a0 a1 a2 a3 a6 a7 a6 a7 -> a0 a3 .. .. a6 a7 .. .. -> a0 a3 a6 .. */
+    a = _mm_shuffle_epi32(a, _MM_SHUFFLE(3, 3, 1, 0));
+    a = _mm_shufflelo_epi16(a, _MM_SHUFFLE(0, 0, 3, 0));
+    a = _mm_shuffle_epi32(a, _MM_SHUFFLE(2, 2, 2, 0));
+    /* b1 at lane 3, b4 and b7 at lanes 4 and 5 */
+    b = _mm_shufflelo_epi16(b, _MM_SHUFFLE(1, 1, 1, 1));
+    b = _mm_shufflehi_epi16(b, _MM_SHUFFLE(3, 3, 3, 0));
+    /* c2 c3 c4 c5 in the top half, then c2 and c5 at lanes 6 and 7 */
+    c = _mm_shuffle_epi32(c, _MM_SHUFFLE(2, 1, 0, 0));
+    c = _mm_shufflehi_epi16(c, _MM_SHUFFLE(3, 0, 0, 0));
+    return _mm_or_si128(_mm_or_si128(_mm_and_si128(a, m0),
+                                     _mm_and_si128(b, m1)),
+                        _mm_and_si128(c, m2));
+}
+
+/* Sum each lane of a with the next 2 lanes of the 16 lanes in a and b. */
+static inline __m128i
+sum_3_16_sse2(__m128i a, __m128i b)
+{
+    __m128i a1 = _mm_or_si128(_mm_srli_si128(a, 2), _mm_slli_si128(b, 14));
+    __m128i a2 = _mm_or_si128(_mm_srli_si128(a, 4), _mm_slli_si128(b, 12));
+
+    return _mm_add_epi16(a, _mm_add_epi16(a1, a2));
+}
+
+static int
+down_core8_3_sse2(byte *outp, const byte *inp, int awidth, int span)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi16(4);
+    /* (v * 0xE38F) >> 19 == v / 9 for all 16 bit v. */
+    const __m128i ninth = _mm_set1_epi16((short)0xE38F);
+    int x, i, y;
+
+    for (x = awidth >> 4; x > 0; x--)
+    {
+        __m128i v[6], r[2];
+
+        /* Vertical sums of the 48 bytes across the 3 lines. */
+        for (i = 0; i < 3; i++)
+        {
+            const byte *p = inp + 16 * i;
+            __m128i lo = zero, hi = zero;
+
+            for (y = 3; y > 0; y--)
+            {
+                __m128i t = _mm_loadu_si128((const __m128i *)p);
+
+                lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(t, zero));
+                hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(t, zero));
+                p += span;
+            }
+            v[2 * i] = lo;
+            v[2 * i + 1] = hi;
+        }
+        /* Each half of the output takes 24 of the vertical sums. */
+        for (i = 0; i < 2; i++)
+        {
+            __m128i a = v[3 * i], b = v[3 * i + 1], c = v[3 * i + 2];
+            __m128i sum = every_third_16_sse2(sum_3_16_sse2(a, b),
+                                              sum_3_16_sse2(b, c),
+                                              sum_3_16_sse2(c, zero));
+
+            sum = _mm_mulhi_epu16(_mm_add_epi16(sum, round), ninth);
+            r[i] = _mm_srli_epi16(sum, 3);
+        }
+        _mm_storeu_si128((__m128i *)outp, _mm_packus_epi16(r[0], r[1]));
+        outp += 16;
+        inp += 48;
+    }
+    return awidth & ~15;
+}
+
+static int
+down_core8_4_sse2(byte *outp, const byte *inp, int awidth, int span)
+{
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i round = _mm_set1_epi16(8);
+    int x, i, y;
+
+    for (x = awidth >> 4; x > 0; x--)
+    {
+        __m128i q[4];
+
+        /* Each group of 16 bytes across the 4 lines gives 4 outputs. */
+        for (i = 0; i < 4; i++)
+        {
+            const byte *p = inp + 16 * i;
+            __m128i s = _mm_setzero_si128();
+
+            for (y = 4; y > 0; y--)
+            {
+                s = _mm_add_epi16(s, pair_sum_8_sse2(_mm_loadu_si128((const __m128i *)p)));
+                p += span;
+            }
+            q[i] = _mm_madd_epi16(s, ones);
+        }
+        q[0] = _mm_packs_epi32(q[0], q[1]);
+        q[2] = _mm_packs_epi32(q[2], q[3]);
+        q[0] = _mm_srli_epi16(_mm_add_epi16(q[0], round), 4);
+        q[2] = _mm_srli_epi16(_mm_add_epi16(q[2], round), 4);
+        _mm_storeu_si128((__m128i *)outp, _mm_packus_epi16(q[0], q[2]));
+        outp += 16;
+        inp += 64;
+    }
+    return awidth & ~15;
+}
+
+/* The general case, for any factor and pixel interleaved data with nc
+ * components. The vertical sums of the factor lines are formed 16 bytes at
+ * a time, then added horizontally, and the divisions are done 4 at a time.
+ * Each group of 16 pixels covers 16*factor*nc bytes, so the vertical pass
+ * has no remainder. A sum is at most 64*255, so the float quotient is
+ * never far enough from the true one to change its integer part, and the
+ * truncation gives exactly the (value + div/2)/div of the scalar code. */
+static int
+down_core8_n_sse2(byte *outp, const byte *inp, int awidth, int factor,
+                  int nc, int span)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32((factor * factor) >> 1);
+    const __m128 div = _mm_set1_ps((float)(factor * factor));
+    const int n = 16 * factor * nc;
+    const int step = factor * nc;
+    __m128i vsum[8 * 4 * 2];    /* 16 pixels, factor <= 8, nc <= 4 */
+    __m128i hsum[4 * 4];
+    int x, i, y, xx, c;
+
+    for (x = awidth >> 4; x > 0; x--)
+    {
+        const ushort *s = (const ushort *)vsum;
+        int *h = (int *)hsum;
+
+        for (i = 0; i < n; i += 16)
+        {
+            const byte *p = inp + i;
+            __m128i lo = zero, hi = zero;
+
+            for (y = factor; y > 0; y--)
+            {
+                __m128i v = _mm_loadu_si128((const __m128i *)p);
+
+                lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+                hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+                p += span;
+            }
+            vsum[i >> 3] = lo;
+            vsum[(i >> 3) + 1] = hi;
+        }
+        for (i = 16; i > 0; i--)
+        {
+            for (c = 0; c < nc; c++)
+            {
+                const ushort *t = s + c;
+                int value = 0;
+
+                for (xx = factor; xx > 0; xx--)
+                {
+                    value += *t;
+                    t += nc;
+                }
+                *h++ = value;
+            }
+            s += step;
+        }
+        for (i = 0; i < 4 * nc; i += 4)
+        {
+            __m128i q[4];
+
+            for (y = 0; y < 4; y++)
+                q[y] = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(
+                           _mm_add_epi32(hsum[i + y], round)), div));
+            q[0] = _mm_packs_epi32(q[0], q[1]);
+            q[2] = _mm_packs_epi32(q[2], q[3]);
+            _mm_storeu_si128((__m128i *)outp, _mm_packus_epi16(q[0], q[2]));
+            outp += 16;
+        }
+        inp += n;
+    }
+    return awidth & ~15;
+}
+
+#ifdef GX_DOWN_AVX2
+/* AVX2 versions of the above, picked at run time. These handle the output
+ * pixels in groups of 32 (16 for the general case), with the same results
+ * and the same care over output overwriting input. */
+
+static inline GX_DOWN_AVX2_TARGET __m256i
+pair_sum_8_avx2(__m256i v)
+{
+    return _mm256_add_epi16(_mm256_and_si256(v, _mm256_set1_epi16(0xff)),
+                            _mm256_srli_epi16(v, 8));
+}
+
+static GX_DOWN_AVX2_TARGET int
+down_core8_2_avx2(byte *outp, const byte *inp, int awidth, int span)
+{
+    const __m256i round = _mm256_set1_epi16(2);
+    int x;
+
+    for (x = awidth >> 5; x > 0; x--)
+    {
+        __m256i a0 = _mm256_loadu_si256((const __m256i *)inp);
+        __m256i a1 = _mm256_loadu_si256((const __m256i *)(inp + 32));
+        __m256i b0 = _mm256_loadu_si256((const __m256i *)(inp + span));
+        __m256i b1 = _mm256_loadu_si256((const __m256i *)(inp + span + 32));
+        __m256i s0 = _mm256_add_epi16(pair_sum_8_avx2(a0), pair_sum_8_avx2(b0));
+        __m256i s1 = _mm256_add_epi16(pair_sum_8_avx2(a1), pair_sum_8_avx2(b1));
+
+        s0 = _mm256_srli_epi16(_mm256_add_epi16(s0, round), 2);
+        s1 = _mm256_srli_epi16(_mm256_add_epi16(s1, round), 2);
+        /* The pack works within each 128 bit half; put the halves back in order. */
+        _mm256_storeu_si256((__m256i *)outp,
+                            _mm256_permute4x64_epi64(_mm256_packus_epi16(s0, s1),
+                                                     _MM_SHUFFLE(3, 1, 2, 0)));
+        outp += 32;
+        inp += 64;
+    }
+    return awidth & ~31;
+}
+
+/* Load 16 bytes from p into the low half and 16 from p + 48 into the high. */
+static inline GX_DOWN_AVX2_TARGET __m256i
+load_2x16_avx2(const byte *p)
+{
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)p)),
+                                   _mm_loadu_si128((const __m128i *)(p + 48)), 1);
+}
+
+/* Gather bytes 3k + i (for k = 0 to 15) of the 48 bytes in a, b and c, in
+ * each 128 bit half. */
+static inline GX_DOWN_AVX2_TARGET __m256i
+every_third_8_avx2(__m256i a, __m256i b, __m256i c, __m256i ma, __m256i mb, __m256i mc)
+{
+    return _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(a, ma),
+                                           _mm256_shuffle_epi8(b, mb)),
+                           _mm256_shuffle_epi8(c, mc));
+}
+
+#define DOWN_SHUF_AVX2(a0,a1,a2,a3,a4,a5,a6,a7,a8,a9,a10,a11,a12,a13,a14,a15) \
+    _mm256_setr_epi8(a0,a1,a2,a3,a4,a5,a6,a7,a8,a9,a10,a11,a12,a13,a14,a15, \
+                     a0,a1,a2,a3,a4,a5,a6,a7,a8,a9,a10,a11,a12,a13,a14,a15)
+
+/* Each half of the registers does a group of 16 output pixels: the bytes
+ * of each line are split into the 3 columns of each pixel and those are
+ * summed, so that the pack at the end leaves everything in order. */
+static GX_DOWN_AVX2_TARGET int
+down_core8_3_avx2(byte *outp, const byte *inp, int awidth, int span)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i round = _mm256_set1_epi16(4);
+    /* (v * 0xE38F) >> 19 == v / 9 for all 16 bit v. */
+    const __m256i ninth = _mm256_set1_epi16((short)0xE38F);
+    const __m256i m0a = DOWN_SHUF_AVX2(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i m0b = DOWN_SHUF_AVX2(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1);
+    const __m256i m0c = DOWN_SHUF_AVX2(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13);
+    const __m256i m1a = DOWN_SHUF_AVX2(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i m1b = DOWN_SHUF_AVX2(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1);
+    const __m256i m1c = DOWN_SHUF_AVX2(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14);
+    const __m256i m2a = DOWN_SHUF_AVX2(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i m2b = DOWN_SHUF_AVX2(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1);
+    const __m256i m2c = DOWN_SHUF_AVX2(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15);
+    int x, y;
+
+    for (x = awidth >> 5; x > 0; x--)
+    {
+        const byte *p = inp;
+        __m256i lo = zero, hi = zero;
+
+        for (y = 3; y > 0; y--)
+        {
+            __m256i a = load_2x16_avx2(p);
+            __m256i b = load_2x16_avx2(p + 16);
+            __m256i c = load_2x16_avx2(p + 32);
+            __m256i c0 = every_third_8_avx2(a, b, c, m0a, m0b, m0c);
+            __m256i c1 = every_third_8_avx2(a, b, c, m1a, m1b, m1c);
+            __m256i c2 = every_third_8_avx2(a, b, c, m2a, m2b, m2c);
+
+            lo = _mm256_add_epi16(lo, _mm256_add_epi16(_mm256_unpacklo_epi8(c0, zero),
+                                  _mm256_add_epi16(_mm256_unpacklo_epi8(c1, zero),
+                                                   _mm256_unpacklo_epi8(c2, zero))));
+            hi = _mm256_add_epi16(hi, _mm256_add_epi16(_mm256_unpackhi_epi8(c0, zero),
+                                  _mm256_add_epi16(_mm256_unpackhi_epi8(c1, zero),
+                                                   _mm256_unpackhi_epi8(c2, zero))));
+            p += span;
+        }
+        lo = _mm256_srli_epi16(_mm256_mulhi_epu16(_mm256_add_epi16(lo, round), ninth), 3);
+        hi = _mm256_srli_epi16(_mm256_mulhi_epu16(_mm256_add_epi16(hi, round), ninth), 3);
+        _mm256_storeu_si256((__m256i *)outp, _mm256_packus_epi16(lo, hi));
+        outp += 32;
+        inp += 96;
+    }
+    return awidth & ~31;
+}
+
+#undef DOWN_SHUF_AVX2
+
+static GX_DOWN_AVX2_TARGET int
+down_core8_4_avx2(byte *outp, const byte *inp, int awidth, int span)
+{
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i round = _mm256_set1_epi16(8);
+    /* Undo the interleaving of the 128 bit halves by the two packs. */
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    int x, i, y;
+
+    for (x = awidth >> 5; x > 0; x--)
+    {
+        __m256i q[4];
+
+        /* Each group of 32 bytes across the 4 lines gives 8 outputs. */
+        for (i = 0; i < 4; i++)
+        {
+            const byte *p = inp + 32 * i;
+            __m256i s = _mm256_setzero_si256();
+
+            for (y = 4; y > 0; y--)
+            {
+                s = _mm256_add_epi16(s, pair_sum_8_avx2(_mm256_loadu_si256((const __m256i *)p)));
+                p += span;
+            }
+            q[i] = _mm256_madd_epi16(s, ones);
+        }
+        q[0] = _mm256_packs_epi32(q[0], q[1]);
+        q[2] = _mm256_packs_epi32(q[2], q[3]);
+        q[0] = _mm256_srli_epi16(_mm256_add_epi16(q[0], round), 4);
+        q[2] = _mm256_srli_epi16(_mm256_add_epi16(q[2], round), 4);
+        _mm256_storeu_si256((__m256i *)outp,
+                            _mm256_permutevar8x32_epi32(_mm256_packus_epi16(q[0], q[2]), order));
+        outp += 32;
+        inp += 128;
+    }
+    return awidth & ~31;
+}
+
+/* As down_core8_n_sse2, but with the horizontal sums done 8 at a time too.
+ * Output value j of a group (pixel j / nc, component j % nc) adds the
+ * vertical sums at (j / nc) * factor * nc + j % nc + xx * nc, for xx up to
+ * factor, and these are gathered from the 16 bit sums as 32 bit values
+ * with the top half masked off. */
+static GX_DOWN_AVX2_TARGET int
+down_core8_n_avx2(byte *outp, const byte *inp, int awidth, int factor,
+                  int nc, int span)
+{
+    const __m256i round = _mm256_set1_epi32((factor * factor) >> 1);
+    const __m256i lo16 = _mm256_set1_epi32(0xffff);
+    const __m256 div = _mm256_set1_ps((float)(factor * factor));
+    const __m256i next = _mm256_set1_epi32(nc);
+    const int n = 16 * factor * nc;
+    /* 16 pixels, factor <= 8, nc <= 4, and room for the last gather */
+    __m256i vsum[8 * 4 + 1];
+    __m256i base[2 * 4];
+    int x, i, y, xx;
+
+    for (i = 0; i < 2 * nc; i++)
+    {
+        int idx[8];
+
+        for (y = 0; y < 8; y++)
+        {
+            int j = i * 8 + y;
+
+            idx[y] = (j / nc) * factor * nc + j % nc;
+        }
+        base[i] = _mm256_loadu_si256((const __m256i *)idx);
+    }
+    vsum[n >> 4] = _mm256_setzero_si256();
+    for (x = awidth >> 4; x > 0; x--)
+    {
+        for (i = 0; i < n; i += 16)
+        {
+            const byte *p = inp + i;
+            __m256i sum = _mm256_setzero_si256();
+
+            for (y = factor; y > 0; y--)
+            {
+                sum = _mm256_add_epi16(sum, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)p)));
+                p += span;
+            }
+            vsum[i >> 4] = sum;
+        }
+        for (i = 0; i < 2 * nc; i += 2)
+        {
+            __m256i idx0 = base[i], idx1 = base[i + 1];
+            __m256i h0 = round, h1 = round;
+            __m256i q0, q1;
+
+            for (xx = factor; xx > 0; xx--)
+            {
+                h0 = _mm256_add_epi32(h0, _mm256_and_si256(lo16,
+                         _mm256_i32gather_epi32((const int *)vsum, idx0, 2)));
+                h1 = _mm256_add_epi32(h1, _mm256_and_si256(lo16,
+                         _mm256_i32gather_epi32((const int *)vsum, idx1, 2)));
+                idx0 = _mm256_add_epi32(idx0, next);
+                idx1 = _mm256_add_epi32(idx1, next);
+            }
+            q0 = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(h0), div));
+            q1 = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(h1), div));
+            /* The pack works within each 128 bit half; put them back in order. */
+            q0 = _mm256_permute4x64_epi64(_mm256_packs_epi32(q0, q1), _MM_SHUFFLE(3, 1, 2, 0));
+            _mm_storeu_si128((__m128i *)outp, _mm_packus_epi16(_mm256_castsi256_si128(q0),
+                                                               _mm256_extracti128_si256(q0, 1)));
+            outp += 16;
+        }
+        inp += n;
+    }
+    return awidth & ~15;
+}
+#endif
+#endif
+
 static void down_core16(gx_downscaler_t *ds,
                         byte            *outp,
                         byte            *in_buffer,
@@ -1257,6 +1747,21 @@ static void down_core8(gx_downscaler_t *ds,
     }
 
     inp = in_buffer;
+#ifdef HAVE_SSE2
+    {
+        int done;
+
+#ifdef GX_DOWN_AVX2
+        if (gx_down_have_avx2())
+            done = down_core8_n_avx2(outp, inp, awidth, factor, 1, span);
+        else
+#endif
+        done = down_core8_n_sse2(outp, inp, awidth, factor, 1, span);
+        outp += done;
+        inp += done*factor;
+        awidth -= done;
+    }
+#endif
     {
         /* Left to Right pass (no min feature size) */
         const int back = span * factor -1;
@@ -1306,6 +1811,25 @@ static void down_core8_2(gx_downscaler_t *ds,
 
     inp = in_buffer;
 
+#ifdef HAVE_SSE2
+    {
+        int done;
+
+#ifdef GX_DOWN_AVX2
+        if (gx_down_have_avx2())
+        {
+            done = down_core8_2_avx2(outp, inp, awidth, span);
+            outp += done;
+            inp += done*2;
+            awidth -= done;
+        }
+#endif
+        done = down_core8_2_sse2(outp, inp, awidth, span);
+        outp += done;
+        inp += done*2;
+        awidth -= done;
+    }
+#endif
     /* Left to Right pass (no min feature size) */
     for (x = awidth; x > 0; x--)
     {
@@ -1343,6 +1867,25 @@ static void down_core8_3(gx_downscaler_t *ds,
 
     inp = in_buffer;
 
+#ifdef HAVE_SSE2
+    {
+        int done;
+
+#ifdef GX_DOWN_AVX2
+        if (gx_down_have_avx2())
+        {
+            done = down_core8_3_avx2(outp, inp, awidth, span);
+            outp += done;
+            inp += done*3;
+            awidth -= done;
+        }
+#endif
+        done = down_core8_3_sse2(outp, inp, awidth, span);
+        outp += done;
+        inp += done*3;
+        awidth -= done;
+    }
+#endif
     /* Left to Right pass (no min feature size) */
     for (x = awidth; x > 0; x--)
     {
@@ -1382,6 +1925,25 @@ static void down_core8_4(gx_downscaler_t *ds,
 
     inp = in_buffer;
 
+#ifdef HAVE_SSE2
+    {
+        int done;
+
+#ifdef GX_DOWN_AVX2
+        if (gx_down_have_avx2())
+        {
+            done = down_core8_4_avx2(outp, inp, awidth, span);
+            outp += done;
+            inp += done*4;
+            awidth -= done;
+        }
+#endif
+        done = down_core8_4_sse2(outp, inp, awidth, span);
+        outp += done;
+        inp += done*4;
+        awidth -= done;
+    }
+#endif
     /* Left to Right pass (no min feature size) */
     for (x = awidth; x > 0; x--)
     {
@@ -1540,6 +2102,30 @@ static void down_core24(gx_downscaler_t *ds,
     }
 
     inp = in_buffer;
+#ifdef HAVE_SSE2
+    {
+        int done;
+
+        /* Let the compiler see a constant factor in the usual case. */
+#ifdef GX_DOWN_AVX2
+        if (gx_down_have_avx2())
+        {
+            if (factor == 3)
+                done = down_core8_n_avx2(outp, inp, awidth, 3, 3, span);
+            else
+                done = down_core8_n_avx2(outp, inp, awidth, factor, 3, span);
+        }
+        else
+#endif
+        if (factor == 3)
+            done = down_core8_n_sse2(outp, inp, awidth, 3, 3, span);
+        else
+            done = down_core8_n_sse2(outp, inp, awidth, factor, 3, span);
+        outp += done*3;
+        inp += done*factor*3;
+        awidth -= done;
+    }
+#endif
     {
         /* Left to Right pass (no min feature size) */
         const int back  = span * factor - 3;
@@ -1621,6 +2207,30 @@ static void down_core32(gx_downscaler_t *ds,
     }
 
     inp = in_buffer;
+#ifdef HAVE_SSE2
+    {
+        int done;
+
+        /* Let the compiler see a constant factor in the usual case. */
+#ifdef GX_DOWN_AVX2
+        if (gx_down_have_avx2())
+        {
+            if (factor == 3)
+                done = down_core8_n_avx2(outp, inp, awidth, 3, 4, span);
+            else
+                done = down_core8_n_avx2(outp, inp, awidth, factor, 4, span);
+        }
+        else
+#endif
+        if (factor == 3)
+            done = down_core8_n_sse2(outp, inp, awidth, 3, 4, span);
+        else
+            done = down_core8_n_sse2(outp, inp, awidth, factor, 4, span);
+        outp += done*4;
+        inp += done*factor*4;
+        awidth -= done;
+    }
+#endif
     {
         /* Left to Right pass (no min feature size) */
         const int back  = span * factor - 4;
@@ -2381,7 +2991,7 @@ gx_downscaler_init_trapped_cm_halftone(gx_downscaler_t    *ds,
                 code = init_ht(ds, 4, select_8_to_8_core(nc, factor));
                 if (code)
                     goto cleanup;
-                core = &down_core4_ht;
+                core = &down_core_ht;
             }
             else
                 core = &down_core4;
@@ -2397,6 +3007,17 @@ gx_downscaler_init_trapped_cm_halftone(gx_downscaler_t    *ds,
                     goto cleanup;
                 core = &down_core_ets_1;
             }
+            else if (ht != NULL)
+            {
+                /* A screen is used for 1 bit gray now too; this used to
+                 * fall through to the error diffusion cores below, so
+                 * callers passing one (the chameleon device does) get
+                 * screened output where it was diffused before. */
+                code = init_ht(ds, 1, select_8_to_8_core(nc, factor));
+                if (code)
+                    goto cleanup;
+                core = &down_core_ht;
+            }
             else if (factor == 4)
                 core = &down_core_4;
             else if (factor == 3)
@@ -2408,6 +3029,15 @@ gx_downscaler_init_trapped_cm_halftone(gx_downscaler_t    *ds,
             else
                 core = &down_core;
         }
+        else if ((src_bpc == 8) && (dst_bpc == 2 || dst_bpc == 4) &&
+                 (nc == 1 || nc == 4) && ht != NULL && ht != &bogus_ets_halftone &&
+                 mfs <= 1)
+        {
+            code = init_ht(ds, nc, select_8_to_8_core(nc, factor));
+            if (code)
+                goto cleanup;
+            core = &down_core_ht;
+        }
         else if ((factor == 1) && (src_bpc == dst_bpc))
             break;
         else if (src_bpc == 8 && dst_bpc == 8)
@@ -1182,6 +1182,86 @@ gs_fapi_finish_render(gs_font *pfont, gs_gstate *pgs, gs_text_enum_t *penum, gs_
 #define MTX_EQ(mtx1,mtx2) (mtx1->xx == mtx2->xx && mtx1->xy == mtx2->xy && \
                            mtx1->yx == mtx2->yx && mtx1->yy == mtx2->yy)
 
+/* How far ahead in a text run fapi_prefetch_chars looks. */
+#define FAPI_PREFETCH_RUN 256
+
+/*
+ * Collect the glyph indices of the uncached characters that follow the
+ * current one in a show, so that the server can start rendering them.
+ * Only TrueType fonts are predicted: their glyph index comes straight
+ * from the character, and the server checks it again when the
+ * character is actually rendered.
+ */
+static int
+fapi_prefetch_chars(gs_fapi_server *I, gs_show_enum *penum_s, gs_font_base *pbfont,
+                    const gs_fapi_char_ref *cr, const gs_log2_scale_point *log2_scale,
+                    int alpha_bits)
+{
+    gs_text_enum_t peek;
+    gs_font *rfont = (penum_s->fstack.depth < 0 ? penum_s->pgs->font :
+                      penum_s->fstack.items[0].font);
+    int wmode = rfont->WMode;
+    int depth = (log2_scale->x + log2_scale->y == 0 ?
+                 1 : min(log2_scale->x + log2_scale->y, alpha_bits));
+    int num_threads = pbfont->dir->glyph_rendering_threads;
+    uint gids[FAPI_PREFETCH_RUN];
+    int count = 0, i, code;
+
+    code = I->prefetch_chars(I, &I->ff, cr, NULL, 0, num_threads);
+    if (code != 0)
+        return (code < 0 ? code : 0);
+
+    /* Run through the rest of the text on a copy of the enumerator. */
+    peek = *(gs_text_enum_t *)penum_s;
+    for (i = 0; i < FAPI_PREFETCH_RUN; i++) {
+        gs_char chr;
+        gs_glyph glyph;
+        gs_font *font;
+        uint gid;
+        int j;
+
+        if (rfont->procs.next_char_glyph(&peek, &chr, &glyph) != 0)
+            break;              /* done, error, or a font change */
+        font = (peek.fstack.depth < 0 ? penum_s->pgs->font :
+                peek.fstack.items[peek.fstack.depth].font);
+        if (font != (gs_font *)pbfont)
+            break;
+        if (glyph == GS_NO_GLYPH)
+            glyph = (*penum_s->encode_char)(font, chr, GLYPH_SPACE_NAME);
+        if (glyph == GS_NO_GLYPH)
+            continue;
+        if (penum_s->pair != NULL) {
+            gs_fixed_point subpix_origin;
+
+            subpix_origin.x = subpix_origin.y = 0;
+            if (gx_lookup_cached_char(font, penum_s->pair, glyph, wmode,
+                                      depth, &subpix_origin) != NULL)
+                continue;
+        }
+        if (pbfont->FontType == ft_CID_TrueType) {
+            gs_font_cid2 *pfcid = (gs_font_cid2 *)pbfont;
+
+            code = pfcid->cidata.CIDMap_proc(pfcid, glyph);
+            if (code < 0)
+                continue;
+            gid = code;
+        }
+        else {
+            gs_font_type42 *pfont42 = (gs_font_type42 *)pbfont;
+
+            gid = pfont42->data.get_glyph_index(pfont42, glyph);
+        }
+        for (j = 0; j < count; j++)
+            if (gids[j] == gid)
+                break;
+        if (j == count)
+            gids[count++] = gid;
+    }
+    if (count == 0)
+        return 0;
+    return I->prefetch_chars(I, &I->ff, cr, gids, count, num_threads);
+}
+
 int
 gs_fapi_do_char(gs_font *pfont, gs_gstate *pgs, gs_text_enum_t *penum, char *font_file_path,
                 bool bBuildGlyph, gs_string *charstring, gs_string *glyphname,
@@ -1217,6 +1297,9 @@ gs_fapi_do_char(gs_font *pfont, gs_gstate *pgs, gs_text_enum_t *penum, char *fon
     bool imagenow = false;
     bool align_to_pixels = gs_currentaligntopixels(pbfont->dir);
     gs_memory_t *mem = pfont->memory;
+
+    extern_st(st_gs_show_enum);
+
     enum
     {
         SBW_DONE,
@@ -1521,6 +1604,16 @@ gs_fapi_do_char(gs_font *pfont, gs_gstate *pgs, gs_text_enum_t *penum, char *fon
         code = I->get_char_outline_metrics(I, &I->ff, &cr, &metrics);
     }
     else {
+        if (I->prefetch_chars != NULL && pbfont->dir->glyph_rendering_threads > 0
+            && (pbfont->FontType == ft_TrueType || pbfont->FontType == ft_CID_TrueType)
+            && font_file_path == NULL && cr.is_glyph_index
+            && cr.metrics_type == gs_fapi_metrics_notdef
+            && gs_object_type(penum->memory, penum) == &st_gs_show_enum
+            && penum_s->charpath_flag == cpm_show && SHOW_IS_DRAWING(penum_s)) {
+            code = fapi_prefetch_chars(I, penum_s, pbfont, &cr, &log2_scale, alpha_bits);
+            if (code < 0)
+                return code;
+        }
         code = I->get_char_raster_metrics(I, &I->ff, &cr, &metrics);
         /* A VMerror could be a real out of memory, or the glyph being too big for a bitmap
          * so it's worth retrying as an outline glyph
@@ -354,6 +354,10 @@ struct gs_fapi_server_s
     gs_fapi_retcode(*check_cmap_for_GID) (gs_fapi_server *server, uint *index);
     gs_fapi_retcode(*get_font_info) (gs_fapi_server *server, gs_fapi_font *ff, gs_fapi_font_info item, int index, void *data, int *datalen);
     gs_fapi_retcode(*set_mm_weight_vector) (gs_fapi_server *server, gs_fapi_font *ff, float *wvector, int length);
+    gs_fapi_retcode(*prefetch_chars) (gs_fapi_server *server, gs_fapi_font *ff, const gs_fapi_char_ref *c, const uint *gids, int count, int num_threads);
+    int version;                /* Version of the renderer once ensure_open has */
+                                /* succeeded, 0 if not known. Rasters made by */
+                                /* different versions may differ. */
 
     /*  Some people get confused with terms "font cache" and "character cache".
        "font cache" means a cache for scaled font objects, which mainly
@@ -374,6 +378,16 @@ struct gs_fapi_server_s
        Therefore calls from GS to these functions must not
        interfer with different characters.
      */
+    /*  prefetch_chars may be NULL. Otherwise it is given the glyph indices
+       that are expected to follow the character c in the text being shown,
+       and may rasterise them on num_threads threads of its own while GS goes
+       on with c, so that later get_char_raster_metrics calls for them only
+       pick up the result. If gids is NULL, it only reports whether c is
+       already among the glyphs being prefetched (1) or not (0).
+       The prefetched rasters must be identical to the ones that would be
+       rendered otherwise; a glyph the server can't guarantee this for
+       is simply left to be rendered when it is asked for.
+     */
 };
 
 /* The font type 10 (ft_CID_user_defined) must not pass to FAPI. */
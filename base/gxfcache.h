@@ -38,6 +38,7 @@ typedef struct gx_ttfReader_s gx_ttfReader;
 typedef struct ttfInterpreter_s ttfInterpreter;
 typedef struct gx_ttfMemory_s gx_ttfMemory;
 typedef struct gx_device_spot_analyzer_s gx_device_spot_analyzer;
+typedef struct gx_char_file_s gx_char_file;
 
 /*
  * Define the entry for a cached (font,matrix) pair.  If the UID
@@ -66,6 +67,9 @@ struct cached_fm_pair_s {
     gx_ttfReader *ttr;		/* True Type interpreter data. */
     bool design_grid;           /* A charpath font face.  */
     uint prev, next;            /* list of pairs. */
+    gx_char_file *cfile;	/* shared character file (not traced, */
+                                /* see gxccfile.c) */
+    bool cfile_tried;		/* true if we looked for cfile */
 };
 
 #define private_st_cached_fm_pair() /* in gxccman.c */\
@@ -82,7 +86,8 @@ struct cached_fm_pair_s {
 #define fm_pair_set_free(pair)\
   ((pair)->font = 0, uid_set_invalid(&(pair)->UID))
 #define fm_pair_init(pair)\
-  (fm_pair_set_free(pair), (pair)->xfont_tried = false, (pair)->xfont = 0)
+  (fm_pair_set_free(pair), (pair)->xfont_tried = false, (pair)->xfont = 0,\
+   (pair)->cfile = 0, (pair)->cfile_tried = false)
 
 /* The font/matrix pair cache itself. */
 typedef struct fm_pair_cache_s {
@@ -260,6 +265,10 @@ struct gs_font_dir_s {
     gx_ttfMemory *ttm;
     /* User parameter GridFitTT. */
     uint grid_fit_tt;
+    /* User parameter GlyphCacheDir, or NULL (see gxccfile.c). */
+    char *glyph_cache_dir;
+    /* User parameter GlyphRenderingThreads. */
+    uint glyph_rendering_threads;
     gx_device_spot_analyzer *san;
     int (*global_glyph_code)(const gs_memory_t *mem, gs_const_string *gstr, gs_glyph *pglyph);
     ulong text_enum_id; /* debug purpose only. */
@@ -303,6 +312,15 @@ int  gx_provide_fm_pair_attributes(gs_font_dir * dir,
                bool design_grid);
 int  gx_touch_fm_pair(gs_font_dir *dir, cached_fm_pair *pair);
 
+/* Shared on-disk character cache procedures (in gxccfile.c) */
+cached_char *gx_char_file_lookup(gs_font_dir *dir, gs_font *font,
+                                 cached_fm_pair *pair, gs_glyph glyph,
+                                 int wmode, int depth,
+                                 const gs_fixed_point *subpix_origin);
+void gx_char_file_add(gs_font_dir *dir, cached_char *cc, cached_fm_pair *pair);
+void gx_char_file_release(gs_font_dir *dir, cached_fm_pair *pair);
+void gx_char_file_release_all(gs_font_dir *dir);
+
 void gs_clean_fm_pair(gs_font_dir * dir, cached_fm_pair * pair);
 int  gs_purge_fm_pair(gs_font_dir *, cached_fm_pair *, int);
 int  gs_purge_font_from_char_caches(gs_font *);
@@ -44,9 +44,39 @@
 #endif
 #define fastfloor(x) (((int)(x)) - (((x)<0) && ((x) != (float)(int)(x))))
 
+/* SSE2 is found by configure. The AVX2 kernels are built along with the
+ * SSE2 ones and picked at run time, when the CPU has AVX2, by gcc and clang
+ * builds; other compilers use them only when targeting AVX2 throughout.
+ * NEON is used whenever the compiler targets it (any AArch64 build, for
+ * instance). The NEON kernels pair bytes through 16 bit lanes, so need a
+ * little endian target. */
+#if defined(HAVE_SSE2) && defined(__AVX2__)
+#define GX_HT_AVX2
+#define GX_HT_AVX2_TARGET
+#define gx_ht_have_avx2() 1
+#elif defined(HAVE_SSE2) && (defined(__clang__) || (defined(__GNUC__) && \
+                             (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define GX_HT_AVX2
+#define GX_HT_AVX2_TARGET __attribute__((target("avx2")))
+#define gx_ht_have_avx2() __builtin_cpu_supports("avx2")
+#endif
+#if !defined(HAVE_SSE2) && (defined(__ARM_NEON) || defined(__ARM_NEON__)) && !ARCH_IS_BIG_ENDIAN
+#define GX_HT_NEON
+#endif
+#if defined(HAVE_SSE2) || defined(GX_HT_NEON)
+#define GX_HT_SIMD
+#endif
+
+#ifdef GX_HT_NEON
+#include <arm_neon.h>
+#endif
+
 #ifdef HAVE_SSE2
 
 #include <emmintrin.h>
+#ifdef GX_HT_AVX2
+#include <immintrin.h>
+#endif
 
 static const byte bitreverse[] =
 { 0x00, 0x80, 0x40, 0xC0, 0x20, 0xA0, 0x60, 0xE0, 0x10, 0x90, 0x50, 0xD0,
@@ -102,7 +132,7 @@ gx_ht_threshold_row_byte(byte *contone, byte *threshold_strip, int contone_strid
 }
 #endif
 
-#ifndef HAVE_SSE2
+#ifndef GX_HT_SIMD
 /* A simple case for use in the landscape mode. Could probably be coded up
    faster */
 static void
@@ -122,7 +152,9 @@ threshold_16_bit(byte *contone_ptr, byte *thresh_ptr, byte *ht_data)
         *ht_data++ = h;
     }
 }
-#else
+#endif
+
+#ifdef HAVE_SSE2
 /* Note this function has strict data alignment needs */
 static void
 threshold_16_SSE(byte *contone_ptr, byte *thresh_ptr, byte *ht_data)
@@ -176,6 +208,66 @@ threshold_16_SSE_unaligned(byte *contone_ptr, byte *thresh_ptr, byte *ht_data)
     ht_data[0] = bitreverse[sse_data[0]];
     ht_data[1] = bitreverse[sse_data[1]];
 }
+
+#ifdef GX_HT_AVX2
+/* Pairs of 16 sample tiles, 32 samples at a time. No alignment needs. */
+static GX_HT_AVX2_TARGET void
+threshold_32_AVX2(const byte *contone_ptr, const byte *thresh_ptr, byte *ht_data,
+                  int num_pairs)
+{
+    const __m256i sign_fix = _mm256_set1_epi8((char)0x80);
+    __m256i input1;
+    __m256i input2;
+    unsigned int result_int;
+
+    for (; num_pairs > 0; num_pairs--) {
+        input1 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)contone_ptr), sign_fix);
+        input2 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)thresh_ptr), sign_fix);
+        /* Set where contone < thresh */
+        result_int = (unsigned int)_mm256_movemask_epi8(_mm256_cmpgt_epi8(input2, input1));
+        ht_data[0] = bitreverse[result_int & 0xff];
+        ht_data[1] = bitreverse[(result_int >> 8) & 0xff];
+        ht_data[2] = bitreverse[(result_int >> 16) & 0xff];
+        ht_data[3] = bitreverse[result_int >> 24];
+        contone_ptr += 32;
+        thresh_ptr += 32;
+        ht_data += 4;
+    }
+}
+#endif
+
+#define threshold_16 threshold_16_SSE
+#define threshold_16_unaligned threshold_16_SSE_unaligned
+#endif
+
+#ifdef GX_HT_NEON
+/* Set bits where contone < thresh, MSB first. No alignment needs. */
+static void
+threshold_16_NEON(const byte *contone_ptr, const byte *thresh_ptr, byte *ht_data)
+{
+    static const uint8_t weights[16] = {
+        0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+        0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01
+    };
+    uint8x16_t mask;
+    uint8x8_t sum;
+
+    mask = vcltq_u8(vld1q_u8(contone_ptr), vld1q_u8(thresh_ptr));
+    mask = vandq_u8(mask, vld1q_u8(weights));
+    /* Add up each half; the weights are distinct bits so nothing carries */
+    sum = vpadd_u8(vget_low_u8(mask), vget_high_u8(mask));
+    sum = vpadd_u8(sum, sum);
+    sum = vpadd_u8(sum, sum);
+    ht_data[0] = vget_lane_u8(sum, 0);
+    ht_data[1] = vget_lane_u8(sum, 1);
+}
+
+#define threshold_16 threshold_16_NEON
+#define threshold_16_unaligned threshold_16_NEON
+#endif
+
+#ifndef GX_HT_SIMD
+#define threshold_16 threshold_16_bit
 #endif
 
 /* SSE2 and non-SSE2 implememntation of thresholding a row. Subtractive case
@@ -187,7 +279,7 @@ gx_ht_threshold_row_bit_sub(byte *contone,  byte *threshold_strip,  int contone_
                   byte *halftone, int dithered_stride, int width,
                   int num_rows, int offset_bits)
 {
-#ifndef HAVE_SSE2
+#ifndef GX_HT_SIMD
     int k, j;
     byte *contone_ptr;
     byte *thresh_ptr;
@@ -267,8 +359,8 @@ gx_ht_threshold_row_bit_sub(byte *contone,  byte *threshold_strip,  int contone_
                requires 128 bit alignment.  contone_ptr and thresh_ptr
                are set up so that after we move in by offset_bits elements
                then we are 128 bit aligned.  */
-            threshold_16_SSE_unaligned(thresh_ptr, contone_ptr,
-                                       halftone_ptr);
+            threshold_16_unaligned(thresh_ptr, contone_ptr,
+                                   halftone_ptr);
             halftone_ptr += 2;
             thresh_ptr += offset_bits;
             contone_ptr += offset_bits;
@@ -276,8 +368,18 @@ gx_ht_threshold_row_bit_sub(byte *contone,  byte *threshold_strip,  int contone_
         /* Now we should have 128 bit aligned with our input data. Iterate
            over sets of 16 going directly into our HT buffer.  Sources and
            halftone_ptr buffers should be padded to allow 15 bit overrun */
-        for (k = 0; k < num_tiles; k++) {
-            threshold_16_SSE(thresh_ptr, contone_ptr, halftone_ptr);
+        k = num_tiles;
+#ifdef GX_HT_AVX2
+        if (k >= 2 && gx_ht_have_avx2()) {
+            threshold_32_AVX2(thresh_ptr, contone_ptr, halftone_ptr, k >> 1);
+            thresh_ptr += (k & ~1) * 16;
+            contone_ptr += (k & ~1) * 16;
+            halftone_ptr += (k & ~1) * 2;
+            k &= 1;
+        }
+#endif
+        for (; k > 0; k--) {
+            threshold_16(thresh_ptr, contone_ptr, halftone_ptr);
             thresh_ptr += 16;
             contone_ptr += 16;
             halftone_ptr += 2;
@@ -292,7 +394,7 @@ gx_ht_threshold_row_bit(byte *contone,  byte *threshold_strip,  int contone_stri
                   byte *halftone, int dithered_stride, int width,
                   int num_rows, int offset_bits)
 {
-#ifndef HAVE_SSE2
+#ifndef GX_HT_SIMD
     int k, j;
     byte *contone_ptr;
     byte *thresh_ptr;
@@ -372,8 +474,8 @@ gx_ht_threshold_row_bit(byte *contone,  byte *threshold_strip,  int contone_stri
                requires 128 bit alignment.  contone_ptr and thresh_ptr
                are set up so that after we move in by offset_bits elements
                then we are 128 bit aligned.  */
-            threshold_16_SSE_unaligned(contone_ptr, thresh_ptr,
-                                       halftone_ptr);
+            threshold_16_unaligned(contone_ptr, thresh_ptr,
+                                   halftone_ptr);
             halftone_ptr += 2;
             thresh_ptr += offset_bits;
             contone_ptr += offset_bits;
@@ -381,8 +483,18 @@ gx_ht_threshold_row_bit(byte *contone,  byte *threshold_strip,  int contone_stri
         /* Now we should have 128 bit aligned with our input data. Iterate
            over sets of 16 going directly into our HT buffer.  Sources and
            halftone_ptr buffers should be padded to allow 15 bit overrun */
-        for (k = 0; k < num_tiles; k++) {
-            threshold_16_SSE(contone_ptr, thresh_ptr, halftone_ptr);
+        k = num_tiles;
+#ifdef GX_HT_AVX2
+        if (k >= 2 && gx_ht_have_avx2()) {
+            threshold_32_AVX2(contone_ptr, thresh_ptr, halftone_ptr, k >> 1);
+            thresh_ptr += (k & ~1) * 16;
+            contone_ptr += (k & ~1) * 16;
+            halftone_ptr += (k & ~1) * 2;
+            k &= 1;
+        }
+#endif
+        for (; k > 0; k--) {
+            threshold_16(contone_ptr, thresh_ptr, halftone_ptr);
             thresh_ptr += 16;
             contone_ptr += 16;
             halftone_ptr += 2;
@@ -465,11 +577,7 @@ gx_ht_threshold_landscape_sub(byte *contone_align, byte *thresh_align,
         j = LAND_BITS;
         do {
 #endif
-#ifdef HAVE_SSE2
-            threshold_16_SSE(thresh_ptr, contone_ptr, halftone_ptr);
-#else
-            threshold_16_bit(thresh_ptr, contone_ptr, halftone_ptr);
-#endif
+            threshold_16(thresh_ptr, contone_ptr, halftone_ptr);
             thresh_ptr += 16;
             position += 16;
             halftone_ptr += 2;
@@ -556,11 +664,7 @@ gx_ht_threshold_landscape(byte *contone_align, byte *thresh_align,
         j = LAND_BITS;
         do {
 #endif
-#ifdef HAVE_SSE2
-            threshold_16_SSE(contone_ptr, thresh_ptr, halftone_ptr);
-#else
-            threshold_16_bit(contone_ptr, thresh_ptr, halftone_ptr);
-#endif
+            threshold_16(contone_ptr, thresh_ptr, halftone_ptr);
             thresh_ptr += 16;
             position += 16;
             halftone_ptr += 2;
@@ -572,6 +676,236 @@ gx_ht_threshold_landscape(byte *contone_align, byte *thresh_align,
     }
 }
 
+/* Multilevel thresholding of a row, for 1, 2 and 4 bit screens. Each sample
+   is quantised to (contone * max + 254 - thresh) / 255 (clamped at 0), where
+   max = (1 << bpc) - 1, so a flat threshold array of 127 gives plain
+   rounding, and with 1 bit this is simply contone > thresh. Output is packed
+   most significant bits first. The vector versions below work on whole
+   output bytes and return the number of samples handled; the C loop in
+   gx_ht_threshold_row_levels finishes the row. */
+#ifdef HAVE_SSE2
+static inline __m128i
+quotient_255_SSE(__m128i x)
+{
+    /* x / 255 for 0 <= x < 4335. x wraps to 0xffff for -1, giving 0. */
+    x = _mm_add_epi16(_mm_add_epi16(x, _mm_set1_epi16(1)), _mm_srli_epi16(x, 8));
+    return _mm_srli_epi16(x, 8);
+}
+
+static inline __m128i
+levels_16_SSE(__m128i c, __m128i t, __m128i max)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16(254);
+    __m128i lo, hi;
+
+    lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(c, zero), max), bias);
+    hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(c, zero), max), bias);
+    lo = quotient_255_SSE(_mm_sub_epi16(lo, _mm_unpacklo_epi8(t, zero)));
+    hi = quotient_255_SSE(_mm_sub_epi16(hi, _mm_unpackhi_epi8(t, zero)));
+    return _mm_packus_epi16(lo, hi);
+}
+
+/* Combine neighbouring values into one byte as (even << shift) | odd. The
+   8 result bytes are in the low half. */
+static inline __m128i
+pack_pairs_SSE(__m128i v, int shift)
+{
+    __m128i even = _mm_and_si128(v, _mm_set1_epi16(0xff));
+    __m128i odd = _mm_srli_epi16(v, 8);
+
+    v = _mm_or_si128(_mm_sll_epi16(even, _mm_cvtsi32_si128(shift)), odd);
+    return _mm_packus_epi16(v, v);
+}
+
+#ifdef GX_HT_AVX2
+static inline GX_HT_AVX2_TARGET __m256i
+quotient_255_AVX2(__m256i x)
+{
+    x = _mm256_add_epi16(_mm256_add_epi16(x, _mm256_set1_epi16(1)), _mm256_srli_epi16(x, 8));
+    return _mm256_srli_epi16(x, 8);
+}
+
+/* 32 levels, in order */
+static inline GX_HT_AVX2_TARGET __m256i
+levels_32_AVX2(const byte *contone_ptr, const byte *thresh_ptr, __m256i max)
+{
+    const __m256i bias = _mm256_set1_epi16(254);
+    __m128i c0 = _mm_loadu_si128((const __m128i *)contone_ptr);
+    __m128i c1 = _mm_loadu_si128((const __m128i *)(contone_ptr + 16));
+    __m128i t0 = _mm_loadu_si128((const __m128i *)thresh_ptr);
+    __m128i t1 = _mm_loadu_si128((const __m128i *)(thresh_ptr + 16));
+    __m256i lo, hi;
+
+    lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_cvtepu8_epi16(c0), max), bias);
+    hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_cvtepu8_epi16(c1), max), bias);
+    lo = quotient_255_AVX2(_mm256_sub_epi16(lo, _mm256_cvtepu8_epi16(t0)));
+    hi = quotient_255_AVX2(_mm256_sub_epi16(hi, _mm256_cvtepu8_epi16(t1)));
+    /* packus works within 128 bit lanes, so put the quadwords back in order */
+    return _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8);
+}
+
+/* As threshold_levels_SSE, 32 samples at a time */
+static GX_HT_AVX2_TARGET int
+threshold_levels_AVX2(byte *contone, byte *thresh, byte *halftone, int width,
+                      int bpc)
+{
+    const __m256i max = _mm256_set1_epi16((1 << bpc) - 1);
+    int i = 0;
+    __m256i v;
+    __m128i v0, v1;
+
+    if (bpc == 1) {
+        threshold_32_AVX2(thresh, contone, halftone, width >> 5);
+        return width & ~31;
+    }
+    for (; i + 32 <= width; i += 32) {
+        v = levels_32_AVX2(contone + i, thresh + i, max);
+        v0 = _mm256_castsi256_si128(v);
+        v1 = _mm256_extracti128_si256(v, 1);
+        if (bpc == 4) {
+            _mm_storel_epi64((__m128i *)halftone, pack_pairs_SSE(v0, 4));
+            _mm_storel_epi64((__m128i *)(halftone + 8), pack_pairs_SSE(v1, 4));
+            halftone += 16;
+        } else {
+            v0 = _mm_unpacklo_epi64(pack_pairs_SSE(v0, 2), pack_pairs_SSE(v1, 2));
+            _mm_storel_epi64((__m128i *)halftone, pack_pairs_SSE(v0, 4));
+            halftone += 8;
+        }
+    }
+    return i;
+}
+#endif
+
+static int
+threshold_levels_SSE(byte *contone, byte *thresh, byte *halftone, int width,
+                     int bpc)
+{
+    const __m128i max = _mm_set1_epi16((1 << bpc) - 1);
+    int i = 0;
+    __m128i v0, v1;
+
+#ifdef GX_HT_AVX2
+    if (gx_ht_have_avx2()) {
+        i = threshold_levels_AVX2(contone, thresh, halftone, width, bpc);
+        halftone += (i * bpc) >> 3;
+    }
+#endif
+    if (bpc == 1) {
+        for (; i + 16 <= width; i += 16, halftone += 2)
+            threshold_16_SSE_unaligned(thresh + i, contone + i, halftone);
+        return i;
+    }
+    if (bpc == 4) {
+        for (; i + 16 <= width; i += 16, halftone += 8) {
+            v0 = levels_16_SSE(_mm_loadu_si128((const __m128i *)(contone + i)),
+                               _mm_loadu_si128((const __m128i *)(thresh + i)), max);
+            _mm_storel_epi64((__m128i *)halftone, pack_pairs_SSE(v0, 4));
+        }
+    } else {
+        for (; i + 32 <= width; i += 32, halftone += 8) {
+            v0 = levels_16_SSE(_mm_loadu_si128((const __m128i *)(contone + i)),
+                               _mm_loadu_si128((const __m128i *)(thresh + i)), max);
+            v1 = levels_16_SSE(_mm_loadu_si128((const __m128i *)(contone + i + 16)),
+                               _mm_loadu_si128((const __m128i *)(thresh + i + 16)), max);
+            v0 = _mm_unpacklo_epi64(pack_pairs_SSE(v0, 2), pack_pairs_SSE(v1, 2));
+            _mm_storel_epi64((__m128i *)halftone, pack_pairs_SSE(v0, 4));
+        }
+    }
+    return i;
+}
+#define threshold_levels_simd threshold_levels_SSE
+#endif
+
+#ifdef GX_HT_NEON
+static inline uint8x8_t
+levels_8_NEON(uint8x8_t c, uint8x8_t t, uint8x8_t max)
+{
+    uint16x8_t x = vmlal_u8(vdupq_n_u16(254), c, max);
+
+    /* As for SSE: -1 wraps to 0xffff, which divides to 0 */
+    x = vsubw_u8(x, t);
+    x = vaddq_u16(vaddq_u16(x, vdupq_n_u16(1)), vshrq_n_u16(x, 8));
+    return vshrn_n_u16(x, 8);
+}
+
+static inline uint8x16_t
+levels_16_NEON(const byte *contone_ptr, const byte *thresh_ptr, uint8x8_t max)
+{
+    uint8x16_t c = vld1q_u8(contone_ptr);
+    uint8x16_t t = vld1q_u8(thresh_ptr);
+
+    return vcombine_u8(levels_8_NEON(vget_low_u8(c), vget_low_u8(t), max),
+                       levels_8_NEON(vget_high_u8(c), vget_high_u8(t), max));
+}
+
+/* (even << shift) | odd for each pair of bytes */
+static inline uint8x8_t
+pack_pairs_NEON(uint8x16_t v, int shift)
+{
+    uint16x8_t w = vreinterpretq_u16_u8(v);
+
+    return vorr_u8(vshl_u8(vmovn_u16(w), vdup_n_s8(shift)), vshrn_n_u16(w, 8));
+}
+
+static int
+threshold_levels_NEON(byte *contone, byte *thresh, byte *halftone, int width,
+                      int bpc)
+{
+    const uint8x8_t max = vdup_n_u8((1 << bpc) - 1);
+    int i = 0;
+    uint8x16_t v0, v1;
+
+    if (bpc == 1) {
+        for (; i + 16 <= width; i += 16, halftone += 2)
+            threshold_16_NEON(thresh + i, contone + i, halftone);
+    } else if (bpc == 4) {
+        for (; i + 16 <= width; i += 16, halftone += 8) {
+            v0 = levels_16_NEON(contone + i, thresh + i, max);
+            vst1_u8(halftone, pack_pairs_NEON(v0, 4));
+        }
+    } else {
+        for (; i + 32 <= width; i += 32, halftone += 8) {
+            v0 = levels_16_NEON(contone + i, thresh + i, max);
+            v1 = levels_16_NEON(contone + i + 16, thresh + i + 16, max);
+            v0 = vcombine_u8(pack_pairs_NEON(v0, 2), pack_pairs_NEON(v1, 2));
+            vst1_u8(halftone, pack_pairs_NEON(v0, 4));
+        }
+    }
+    return i;
+}
+#define threshold_levels_simd threshold_levels_NEON
+#endif
+
+void
+gx_ht_threshold_row_levels(byte *contone, byte *thresh, byte *halftone,
+                           int width, int bpc)
+{
+    int max = (1 << bpc) - 1;
+    int shift = 8 - bpc;
+    int i = 0;
+    int v;
+    byte acc = 0;
+
+#ifdef GX_HT_SIMD
+    i = threshold_levels_simd(contone, thresh, halftone, width, bpc);
+    halftone += (i * bpc) >> 3;
+#endif
+    for (; i < width; i++) {
+        v = contone[i] * max + 254 - thresh[i];
+        if (v > 0)
+            acc |= (v / 255) << shift;
+        shift -= bpc;
+        if (shift < 0) {
+            *halftone++ = acc;
+            acc = 0;
+            shift = 8 - bpc;
+        }
+    }
+    if (shift != 8 - bpc)
+        *halftone = acc;
+}
+
 int
 gxht_thresh_image_init(gx_image_enum *penum)
 {
@@ -843,7 +1177,10 @@ reset_landscape_buffer(ht_landscape_info_t *ht_landscape, byte *contone_align,
 
 /* This performs a thresholding operation on multiple planes of data and
    stores the bits into a planar buffer which can then be used for
-   copy_planes */
+   copy_planes.  Only 1 bit per component devices get here (see the tests
+   in gximono.c and gxicolor.c): images on 2 and 4 bit halftoned devices
+   still go through the tiled halftones, as gx_ht_threshold_row_levels is
+   only used by the downscaler so far. */
 int
 gxht_thresh_planes(gx_image_enum *penum, fixed xrun,
                    int dest_width, int dest_height,
@@ -47,6 +47,10 @@ void gx_ht_threshold_landscape(byte *contone_align, byte *thresh_align,
 void gx_ht_threshold_landscape_sub(byte *contone_align, byte *thresh_align,
                     ht_landscape_info_t *ht_landscape, byte *halftone,
                     int data_length);
+/* Quantise a row of 8 bit contone against a threshold row of the same
+   width to 1, 2 or 4 bits per sample, packed, 255 being full coverage. */
+void gx_ht_threshold_row_levels(byte *contone, byte *thresh, byte *halftone,
+                                int width, int bpc);
 int gxht_thresh_image_init(gx_image_enum *penum);
 int gxht_thresh_planes(gx_image_enum *penum, fixed xrun, int dest_width,
                        int dest_height, byte *thresh_align, gx_device * dev,
@@ -62,6 +62,7 @@ static irender_proc(image_render_color_icc_tpr);
 static irender_proc(image_render_color_thresh);
 
 static int image_skip_color_icc_tpr(gx_image_enum *penum, gx_device *dev);
+static int image_init_decode_lut(gx_image_enum *penum);
 
 int
 gs_image_class_4_color(gx_image_enum * penum, irender_proc_t *render_fn)
@@ -173,6 +174,11 @@ gs_image_class_4_color(gx_image_enum * penum, irender_proc_t *render_fn)
             penum->use_cie_range = (get_cie_range(penum->pcs) != NULL);
         }
     }
+    if (penum->icc_setup.need_decode && penum->icc_decode_lut == NULL) {
+        code = image_init_decode_lut(penum);
+        if (code < 0)
+            return code;
+    }
     if (gx_device_must_halftone(penum->dev) && use_fast_thresh &&
         (penum->posture == image_portrait || penum->posture == image_landscape)
         && penum->image_parent_type == gs_image_type1) {
@@ -329,15 +335,101 @@ decode_row(const gx_image_enum *penum, const byte *psrc, int spp, byte *pdes,
     }
 }
 
+/* Decode is a fixed function of each component's 8 bit sample, so run
+   decode_row once over all 256 values and keep the results as a table.
+   Rows are then decoded with one lookup per sample. */
+static int
+image_init_decode_lut(gx_image_enum *penum)
+{
+    int spp = penum->spp;
+    byte *samples, *decoded, *lut;
+    int k, v;
+
+    samples = gs_alloc_bytes(penum->memory, 512 * spp, "image_init_decode_lut");
+    lut = gs_alloc_bytes(penum->memory, 256 * spp, "image icc_decode_lut");
+    if (samples == NULL || lut == NULL) {
+        gs_free_object(penum->memory, samples, "image_init_decode_lut");
+        gs_free_object(penum->memory, lut, "image icc_decode_lut");
+        return_error(gs_error_VMerror);
+    }
+    decoded = samples + 256 * spp;
+    for (v = 0; v < 256; v++)
+        memset(samples + v * spp, v, spp);
+    if (!penum->use_cie_range) {
+        decode_row(penum, samples, spp, decoded, decoded + 256 * spp);
+    } else {
+        decode_row_cie(penum, samples, spp, decoded, decoded + 256 * spp,
+                       get_cie_range(penum->pcs));
+    }
+    for (k = 0; k < spp; k++)
+        for (v = 0; v < 256; v++)
+            lut[k * 256 + v] = decoded[v * spp + k];
+    gs_free_object(penum->memory, samples, "image_init_decode_lut");
+    penum->icc_decode_lut = lut;
+    return 0;
+}
+
+static void
+decode_row_lut(const byte *lut, const byte *psrc, int spp, byte *pdes,
+               byte *bufend)
+{
+    int k;
+
+    switch (spp) {
+        case 1:
+            while (pdes < bufend)
+                *pdes++ = lut[*psrc++];
+            break;
+        case 3:
+            while (pdes < bufend) {
+                pdes[0] = lut[psrc[0]];
+                pdes[1] = lut[256 + psrc[1]];
+                pdes[2] = lut[512 + psrc[2]];
+                pdes += 3;
+                psrc += 3;
+            }
+            break;
+        case 4:
+            while (pdes < bufend) {
+                pdes[0] = lut[psrc[0]];
+                pdes[1] = lut[256 + psrc[1]];
+                pdes[2] = lut[512 + psrc[2]];
+                pdes[3] = lut[768 + psrc[3]];
+                pdes += 4;
+                psrc += 4;
+            }
+            break;
+        default:
+            while (pdes < bufend)
+                for (k = 0; k < spp; k++)
+                    *pdes++ = lut[k * 256 + *psrc++];
+    }
+}
+
+/* The decode and color converted rows live in a buffer kept with the
+   enumerator, so that we do not allocate for every row. */
+static byte *
+image_icc_buffer(gx_image_enum *penum, uint size)
+{
+    if (penum->icc_buffer_size < size) {
+        gs_free_object(penum->memory, penum->icc_buffer, "image icc_buffer");
+        penum->icc_buffer_size = 0;
+        penum->icc_buffer = gs_alloc_bytes(penum->memory, size,
+                                           "image icc_buffer");
+        if (penum->icc_buffer == NULL)
+            return NULL;
+        penum->icc_buffer_size = size;
+    }
+    return penum->icc_buffer;
+}
+
 /* Common code shared amongst the thresholding and non thresholding color image
    renderers */
 static int
-image_color_icc_prep(gx_image_enum *penum_orig, const byte *psrc, uint w,
+image_color_icc_prep(gx_image_enum *penum, const byte *psrc, uint w,
                      gx_device *dev, int *spp_cm_out, byte **psrc_cm,
-                     byte **psrc_cm_start, byte **bufend, bool planar_out)
+                     byte **bufend, bool planar_out)
 {
-    const gx_image_enum *const penum = penum_orig; /* const within proc */
-    const gs_gstate *pgs = penum->pgs;
     bool need_decode = penum->icc_setup.need_decode;
     gsicc_bufferdesc_t input_buff_desc;
     gsicc_bufferdesc_t output_buff_desc;
@@ -350,6 +442,7 @@ image_color_icc_prep(gx_image_enum *penum_orig, const byte *psrc, uint w,
     byte *psrc_decode;
     const byte *planar_src;
     byte *planar_des;
+    uint cm_size;
     int j, k;
     int width;
 
@@ -372,35 +465,30 @@ image_color_icc_prep(gx_image_enum *penum_orig, const byte *psrc, uint w,
         *psrc_cm = (unsigned char *) psrc;
         spp_cm = spp;
         *bufend = *psrc_cm + w;
-        *psrc_cm_start = NULL;
     } else {
         spp_cm = num_des_comps;
-        *psrc_cm = gs_alloc_bytes(pgs->memory,  w * spp_cm/spp,
-                                  "image_color_icc_prep");
-        *psrc_cm_start = *psrc_cm;
-        *bufend = *psrc_cm +  w * spp_cm/spp;
+        cm_size = w * spp_cm/spp;
+        /* The whole row goes through the decode and the link in one call,
+           any decoded data follows the color managed row in the buffer */
+        *psrc_cm = image_icc_buffer(penum, cm_size + (need_decode ? w : 0));
+        if (*psrc_cm == NULL)
+            return_error(gs_error_VMerror);
+        *bufend = *psrc_cm + cm_size;
+        psrc_decode = *psrc_cm + cm_size;
         if (penum->icc_link->is_identity) {
             if (!force_planar) {
-                /* decode only. no CM.  This is slow but does not happen that often */
-                decode_row(penum, psrc, spp, *psrc_cm, *bufend);
+                /* decode only. no CM. */
+                decode_row_lut(penum->icc_decode_lut, psrc, spp, *psrc_cm, *bufend);
             } else {
                 /* CM is identity but we may need to do decode and then off
                    to planar. The planar out case is only used when coming from
                    imager_render_color_thresh, which is limited to 8 bit case */
                 if (need_decode) {
                     /* Need decode and then to planar */
-                    psrc_decode = gs_alloc_bytes(pgs->memory,  w,
-                                                  "image_color_icc_prep");
-                    if (!penum->use_cie_range) {
-                        decode_row(penum, psrc, spp, psrc_decode, psrc_decode+w);
-                    } else {
-                        /* Decode needs to include adjustment for CIE range */
-                        decode_row_cie(penum, psrc, spp, psrc_decode,
-                                        psrc_decode + w, get_cie_range(penum->pcs));
-                    }
+                    decode_row_lut(penum->icc_decode_lut, psrc, spp,
+                                   psrc_decode, psrc_decode + w);
                     planar_src = psrc_decode;
                 } else {
-                    psrc_decode = NULL;
                     planar_src = psrc;
                 }
                 /* Now to planar */
@@ -412,11 +500,6 @@ image_color_icc_prep(gx_image_enum *penum_orig, const byte *psrc, uint w,
                     }
                     planar_des++;
                 }
-                /* Free up decode if we used it */
-                if (psrc_decode != NULL) {
-                    gs_free_object(pgs->memory, (byte *) psrc_decode,
-                                   "image_render_color_icc");
-                }
             }
         } else {
             /* Set up the buffer descriptors. planar out always ends up here */
@@ -433,28 +516,15 @@ image_color_icc_prep(gx_image_enum *penum_orig, const byte *psrc, uint w,
                               false, false, true, w/spp, w/spp,
                               1, num_pixels);
             }
-            /* For now, just blast it all through the link. If we had a significant reduction
-               we will want to repack the data first and then do this.  That will be
-               an optimization shortly.  For now just allocate a new output
-               buffer.  We can reuse the old one if the number of channels in the output is
-               less than or equal to the new one.  */
             if (need_decode) {
-                /* Need decode and CM.  This is slow but does not happen that often */
-                psrc_decode = gs_alloc_bytes(pgs->memory, w,
-                                              "image_color_icc_prep");
-                if (!penum->use_cie_range) {
-                    decode_row(penum, psrc, spp, psrc_decode, psrc_decode+w);
-                } else {
-                    /* Decode needs to include adjustment for CIE range */
-                    decode_row_cie(penum, psrc, spp, psrc_decode,
-                                    psrc_decode+w, get_cie_range(penum->pcs));
-                }
+                /* Need decode and CM */
+                decode_row_lut(penum->icc_decode_lut, psrc, spp,
+                               psrc_decode, psrc_decode + w);
                 (penum->icc_link->procs.map_buffer)(dev, penum->icc_link,
                                                     &input_buff_desc,
                                                     &output_buff_desc,
                                                     (void*) psrc_decode,
                                                     (void*) *psrc_cm);
-                gs_free_object(pgs->memory, psrc_decode, "image_color_icc_prep");
             } else {
                 /* CM only. No decode */
                 (penum->icc_link->procs.map_buffer)(dev, penum->icc_link,
@@ -497,14 +567,14 @@ image_render_color_thresh(gx_image_enum *penum_orig, const byte *buffer, int dat
     int xn, xr;		/* destination position (pixel, not contone buffer offset) */
     int code = 0;
     int spp_cm = 0;
-    byte *psrc_cm = NULL, *psrc_cm_start = NULL;
+    byte *psrc_cm = NULL;
     byte *bufend = NULL;
     int psrc_planestride = w/penum->spp;
 
     if (h != 0 && penum->line_size != 0) {      /* line_size == 0, nothing to do */
         /* Get the buffer into the device color space */
         code = image_color_icc_prep(penum, psrc, w, dev, &spp_cm, &psrc_cm,
-                                    &psrc_cm_start,  &bufend, true);
+                                    &bufend, true);
         if (code < 0)
             return code;
     } else {
@@ -885,11 +955,6 @@ flush:
     code = gxht_thresh_planes(penum, xrun, dest_width, dest_height,
                               thresh_align, dev, offset_contone,
                                contone_stride);
-    /* Free cm buffer, if it was used */
-    if (psrc_cm_start != NULL) {
-        gs_free_object(penum->pgs->memory, (byte *)psrc_cm_start,
-                       "image_render_color_thresh");
-    }
     return code;
 }
 
@@ -911,7 +976,7 @@ image_render_color_icc_tpr(gx_image_enum *penum_orig, const byte *buffer, int da
     int spp = penum->spp;
     const byte *psrc = buffer + data_x * spp;
     int code;
-    byte *psrc_cm = NULL, *psrc_cm_start = NULL;
+    byte *psrc_cm = NULL;
     byte *psrc_cm_initial;
     byte *bufend = NULL;
     int spp_cm = 0;
@@ -923,7 +988,7 @@ image_render_color_icc_tpr(gx_image_enum *penum_orig, const byte *buffer, int da
     if (h == 0)
         return 0;
     code = image_color_icc_prep(penum_orig, psrc, w, dev, &spp_cm, &psrc_cm,
-                                &psrc_cm_start, &bufend, false);
+                                &bufend, false);
     if (code < 0) return code;
     psrc_cm_initial = psrc_cm;
     gx_get_cmapper(&cmapper, pgs, dev, has_transfer, must_halftone, gs_color_select_source);
@@ -933,7 +998,6 @@ image_render_color_icc_tpr(gx_image_enum *penum_orig, const byte *buffer, int da
     data.u.process_data.data_x = 0;
     data.u.process_data.cmapper = &cmapper;
     code = dev_proc(dev, transform_pixel_region)(dev, transform_pixel_region_process_data, &data);
-    gs_free_object(pgs->memory, (byte *)psrc_cm_start, "image_render_color_icc");
 
     if (code < 0) {
         /* Save position if error, in case we resume. */
@@ -514,6 +514,8 @@ gx_image1_end_image(gx_image_enum_common_t * info, bool draw_last)
     if (penum->ht_buffer != NULL) {
         gs_free_object(mem, penum->ht_buffer, "image ht_buffer");
     }
+    gs_free_object(mem, penum->icc_decode_lut, "image icc_decode_lut");
+    gs_free_object(mem, penum->icc_buffer, "image icc_buffer");
     if (penum->clues != NULL) {
         gs_free_object(mem,penum->clues, "image clues");
     }
@@ -294,6 +294,9 @@ struct gx_image_enum_s {
     gx_image_icc_setup_t icc_setup;
     bool use_cie_range;   /* Needed potentially if CS was PS CIE based */
     void *tpr_state;
+    byte *icc_decode_lut;   /* Decoded value of each 8 bit sample, per component */
+    byte *icc_buffer;       /* Row buffer for decode and color conversion */
+    uint icc_buffer_size;
 };
 
 /* Enumerate the pointers in an image enumerator. */
@@ -301,8 +304,8 @@ struct gx_image_enum_s {
   m(0,pgs) m(1,pcs) m(2,dev) m(3,buffer) m(4,line)\
   m(5,clip_dev) m(6,rop_dev) m(7,scaler) m(8,icc_link)\
   m(9,color_cache) m(10,ht_buffer) m(11,thresh_buffer) \
-  m(12,clues)
-#define gx_image_enum_num_ptrs 13
+  m(12,clues) m(13,icc_decode_lut) m(14,icc_buffer)
+#define gx_image_enum_num_ptrs 15
 #define private_st_gx_image_enum() /* in gsimage.c */\
   gs_private_st_composite(st_gx_image_enum, gx_image_enum, "gx_image_enum",\
     image_enum_enum_ptrs, image_enum_reloc_ptrs)
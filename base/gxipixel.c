@@ -810,6 +810,9 @@ gx_image_enum_begin(gx_device * dev, const gs_gstate * pgs,
     penum->color_cache = NULL;
     penum->ht_buffer = NULL;
     penum->thresh_buffer = NULL;
+    penum->icc_decode_lut = NULL;
+    penum->icc_buffer = NULL;
+    penum->icc_buffer_size = 0;
     penum->use_cie_range = false;
     penum->line_size = 0;
     penum->use_rop = lop != (masked ? rop3_T : rop3_S);
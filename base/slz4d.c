@@ -0,0 +1,212 @@
+/* Copyright (C) 2001-2019 Artifex Software, Inc.
+   All Rights Reserved.
+
+   This software is provided AS-IS with no warranty, either express or
+   implied.
+
+   This software is distributed under license and may not be copied,
+   modified or distributed except as expressly authorized under the terms
+   of the license contained in the file LICENSE in this distribution.
+
+   Refer to licensing information at http://www.artifex.com or contact
+   Artifex Software, Inc.,  1305 Grant Avenue - Suite 200, Novato,
+   CA 94945, U.S.A., +1(415)492-9861, for further information.
+*/
+
+
+/* LZ4Decode filter */
+#include "stdio_.h"		/* includes std.h */
+#include "memory_.h"
+#include "strimpl.h"
+#include "slz4x.h"
+
+/* ------ LZ4Decode ------ */
+
+private_st_LZ4D_state();
+
+#define LZ4_MIN_MATCH 4
+
+/* Initialize */
+static int
+s_LZ4D_init(stream_state * st)
+{
+    stream_LZ4D_state *const ss = (stream_LZ4D_state *) st;
+
+    ss->hdr_count = 0;
+    ss->in_count = 0;
+    ss->out_pos = ss->out_count = 0;
+    return 0;
+}
+
+/*
+ * Decompress one LZ4 coded block of n bytes into dst, which has room for
+ * cap bytes.  Return the decoded length, or -1 if the data is invalid.
+ */
+static int
+lz4_decompress_block(const byte *src, uint n, byte *dst, uint cap)
+{
+    const byte *ip = src;
+    const byte *const iend = src + n;
+    byte *op = dst;
+    byte *const oend = dst + cap;
+
+    while (ip < iend) {
+        uint token = *ip++;
+        uint len = token >> 4;
+        uint offset;
+        const byte *ref;
+
+        if (len == 15) {
+            uint b;
+
+            do {
+                if (ip >= iend)
+                    return -1;
+                b = *ip++;
+                len += b;
+            } while (b == 255);
+        }
+        if (len > iend - ip || len > oend - op)
+            return -1;
+        memcpy(op, ip, len);
+        op += len;
+        ip += len;
+        if (ip == iend)
+            break;		/* the last sequence has no match */
+        if (iend - ip < 2)
+            return -1;
+        offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op - dst)
+            return -1;
+        len = token & 15;
+        if (len == 15) {
+            uint b;
+
+            do {
+                if (ip >= iend)
+                    return -1;
+                b = *ip++;
+                len += b;
+            } while (b == 255);
+        }
+        len += LZ4_MIN_MATCH;
+        if (len > oend - op)
+            return -1;
+        ref = op - offset;
+        if (offset >= len) {
+            memcpy(op, ref, len);
+            op += len;
+        } else {
+            /* Overlapping copy, replicates the last offset bytes. */
+            while (len--)
+                *op++ = *ref++;
+        }
+    }
+    return op - dst;
+}
+
+/* Check a block header and set up the lengths in the state. */
+static int
+s_LZ4D_header(stream_LZ4D_state * ss, const byte *hdr)
+{
+    uint coded = (hdr[2] << 8) | hdr[3];
+
+    ss->raw_len = (hdr[0] << 8) | hdr[1];
+    ss->stored = (coded & s_LZ4_STORED) != 0;
+    ss->coded_len = coded & ~s_LZ4_STORED;
+    if (ss->raw_len == 0 || ss->raw_len > s_LZ4_BLOCK_SIZE ||
+        ss->coded_len == 0 || ss->coded_len > s_LZ4_BLOCK_SIZE ||
+        (ss->stored && ss->coded_len != ss->raw_len))
+        return ERRC;
+    return 0;
+}
+
+/* Decode the current block from src into dst. */
+static int
+s_LZ4D_block(stream_LZ4D_state * ss, const byte *src, byte *dst)
+{
+    if (ss->stored)
+        memcpy(dst, src, ss->raw_len);
+    else if (lz4_decompress_block(src, ss->coded_len, dst, ss->raw_len) !=
+             ss->raw_len)
+        return ERRC;
+    return 0;
+}
+
+/* Process a buffer */
+static int
+s_LZ4D_process(stream_state * st, stream_cursor_read * pr,
+               stream_cursor_write * pw, bool last)
+{
+    stream_LZ4D_state *const ss = (stream_LZ4D_state *) st;
+
+    for (;;) {
+        uint avail, count;
+
+        /* Write out any decoded data left over from the last block. */
+        if (ss->out_pos < ss->out_count) {
+            count = min(pw->limit - pw->ptr, ss->out_count - ss->out_pos);
+            memcpy(pw->ptr + 1, ss->out_buf + ss->out_pos, count);
+            pw->ptr += count;
+            ss->out_pos += count;
+            if (ss->out_pos < ss->out_count)
+                return 1;
+        }
+        /* Don't start on another block until there is room for it. */
+        if (pw->ptr == pw->limit)
+            return 1;
+        avail = pr->limit - pr->ptr;
+        if (ss->hdr_count < s_LZ4_HEADER_SIZE) {
+            /*
+             * There is no end-of-data marker, so even if last is set,
+             * running out of input just means we need more.
+             */
+            if (avail == 0)
+                return 0;
+            if (ss->hdr_count == 0 && avail >= s_LZ4_HEADER_SIZE) {
+                if (s_LZ4D_header(ss, pr->ptr + 1) < 0)
+                    return ERRC;
+                if (avail - s_LZ4_HEADER_SIZE >= ss->coded_len &&
+                    pw->limit - pw->ptr >= ss->raw_len) {
+                    /* The whole block is available and fits: */
+                    /* decode it in place. */
+                    if (s_LZ4D_block(ss, pr->ptr + 1 + s_LZ4_HEADER_SIZE,
+                                     pw->ptr + 1) < 0)
+                        return ERRC;
+                    pr->ptr += s_LZ4_HEADER_SIZE + ss->coded_len;
+                    pw->ptr += ss->raw_len;
+                    continue;
+                }
+            }
+            count = min(avail, s_LZ4_HEADER_SIZE - ss->hdr_count);
+            memcpy(ss->hdr + ss->hdr_count, pr->ptr + 1, count);
+            pr->ptr += count;
+            avail -= count;
+            ss->hdr_count += count;
+            if (ss->hdr_count < s_LZ4_HEADER_SIZE)
+                return 0;
+            if (s_LZ4D_header(ss, ss->hdr) < 0)
+                return ERRC;
+            ss->in_count = 0;
+        }
+        /* Collect the coded data for the current block. */
+        count = min(avail, ss->coded_len - ss->in_count);
+        memcpy(ss->in_buf + ss->in_count, pr->ptr + 1, count);
+        pr->ptr += count;
+        ss->in_count += count;
+        if (ss->in_count < ss->coded_len)
+            return 0;
+        if (s_LZ4D_block(ss, ss->in_buf, ss->out_buf) < 0)
+            return ERRC;
+        ss->out_pos = 0;
+        ss->out_count = ss->raw_len;
+        ss->hdr_count = 0;
+    }
+}
+
+/* Stream template */
+const stream_template s_LZ4D_template = {
+    &st_LZ4D_state, s_LZ4D_init, s_LZ4D_process, 1, 1, NULL,
+    NULL, s_LZ4D_init
+};
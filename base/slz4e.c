@@ -0,0 +1,205 @@
+/* Copyright (C) 2001-2019 Artifex Software, Inc.
+   All Rights Reserved.
+
+   This software is provided AS-IS with no warranty, either express or
+   implied.
+
+   This software is distributed under license and may not be copied,
+   modified or distributed except as expressly authorized under the terms
+   of the license contained in the file LICENSE in this distribution.
+
+   Refer to licensing information at http://www.artifex.com or contact
+   Artifex Software, Inc.,  1305 Grant Avenue - Suite 200, Novato,
+   CA 94945, U.S.A., +1(415)492-9861, for further information.
+*/
+
+
+/* LZ4Encode filter */
+#include "stdio_.h"		/* includes std.h */
+#include "memory_.h"
+#include "stdint_.h"
+#include "strimpl.h"
+#include "slz4x.h"
+
+/* ------ LZ4Encode ------ */
+
+private_st_LZ4E_state();
+
+/* Parameters of the LZ4 block format. */
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5	/* the last bytes of a block are literals */
+#define LZ4_MF_LIMIT 12		/* no match may start in the last bytes */
+
+#define LZ4_READ32(p)\
+  ((uint32_t)(p)[0] | ((uint32_t)(p)[1] << 8) |\
+   ((uint32_t)(p)[2] << 16) | ((uint32_t)(p)[3] << 24))
+#define LZ4_HASH(p)\
+  ((LZ4_READ32(p) * 2654435761U) >> (32 - s_LZ4_HASH_BITS))
+
+/* Initialize */
+static int
+s_LZ4E_init(stream_state * st)
+{
+    stream_LZ4E_state *const ss = (stream_LZ4E_state *) st;
+
+    ss->in_count = 0;
+    ss->out_pos = ss->out_count = 0;
+    return 0;
+}
+
+/* Write an LZ4 length continuation (the part of a length >= 15). */
+static byte *
+lz4_put_length(byte *op, uint len)
+{
+    for (; len >= 255; len -= 255)
+        *op++ = 255;
+    *op++ = (byte)len;
+    return op;
+}
+
+/* Emit one sequence: the literals from anchor up to ip, then (if */
+/* match_len != 0) a match of match_len bytes at distance offset. */
+static byte *
+lz4_put_sequence(byte *op, const byte *anchor, const byte *ip,
+                 uint offset, uint match_len)
+{
+    uint lit_len = ip - anchor;
+    byte *token = op++;
+
+    if (lit_len >= 15) {
+        *token = 15 << 4;
+        op = lz4_put_length(op, lit_len - 15);
+    } else
+        *token = (byte)(lit_len << 4);
+    memcpy(op, anchor, lit_len);
+    op += lit_len;
+    if (match_len == 0)
+        return op;
+    *op++ = (byte)offset;
+    *op++ = (byte)(offset >> 8);
+    match_len -= LZ4_MIN_MATCH;
+    if (match_len >= 15) {
+        *token |= 15;
+        op = lz4_put_length(op, match_len - 15);
+    } else
+        *token |= (byte)match_len;
+    return op;
+}
+
+/*
+ * Compress one block of n <= s_LZ4_BLOCK_SIZE bytes.  This is a greedy
+ * single probe match finder, which skips ahead faster the longer it goes
+ * without finding a match, so incompressible data is passed over quickly.
+ * Return the compressed length; dst must have room for
+ * s_LZ4_MAX_FRAME - s_LZ4_HEADER_SIZE bytes.
+ */
+static uint
+lz4_compress_block(ushort *table, const byte *src, uint n, byte *dst)
+{
+    const byte *ip = src;
+    const byte *anchor = src;
+    const byte *const iend = src + n;
+    byte *op = dst;
+
+    if (n > LZ4_MF_LIMIT) {
+        const byte *const mf_limit = iend - LZ4_MF_LIMIT;
+        const byte *const match_limit = iend - LZ4_LAST_LITERALS;
+
+        memset(table, 0, sizeof(ushort) << s_LZ4_HASH_BITS);
+        ip++;
+        while (ip < mf_limit) {
+            uint h = LZ4_HASH(ip);
+            const byte *ref = src + table[h];
+            uint len;
+
+            table[h] = (ushort)(ip - src);
+            if (ref >= ip || LZ4_READ32(ref) != LZ4_READ32(ip)) {
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+            /* Extend the match backwards over pending literals, */
+            /* then forwards. */
+            while (ip > anchor && ref > src && ip[-1] == ref[-1])
+                ip--, ref--;
+            len = LZ4_MIN_MATCH;
+            while (ip + len < match_limit && ip[len] == ref[len])
+                len++;
+            op = lz4_put_sequence(op, anchor, ip, ip - ref, len);
+            ip += len;
+            anchor = ip;
+            if (ip < mf_limit)
+                table[LZ4_HASH(ip - 2)] = (ushort)(ip - 2 - src);
+        }
+    }
+    /* The rest of the block is literals. */
+    return lz4_put_sequence(op, anchor, iend, 0, 0) - dst;
+}
+
+/* Code one block with its header into dst, return the total length. */
+static uint
+s_LZ4E_block(stream_LZ4E_state * ss, const byte *src, uint n, byte *dst)
+{
+    uint coded = lz4_compress_block(ss->table, src, n,
+                                    dst + s_LZ4_HEADER_SIZE);
+
+    if (coded >= n) {
+        /* Didn't compress, store it. */
+        memcpy(dst + s_LZ4_HEADER_SIZE, src, n);
+        coded = n | s_LZ4_STORED;
+    }
+    dst[0] = (byte)(n >> 8);
+    dst[1] = (byte)n;
+    dst[2] = (byte)(coded >> 8);
+    dst[3] = (byte)coded;
+    return s_LZ4_HEADER_SIZE + (coded & ~s_LZ4_STORED);
+}
+
+/* Process a buffer */
+static int
+s_LZ4E_process(stream_state * st, stream_cursor_read * pr,
+               stream_cursor_write * pw, bool last)
+{
+    stream_LZ4E_state *const ss = (stream_LZ4E_state *) st;
+
+    for (;;) {
+        uint avail, count;
+
+        /* Write out any coded data left over from the last block. */
+        if (ss->out_pos < ss->out_count) {
+            count = min(pw->limit - pw->ptr, ss->out_count - ss->out_pos);
+            memcpy(pw->ptr + 1, ss->out_buf + ss->out_pos, count);
+            pw->ptr += count;
+            ss->out_pos += count;
+            if (ss->out_pos < ss->out_count)
+                return 1;
+        }
+        avail = pr->limit - pr->ptr;
+        if (ss->in_count == 0 && (avail >= s_LZ4_BLOCK_SIZE || (last && avail > 0)) &&
+            pw->limit - pw->ptr >= s_LZ4_MAX_FRAME) {
+            /* A whole block is available and fits: code it in place. */
+            count = min(avail, s_LZ4_BLOCK_SIZE);
+            pw->ptr += s_LZ4E_block(ss, pr->ptr + 1, count, pw->ptr + 1);
+            pr->ptr += count;
+            continue;
+        }
+        count = min(avail, s_LZ4_BLOCK_SIZE - ss->in_count);
+        memcpy(ss->in_buf + ss->in_count, pr->ptr + 1, count);
+        pr->ptr += count;
+        ss->in_count += count;
+        if (ss->in_count == s_LZ4_BLOCK_SIZE ||
+            (last && ss->in_count > 0 && pr->ptr == pr->limit)) {
+            ss->out_count = s_LZ4E_block(ss, ss->in_buf, ss->in_count,
+                                         ss->out_buf);
+            ss->out_pos = 0;
+            ss->in_count = 0;
+            continue;
+        }
+        return 0;
+    }
+}
+
+/* Stream template */
+const stream_template s_LZ4E_template = {
+    &st_LZ4E_state, s_LZ4E_init, s_LZ4E_process, 1, 1, NULL,
+    NULL, s_LZ4E_init
+};
@@ -0,0 +1,82 @@
+/* Copyright (C) 2001-2019 Artifex Software, Inc.
+   All Rights Reserved.
+
+   This software is provided AS-IS with no warranty, either express or
+   implied.
+
+   This software is distributed under license and may not be copied,
+   modified or distributed except as expressly authorized under the terms
+   of the license contained in the file LICENSE in this distribution.
+
+   Refer to licensing information at http://www.artifex.com or contact
+   Artifex Software, Inc.,  1305 Grant Avenue - Suite 200, Novato,
+   CA 94945, U.S.A., +1(415)492-9861, for further information.
+*/
+
+
+/* Definitions for the LZ4 block filters */
+/* Requires scommon.h; strimpl.h if any templates are referenced */
+
+#ifndef slz4x_INCLUDED
+#  define slz4x_INCLUDED
+
+#include "scommon.h"
+
+/*
+ * These filters are intended for short lived internal data (in particular
+ * RAM-based band lists), where speed matters much more than the compression
+ * ratio.  The data is cut into blocks of at most s_LZ4_BLOCK_SIZE bytes and
+ * each block is compressed independently using the LZ4 block format
+ * (token, literals, 2 byte offset, match length), so no dictionary is
+ * carried from one block to the next.  Each block is preceded by a 4 byte
+ * header:
+ *      raw length (2 bytes, big-endian)
+ *      coded length (2 bytes, big-endian), with s_LZ4_STORED set if the
+ *        block did not compress and the data follows uncompressed.
+ * There is no end-of-data marker: the data ends after the last block.
+ */
+#define s_LZ4_BLOCK_SIZE 16384
+#define s_LZ4_HEADER_SIZE 4
+#define s_LZ4_STORED 0x8000
+/* Worst case size of an LZ4 coded block, including the header. */
+#define s_LZ4_MAX_FRAME\
+  (s_LZ4_HEADER_SIZE + s_LZ4_BLOCK_SIZE + s_LZ4_BLOCK_SIZE / 255 + 16)
+#define s_LZ4_HASH_BITS 12
+
+/* LZ4Encode */
+typedef struct stream_LZ4E_state_s {
+    stream_state_common;
+    /* The following change dynamically. */
+    uint in_count;		/* bytes collected in in_buf */
+    uint out_pos;		/* next byte of out_buf to write */
+    uint out_count;		/* bytes of coded data in out_buf */
+    ushort table[1 << s_LZ4_HASH_BITS];	/* match finder hash table */
+    byte in_buf[s_LZ4_BLOCK_SIZE];
+    byte out_buf[s_LZ4_MAX_FRAME];
+} stream_LZ4E_state;
+
+#define private_st_LZ4E_state()	/* in slz4e.c */\
+  gs_private_st_simple(st_LZ4E_state, stream_LZ4E_state, "LZ4Encode state")
+extern const stream_template s_LZ4E_template;
+
+/* LZ4Decode */
+typedef struct stream_LZ4D_state_s {
+    stream_state_common;
+    /* The following change dynamically. */
+    uint hdr_count;		/* bytes collected in hdr */
+    uint raw_len;		/* raw length of the current block */
+    uint coded_len;		/* coded length of the current block */
+    bool stored;		/* current block is not compressed */
+    uint in_count;		/* bytes collected in in_buf */
+    uint out_pos;		/* next byte of out_buf to write */
+    uint out_count;		/* bytes of decoded data in out_buf */
+    byte hdr[s_LZ4_HEADER_SIZE];
+    byte in_buf[s_LZ4_BLOCK_SIZE];
+    byte out_buf[s_LZ4_BLOCK_SIZE];
+} stream_LZ4D_state;
+
+#define private_st_LZ4D_state()	/* in slz4d.c */\
+  gs_private_st_simple(st_LZ4D_state, stream_LZ4D_state, "LZ4Decode state")
+extern const stream_template s_LZ4D_template;
+
+#endif /* slz4x_INCLUDED */
@@ -372,6 +372,9 @@ const gx_device_bit gs_bitrgbtags_device =
         false, /* bg_print_requested */
         {0},   /* bg_print */
         0,     /* num_render_threads_requested */
+        0,     /* band_split_limit */
+        false, /* BLS_mmap */
+        false, /* BLC_lz4 */
         NULL,  /* saved_pages_list */
         {0},   /* save_procs_while_delaying_erasepage */
         {0}    /* orig_procs */
@@ -636,6 +636,9 @@ chameleon_print_page(gx_device_printer * pdev, FILE * prn_stream)
         return gs_error_rangecheck;
     }
 
+    /* default_ht screens every 1, 2 and 4 bit output, gray included.
+     * Before the downscaler had its threshold halftoning, 1 bit gray was
+     * error diffused and 2 and 4 bit gray and CMYK were refused. */
     code = gx_downscaler_init_trapped_cm_halftone
                                             (&ds,
                                              (gx_device *)pdev,
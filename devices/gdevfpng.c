@@ -23,6 +23,7 @@
 #include "gxgetbit.h"
 #include "gxdownscale.h"
 #include "gxdevsop.h"
+#include "gdevfpng.h"
 
 /* ------ The device descriptors ------ */
 
@@ -39,6 +40,7 @@ struct gx_device_fpng_s {
     gx_device_common;
     gx_prn_device_common;
     gx_downscaler_params downscale;
+    fpng_params png;
 };
 
 static int
@@ -62,6 +64,8 @@ fpng_get_params(gx_device * dev, gs_param_list * plist)
     ecode = 0;
     if ((code = gx_downscaler_write_params(plist, &pdev->downscale, 0)) < 0)
         ecode = code;
+    if ((code = fpng_write_params(plist, &pdev->png)) < 0)
+        ecode = code;
 
     code = gdev_prn_get_params(dev, plist);
     if (code < 0)
@@ -77,6 +81,9 @@ fpng_put_params(gx_device *dev, gs_param_list *plist)
     int code, ecode;
 
     ecode = gx_downscaler_read_params(plist, &pdev->downscale, 0);
+    code = fpng_read_params(plist, &pdev->png);
+    if (code < 0)
+        ecode = code;
 
     code = gdev_prn_put_params(dev, plist);
     if (code < 0)
@@ -185,14 +192,99 @@ const gx_device_fpng gs_fpng_device =
                  X_DPI, Y_DPI,
                  0, 0, 0, 0,	/* margins */
                  3, 24, 255, 255, 256, 256, fpng_print_page),
-                 GX_DOWNSCALER_PARAMS_DEFAULTS
+                 GX_DOWNSCALER_PARAMS_DEFAULTS,
+                 FPNG_PARAMS_DEFAULTS(FPNG_FILTER_PAETH)
 };
 
 /* ------ Private definitions ------ */
 
+static const char *const fpng_filter_names[] = {
+    "none", "sub", "up", "average", "paeth", "adaptive"
+};
+
+int
+fpng_read_params(gs_param_list *plist, fpng_params *params)
+{
+    int ecode = 0;
+    int code;
+    const char *param_name;
+    int level = params->compression_level;
+    int filter = params->filter;
+    gs_param_string fstr;
+
+    switch (code = param_read_int(plist, (param_name = "CompressionLevel"), &level)) {
+        case 0:
+            if (level < -1 || level > 9)
+                ecode = gs_error_rangecheck;
+            else
+                break;
+            goto cle;
+        default:
+            ecode = code;
+          cle:param_signal_error(plist, param_name, ecode);
+        case 1:
+            break;
+    }
+
+    switch (code = param_read_string(plist, (param_name = "PNGFilter"), &fstr)) {
+        case 0:
+            for (filter = FPNG_FILTER_ADAPTIVE; filter >= 0; filter--)
+                if (!bytes_compare(fstr.data, fstr.size,
+                                   (const byte *)fpng_filter_names[filter],
+                                   strlen(fpng_filter_names[filter])))
+                    break;
+            if (filter < 0)
+                ecode = gs_error_rangecheck;
+            else
+                break;
+            goto fe;
+        default:
+            ecode = code;
+          fe:param_signal_error(plist, param_name, ecode);
+        case 1:
+            break;
+    }
+
+    if (ecode < 0)
+        return ecode;
+    params->compression_level = level;
+    params->filter = filter;
+    return 0;
+}
+
+int
+fpng_write_params(gs_param_list *plist, const fpng_params *params)
+{
+    int code, ecode = 0;
+    int level = params->compression_level;
+    gs_param_string fstr;
+
+    if ((code = param_write_int(plist, "CompressionLevel", &level)) < 0)
+        ecode = code;
+    param_string_from_string(fstr, fpng_filter_names[params->filter]);
+    if ((code = param_write_string(plist, "PNGFilter", &fstr)) < 0)
+        ecode = code;
+    return ecode;
+}
+
+/* State shared by the rendering threads (read only) and the output
+ * callback (which runs in band order in the main thread). */
+typedef struct fpng_encode_s {
+    FILE *file;
+    int level;
+    int filter;
+    int transform;
+    int depth;
+    int first;
+    uLong adler;
+} fpng_encode_t;
+
 typedef struct fpng_buffer_s {
     int size;
     int compressed;
+    uLong adler;                /* Adler-32 of this band's filtered rows */
+    long length;                /* and their length */
+    byte *rows;                 /* 3 rows: previous, current, filtered */
     unsigned char data[1];
 } fpng_buffer_t;
 
@@ -208,13 +300,17 @@ static int fpng_init_buffer(void *arg, gx_device *dev, gs_memory_t *mem, int w,
      * in paged mode. For now we leave this as an exercise for the reader.
      */
     fpng_buffer_t *buffer;
-    int size = deflateBound(NULL, (w*3+1)*h);
-    buffer = (fpng_buffer_t *)gs_alloc_bytes(mem, sizeof(fpng_buffer_t) + size, "fpng_init_buffer");
+    int row = bitmap_raster(w * dev->color_info.depth) + 1;
+    /* Leave room for the zlib header in front of the data. */
+    int size = 2 + deflateBound(NULL, row * h) + 64;
+
+    buffer = (fpng_buffer_t *)gs_alloc_bytes(mem, sizeof(fpng_buffer_t) + size + 3 * row, "fpng_init_buffer");
     *pbuffer = (void *)buffer;
     if (buffer == NULL)
       return_error(gs_error_VMerror);
     buffer->size = size;
     buffer->compressed = 0;
+    buffer->rows = &buffer->data[size];
     return 0;
 }
 
@@ -265,11 +361,8 @@ static void zfree(void *mem_, void *address)
     gs_free_object(mem, address, "zfree (fpng_process)");
 }
 
-static inline int paeth_predict(const unsigned char *d, int raster)
+static inline int paeth_predict(int a, int b, int c)
 {
-    int a = d[-3]; /* Left */
-    int b = d[-raster]; /* Above */
-    int c = d[-3-raster]; /* Above left */
     int p = a + b - c;
     int pa, pb, pc;
     pa = p - a;
@@ -288,122 +381,265 @@ static inline int paeth_predict(const unsigned char *d, int raster)
     return c;
 }
 
-static int fpng_process(void *arg, gx_device *dev, gx_device *bdev, const gs_int_rect *rect, void *buffer_)
+/* Filter one row of n bytes with bpp bytes per pixel (at least 1) into
+ * out, preceded by the filter type byte. prev is only used by the
+ * filters that look at the row above. */
+static void
+fpng_filter_row(int filter, byte *out, const byte *cur, const byte *prev,
+                int n, int bpp)
+{
+    int i;
+
+    *out++ = filter;
+    switch (filter) {
+        case FPNG_FILTER_NONE:
+            memcpy(out, cur, n);
+            break;
+        case FPNG_FILTER_SUB:
+            for (i = 0; i < bpp; i++)
+                out[i] = cur[i];
+            for (; i < n; i++)
+                out[i] = cur[i] - cur[i-bpp];
+            break;
+        case FPNG_FILTER_UP:
+            for (i = 0; i < n; i++)
+                out[i] = cur[i] - prev[i];
+            break;
+        case FPNG_FILTER_AVERAGE:
+            for (i = 0; i < bpp; i++)
+                out[i] = cur[i] - (prev[i] >> 1);
+            for (; i < n; i++)
+                out[i] = cur[i] - ((cur[i-bpp] + prev[i]) >> 1);
+            break;
+        case FPNG_FILTER_PAETH:
+            for (i = 0; i < bpp; i++)
+                out[i] = cur[i] - prev[i];
+            for (; i < n; i++)
+                out[i] = cur[i] - paeth_predict(cur[i-bpp], prev[i], prev[i-bpp]);
+            break;
+    }
+}
+
+/* Fetch row y of the band and apply the output transformations. */
+static int
+fpng_get_row(const fpng_encode_t *enc, gx_device *bdev, int y, int w,
+             byte *row, int n)
 {
-    int code;
-    gx_device_fpng *fdev = (gx_device_fpng *)dev;
     gs_get_bits_params_t params;
+    gs_int_rect rect;
+    int code, i;
+    int pad = (w * enc->depth) & 7;
+
+    rect.p.x = 0;
+    rect.q.x = w;
+    rect.p.y = y;
+    rect.q.y = y + 1;
+    params.options = GB_COLORS_NATIVE | GB_ALPHA_NONE | GB_PACKING_CHUNKY |
+                     GB_RETURN_POINTER | GB_RETURN_COPY | GB_ALIGN_ANY |
+                     GB_OFFSET_0 | GB_RASTER_ANY;
+    params.data[0] = row;
+    code = dev_proc(bdev, get_bits_rectangle)(bdev, &rect, &params, NULL);
+    if (code < 0)
+        return code;
+    if (params.data[0] != row)
+        memcpy(row, params.data[0], n);
+
+    if (enc->transform & FPNG_INVERT)
+        for (i = 0; i < n; i++)
+            row[i] ^= 0xff;
+    if (enc->transform & FPNG_INVERT_ALPHA)
+        for (i = 3; i < n; i += 4)
+            row[i] ^= 0xff;
+    /* The bits past the end of the row are undefined in the device. */
+    if (pad)
+        row[n-1] &= 0xff << (8 - pad);
+    return 0;
+}
+
+static int
+fpng_filter_cost(const byte *out, int n)
+{
+    int i, cost = 0;
+
+    for (i = 1; i <= n; i++)
+        cost += (out[i] < 128 ? out[i] : 256 - out[i]);
+    return cost;
+}
+
+/* Choose a single filter for the whole band from a few sample rows, using
+ * the usual minimum sum of absolute differences heuristic. Choosing per
+ * band rather than per row keeps the inner loop of the encoder simple. */
+static int
+fpng_choose_filter(const fpng_encode_t *enc, gx_device *bdev, int w, int h,
+                   byte *prev, byte *cur, byte *out, int n, int bpp)
+{
+    int cost[FPNG_FILTER_PAETH + 1];
+    int i, f, y, best, code;
+
+    if ((enc->transform & FPNG_PALETTE) || enc->depth < 8)
+        return FPNG_FILTER_NONE;
+    if (h < 2)
+        return FPNG_FILTER_SUB;
+    memset(cost, 0, sizeof(cost));
+    for (i = 0; i < 4; i++) {
+        y = 1 + i * (h - 2) / 3;
+        if (i > 0 && y == 1 + (i - 1) * (h - 2) / 3)
+            continue;
+        if ((code = fpng_get_row(enc, bdev, y - 1, w, prev, n)) < 0 ||
+            (code = fpng_get_row(enc, bdev, y, w, cur, n)) < 0)
+            return code;
+        for (f = FPNG_FILTER_NONE; f <= FPNG_FILTER_PAETH; f++) {
+            fpng_filter_row(f, out, cur, prev, n, bpp);
+            cost[f] += fpng_filter_cost(out, n);
+        }
+    }
+    best = FPNG_FILTER_NONE;
+    for (f = FPNG_FILTER_SUB; f <= FPNG_FILTER_PAETH; f++)
+        if (cost[f] < cost[best])
+            best = f;
+    return best;
+}
+
+static int fpng_process(void *arg, gx_device *dev, gx_device *bdev, const gs_int_rect *rect, void *buffer_)
+{
+    fpng_encode_t *enc = (fpng_encode_t *)arg;
     int w = rect->q.x - rect->p.x;
-    int raster = bitmap_raster(bdev->width * 3 * 8);
     int h = rect->q.y - rect->p.y;
-    int x, y;
-    unsigned char *p;
-    unsigned char sub = 1;
-    unsigned char paeth = 4;
-    int firstband = (rect->p.y == 0);
-    int lastband;
-    gs_int_rect my_rect;
+    int n = (w * enc->depth + 7) >> 3;
+    int raster = bitmap_raster(w * enc->depth) + 1;
+    int bpp = (enc->depth + 7) >> 3;
+    int y, filter, code = 0;
+    byte *prev, *cur, *out, *tmp;
     z_stream stream;
     int err;
-    int page_height = gx_downscaler_scale_rounded(dev->height, fdev->downscale.downscale_factor);
     fpng_buffer_t *buffer = (fpng_buffer_t *)buffer_;
 
+    buffer->compressed = 0;
+    buffer->adler = adler32(0, NULL, 0);
+    buffer->length = 0;
     if (h <= 0 || w <= 0)
         return 0;
 
-    lastband = (rect->q.y == page_height-1);
+    prev = buffer->rows;
+    cur = prev + raster;
+    out = cur + raster;
 
-    params.options = GB_COLORS_NATIVE | GB_ALPHA_NONE | GB_PACKING_CHUNKY | GB_RETURN_POINTER | GB_ALIGN_ANY | GB_OFFSET_0 | GB_RASTER_ANY;
-    my_rect.p.x = 0;
-    my_rect.p.y = 0;
-    my_rect.q.x = w;
-    my_rect.q.y = h;
-    code = dev_proc(bdev, get_bits_rectangle)(bdev, &my_rect, &params, NULL);
-    if (code < 0)
-        return code;
-
-    /* Apply the paeth prediction filter to the buffered data */
-    p = params.data[0];
-    /* Paeth for lines h-1 to 1 */
-    p += raster*(h-1);
-    for (y = h-1; y > 0; y--)
-    {
-        p += 3*(w-1);
-        for (x = w-1; x > 0; x--)
-        {
-            p[0] -= paeth_predict(p+0, raster);
-            p[1] -= paeth_predict(p+1, raster);
-            p[2] -= paeth_predict(p+2, raster);
-            p -= 3;
-        }
-        p[0] -= p[-raster];
-        p[1] -= p[1-raster];
-        p[2] -= p[2-raster];
-        p -= raster;
-    }
-    /* Sub for the first line */
-    {
-        p += 3*(w-1);
-        for (x = w-1; x > 0; x--)
-        {
-            p[2] -= p[-1];
-            p[1] -= p[-2];
-            p[0] -= p[-3];
-            p -= 3;
-        }
+    filter = enc->filter;
+    if (filter == FPNG_FILTER_ADAPTIVE) {
+        filter = fpng_choose_filter(enc, bdev, w, h, prev, cur, out, n, bpp);
+        if (filter < 0)
+            return filter;
     }
 
-    /* Compress the data */
+    /* Each band is compressed as a raw deflate stream ending on a byte
+     * boundary, so that the bands can simply be concatenated. The zlib
+     * header and the Adler-32 checksum are written by fpng_output and
+     * fpng_write_image. */
     stream.zalloc = zalloc;
     stream.zfree = zfree;
     stream.opaque = bdev->memory;
-    err = deflateInit(&stream, Z_DEFAULT_COMPRESSION);
+    err = deflateInit2(&stream, enc->level, Z_DEFLATED, -MAX_WBITS, 8,
+                       Z_DEFAULT_STRATEGY);
     if (err != Z_OK)
       return_error(gs_error_VMerror);
-    p = params.data[0];
-    stream.next_out = &buffer->data[0];
-    stream.avail_out = buffer->size;
-
-    /* Nasty zlib hackery here. Zlib always outputs a 'start of stream'
-     * marker at the beginning. We just want a block, so for all blocks
-     * except the first one, we compress a single byte and flush it. This
-     * takes care of the 'start of stream' marker. Throw this deflate block
-     * away, and start compression again. */
-    if (!firstband)
-    {
-        stream.next_in = &sub;
-        stream.avail_in = 1;
-        deflate(&stream, Z_FULL_FLUSH);
-        stream.next_out = &buffer->data[0];
-        stream.avail_out = buffer->size;
-        stream.total_out = 0;
-    }
+    stream.next_out = &buffer->data[2];
+    stream.avail_out = buffer->size - 2;
 
-    stream.next_in = &sub;
-    for (y = h-1; y >= 0; y--)
+    for (y = 0; y < h; y++)
     {
-        stream.avail_in = 1;
-        deflate(&stream, Z_NO_FLUSH);
-        stream.next_in = p;
-        stream.avail_in = w*3;
-        deflate(&stream, (y == 0 ? (lastband ? Z_FINISH : Z_FULL_FLUSH) : Z_NO_FLUSH));
-        p += raster;
-        stream.next_in = &paeth;
+        tmp = prev;
+        prev = cur;
+        cur = tmp;
+        code = fpng_get_row(enc, bdev, y, w, cur, n);
+        if (code < 0)
+            break;
+        /* The row above the first row of the band isn't available, and
+         * the row above the first row of the page is defined as zero, so
+         * neither can use a filter that looks at it. */
+        fpng_filter_row((y > 0 || filter == FPNG_FILTER_NONE ?
+                         filter : FPNG_FILTER_SUB), out, cur, prev, n, bpp);
+        buffer->adler = adler32(buffer->adler, out, n + 1);
+        stream.next_in = out;
+        stream.avail_in = n + 1;
+        err = deflate(&stream, (y == h-1 ? Z_FULL_FLUSH : Z_NO_FLUSH));
+        if (err != Z_OK || stream.avail_in != 0) {
+            code = gs_note_error(gs_error_ioerror);
+            break;
+        }
     }
+    buffer->length = (long)(n + 1) * h;
+    buffer->compressed = stream.total_out;
     /* Ignore errors given here */
     deflateEnd(&stream);
 
-    buffer->compressed = stream.total_out;
-
     return code;
 }
 
 static int fpng_output(void *arg, gx_device *dev, void *buffer_)
 {
-    FILE *file = (FILE *)arg;
+    fpng_encode_t *enc = (fpng_encode_t *)arg;
     fpng_buffer_t *buffer = (fpng_buffer_t *)buffer_;
+    unsigned char *data = &buffer->data[2];
+    int size = buffer->compressed;
+
+    if (enc->first) {
+        int level = enc->level;
+        int flevel = (level < 0 ? 2 : level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3);
+
+        data -= 2;
+        size += 2;
+        data[0] = 0x78; /* deflate, 32K window */
+        data[1] = flevel << 6;
+        data[1] += 31 - ((data[0] << 8) + data[1]) % 31;
+        enc->first = 0;
+        enc->adler = buffer->adler;
+    } else
+        enc->adler = adler32_combine(enc->adler, buffer->adler, buffer->length);
+
+    if (size > 0)
+        putchunk("IDAT", data, size, enc->file);
 
-    putchunk("IDAT", &buffer->data[0], buffer->compressed, file);
+    return 0;
+}
+
+int
+fpng_write_image(gx_device *dev, FILE *file, const fpng_params *params,
+                 int transform, int factor)
+{
+    fpng_encode_t enc;
+    gx_process_page_options_t process = { 0 };
+    unsigned char tail[6];
+    int code;
+
+    enc.file = file;
+    enc.level = params->compression_level;
+    enc.filter = params->filter;
+    enc.transform = transform;
+    enc.depth = dev->color_info.depth;
+    enc.first = 1;
+    enc.adler = adler32(0, NULL, 0);
+
+    process.init_buffer_fn = fpng_init_buffer;
+    process.free_buffer_fn = fpng_free_buffer;
+    process.process_fn = fpng_process;
+    process.output_fn = fpng_output;
+    process.arg = &enc;
+
+    if (factor == 1)
+        code = dev_proc(dev, process_page)(dev, &process);
+    else
+        code = gx_downscaler_process_page(dev, &process, factor);
+    if (code < 0)
+        return code;
+    if (enc.first)
+        return_error(gs_error_unknownerror);
+
+    /* Finish the stream with an empty final block and the checksum. */
+    tail[0] = 0x03;
+    tail[1] = 0x00;
+    big32(&tail[2], enc.adler);
+    putchunk("IDAT", tail, 6, file);
+    putchunk("IEND", tail, 0, file);
 
     return 0;
 }
@@ -415,7 +651,6 @@ fpng_print_page(gx_device_printer *pdev, FILE *file)
     gx_device_fpng *fdev = (gx_device_fpng *)pdev;
     static const unsigned char pngsig[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
     unsigned char head[13];
-    gx_process_page_options_t process = { 0 };
 
     fwrite(pngsig, 1, 8, file); /* Signature */
 
@@ -429,11 +664,6 @@ fpng_print_page(gx_device_printer *pdev, FILE *file)
     head[12] = 0; /* interlace */
     putchunk("IHDR", head, 13, file);
 
-    process.init_buffer_fn = fpng_init_buffer;
-    process.free_buffer_fn = fpng_free_buffer;
-    process.process_fn = fpng_process;
-    process.output_fn = fpng_output;
-    process.arg = file;
-
-    return gx_downscaler_process_page((gx_device *)pdev, &process, fdev->downscale.downscale_factor);
+    return fpng_write_image((gx_device *)pdev, file, &fdev->png,
+                            0, fdev->downscale.downscale_factor);
 }
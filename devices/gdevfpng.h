@@ -0,0 +1,55 @@
+/* Copyright (C) 2001-2019 Artifex Software, Inc.
+   All Rights Reserved.
+
+   This software is provided AS-IS with no warranty, either express or
+   implied.
+
+   This software is distributed under license and may not be copied,
+   modified or distributed except as expressly authorized under the terms
+   of the license contained in the file LICENSE in this distribution.
+
+   Refer to licensing information at http://www.artifex.com or contact
+   Artifex Software, Inc.,  1305 Grant Avenue - Suite 200, Novato,
+   CA 94945, U.S.A., +1(415)492-9861, for further information.
+*/
+
+
+/* Band parallel PNG image data encoder, shared by the png and fpng devices. */
+
+#ifndef gdevfpng_INCLUDED
+#  define gdevfpng_INCLUDED
+
+#include "gdevprn.h"
+
+/* Values for the PNGFilter parameter. The first five match the PNG
+ * filter type numbers. */
+#define FPNG_FILTER_NONE     0
+#define FPNG_FILTER_SUB      1
+#define FPNG_FILTER_UP       2
+#define FPNG_FILTER_AVERAGE  3
+#define FPNG_FILTER_PAETH    4
+#define FPNG_FILTER_ADAPTIVE 5
+
+typedef struct fpng_params_s {
+    int compression_level;      /* zlib level, -1 = zlib default */
+    int filter;                 /* FPNG_FILTER_* */
+} fpng_params;
+
+#define FPNG_PARAMS_DEFAULTS(filter) { -1, filter }
+
+int fpng_read_params(gs_param_list *plist, fpng_params *params);
+int fpng_write_params(gs_param_list *plist, const fpng_params *params);
+
+/* Transformations applied to the device rows before filtering, to match
+ * the libpng transformations used by the png devices. */
+#define FPNG_INVERT       1     /* png_set_invert_mono */
+#define FPNG_INVERT_ALPHA 2     /* png_set_invert_alpha, 32 bit RGBA */
+#define FPNG_PALETTE      4     /* indexed color, adaptive means no filter */
+
+/* Compress the page through the device's process_page, one deflate block
+ * sequence per band, and write the IDAT chunks and the IEND chunk to file.
+ * The caller has already written the signature and the header chunks. */
+int fpng_write_image(gx_device *dev, FILE *file, const fpng_params *params,
+                     int transform, int factor);
+
+#endif /* gdevfpng_INCLUDED */
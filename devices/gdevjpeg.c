@@ -22,6 +22,7 @@
 #include "sdct.h"
 #include "sjpeg.h"
 #include "gxdownscale.h"
+#include "gxgetbit.h"
 
 /* Structure for the JPEG-writing device. */
 typedef struct gx_device_jpeg_s {
@@ -412,76 +413,63 @@ jpeg_get_initial_matrix(gx_device *dev, gs_matrix *pmat)
 
 }
 
-/* Send the page to the file. */
+/*
+ * Set up a DCT encoder for 'height' rows of the page. With 'restart', each
+ * row of MCUs ends with a restart marker; with 'icc', the device profile is
+ * written with the markers.
+ */
 static int
-jpeg_print_page(gx_device_printer * pdev, FILE * prn_stream)
+jpeg_init_encoder(gx_device_jpeg *jdev, gs_memory_t *mem,
+                  stream_DCT_state *state, jpeg_compress_data **pjcdp,
+                  int height, bool restart, bool icc)
 {
-    gx_device_jpeg *jdev = (gx_device_jpeg *) pdev;
-    gs_memory_t *mem = pdev->memory;
-    int line_size = gdev_mem_bytes_per_scan_line((gx_device *) pdev);
-    byte *in = gs_alloc_bytes(mem, line_size, "jpeg_print_page(in)");
+    gx_device_printer *pdev = (gx_device_printer *)jdev;
     jpeg_compress_data *jcdp = gs_alloc_struct_immovable(mem, jpeg_compress_data,
-      &st_jpeg_compress_data, "jpeg_print_page(jpeg_compress_data)");
-    byte *fbuf = 0;
-    uint fbuf_size;
-    byte *jbuf = 0;
-    uint jbuf_size;
-    int lnum;
+      &st_jpeg_compress_data, "jpeg_init_encoder(jpeg_compress_data)");
     int code;
-    stream_DCT_state state;
-    stream fstrm, jstrm;
-    gx_downscaler_t ds;
 
-    if (jcdp == 0 || in == 0) {
-        code = gs_note_error(gs_error_VMerror);
-        goto fail;
-    }
-    code = gx_downscaler_init(&ds, (gx_device *)jdev, 8, 8,
-                              jdev->color_info.depth/8, jdev->downscale.downscale_factor, 0, NULL, 0);
-    if (code < 0) {
-        gs_free_object(mem, jcdp, "jpeg_print_page(jpeg_compress_data)");
-        jcdp = NULL;
-        goto fail;
-    }
+    *pjcdp = NULL;
+    if (jcdp == 0)
+        return_error(gs_error_VMerror);
 
     /* Create the DCT encoder state. */
     jcdp->templat = s_DCTE_template;
-    s_init_state((stream_state *)&state, &jcdp->templat, 0);
-    if (state.templat->set_defaults) {
-        state.memory = mem;
-        (*state.templat->set_defaults) ((stream_state *) & state);
-        state.memory = NULL;
+    s_init_state((stream_state *)state, &jcdp->templat, 0);
+    if (state->templat->set_defaults) {
+        state->memory = mem;
+        (*state->templat->set_defaults) ((stream_state *) state);
+        state->memory = NULL;
     }
-    state.QFactor = 1.0;	/* disable quality adjustment in zfdcte.c */
-    state.ColorTransform = 1;	/* default for RGB */
+    state->QFactor = 1.0;	/* disable quality adjustment in zfdcte.c */
+    state->ColorTransform = 1;	/* default for RGB */
     /* We insert no markers, allowing the IJG library to emit */
     /* the format it thinks best. */
-    state.NoMarker = true;	/* do not insert our own Adobe marker */
-    state.Markers.data = 0;
-    state.Markers.size = 0;
-    state.data.compress = jcdp;
+    state->NoMarker = true;	/* do not insert our own Adobe marker */
+    state->Markers.data = 0;
+    state->Markers.size = 0;
+    state->data.compress = jcdp;
     /* Add in ICC profile */
-    state.icc_profile = NULL; /* In case it is not set here */
-    if (pdev->icc_struct != NULL && pdev->icc_struct->device_profile[0] != NULL) {
+    state->icc_profile = NULL; /* In case it is not set here */
+    if (icc && pdev->icc_struct != NULL && pdev->icc_struct->device_profile[0] != NULL) {
         cmm_profile_t *icc_profile = pdev->icc_struct->device_profile[0];
         if (icc_profile->num_comps == pdev->color_info.num_components &&
             !(pdev->icc_struct->usefastcolor)) {
-            state.icc_profile = icc_profile;
+            state->icc_profile = icc_profile;
         }
     }
     /* We need state.memory for gs_jpeg_create_compress().... */
-    jcdp->memory = state.jpeg_memory = state.memory = mem;
-    if ((code = gs_jpeg_create_compress(&state)) < 0)
-    {
-        gx_downscaler_fin(&ds);
-        goto fail;
+    jcdp->memory = state->jpeg_memory = state->memory = mem;
+    if ((code = gs_jpeg_create_compress(state)) < 0) {
+        gs_free_object(mem, jcdp, "jpeg_init_encoder(jpeg_compress_data)");
+        return code;
     }
     /* ....but we need it to be NULL so we don't try to free
      * the stack based state...
      */
-    state.memory = NULL;
+    state->memory = NULL;
+    *pjcdp = jcdp;
     jcdp->cinfo.image_width = gx_downscaler_scale(pdev->width, jdev->downscale.downscale_factor);
-    jcdp->cinfo.image_height = gx_downscaler_scale(pdev->height, jdev->downscale.downscale_factor);
+    jcdp->cinfo.image_height = height;
     switch (pdev->color_info.depth) {
         case 32:
             jcdp->cinfo.input_components = 4;
@@ -497,33 +485,409 @@ jpeg_print_page(gx_device_printer * pdev, FILE * prn_stream)
             break;
     }
     /* Set compression parameters. */
-    if ((code = gs_jpeg_set_defaults(&state)) < 0)
-        goto done;
+    if ((code = gs_jpeg_set_defaults(state)) < 0)
+        return code;
     if (jdev->JPEGQ > 0) {
-        code = gs_jpeg_set_quality(&state, jdev->JPEGQ, TRUE);
+        code = gs_jpeg_set_quality(state, jdev->JPEGQ, TRUE);
         if (code < 0)
-            goto done;
+            return code;
     } else if (jdev->QFactor > 0.0) {
-        code = gs_jpeg_set_linear_quality(&state,
+        code = gs_jpeg_set_linear_quality(state,
                                           (int)(min(jdev->QFactor, 100.0)
                                                 * 100.0 + 0.5),
                                           TRUE);
         if (code < 0)
-            goto done;
+            return code;
     }
     jcdp->cinfo.restart_interval = 0;
+    jcdp->cinfo.restart_in_rows = (restart ? 1 : 0);
     jcdp->cinfo.density_unit = 1;	/* dots/inch (no #define or enum) */
     jcdp->cinfo.X_density = (UINT16)pdev->HWResolution[0];
     jcdp->cinfo.Y_density = (UINT16)pdev->HWResolution[1];
     /* Create the filter. */
     /* Make sure we get at least a full scan line of input. */
-    state.scan_line_size = jcdp->cinfo.input_components *
+    state->scan_line_size = jcdp->cinfo.input_components *
         jcdp->cinfo.image_width;
     jcdp->templat.min_in_size =
-        max(s_DCTE_template.min_in_size, state.scan_line_size);
+        max(s_DCTE_template.min_in_size, state->scan_line_size);
     /* Make sure we can write the user markers in a single go. */
     jcdp->templat.min_out_size =
-        max(s_DCTE_template.min_out_size, state.Markers.size);
+        max(s_DCTE_template.min_out_size, state->Markers.size);
+    return 0;
+}
+
+static void
+jpeg_fin_encoder(gs_memory_t *mem, stream_DCT_state *state,
+                 jpeg_compress_data *jcdp)
+{
+    if (jcdp) {
+        gs_jpeg_destroy(state);
+        gs_free_object(mem, jcdp, "jpeg_init_encoder(jpeg_compress_data)");
+    }
+}
+
+/* ------ Band-parallel encoding ------ */
+
+/*
+ * With a multi-threaded clist, each rendering thread encodes the rows of
+ * MCUs that lie wholly within its band as a JPEG of its own, in which each
+ * row of MCUs is a restart interval. The output step (in band order) keeps
+ * the headers of the piece that starts the page, with the page height
+ * patched into the frame header, and joins the entropy coded data of the
+ * pieces with restart markers, renumbering those within each piece to
+ * follow on from the previous one. A row of MCUs that straddles two bands
+ * is collected in the main thread and encoded there once complete.
+ */
+
+typedef struct jpeg_piece_s {
+    byte *data;
+    uint size, alloc;
+    uint entropy;               /* start of the entropy coded data */
+    uint length;                /* of the entropy coded data */
+} jpeg_piece;
+
+typedef struct jpeg_band_s {
+    gs_memory_t *memory;
+    int max_rows;
+    byte *rows;                 /* the band's rows, line_size bytes apiece */
+    int y0, num_rows;
+    int mcu_row, num_mcu_rows;  /* the MCU rows encoded in piece */
+    jpeg_piece piece;
+} jpeg_band;
+
+typedef struct jpeg_process_arg_s {
+    gx_device_jpeg *jdev;
+    FILE *file;
+    int height;
+    int line_size;
+    int mcu_height;             /* rows in a row of MCUs */
+    int num_mcu_rows;
+    byte *carry;                /* a row of MCUs straddling two bands */
+    jpeg_piece piece;           /* encoded from carry */
+} jpeg_process_arg;
+
+static void
+jpeg_piece_free(gs_memory_t *mem, jpeg_piece *piece)
+{
+    gs_free_object(mem, piece->data, "jpeg_piece_free");
+    piece->data = NULL;
+    piece->size = piece->alloc = 0;
+}
+
+/* Encode rows starting with the row of MCUs 'mcu_row' into 'piece'. */
+static int
+jpeg_encode_piece(const jpeg_process_arg *arg, gs_memory_t *mem,
+                  const byte *rows, int mcu_row, int num_rows,
+                  jpeg_piece *piece)
+{
+    stream_DCT_state state;
+    jpeg_compress_data *jcdp;
+    stream_cursor_read r;
+    stream_cursor_write w;
+    uint pos, len, rst = mcu_row;
+    byte *p, *end, marker;
+    int status, code;
+
+    code = jpeg_init_encoder(arg->jdev, mem, &state, &jcdp, num_rows, true,
+                             mcu_row == 0);
+    if (code < 0) {
+        jpeg_fin_encoder(mem, &state, jcdp);
+        return code;
+    }
+    if (state.templat->init)
+        (*state.templat->init) ((stream_state *)&state);
+    piece->size = 0;
+    r.ptr = rows - 1;
+    r.limit = rows + num_rows * arg->line_size - 1;
+    do {
+        if (piece->alloc - piece->size < jcdp->templat.min_out_size) {
+            uint alloc = max(piece->alloc * 2, 65536);
+            byte *data = gs_alloc_bytes(mem, alloc, "jpeg_encode_piece");
+
+            if (data == NULL) {
+                jpeg_fin_encoder(mem, &state, jcdp);
+                return_error(gs_error_VMerror);
+            }
+            if (piece->size)
+                memcpy(data, piece->data, piece->size);
+            gs_free_object(mem, piece->data, "jpeg_encode_piece");
+            piece->data = data;
+            piece->alloc = alloc;
+        }
+        w.ptr = piece->data + piece->size - 1;
+        w.limit = piece->data + piece->alloc - 1;
+        status = (*jcdp->templat.process)((stream_state *)&state, &r, &w, true);
+        piece->size = w.ptr + 1 - piece->data;
+    } while (status == 1);
+    jpeg_fin_encoder(mem, &state, jcdp);
+    if (status != EOFC)
+        return_error(gs_error_ioerror);
+
+    /* Find the start of scan, skipping SOI and the marker segments. */
+    pos = 2;
+    for (;;) {
+        if (pos + 4 > piece->size || piece->data[pos] != 0xFF)
+            return_error(gs_error_ioerror);
+        marker = piece->data[pos + 1];
+        len = (piece->data[pos + 2] << 8) + piece->data[pos + 3];
+        if (marker >= 0xC0 && marker <= 0xC2 && mcu_row == 0 &&
+            pos + 7 <= piece->size) {
+            /* SOFn: the frame is the height of the page. */
+            piece->data[pos + 5] = (byte)(arg->height >> 8);
+            piece->data[pos + 6] = (byte)arg->height;
+        }
+        pos += 2 + len;
+        if (marker == 0xDA)     /* SOS */
+            break;
+    }
+    if (pos + 2 > piece->size)
+        return_error(gs_error_ioerror);
+    piece->entropy = pos;
+    piece->length = piece->size - 2 - pos;      /* less EOI */
+
+    /* Within the entropy coded data, 0xFF is always followed by 0 (for a
+     * data byte) or a marker; the restarts must count from mcu_row. */
+    p = piece->data + piece->entropy;
+    end = p + piece->length - 1;
+    for (; p < end; p++) {
+        if (p[0] == 0xFF && (p[1] & 0xF8) == JPEG_RST0) {
+            p[1] = JPEG_RST0 + (rst++ & 7);
+            p++;
+        }
+    }
+    return 0;
+}
+
+/* Write the encoded rows of MCUs mcu_row .. mcu_row + n - 1. */
+static int
+jpeg_write_piece(const jpeg_process_arg *arg, const jpeg_piece *piece,
+                 int mcu_row, int n)
+{
+    FILE *file = arg->file;
+
+    if (mcu_row == 0)
+        fwrite(piece->data, 1, piece->entropy, file);
+    else {
+        fputc(0xFF, file);
+        fputc(JPEG_RST0 + ((mcu_row - 1) & 7), file);
+    }
+    fwrite(piece->data + piece->entropy, 1, piece->length, file);
+    if (mcu_row + n == arg->num_mcu_rows) {
+        fputc(0xFF, file);
+        fputc(JPEG_EOI, file);
+    }
+    return (ferror(file) ? gs_note_error(gs_error_ioerror) : 0);
+}
+
+static int
+jpeg_band_init_buffer(void *arg_, gx_device *dev, gs_memory_t *mem, int w,
+                      int h, void **pbuffer)
+{
+    jpeg_process_arg *arg = (jpeg_process_arg *)arg_;
+    jpeg_band *band = (jpeg_band *)gs_alloc_bytes(mem, sizeof(jpeg_band),
+                                                  "jpeg_band_init_buffer");
+
+    *pbuffer = band;
+    if (band == NULL)
+        return_error(gs_error_VMerror);
+    memset(band, 0, sizeof(jpeg_band));
+    band->memory = mem;
+    band->max_rows = h;
+    band->rows = gs_alloc_bytes(mem, (size_t)arg->line_size * h,
+                                "jpeg_band_init_buffer(rows)");
+    if (band->rows == NULL)
+        return_error(gs_error_VMerror);
+    return 0;
+}
+
+static void
+jpeg_band_free_buffer(void *arg, gx_device *dev, gs_memory_t *mem, void *buffer)
+{
+    jpeg_band *band = (jpeg_band *)buffer;
+
+    if (band == NULL)
+        return;
+    jpeg_piece_free(mem, &band->piece);
+    gs_free_object(mem, band->rows, "jpeg_band_free_buffer(rows)");
+    gs_free_object(mem, band, "jpeg_band_free_buffer");
+}
+
+static int
+jpeg_band_process(void *arg_, gx_device *dev, gx_device *bdev,
+                  const gs_int_rect *rect, void *buffer)
+{
+    jpeg_process_arg *arg = (jpeg_process_arg *)arg_;
+    jpeg_band *band = (jpeg_band *)buffer;
+    int mh = arg->mcu_height;
+    int y0 = rect->p.y, y1 = rect->q.y;
+    int m0 = (y0 + mh - 1) / mh;
+    int m1 = (y1 == arg->height ? arg->num_mcu_rows : y1 / mh);
+    gs_get_bits_params_t params;
+    gs_int_rect my_rect;
+    int y, code;
+
+    band->y0 = y0;
+    band->num_rows = y1 - y0;
+    band->mcu_row = m0;
+    band->num_mcu_rows = 0;
+    if (y1 <= y0)
+        return 0;
+    if (y1 - y0 > band->max_rows)
+        return_error(gs_error_rangecheck);
+
+    my_rect.p.x = 0;
+    my_rect.q.x = rect->q.x - rect->p.x;
+    for (y = 0; y < y1 - y0; y++) {
+        params.options = GB_COLORS_NATIVE | GB_ALPHA_NONE | GB_PACKING_CHUNKY |
+                         GB_RETURN_POINTER | GB_ALIGN_ANY | GB_OFFSET_0 |
+                         GB_RASTER_ANY;
+        my_rect.p.y = y;
+        my_rect.q.y = y + 1;
+        code = dev_proc(bdev, get_bits_rectangle)(bdev, &my_rect, &params, NULL);
+        if (code < 0)
+            return code;
+        memcpy(band->rows + y * arg->line_size, params.data[0], arg->line_size);
+    }
+    if (m1 <= m0)
+        return 0;
+    code = jpeg_encode_piece(arg, band->memory,
+                             band->rows + (m0 * mh - y0) * arg->line_size,
+                             m0, min(m1 * mh, arg->height) - m0 * mh,
+                             &band->piece);
+    if (code < 0)
+        return code;
+    band->num_mcu_rows = m1 - m0;
+    return 0;
+}
+
+static int
+jpeg_band_output(void *arg_, gx_device *dev, void *buffer)
+{
+    jpeg_process_arg *arg = (jpeg_process_arg *)arg_;
+    jpeg_band *band = (jpeg_band *)buffer;
+    int mh = arg->mcu_height;
+    int y = band->y0, y1 = band->y0 + band->num_rows;
+    int m, my0, my1, n, code;
+
+    while (y < y1) {
+        m = y / mh;
+        my0 = m * mh;
+        my1 = min(my0 + mh, arg->height);
+        if (band->num_mcu_rows > 0 && m == band->mcu_row) {
+            code = jpeg_write_piece(arg, &band->piece, m, band->num_mcu_rows);
+            if (code < 0)
+                return code;
+            y = min((m + band->num_mcu_rows) * mh, arg->height);
+            continue;
+        }
+        n = min(my1, y1) - y;
+        memcpy(arg->carry + (y - my0) * arg->line_size,
+               band->rows + (y - band->y0) * arg->line_size,
+               n * arg->line_size);
+        y += n;
+        if (y == my1) {
+            code = jpeg_encode_piece(arg, arg->jdev->memory, arg->carry, m,
+                                     my1 - my0, &arg->piece);
+            if (code >= 0)
+                code = jpeg_write_piece(arg, &arg->piece, m, 1);
+            if (code < 0)
+                return code;
+        }
+    }
+    return 0;
+}
+
+/* Encoding by bands needs the unscaled rows, in more than one row of MCUs. */
+static int
+jpeg_print_page_bands(gx_device_printer *pdev, FILE *prn_stream)
+{
+    gx_device_jpeg *jdev = (gx_device_jpeg *) pdev;
+    gs_memory_t *mem = pdev->memory;
+    jpeg_process_arg arg;
+    gx_process_page_options_t process = { 0 };
+    stream_DCT_state state;
+    jpeg_compress_data *jcdp;
+    int ci, code;
+
+    if (!PRINTER_IS_CLIST(pdev) || pdev->num_render_threads_requested < 1 ||
+        jdev->downscale.downscale_factor != 1)
+        return 1;
+
+    /* The sampling factors fix the height of a row of MCUs. */
+    code = jpeg_init_encoder(jdev, mem, &state, &jcdp, pdev->height, true, false);
+    if (code >= 0) {
+        arg.mcu_height = 1;
+        for (ci = 0; ci < jcdp->cinfo.num_components; ci++)
+            arg.mcu_height = max(arg.mcu_height,
+                                 jcdp->cinfo.comp_info[ci].v_samp_factor);
+        arg.mcu_height *= DCTSIZE;
+    }
+    jpeg_fin_encoder(mem, &state, jcdp);
+    if (code < 0)
+        return code;
+    arg.num_mcu_rows = (pdev->height + arg.mcu_height - 1) / arg.mcu_height;
+    if (arg.num_mcu_rows < 2)
+        return 1;
+
+    arg.jdev = jdev;
+    arg.file = prn_stream;
+    arg.height = pdev->height;
+    arg.line_size = gdev_mem_bytes_per_scan_line((gx_device *) pdev);
+    arg.piece.data = NULL;
+    arg.piece.size = arg.piece.alloc = 0;
+    arg.carry = gs_alloc_bytes(mem, (size_t)arg.line_size * arg.mcu_height,
+                               "jpeg_print_page_bands(carry)");
+    if (arg.carry == NULL)
+        return_error(gs_error_VMerror);
+
+    process.init_buffer_fn = jpeg_band_init_buffer;
+    process.free_buffer_fn = jpeg_band_free_buffer;
+    process.process_fn = jpeg_band_process;
+    process.output_fn = jpeg_band_output;
+    process.arg = &arg;
+    code = dev_proc(pdev, process_page)((gx_device *)pdev, &process);
+
+    jpeg_piece_free(mem, &arg.piece);
+    gs_free_object(mem, arg.carry, "jpeg_print_page_bands(carry)");
+    return code;
+}
+
+/* Send the page to the file. */
+static int
+jpeg_print_page(gx_device_printer * pdev, FILE * prn_stream)
+{
+    gx_device_jpeg *jdev = (gx_device_jpeg *) pdev;
+    gs_memory_t *mem = pdev->memory;
+    int line_size = gdev_mem_bytes_per_scan_line((gx_device *) pdev);
+    byte *in;
+    jpeg_compress_data *jcdp = NULL;
+    byte *fbuf = 0;
+    uint fbuf_size;
+    byte *jbuf = 0;
+    uint jbuf_size;
+    int lnum;
+    int code;
+    stream_DCT_state state;
+    stream fstrm, jstrm;
+    gx_downscaler_t ds;
+
+    code = jpeg_print_page_bands(pdev, prn_stream);
+    if (code <= 0)
+        return code;
+
+    in = gs_alloc_bytes(mem, line_size, "jpeg_print_page(in)");
+    if (in == 0)
+        return_error(gs_error_VMerror);
+    code = gx_downscaler_init(&ds, (gx_device *)jdev, 8, 8,
+                              jdev->color_info.depth/8, jdev->downscale.downscale_factor, 0, NULL, 0);
+    if (code < 0)
+        goto fail;
+
+    code = jpeg_init_encoder(jdev, mem, &state, &jcdp,
+                             gx_downscaler_scale(pdev->height, jdev->downscale.downscale_factor),
+                             false, true);
+    if (code < 0)
+        goto done;
 
     /* Set up the streams. */
     fbuf_size = max(512 /* arbitrary */ , jcdp->templat.min_out_size);
@@ -563,17 +927,9 @@ jpeg_print_page(gx_device_printer * pdev, FILE * prn_stream)
   done:
     gs_free_object(mem, jbuf, "jpeg_print_page(jbuf)");
     gs_free_object(mem, fbuf, "jpeg_print_page(fbuf)");
-    if (jcdp) {
-        gs_jpeg_destroy(&state);
-        gs_free_object(mem, jcdp, "jpeg_print_page(jpeg_compress_data)");
-    }
+    jpeg_fin_encoder(mem, &state, jcdp);
     gx_downscaler_fin(&ds);
-    gs_free_object(mem, in, "jpeg_print_page(in)");
-    return code;
   fail:
-    if (jcdp)
-        gs_free_object(mem, jcdp, "jpeg_print_page(jpeg_compress_data)");
     gs_free_object(mem, in, "jpeg_print_page(in)");
     return code;
 }
-
@@ -55,6 +55,7 @@
 #include "gdevpccm.h"
 #include "gscdefs.h"
 #include "gxdownscale.h"
+#include "gdevfpng.h"
 
 /* ------ The device descriptors ------ */
 
@@ -79,24 +80,32 @@ static dev_proc_get_params(png_get_params_downscale);
 static dev_proc_put_params(png_put_params_downscale);
 static dev_proc_get_params(png_get_params_downscale_mfs);
 static dev_proc_put_params(png_put_params_downscale_mfs);
+static dev_proc_get_params(png_get_params);
+static dev_proc_put_params(png_put_params);
 
 typedef struct gx_device_png_s gx_device_png;
 struct gx_device_png_s {
     gx_device_common;
     gx_prn_device_common;
     gx_downscaler_params downscale;
+    fpng_params png;
 };
 
 /* Monochrome. */
 
+/* Since the print_page doesn't alter the device, this device can print in the background */
+static const gx_device_procs pngmono_procs =
+prn_params_procs(gdev_prn_open, gdev_prn_bg_output_page, gdev_prn_close,
+                 png_get_params, png_put_params);
 const gx_device_png gs_pngmono_device =
-{ /* The print_page proc is compatible with allowing bg printing */
-  prn_device_body(gx_device_png, prn_bg_procs, "pngmono",
+{
+  prn_device_body(gx_device_png, pngmono_procs, "pngmono",
            DEFAULT_WIDTH_10THS, DEFAULT_HEIGHT_10THS,
            X_DPI, Y_DPI,
            0, 0, 0, 0,		/* margins */
            1, 1, 1, 1, 2, 2, png_print_page),
-    GX_DOWNSCALER_PARAMS_DEFAULTS
+    GX_DOWNSCALER_PARAMS_DEFAULTS,
+    FPNG_PARAMS_DEFAULTS(FPNG_FILTER_ADAPTIVE)
 };
 
 
@@ -104,15 +113,17 @@ const gx_device_png gs_pngmono_device =
 
 /* Since the print_page doesn't alter the device, this device can print in the background */
 static const gx_device_procs png16_procs =
-prn_color_procs(gdev_prn_open, gdev_prn_bg_output_page, gdev_prn_close,
-                pc_4bit_map_rgb_color, pc_4bit_map_color_rgb);
+prn_color_params_procs(gdev_prn_open, gdev_prn_bg_output_page, gdev_prn_close,
+                       pc_4bit_map_rgb_color, pc_4bit_map_color_rgb,
+                       png_get_params, png_put_params);
 const gx_device_png gs_png16_device = {
   prn_device_body(gx_device_png, png16_procs, "png16",
            DEFAULT_WIDTH_10THS, DEFAULT_HEIGHT_10THS,
            X_DPI, Y_DPI,
            0, 0, 0, 0,		/* margins */
            3, 4, 1, 1, 2, 2, png_print_page),
-    GX_DOWNSCALER_PARAMS_DEFAULTS
+    GX_DOWNSCALER_PARAMS_DEFAULTS,
+    FPNG_PARAMS_DEFAULTS(FPNG_FILTER_ADAPTIVE)
 };
 
 /* 8-bit (SuperVGA-style) color. */
@@ -120,15 +131,17 @@ const gx_device_png gs_png16_device = {
 
 /* Since the print_page doesn't alter the device, this device can print in the background */
 static const gx_device_procs png256_procs =
-prn_color_procs(gdev_prn_open, gdev_prn_bg_output_page, gdev_prn_close,
-                pc_8bit_map_rgb_color, pc_8bit_map_color_rgb);
+prn_color_params_procs(gdev_prn_open, gdev_prn_bg_output_page, gdev_prn_close,
+                       pc_8bit_map_rgb_color, pc_8bit_map_color_rgb,
+                       png_get_params, png_put_params);
 const gx_device_png gs_png256_device = {
   prn_device_body(gx_device_png, png256_procs, "png256",
            DEFAULT_WIDTH_10THS, DEFAULT_HEIGHT_10THS,
            X_DPI, Y_DPI,
            0, 0, 0, 0,		/* margins */
            3, 8, 5, 5, 6, 6, png_print_page),
-    GX_DOWNSCALER_PARAMS_DEFAULTS
+    GX_DOWNSCALER_PARAMS_DEFAULTS,
+    FPNG_PARAMS_DEFAULTS(FPNG_FILTER_ADAPTIVE)
 };
 
 /* 8-bit gray */
@@ -145,7 +158,8 @@ const gx_device_png gs_pnggray_device =
                  X_DPI, Y_DPI,
                  0, 0, 0, 0,	/* margins */
                  1, 8, 255, 0, 256, 0, png_print_page),
-    GX_DOWNSCALER_PARAMS_DEFAULTS
+    GX_DOWNSCALER_PARAMS_DEFAULTS,
+    FPNG_PARAMS_DEFAULTS(FPNG_FILTER_ADAPTIVE)
 };
 
 /* Monochrome (with error diffusion) */
@@ -163,7 +177,8 @@ const gx_device_png gs_pngmonod_device =
                  X_DPI, Y_DPI,
                  0, 0, 0, 0,	/* margins */
                  1, 8, 255, 0, 256, 0, png_print_page_monod),
-    GX_DOWNSCALER_PARAMS_DEFAULTS
+    GX_DOWNSCALER_PARAMS_DEFAULTS,
+    FPNG_PARAMS_DEFAULTS(FPNG_FILTER_ADAPTIVE)
 };
 
 /* 24-bit color. */
@@ -180,22 +195,26 @@ const gx_device_png gs_png16m_device =
                  X_DPI, Y_DPI,
                  0, 0, 0, 0,	/* margins */
                  3, 24, 255, 255, 256, 256, png_print_page),
-    GX_DOWNSCALER_PARAMS_DEFAULTS
+    GX_DOWNSCALER_PARAMS_DEFAULTS,
+    FPNG_PARAMS_DEFAULTS(FPNG_FILTER_ADAPTIVE)
 };
 
 /* 48 bit color. */
 
 /* Since the print_page doesn't alter the device, this device can print in the background */
 static const gx_device_procs png48_procs =
-prn_color_procs(gdev_prn_open, gdev_prn_bg_output_page, gdev_prn_close,
-                gx_default_rgb_map_rgb_color, gx_default_rgb_map_color_rgb);
+prn_color_params_procs(gdev_prn_open, gdev_prn_bg_output_page, gdev_prn_close,
+                       gx_default_rgb_map_rgb_color,
+                       gx_default_rgb_map_color_rgb,
+                       png_get_params, png_put_params);
 const gx_device_png gs_png48_device =
 {prn_device_body(gx_device_png, png48_procs, "png48",
                  DEFAULT_WIDTH_10THS, DEFAULT_HEIGHT_10THS,
                  X_DPI, Y_DPI,
                  0, 0, 0, 0,	/* margins */
                  3, 48, 0, 65535, 1, 65536, png_print_page),
-    GX_DOWNSCALER_PARAMS_DEFAULTS
+    GX_DOWNSCALER_PARAMS_DEFAULTS,
+    FPNG_PARAMS_DEFAULTS(FPNG_FILTER_ADAPTIVE)
 };
 
 /* 32-bit RGBA */
@@ -211,6 +230,7 @@ struct gx_device_pngalpha_s {
     gx_device_common;
     gx_prn_device_common;
     gx_downscaler_params downscale;
+    fpng_params png;
     int background;
 };
 static const gx_device_procs pngalpha_procs =
@@ -314,11 +334,42 @@ const gx_device_pngalpha gs_pngalpha_device = {
         std_device_part3_(),
         prn_device_body_rest_(png_print_page),
         GX_DOWNSCALER_PARAMS_DEFAULTS,
+        FPNG_PARAMS_DEFAULTS(FPNG_FILTER_ADAPTIVE),
         0xffffff	/* white background */
 };
 
 /* ------ Private definitions ------ */
 
+static int
+png_get_params(gx_device * dev, gs_param_list * plist)
+{
+    gx_device_png *pdev = (gx_device_png *)dev;
+    int code, ecode;
+
+    ecode = fpng_write_params(plist, &pdev->png);
+
+    code = gdev_prn_get_params(dev, plist);
+    if (code < 0)
+        ecode = code;
+
+    return ecode;
+}
+
+static int
+png_put_params(gx_device *dev, gs_param_list *plist)
+{
+    gx_device_png *pdev = (gx_device_png *)dev;
+    int code, ecode;
+
+    ecode = fpng_read_params(plist, &pdev->png);
+
+    code = gdev_prn_put_params(dev, plist);
+    if (code < 0)
+        ecode = code;
+
+    return ecode;
+}
+
 static int
 png_get_params_downscale(gx_device * dev, gs_param_list * plist)
 {
@@ -328,6 +379,8 @@ png_get_params_downscale(gx_device * dev, gs_param_list * plist)
     ecode = 0;
     if ((code = gx_downscaler_write_params(plist, &pdev->downscale, 0)) < 0)
         ecode = code;
+    if ((code = fpng_write_params(plist, &pdev->png)) < 0)
+        ecode = code;
 
     code = gdev_prn_get_params(dev, plist);
     if (code < 0)
@@ -343,6 +396,9 @@ png_put_params_downscale(gx_device *dev, gs_param_list *plist)
     int code, ecode;
 
     ecode = gx_downscaler_read_params(plist, &pdev->downscale, 0);
+    code = fpng_read_params(plist, &pdev->png);
+    if (code < 0)
+        ecode = code;
 
     code = gdev_prn_put_params(dev, plist);
     if (code < 0)
@@ -359,6 +415,8 @@ png_get_params_downscale_mfs(gx_device *dev, gs_param_list *plist)
 
     ecode = gx_downscaler_write_params(plist, &pdev->downscale,
                                       GX_DOWNSCALER_PARAMS_MFS);
+    if ((code = fpng_write_params(plist, &pdev->png)) < 0)
+        ecode = code;
 
     code = gdev_prn_get_params(dev, plist);
     if (code < 0)
@@ -375,6 +433,9 @@ png_put_params_downscale_mfs(gx_device *dev, gs_param_list *plist)
 
     ecode = gx_downscaler_read_params(plist, &pdev->downscale,
                                       GX_DOWNSCALER_PARAMS_MFS);
+    code = fpng_read_params(plist, &pdev->png);
+    if (code < 0)
+        ecode = code;
 
     code = gdev_prn_put_params(dev, plist);
     if (code < 0)
@@ -453,6 +514,8 @@ do_png_print_page(gx_device_png * pdev, FILE * file, bool monod)
     png_color *palettep;
     png_uint_16 num_palette;
     png_uint_32 valid = 0;
+    int transform = 0;
+    bool bands;
 
     /* Sanity check params */
     if (factor < 1)
@@ -598,6 +661,14 @@ do_png_print_page(gx_device_png * pdev, FILE * file, bool monod)
     width = pdev->width/factor;
     height = pdev->height/factor;
 
+    /* When the page is rendered by threads, filter and compress the
+     * bands in the rendering threads too; libpng then only writes the
+     * chunks before the image data. The error diffusion and feature size
+     * code of the downscaler need the whole page in order, so those
+     * keep to the serial path. */
+    bands = PRINTER_IS_CLIST(pdev) && pdev->num_render_threads_requested >= 1 &&
+            !monod && factor == 1 && mfs == 1;
+
 #if PNG_LIBPNG_VER_MINOR >= 5
     png_set_pHYs(png_ptr, info_ptr,
                  x_pixels_per_unit, y_pixels_per_unit, phys_unit_type);
@@ -666,6 +737,11 @@ do_png_print_page(gx_device_png * pdev, FILE * file, bool monod)
         png_set_swap(png_ptr);
     }
 #endif
+    if (pdev->png.compression_level != -1)
+        png_set_compression_level(png_ptr, pdev->png.compression_level);
+    if (pdev->png.filter != FPNG_FILTER_ADAPTIVE)
+        png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE,
+                       PNG_FILTER_NONE << pdev->png.filter);
 
     /* write the file information */
     png_write_info(png_ptr, info_ptr);
@@ -677,24 +753,36 @@ do_png_print_page(gx_device_png * pdev, FILE * file, bool monod)
     info_ptr->text = NULL;
 #endif
 
-    /* For simplicity of code, we always go through the downscaler. For
-     * non-supported depths, it will pass through with minimal performance
-     * hit. So ensure that we only trigger downscales when we need them.
-     */
-    code = gx_downscaler_init(&ds, (gx_device *)pdev, src_bpc, dst_bpc,
-                              depth/dst_bpc, factor, mfs, NULL, 0);
-    if (code >= 0)
-    {
-        /* Write the contents of the image. */
-        for (y = 0; y < height; y++) {
-            gx_downscaler_getbits(&ds, row, y);
-            png_write_rows(png_ptr, &row, 1);
+    if (bands) {
+        /* The 48 bit rows are read straight from the band buffer, so
+         * they are big endian already and need no swap. */
+        if (invert)
+            transform |= (depth == 32 ? FPNG_INVERT_ALPHA : FPNG_INVERT);
+        if (palettep)
+            transform |= FPNG_PALETTE;
+        /* This writes the image data and the end of the file. */
+        code = fpng_write_image((gx_device *)pdev, file, &pdev->png,
+                                transform, 1);
+    } else {
+        /* For simplicity of code, we always go through the downscaler. For
+         * non-supported depths, it will pass through with minimal performance
+         * hit. So ensure that we only trigger downscales when we need them.
+         */
+        code = gx_downscaler_init(&ds, (gx_device *)pdev, src_bpc, dst_bpc,
+                                  depth/dst_bpc, factor, mfs, NULL, 0);
+        if (code >= 0)
+        {
+            /* Write the contents of the image. */
+            for (y = 0; y < height; y++) {
+                gx_downscaler_getbits(&ds, row, y);
+                png_write_rows(png_ptr, &row, 1);
+            }
+            gx_downscaler_fin(&ds);
         }
-        gx_downscaler_fin(&ds);
-    }
 
-    /* write the rest of the file */
-    png_write_end(png_ptr, info_ptr);
+        /* write the rest of the file */
+        png_write_end(png_ptr, info_ptr);
+    }
 
 #if PNG_LIBPNG_VER_MINOR >= 5
 #else
@@ -814,6 +902,8 @@ pngalpha_put_params(gx_device * pdev, gs_param_list * plist)
 
     if ((ecode = gx_downscaler_read_params(plist, &ppdev->downscale, 0)) < 0)
         code = ecode;
+    if ((ecode = fpng_read_params(plist, &ppdev->png)) < 0)
+        code = ecode;
 
     if (code == 0) {
         code = gdev_prn_put_params(pdev, plist);
@@ -835,6 +925,8 @@ pngalpha_get_params(gx_device * pdev, gs_param_list * plist)
     ecode = 0;
     if ((ecode = gx_downscaler_write_params(plist, &ppdev->downscale, 0)) < 0)
         code = ecode;
+    if ((ecode = fpng_write_params(plist, &ppdev->png)) < 0)
+        code = ecode;
 
     return code;
 }
@@ -25,6 +25,7 @@
 #include "gdevprn.h"
 #include "minftrsz.h"
 #include "gxdownscale.h"
+#include "gxgetbit.h"
 #include "scommon.h"
 #include "stream.h"
 #include "strmio.h"
@@ -440,6 +441,351 @@ int tiff_set_fields_for_printer(gx_device_printer *pdev,
     return 0;
 }
 
+/* ------ Band-parallel strip encoding ------ */
+
+/*
+ * When the page is rendered from a clist, the rows of each band are
+ * handed to us (through process_page) in the thread that rendered them.
+ * The strips lying wholly within the band are compressed there, into a
+ * TIFF held in memory, and the output step copies the compressed strips
+ * to the real file with TIFFWriteRawStrip, in band order. Bands need not
+ * be a multiple of RowsPerStrip high, so a strip that straddles a band
+ * boundary is assembled in the writer's carry buffer as its rows arrive,
+ * and compressed by the output step once it is complete.
+ */
+
+int
+tiff_strip_writer_init(tiff_strip_writer *w, gx_device_printer *dev, TIFF *tif,
+                       int height)
+{
+    uint32 rps;
+
+    w->dev = dev;
+    w->tif = tif;
+    w->height = height;
+    w->scanline = TIFFScanlineSize(tif);
+    if (!TIFFGetField(tif, TIFFTAG_ROWSPERSTRIP, &rps) || rps > height)
+        rps = height;
+    w->rows_per_strip = rps;
+    w->carry = gs_alloc_bytes(dev->memory, w->scanline * rps,
+                              "tiff_strip_writer_init");
+    if (w->carry == NULL)
+        return_error(gs_error_VMerror);
+    return 0;
+}
+
+void
+tiff_strip_writer_fin(tiff_strip_writer *w)
+{
+    gs_free_object(w->dev->memory, w->carry, "tiff_strip_writer_fin");
+    w->carry = NULL;
+}
+
+int
+tiff_band_strips_alloc(tiff_band_strips **pbs, gs_memory_t *mem,
+                       const tiff_strip_writer *w, int max_rows)
+{
+    tiff_band_strips *bs;
+    int max_strips = max_rows / w->rows_per_strip + 1;
+
+    *pbs = NULL;
+    bs = (tiff_band_strips *)gs_alloc_bytes(mem, sizeof(tiff_band_strips),
+                                            "tiff_band_strips_alloc");
+    if (bs == NULL)
+        return_error(gs_error_VMerror);
+    bs->memory = mem;
+    bs->max_rows = max_rows;
+    bs->y0 = bs->rows = 0;
+    bs->mtif = NULL;
+    bs->first_strip = bs->num_strips = 0;
+    bs->data = gs_alloc_bytes(mem, w->scanline * max_rows,
+                              "tiff_band_strips_alloc(data)");
+    bs->offset = (toff_t *)gs_alloc_bytes(mem, 2 * max_strips * sizeof(toff_t),
+                                          "tiff_band_strips_alloc(offsets)");
+    if (bs->data == NULL || bs->offset == NULL) {
+        tiff_band_strips_free(bs);
+        return_error(gs_error_VMerror);
+    }
+    bs->length = bs->offset + max_strips;
+    *pbs = bs;
+    return 0;
+}
+
+void
+tiff_band_strips_free(tiff_band_strips *bs)
+{
+    if (bs == NULL)
+        return;
+    if (bs->mtif != NULL)
+        tiff_memory_free(bs->mtif);
+    gs_free_object(bs->memory, bs->offset, "tiff_band_strips_free(offsets)");
+    gs_free_object(bs->memory, bs->data, "tiff_band_strips_free(data)");
+    gs_free_object(bs->memory, bs, "tiff_band_strips_free");
+}
+
+/* Give the memory TIFF the fields that determine how strips are encoded. */
+static void
+tiff_copy_encoding_fields(TIFF *to, TIFF *from)
+{
+    uint32 v32;
+    uint16 v16, compression = COMPRESSION_NONE;
+
+    if (TIFFGetField(from, TIFFTAG_IMAGEWIDTH, &v32))
+        TIFFSetField(to, TIFFTAG_IMAGEWIDTH, v32);
+    if (TIFFGetField(from, TIFFTAG_BITSPERSAMPLE, &v16))
+        TIFFSetField(to, TIFFTAG_BITSPERSAMPLE, v16);
+    if (TIFFGetField(from, TIFFTAG_SAMPLESPERPIXEL, &v16))
+        TIFFSetField(to, TIFFTAG_SAMPLESPERPIXEL, v16);
+    if (TIFFGetField(from, TIFFTAG_PHOTOMETRIC, &v16))
+        TIFFSetField(to, TIFFTAG_PHOTOMETRIC, v16);
+    if (TIFFGetField(from, TIFFTAG_FILLORDER, &v16))
+        TIFFSetField(to, TIFFTAG_FILLORDER, v16);
+    if (TIFFGetField(from, TIFFTAG_PLANARCONFIG, &v16))
+        TIFFSetField(to, TIFFTAG_PLANARCONFIG, v16);
+    TIFFGetField(from, TIFFTAG_COMPRESSION, &compression);
+    TIFFSetField(to, TIFFTAG_COMPRESSION, compression);
+    switch (compression) {
+        case COMPRESSION_LZW:
+        case COMPRESSION_ADOBE_DEFLATE:
+        case COMPRESSION_DEFLATE:
+            if (TIFFGetField(from, TIFFTAG_PREDICTOR, &v16))
+                TIFFSetField(to, TIFFTAG_PREDICTOR, v16);
+            break;
+        case COMPRESSION_CCITTFAX3:
+            if (TIFFGetField(from, TIFFTAG_GROUP3OPTIONS, &v32))
+                TIFFSetField(to, TIFFTAG_GROUP3OPTIONS, v32);
+            break;
+        case COMPRESSION_CCITTFAX4:
+            if (TIFFGetField(from, TIFFTAG_GROUP4OPTIONS, &v32))
+                TIFFSetField(to, TIFFTAG_GROUP4OPTIONS, v32);
+            break;
+        default:
+            break;
+    }
+}
+
+/*
+ * Called in a rendering thread, once the rows y0 .. y0 + rows - 1 of the
+ * image have been placed in the band's data: compress the strips that lie
+ * wholly within them.
+ */
+int
+tiff_band_strips_encode(tiff_band_strips *bs, const tiff_strip_writer *w,
+                        int y0, int rows)
+{
+    int rps = w->rows_per_strip;
+    int y1 = y0 + rows;
+    int s0 = (y0 + rps - 1) / rps;
+    int s1 = (y1 == w->height ? (w->height + rps - 1) / rps : y1 / rps);
+    int s, sy0, sy1;
+    toff_t size;
+
+    bs->y0 = y0;
+    bs->rows = rows;
+    bs->first_strip = s0;
+    bs->num_strips = 0;
+    if (bs->mtif != NULL) {
+        tiff_memory_free(bs->mtif);
+        bs->mtif = NULL;
+    }
+    if (s1 <= s0)
+        return 0;
+
+    bs->mtif = tiff_to_memory(w->dev, bs->memory, "band",
+                              TIFFIsBigEndian(w->tif));
+    if (bs->mtif == NULL)
+        return_error(gs_error_VMerror);
+    tiff_copy_encoding_fields(bs->mtif, w->tif);
+    TIFFSetField(bs->mtif, TIFFTAG_ROWSPERSTRIP, rps);
+    TIFFSetField(bs->mtif, TIFFTAG_IMAGELENGTH,
+                 (uint32)(min(s1 * rps, w->height) - s0 * rps));
+
+    for (s = s0; s < s1; s++) {
+        sy0 = s * rps;
+        sy1 = min(sy0 + rps, w->height);
+        tiff_memory_data(bs->mtif, &size);
+        bs->offset[s - s0] = size;
+        if (TIFFWriteEncodedStrip(bs->mtif, s - s0,
+                                  bs->data + (sy0 - y0) * w->scanline,
+                                  (sy1 - sy0) * w->scanline) < 0)
+            return_error(gs_error_ioerror);
+        tiff_memory_data(bs->mtif, &size);
+        bs->length[s - s0] = size - bs->offset[s - s0];
+        bs->num_strips++;
+    }
+    return 0;
+}
+
+/*
+ * Called in the main thread, in band order: copy the band's compressed
+ * strips to the output, and add its remaining rows to the strips that
+ * straddle its edges.
+ */
+int
+tiff_band_strips_write(tiff_strip_writer *w, tiff_band_strips *bs)
+{
+    int rps = w->rows_per_strip;
+    int y = bs->y0, y1 = bs->y0 + bs->rows;
+    const byte *mdata = NULL;
+    toff_t msize;
+    int s, sy0, sy1, n;
+
+    if (bs->mtif != NULL)
+        mdata = tiff_memory_data(bs->mtif, &msize);
+    while (y < y1) {
+        s = y / rps;
+        sy0 = s * rps;
+        sy1 = min(sy0 + rps, w->height);
+        if (s >= bs->first_strip && s < bs->first_strip + bs->num_strips) {
+            if (TIFFWriteRawStrip(w->tif, s,
+                                  (void *)(mdata + bs->offset[s - bs->first_strip]),
+                                  bs->length[s - bs->first_strip]) < 0)
+                return_error(gs_error_ioerror);
+            y = sy1;
+            continue;
+        }
+        n = min(sy1, y1) - y;
+        memcpy(w->carry + (y - sy0) * w->scanline,
+               bs->data + (y - bs->y0) * w->scanline, n * w->scanline);
+        y += n;
+        if (y == sy1 &&
+            TIFFWriteEncodedStrip(w->tif, s, w->carry,
+                                  (sy1 - sy0) * w->scanline) < 0)
+            return_error(gs_error_ioerror);
+    }
+    if (bs->mtif != NULL) {
+        tiff_memory_free(bs->mtif);
+        bs->mtif = NULL;
+    }
+    return 0;
+}
+
+/*
+ * The process_page callbacks for the chunky devices, whose rows go to
+ * the file unchanged apart from byte order and padding.
+ */
+typedef struct tiff_process_arg_s {
+    tiff_strip_writer w;
+    int size;                   /* bytes per device scan line */
+    byte pad_mask;              /* for the last byte, if the row ends within it */
+    bool swab16;
+} tiff_process_arg;
+
+static int
+tiff_band_init_buffer(void *arg_, gx_device *dev, gs_memory_t *mem, int w,
+                      int h, void **pbuffer)
+{
+    tiff_process_arg *arg = (tiff_process_arg *)arg_;
+
+    return tiff_band_strips_alloc((tiff_band_strips **)pbuffer, mem, &arg->w, h);
+}
+
+static void
+tiff_band_free_buffer(void *arg, gx_device *dev, gs_memory_t *mem, void *buffer)
+{
+    tiff_band_strips_free((tiff_band_strips *)buffer);
+}
+
+static int
+tiff_band_process(void *arg_, gx_device *dev, gx_device *bdev,
+                  const gs_int_rect *rect, void *buffer)
+{
+    tiff_process_arg *arg = (tiff_process_arg *)arg_;
+    tiff_band_strips *bs = (tiff_band_strips *)buffer;
+    int h = rect->q.y - rect->p.y;
+    gs_get_bits_params_t params;
+    gs_int_rect my_rect;
+    byte *row;
+    int y, code;
+
+    if (h <= 0)
+        return 0;
+    if (h > bs->max_rows)
+        return_error(gs_error_rangecheck);
+
+    my_rect.p.x = 0;
+    my_rect.q.x = rect->q.x - rect->p.x;
+    for (y = 0; y < h; y++) {
+        params.options = GB_COLORS_NATIVE | GB_ALPHA_NONE | GB_PACKING_CHUNKY |
+                         GB_RETURN_POINTER | GB_ALIGN_ANY | GB_OFFSET_0 |
+                         GB_RASTER_ANY;
+        my_rect.p.y = y;
+        my_rect.q.y = y + 1;
+        code = dev_proc(bdev, get_bits_rectangle)(bdev, &my_rect, &params, NULL);
+        if (code < 0)
+            return code;
+        row = bs->data + y * arg->w.scanline;
+        memcpy(row, params.data[0], min(arg->size, arg->w.scanline));
+        /* The band buffer's bits beyond the page width are undefined. */
+        if (arg->pad_mask)
+            row[arg->size - 1] &= arg->pad_mask;
+        if (arg->w.scanline > arg->size)
+            memset(row + arg->size, 0, arg->w.scanline - arg->size);
+#if defined(ARCH_IS_BIG_ENDIAN) && (!ARCH_IS_BIG_ENDIAN)
+        if (arg->swab16)
+            TIFFSwabArrayOfShort((uint16 *)row,
+                                 dev->width * (long)dev->color_info.num_components);
+#endif
+    }
+    return tiff_band_strips_encode(bs, &arg->w, rect->p.y, h);
+}
+
+static int
+tiff_band_output(void *arg_, gx_device *dev, void *buffer)
+{
+    tiff_process_arg *arg = (tiff_process_arg *)arg_;
+
+    return tiff_band_strips_write(&arg->w, (tiff_band_strips *)buffer);
+}
+
+/*
+ * Band-parallel encoding is only worth setting up when the clist will be
+ * rendered by several threads, and only applies when there is more than
+ * one strip to the page.
+ */
+bool
+tiff_can_encode_bands(gx_device_printer *dev, TIFF *tif, int height)
+{
+    uint32 rps;
+
+    if (!PRINTER_IS_CLIST(dev) || dev->num_render_threads_requested < 1)
+        return false;
+    if (!TIFFGetField(tif, TIFFTAG_ROWSPERSTRIP, &rps) || rps >= height)
+        return false;
+    return true;
+}
+
+/* Write the page, as it comes from the device, through process_page. */
+static int
+tiff_print_page_bands(gx_device_printer *dev, TIFF *tif)
+{
+    tiff_process_arg arg;
+    gx_process_page_options_t process = { 0 };
+    int bits, code;
+
+    code = tiff_strip_writer_init(&arg.w, dev, tif, dev->height);
+    if (code < 0)
+        return code;
+    arg.size = gdev_mem_bytes_per_scan_line((gx_device *)dev);
+    bits = (dev->width * dev->color_info.depth) & 7;
+    arg.pad_mask = (bits ? (byte)(0xff00 >> bits) : 0);
+    arg.swab16 = (dev->color_info.depth / dev->color_info.num_components == 16);
+
+    process.init_buffer_fn = tiff_band_init_buffer;
+    process.free_buffer_fn = tiff_band_free_buffer;
+    process.process_fn = tiff_band_process;
+    process.output_fn = tiff_band_output;
+    process.arg = &arg;
+
+    code = TIFFCheckpointDirectory(tif);
+    if (code >= 0)
+        code = dev_proc(dev, process_page)((gx_device *)dev, &process);
+    if (code >= 0)
+        code = TIFFWriteDirectory(tif);
+    tiff_strip_writer_fin(&arg.w);
+    return code;
+}
+
 int
 tiff_print_page(gx_device_printer *dev, TIFF *tif, int min_feature_size)
 {
@@ -453,6 +799,10 @@ tiff_print_page(gx_device_printer *dev, TIFF *tif, int min_feature_size)
     int line_lag = 0;
     int filtered_count;
 
+    if ((bpc != 1 || min_feature_size <= 1) &&
+        tiff_can_encode_bands(dev, tif, dev->height))
+        return tiff_print_page_bands(dev, tif);
+
     data = gs_alloc_bytes(dev->memory, max_size, "tiff_print_page(data)");
     if (data == NULL)
         return_error(gs_error_VMerror);
@@ -542,6 +892,14 @@ tiff_downscale_and_print_page(gx_device_printer *dev, TIFF *tif, int factor,
     int height = dev->height/factor;
     gx_downscaler_t ds;
 
+    /* Without scaling, filtering or colour management, the rows are those
+     * of the device, and can be encoded as the bands are rendered. */
+    if (factor == 1 && mfs <= 1 && bpc == 8 && trap_w == 0 && trap_h == 0 &&
+        ets == 0 && tfdev->icclink == NULL &&
+        fax_adjusted_width(dev->width, aw) == dev->width &&
+        tiff_can_encode_bands(dev, tif, height))
+        return tiff_print_page_bands(dev, tif);
+
     code = TIFFCheckpointDirectory(tif);
     if (code < 0)
         return code;
@@ -61,6 +61,40 @@ int tiff_downscale_and_print_page(gx_device_printer *dev, TIFF *tif,
                                   int ets);
 void tiff_set_handlers (void);
 
+/*
+ * Encoding of strips in the clist rendering threads: the writer belongs
+ * to the output TIFF, and there is one tiff_band_strips per band buffer.
+ */
+typedef struct tiff_strip_writer_s {
+    gx_device_printer *dev;
+    TIFF *tif;
+    int height;                 /* rows in the image */
+    int rows_per_strip;
+    tmsize_t scanline;          /* bytes per row, as TIFFScanlineSize */
+    byte *carry;                /* a strip straddling two bands */
+} tiff_strip_writer;
+
+typedef struct tiff_band_strips_s {
+    gs_memory_t *memory;
+    int max_rows;
+    byte *data;                 /* the band's rows, scanline bytes apiece */
+    int y0, rows;               /* the image rows held in data */
+    TIFF *mtif;                 /* the band's complete strips, compressed */
+    int first_strip, num_strips;
+    toff_t *offset, *length;    /* of each strip in mtif */
+} tiff_band_strips;
+
+bool tiff_can_encode_bands(gx_device_printer *dev, TIFF *tif, int height);
+int tiff_strip_writer_init(tiff_strip_writer *w, gx_device_printer *dev,
+                           TIFF *tif, int height);
+void tiff_strip_writer_fin(tiff_strip_writer *w);
+int tiff_band_strips_alloc(tiff_band_strips **pbs, gs_memory_t *mem,
+                           const tiff_strip_writer *w, int max_rows);
+void tiff_band_strips_free(tiff_band_strips *bs);
+int tiff_band_strips_encode(tiff_band_strips *bs, const tiff_strip_writer *w,
+                            int y0, int rows);
+int tiff_band_strips_write(tiff_strip_writer *w, tiff_band_strips *bs);
+
 /*
  * Sets the compression tag for TIFF and updates the rows_per_strip tag to
  * reflect max_strip_size under the new compression scheme.
@@ -2283,6 +2283,180 @@ print_cmyk_equivalent_colors(tiffsep_device *tfdev, int num_comp, cmyk_composite
     return 0;
 }
 
+/*
+ * Encoding the separations and the composite as the bands are rendered.
+ * This covers 8 bit output at full resolution without SeparationOrder,
+ * trapping or a post rendering profile; the rows then come straight from
+ * the device planes.
+ */
+typedef struct tiffsep_process_arg_s {
+    tiffsep_device *tfdev;
+    int num_comp;
+    int num_sep;                /* separation files written; 0 or num_comp */
+    cmyk_composite_map *cmyk_map;
+    tiff_strip_writer w[GX_DEVICE_COLOR_MAX_COMPONENTS + 1]; /* the seps, then the composite */
+} tiffsep_process_arg;
+
+typedef struct tiffsep_band_s {
+    tiff_band_strips *strips[GX_DEVICE_COLOR_MAX_COMPONENTS + 1];
+} tiffsep_band;
+
+static void
+tiffsep_band_free_buffer(void *arg_, gx_device *dev, gs_memory_t *mem, void *buffer)
+{
+    tiffsep_band *band = (tiffsep_band *)buffer;
+    int i;
+
+    if (band == NULL)
+        return;
+    for (i = 0; i <= GX_DEVICE_COLOR_MAX_COMPONENTS; i++)
+        tiff_band_strips_free(band->strips[i]);
+    gs_free_object(mem, band, "tiffsep_band_free_buffer");
+}
+
+static int
+tiffsep_band_init_buffer(void *arg_, gx_device *dev, gs_memory_t *mem, int w,
+                         int h, void **pbuffer)
+{
+    tiffsep_process_arg *arg = (tiffsep_process_arg *)arg_;
+    tiffsep_band *band;
+    int i, code;
+
+    band = (tiffsep_band *)gs_alloc_bytes(mem, sizeof(tiffsep_band),
+                                          "tiffsep_band_init_buffer");
+    *pbuffer = band;
+    if (band == NULL)
+        return_error(gs_error_VMerror);
+    memset(band, 0, sizeof(tiffsep_band));
+    for (i = 0; i <= arg->num_sep; i++) {
+        code = tiff_band_strips_alloc(&band->strips[i], mem, &arg->w[i], h);
+        if (code < 0)
+            return code;
+    }
+    return 0;
+}
+
+static int
+tiffsep_band_process(void *arg_, gx_device *dev, gx_device *bdev,
+                     const gs_int_rect *rect, void *buffer)
+{
+    tiffsep_process_arg *arg = (tiffsep_process_arg *)arg_;
+    tiffsep_band *band = (tiffsep_band *)buffer;
+    int width = rect->q.x - rect->p.x;
+    int h = rect->q.y - rect->p.y;
+    gs_get_bits_params_t params;
+    gs_int_rect my_rect;
+    const byte *src;
+    byte *dest;
+    int comp_num, pixel, y, code;
+
+    if (h <= 0)
+        return 0;
+    if (h > band->strips[0]->max_rows)
+        return_error(gs_error_rangecheck);
+
+    my_rect.p.x = 0;
+    my_rect.q.x = width;
+    for (y = 0; y < h; y++) {
+        params.options = GB_COLORS_NATIVE | GB_ALPHA_NONE | GB_PACKING_PLANAR |
+                         GB_RETURN_POINTER | GB_ALIGN_ANY | GB_OFFSET_0 |
+                         GB_RASTER_ANY;
+        my_rect.p.y = y;
+        my_rect.q.y = y + 1;
+        code = dev_proc(bdev, get_bits_rectangle)(bdev, &my_rect, &params, NULL);
+        if (code < 0)
+            return code;
+        /* Write separation data (tiffgray format) */
+        for (comp_num = 0; comp_num < arg->num_sep; comp_num++) {
+            src = params.data[comp_num];
+            dest = band->strips[comp_num]->data + y * arg->w[comp_num].scanline;
+            for (pixel = 0; pixel < width; pixel++)
+                dest[pixel] = MAX_COLOR_VALUE - src[pixel];    /* Gray is additive */
+        }
+        /* and the CMYK equivalent data */
+        build_cmyk_raster_line_fromplanar(&params,
+            band->strips[arg->num_sep]->data + y * arg->w[arg->num_sep].scanline,
+            width, arg->num_comp, arg->cmyk_map, 0, arg->tfdev);
+    }
+    for (comp_num = 0; comp_num <= arg->num_sep; comp_num++) {
+        code = tiff_band_strips_encode(band->strips[comp_num], &arg->w[comp_num],
+                                       rect->p.y, h);
+        if (code < 0)
+            return code;
+    }
+    return 0;
+}
+
+static int
+tiffsep_band_output(void *arg_, gx_device *dev, void *buffer)
+{
+    tiffsep_process_arg *arg = (tiffsep_process_arg *)arg_;
+    tiffsep_band *band = (tiffsep_band *)buffer;
+    int comp_num, code;
+
+    for (comp_num = 0; comp_num <= arg->num_sep; comp_num++) {
+        code = tiff_band_strips_write(&arg->w[comp_num], band->strips[comp_num]);
+        if (code < 0)
+            return code;
+    }
+    return 0;
+}
+
+static bool
+tiffsep_can_encode_bands(tiffsep_device *tfdev, int num_order)
+{
+    return tfdev->downscale.downscale_factor == 1 &&
+           tfdev->downscale.min_feature_size <= 1 &&
+           tfdev->BitsPerComponent == 8 &&
+           tfdev->downscale.trap_w == 0 && tfdev->downscale.trap_h == 0 &&
+           num_order == 0 && tfdev->icclink == NULL &&
+           tiff_can_encode_bands((gx_device_printer *)tfdev, tfdev->tiff_comp,
+                                 tfdev->height);
+}
+
+static int
+tiffsep_print_bands(tiffsep_device *tfdev, int num_comp,
+                    cmyk_composite_map *cmyk_map)
+{
+    gx_device_printer *pdev = (gx_device_printer *)tfdev;
+    tiffsep_process_arg *arg;
+    gx_process_page_options_t process = { 0 };
+    int comp_num, num_writers = 0, code = 0;
+
+    /* The writers are too big for the C stack. */
+    arg = (tiffsep_process_arg *)gs_alloc_bytes(pdev->memory,
+                                    sizeof(tiffsep_process_arg),
+                                    "tiffsep_print_bands");
+    if (arg == NULL)
+        return_error(gs_error_VMerror);
+    arg->tfdev = tfdev;
+    arg->num_comp = num_comp;
+    arg->num_sep = (tfdev->NoSeparationFiles ? 0 : num_comp);
+    arg->cmyk_map = cmyk_map;
+    for (comp_num = 0; comp_num <= arg->num_sep && code >= 0; comp_num++) {
+        code = tiff_strip_writer_init(&arg->w[comp_num], pdev,
+                                      comp_num < arg->num_sep ?
+                                          tfdev->tiff[comp_num] : tfdev->tiff_comp,
+                                      tfdev->height);
+        if (code >= 0)
+            num_writers++;
+    }
+
+    if (code >= 0) {
+        process.init_buffer_fn = tiffsep_band_init_buffer;
+        process.free_buffer_fn = tiffsep_band_free_buffer;
+        process.process_fn = tiffsep_band_process;
+        process.output_fn = tiffsep_band_output;
+        process.arg = arg;
+        code = dev_proc(pdev, process_page)((gx_device *)pdev, &process);
+    }
+
+    for (comp_num = 0; comp_num < num_writers; comp_num++)
+        tiff_strip_writer_fin(&arg->w[comp_num]);
+    gs_free_object(pdev->memory, arg, "tiffsep_print_bands");
+    return code;
+}
+
 /*
  * Output the image data for the tiff separation (tiffsep) device.  The data
  * for the tiffsep device is written in separate planes to separate files.
@@ -2471,7 +2645,10 @@ tiffsep_print_page(gx_device_printer * pdev, FILE * file)
         TIFFCheckpointDirectory(tfdev->tiff_comp);
 
         /* Write the page data. */
-        {
+        if (tiffsep_can_encode_bands(tfdev, num_order)) {
+            gs_free_object(pdev->memory, sep_line, "tiffsep_print_page");
+            code = tiffsep_print_bands(tfdev, num_comp, cmyk_map);
+        } else {
             gs_get_bits_params_t params;
             int byte_width;
 
@@ -1192,6 +1192,13 @@ gs_main_finit(gs_main_instance * minst, int exit_status, int code)
     }
     gp_readline_finit(minst->readline_data);
     gs_free_object(minst->heap, minst->saved_pages_initial_arg, "gs_main_finit");
+    {
+        int i;
+
+        for (i = 0; i < minst->num_switches; i++)
+            gs_free_object(minst->heap, minst->switches[i], "gs_main_finit");
+        gs_free_object(minst->heap, minst->switches, "gs_main_finit");
+    }
     i_ctx_p = minst->i_ctx_p;		/* get current interp context */
     if (gs_debug_c(':')) {
         print_resource_usage(minst, &gs_imemory, "Final");
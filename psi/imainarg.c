@@ -91,6 +91,7 @@ extern int zflushpage(i_ctx_t *);
 #define runFlush 2
 #define runBuffer 4
 static int swproc(gs_main_instance *, const char *, arg_list *);
+static int save_switch(gs_main_instance *, const char *, const char *);
 static int argproc(gs_main_instance *, const char *);
 static int run_buffered(gs_main_instance *, const char *);
 static int esc_strlen(const char *);
@@ -215,6 +216,9 @@ gs_main_init_with_args01(gs_main_instance * minst, int argc, char *argv[])
     while ((code = arg_next(&args, (const char **)&arg, minst->heap)) > 0) {
         switch (*arg) {
             case '-':
+                code = save_switch(minst, arg, NULL);
+                if (code < 0)
+                    return code;
                 code = swproc(minst, arg, &args);
                 if (code < 0)
                     return code;
@@ -309,6 +313,44 @@ gs_main_run_start(gs_main_instance * minst)
     return run_string(minst, "systemdict /start get exec", runFlush, minst->user_errors, NULL, NULL);
 }
 
+/*
+ * Remember a switch that sets a parameter (-d, -s, -r and so on), so that
+ * the instances started for -dPDFParallelPages can be given the same
+ * settings.  Switches that run something, such as -c and -f, are not kept.
+ * A switch whose value is the next argument ("-I <path>") is saved from
+ * swproc, with the value joined on.
+ */
+static int
+save_switch(gs_main_instance * minst, const char *arg, const char *value)
+{
+    char **switches;
+    char *copy;
+    size_t len = strlen(arg);
+
+    if (arg[1] == 0 || strchr("dDsSrgIqPKMNZ", arg[1]) == NULL ||
+        (arg[1] == 'I' && arg[2] == 0 && value == NULL))
+        return 0;
+    if (value == NULL)
+        value = "";
+    switches = (char **)gs_alloc_byte_array(minst->heap, minst->num_switches + 1,
+                                            sizeof(char *), "save_switch");
+    copy = (char *)gs_alloc_bytes(minst->heap, len + strlen(value) + 1,
+                                  "save_switch");
+    if (switches == NULL || copy == NULL) {
+        gs_free_object(minst->heap, switches, "save_switch");
+        gs_free_object(minst->heap, copy, "save_switch");
+        return_error(gs_error_VMerror);
+    }
+    strcpy(copy, arg);
+    strcpy(copy + len, value);
+    if (minst->num_switches > 0)
+        memcpy(switches, minst->switches, minst->num_switches * sizeof(char *));
+    switches[minst->num_switches++] = copy;
+    gs_free_object(minst->heap, minst->switches, "save_switch");
+    minst->switches = switches;
+    return 0;
+}
+
 /* Process switches.  Return 0 if processed, 1 for unknown switch, */
 /* <0 if error. */
 static int
@@ -628,6 +670,11 @@ run_stdin:
                     code = arg_next(pal, (const char **)&path, minst->heap);
                     if (code < 0)
                         return code;
+                    if (path != NULL) {
+                        code = save_switch(minst, "-I", path);
+                        if (code < 0)
+                            return code;
+                    }
                 } else
                     path = arg;
                 if (path == NULL)
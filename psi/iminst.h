@@ -83,6 +83,9 @@ struct gs_main_instance_s {
     i_ctx_t *i_ctx_p;		/* current interpreter context state */
     char *saved_pages_initial_arg;	/* used to defer processing of --saved-pages=begin... */
     bool saved_pages_test_mode;	/* for regression testing of saved-pages */
+    char **switches;		/* the -d, -s etc. switches seen, */
+    int num_switches;		/* for -dPDFParallelPages instances */
+    void *pdf_parallel_worker;	/* set in those instances */
 };
 
 /*
@@ -1831,16 +1831,25 @@ $(PSOBJ)zncdummy.$(OBJ) : $(PSSRC)zncdummy.c $(OP) $(GX) $(math_h)\
 
 # ---------------- Custom operators for PDF interpreter ---------------- #
 
-zpdfops_=$(PSOBJ)zpdfops.$(OBJ)
+zpdfops_=$(PSOBJ)zpdfops.$(OBJ) $(PSOBJ)zpdfcont.$(OBJ)
 $(PSD)pdfops.dev : $(ECHOGS_XE) $(zpdfops_) $(INT_MAK) $(MAKEDIRS)
 	$(SETMOD) $(PSD)pdfops $(zpdfops_)
-	$(ADDMOD) $(PSD)pdfops -oper zpdfops
+	$(ADDMOD) $(PSD)pdfops -oper zpdfops zpdfcont
 
 $(PSOBJ)zpdfops.$(OBJ) : $(PSSRC)zpdfops.c $(OP) $(MAKEFILE)\
  $(igstate_h) $(istack_h) $(iutil_h) $(gspath_h) $(math__h) $(ialloc_h)\
- $(string__h) $(store_h) $(INT_MAK) $(MAKEDIRS)
+ $(string__h) $(memory__h) $(store_h) $(stream_h) $(files_h) $(gp_h)\
+ $(gpsync_h) $(gsstruct_h) $(gxdevice_h) $(gxsync_h) $(iapi_h) $(imain_h)\
+ $(iminst_h) $(INT_MAK) $(MAKEDIRS)
 	$(PSCC) $(PSO_)zpdfops.$(OBJ) $(C_) $(PSSRC)zpdfops.c
 
+$(PSOBJ)zpdfcont.$(OBJ) : $(PSSRC)zpdfcont.c $(OP) $(MAKEFILE)\
+ $(memory__h) $(opextern_h) $(dstack_h) $(estack_h) $(gsstruct_h)\
+ $(gspath_h) $(idict_h) $(iname_h) $(iscan_h) $(istack_h)\
+ $(iutil_h) $(igstate_h) $(store_h) $(stream_h) $(files_h)\
+ $(INT_MAK) $(MAKEDIRS)
+	$(PSCC) $(PSO_)zpdfcont.$(OBJ) $(C_) $(PSSRC)zpdfcont.c
+
 zutf8_=$(PSOBJ)zutf8.$(OBJ)
 $(PSD)utf8.dev : $(ECHOGS_XE) $(zutf8_) $(INT_MAK) $(MAKEDIRS)
 	$(SETMOD) $(PSD)utf8 $(zutf8_)
@@ -0,0 +1,474 @@
+/* Copyright (C) 2001-2019 Artifex Software, Inc.
+   All Rights Reserved.
+
+   This software is provided AS-IS with no warranty, either express or
+   implied.
+
+   This software is distributed under license and may not be copied,
+   modified or distributed except as expressly authorized under the terms
+   of the license contained in the file LICENSE in this distribution.
+
+   Refer to licensing information at http://www.artifex.com or contact
+   Artifex Software, Inc.,  1305 Grant Avenue - Suite 200, Novato,
+   CA 94945, U.S.A., +1(415)492-9861, for further information.
+*/
+
+
+/* Native execution of PDF content streams */
+#include "memory_.h"
+#include "ghost.h"
+#include "oper.h"
+#include "opextern.h"
+#include "dstack.h"		/* for dict_find_name */
+#include "estack.h"
+#include "gsstruct.h"		/* for iscan.h */
+#include "gspath.h"
+#include "idict.h"
+#include "iname.h"
+#include "iscan.h"
+#include "istack.h"
+#include "iutil.h"
+#include "igstate.h"
+#include "store.h"
+#include "stream.h"
+#include "files.h"
+
+/*
+ * The PostScript implementation of .pdfrun reads a content stream with a
+ * loop that runs 'token', checks the type of the result, and calls
+ * .pdfexectoken to look up operator names in the operator dictionary: a
+ * dozen or so trips through the interpreter for every token.  For the path
+ * construction operators that make up most of a vector heavy page, that
+ * costs much more than the graphics library calls themselves.
+ *
+ * .pdfexecstream does the same job in C.  Operands go straight from the
+ * scanner to the o-stack, and operator names are looked up in the operator
+ * dictionary here.  If the definition is (or is a procedure consisting of
+ * just) one of the operators in pdf_direct_ops, it is called without going
+ * back to the interpreter; anything else is pushed on the e-stack and run
+ * by the interpreter as before.  Names that aren't in the dictionary are
+ * handed to .pdfexectoken, which knows how to deal with broken content.
+ *
+ * The .pdfm, .pdfl, .pdfc, .pdfv, .pdfy and .pdfre operators below
+ * implement the PostScript definitions of m, l, c, v, y and re (outside
+ * text objects), including their recovery from bad operands.
+ */
+
+/* ------ Path construction operators ------ */
+
+/* Return the number of operands of the current PDF operator, */
+/* i.e. the number of o-stack entries above pdfemptycount. */
+static int
+pdf_operand_count(i_ctx_t *i_ctx_p)
+{
+    int count = ref_stack_count(&o_stack);
+    ref nref;
+    ref *pvalue;
+
+    if (name_ref(imemory, (const byte *)"pdfemptycount", 13, &nref, -1) >= 0 &&
+        (pvalue = dict_find_name(&nref)) != 0 &&
+        r_has_type(pvalue, t_integer))
+        count -= pvalue->value.intval;
+    return max(count, 0);
+}
+
+/* Recover from an error in a PDF operator by popping (at most) */
+/* count of its operands, like the PostScript definitions do. */
+static void
+pdf_pop_operands(i_ctx_t *i_ctx_p, int count)
+{
+    ref_stack_pop(&o_stack, min(count, pdf_operand_count(i_ctx_p)));
+}
+
+/* Get the values of count numeric operands, first making sure */
+/* that they are all in the top block of the o-stack. */
+static int
+pdf_num_operands(i_ctx_t *i_ctx_p, int count, double *pval)
+{
+    while (osp - osbot + 1 < count) {
+        int code;
+
+        if (ref_stack_count(&o_stack) < count)
+            return_error(gs_error_stackunderflow);
+        code = ref_stack_pop_block(&o_stack);
+        if (code < 0)
+            return code;
+    }
+    return num_params(osp, count, pval);
+}
+
+/* <x> <y> .pdfm - */
+static int
+zpdfm(i_ctx_t *i_ctx_p)
+{
+    double xy[2];
+    int code = pdf_num_operands(i_ctx_p, 2, xy);
+
+    if (code >= 0 && (code = gs_moveto(igs, xy[0], xy[1])) >= 0) {
+        pop(2);
+        return 0;
+    }
+    pdf_pop_operands(i_ctx_p, 2);
+    return gs_moveto(igs, 0.0, 0.0);
+}
+
+/* <x> <y> .pdfl - */
+static int
+zpdfl(i_ctx_t *i_ctx_p)
+{
+    double xy[2];
+    int code = pdf_num_operands(i_ctx_p, 2, xy);
+
+    if (code >= 0 && (code = gs_lineto(igs, xy[0], xy[1])) >= 0)
+        pop(2);
+    else
+        pdf_pop_operands(i_ctx_p, 2);
+    return 0;
+}
+
+/* <x1> <y1> <x2> <y2> <x3> <y3> .pdfc - */
+static int
+zpdfc(i_ctx_t *i_ctx_p)
+{
+    double xy[6];
+    int code = pdf_num_operands(i_ctx_p, 6, xy);
+
+    if (code >= 0 &&
+        (code = gs_curveto(igs, xy[0], xy[1], xy[2], xy[3], xy[4], xy[5])) >= 0)
+        pop(6);
+    else
+        pdf_pop_operands(i_ctx_p, 6);
+    return 0;
+}
+
+/* <x2> <y2> <x3> <y3> .pdfv - */
+static int
+zpdfv(i_ctx_t *i_ctx_p)
+{
+    int count = pdf_operand_count(i_ctx_p);
+    double xy[4];
+    gs_point pt;
+    int code;
+
+    if (count < 4) {
+        ref_stack_pop(&o_stack, count);
+        return 0;
+    }
+    /* The PostScript version pops 2 more operands if there is no */
+    /* current point than if curveto fails. */
+    if (gs_currentpoint(igs, &pt) < 0) {
+        pdf_pop_operands(i_ctx_p, 6);
+        return 0;
+    }
+    code = pdf_num_operands(i_ctx_p, 4, xy);
+    if (code >= 0 &&
+        (code = gs_curveto(igs, pt.x, pt.y, xy[0], xy[1], xy[2], xy[3])) >= 0)
+        pop(4);
+    else
+        pdf_pop_operands(i_ctx_p, 4);
+    return 0;
+}
+
+/* <x1> <y1> <x3> <y3> .pdfy - */
+static int
+zpdfy(i_ctx_t *i_ctx_p)
+{
+    double xy[4];
+    int code = pdf_num_operands(i_ctx_p, 4, xy);
+
+    if (code >= 0 &&
+        (code = gs_curveto(igs, xy[0], xy[1], xy[2], xy[3], xy[2], xy[3])) >= 0)
+        pop(4);
+    else
+        pdf_pop_operands(i_ctx_p, 4);
+    return 0;
+}
+
+/* <x> <y> <width> <height> .pdfre - */
+static int
+zpdfre(i_ctx_t *i_ctx_p)
+{
+    double xywh[4];
+    int code = pdf_num_operands(i_ctx_p, 4, xywh);
+
+    if (code < 0 ||
+        (code = gs_moveto(igs, xywh[0], xywh[1])) < 0 ||
+        (code = gs_rlineto(igs, xywh[2], 0.0)) < 0 ||
+        (code = gs_rlineto(igs, 0.0, xywh[3])) < 0 ||
+        (code = gs_rlineto(igs, -xywh[2], 0.0)) < 0 ||
+        (code = gs_closepath(igs)) < 0)
+        return code;
+    pop(4);
+    return 0;
+}
+
+/*
+ * The operators that .pdfexecstream may call directly.  They must not
+ * touch the e-stack, and must only return 0 or an error: in particular
+ * not gs_error_Remap_Color, or an o-stack overflow or underflow that the
+ * interpreter would recover from by running the operator again.
+ */
+static const op_proc_t pdf_direct_ops[] = {
+    zpdfm, zpdfl, zpdfc, zpdfv, zpdfy, zpdfre, zclosepath
+};
+
+/* If the definition of a PDF operator can be called directly, */
+/* return the procedure, otherwise return 0. */
+static op_proc_t
+pdf_direct_op(const gs_memory_t *mem, const ref *pvalue)
+{
+    ref elt;
+    op_proc_t proc;
+    int i;
+
+    switch (r_type(pvalue)) {
+        case t_operator:
+            break;
+        case t_array:
+            if (r_size(pvalue) != 1 || !r_has_attr(pvalue, a_executable))
+                return 0;
+            pvalue = pvalue->value.refs;
+            break;
+        case t_mixedarray:
+        case t_shortarray:
+            if (r_size(pvalue) != 1 || !r_has_attr(pvalue, a_executable))
+                return 0;
+            packed_get(mem, pvalue->value.packed, &elt);
+            pvalue = &elt;
+            break;
+        default:
+            return 0;
+    }
+    if (!r_has_type_attrs(pvalue, t_operator, a_executable))
+        return 0;
+    proc = real_opproc(pvalue);
+    for (i = 0; i < countof(pdf_direct_ops); ++i)
+        if (proc == pdf_direct_ops[i])
+            return proc;
+    return 0;
+}
+
+/* ------ Content stream execution ------ */
+
+/*
+ * The e-stack frame of .pdfexecstream is an es_for mark (so that 'exit',
+ * which is how the endstream operator stops the PostScript loop, works
+ * the same way), followed by the four operands.
+ */
+#define PDFEXEC_FRAME 5
+#define pdfexec_count(ep) ((ep) - 3)
+#define pdfexec_opdict(ep) ((ep) - 2)
+#define pdfexec_file(ep) ((ep) - 1)
+#define pdfexec_procs(ep) (ep)
+
+static int pdfexec_continue(i_ctx_t *);
+static int pdfexec_refill_continue(i_ctx_t *);
+static int pdfexec_tokens(i_ctx_t *, scanner_state *);
+
+/* The es_for mark needs no cleanup. */
+static int
+pdfexec_no_cleanup(i_ctx_t *i_ctx_p)
+{
+    return 0;
+}
+
+/* <count> <opdict> <file> <procs> .pdfexecstream - */
+/* procs is [ .pdffixname .pdfexectoken ]. */
+static int
+zpdfexecstream(i_ctx_t *i_ctx_p)
+{
+    os_ptr op = osp;
+    stream *s;
+
+    check_type(op[-3], t_integer);
+    check_type(op[-2], t_dictionary);
+    check_read_file(i_ctx_p, s, op - 1);
+    check_read_type(*op, t_array);
+    if (r_size(op) != 2)
+        return_error(gs_error_rangecheck);
+    check_estack(PDFEXEC_FRAME + 1);
+    push_mark_estack(es_for, pdfexec_no_cleanup);
+    esp += 4;
+    ref_assign(pdfexec_count(esp), op - 3);
+    ref_assign(pdfexec_opdict(esp), op - 2);
+    ref_assign(pdfexec_file(esp), op - 1);
+    ref_assign(pdfexec_procs(esp), op);
+    pop(4);
+    return pdfexec_continue(i_ctx_p);
+}
+
+/* Continue reading the stream after running a PDF operator. */
+static int
+pdfexec_continue(i_ctx_t *i_ctx_p)
+{
+    return pdfexec_tokens(i_ctx_p, NULL);
+}
+
+/* Continue reading the stream after a callout to refill it. */
+/* *op is the scanner state. */
+static int
+pdfexec_refill_continue(i_ctx_t *i_ctx_p)
+{
+    os_ptr op = osp;
+    scanner_state *pstate;
+
+    check_stype(*op, st_scanner_state_dynamic);
+    pstate = r_ptr(op, scanner_state);
+    /* See token_continue in ztoken.c. */
+    make_null(op);
+    pop(1);
+    return pdfexec_tokens(i_ctx_p, pstate);
+}
+
+/*
+ * Read and execute tokens until the end of the stream, or until a token
+ * needs the interpreter.  pdyn is a heap copy of the scanner state if we
+ * are resuming after a refill callout, otherwise NULL.
+ */
+static int
+pdfexec_tokens(i_ctx_t *i_ctx_p, scanner_state *pdyn)
+{
+    scanner_state sstate;
+    scanner_state *pstate = pdyn;
+    ref token;
+    ref *pvalue;
+    op_proc_t proc;
+    stream *s;
+    int code;
+
+    for (;;) {
+        /*
+         * Make room for the longest sequence we might push below, before
+         * reading the token, so that we never have to drop it.
+         */
+        if (ostop - osp < 3) {
+            code = ref_stack_extend(&o_stack, 3);
+            if (code < 0)
+                goto out;
+        }
+        if (estop - esp < 2) {
+            code = ref_stack_extend(&e_stack, 2);
+            if (code < 0)
+                goto out;
+        }
+        if (pstate == NULL) {
+            check_read_file(i_ctx_p, s, pdfexec_file(esp));
+            gs_scanner_init(&sstate, pdfexec_file(esp));
+            pstate = &sstate;
+        }
+again:
+        code = gs_scan_token(i_ctx_p, &token, pstate);
+        switch (code) {
+            case 0:
+            case scan_BOS:
+                break;
+            case scan_EOF:
+                if (pdyn)
+                    gs_free_object(((scanner_state_dynamic *)pdyn)->mem, pdyn,
+                                   "pdfexec_tokens");
+                esp -= PDFEXEC_FRAME;
+                return o_pop_estack;
+            case scan_Refill:
+                code = gs_scan_handle_refill(i_ctx_p, pstate, pstate != pdyn,
+                                             pdfexec_refill_continue);
+                if (code == 0)
+                    goto again;
+                if (code == o_push_estack)
+                    return code;
+                goto out;
+            default:
+                if (code > 0)	/* comment, not possible */
+                    code = gs_note_error(gs_error_syntaxerror);
+                gs_scanner_error_object(i_ctx_p, pstate, &i_ctx_p->error_object);
+                goto out;
+        }
+        if (pdyn) {
+            gs_free_object(((scanner_state_dynamic *)pdyn)->mem, pdyn,
+                           "pdfexec_tokens");
+            pdyn = NULL;
+        }
+        pstate = NULL;
+
+        if (!r_has_type(&token, t_name)) {
+            /* Operands, including executable arrays, are just pushed. */
+            ref_assign(osp + 1, &token);
+            osp++;
+            continue;
+        }
+        if (!r_has_attr(&token, a_executable)) {
+            ref sref;
+
+            name_string_ref(imemory, &token, &sref);
+            if (memchr(sref.value.const_bytes, '#', r_size(&sref)) == 0) {
+                ref_assign(osp + 1, &token);
+                osp++;
+                continue;
+            }
+            /* Let .pdffixname handle the #nn escapes. */
+            ref_assign(osp + 1, &token);
+            osp++;
+            make_op_estack(esp + 1, pdfexec_continue);
+            pvalue = pdfexec_procs(esp)->value.refs;
+            ref_assign(esp + 2, pvalue);
+            esp += 2;
+            return o_push_estack;
+        }
+        if (dict_find(pdfexec_opdict(esp), &token, &pvalue) <= 0) {
+            /* Not an operator: let .pdfexectoken sort it out. */
+            ref_assign(osp + 1, pdfexec_count(esp));
+            ref_assign(osp + 2, pdfexec_opdict(esp));
+            ref_assign(osp + 3, &token);
+            osp += 3;
+            make_op_estack(esp + 1, pdfexec_continue);
+            pvalue = pdfexec_procs(esp)->value.refs + 1;
+            ref_assign(esp + 2, pvalue);
+            esp += 2;
+            return o_push_estack;
+        }
+        proc = pdf_direct_op(imemory, pvalue);
+        if (proc != 0) {
+            code = (*proc)(i_ctx_p);
+            if (code < 0) {
+                i_ctx_p->error_object = token;
+                goto out;
+            }
+            /*
+             * Count the call against the interpreter's time slice, and go
+             * back to the interpreter when it runs out, so that it can
+             * poll for interrupts and garbage collect as usual.
+             */
+            if (--(imemory_system->gs_lib_ctx->gcsignal) <= 0) {
+                make_op_estack(esp + 1, pdfexec_continue);
+                esp++;
+                return o_push_estack;
+            }
+            continue;
+        }
+        make_op_estack(esp + 1, pdfexec_continue);
+        ref_assign(esp + 2, pvalue);
+        esp += 2;
+        return o_push_estack;
+    }
+out:
+    if (pdyn)
+        gs_free_object(((scanner_state_dynamic *)pdyn)->mem, pdyn,
+                       "pdfexec_tokens");
+    return code;
+}
+
+/* ------ Initialization procedure ------ */
+
+const op_def zpdfcont_op_defs[] =
+{
+    {"4.pdfexecstream", zpdfexecstream},
+    {"0.pdfm", zpdfm},
+    {"0.pdfl", zpdfl},
+    {"0.pdfc", zpdfc},
+    {"0.pdfv", zpdfv},
+    {"0.pdfy", zpdfy},
+    {"0.pdfre", zpdfre},
+                /* Internal operators */
+    {"0%pdfexec_continue", pdfexec_continue},
+    {"0%pdfexec_refill_continue", pdfexec_refill_continue},
+    op_def_end(0)
+};
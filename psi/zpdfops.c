@@ -26,9 +26,20 @@
 #include "ialloc.h"
 #include "malloc_.h"
 #include "string_.h"
+#include "memory_.h"
 #include "store.h"
 #include "gxgstate.h"
 #include "gxdevsop.h"
+#include "stream.h"
+#include "files.h"
+#include "gp.h"
+#include "gpsync.h"
+#include "gsstruct.h"
+#include "gxdevice.h"
+#include "gxsync.h"
+#include "iapi.h"
+#include "imain.h"
+#include "iminst.h"
 
 #ifdef HAVE_LIBIDN
 #  include <stringprep.h>
@@ -242,6 +253,1214 @@ zsaslprep(i_ctx_t *i_ctx_p)
 }
 #endif
 
+/* ------ Cross-reference tables ------ */
+
+/*
+ * The PDF interpreter keeps the xref in three tables indexed by object
+ * number (see pdf_base.ps): Objects holds the file position, or the index
+ * in the object stream, as an executable integer; ObjectStream holds the
+ * object stream number (0 if none), also executable; Generations holds the
+ * generation number + 1 (0 for a free entry), in a string until a number
+ * doesn't fit in a byte, then in an array.  The operators below fill in
+ * the tables for the well formed entries of an xref section and leave
+ * everything else to setxrefentry in pdf_rbld.ps, which checks and warns.
+ */
+
+/* Check the three xref tables on the operand stack. */
+static int
+check_xref_tables(os_ptr op)
+{
+    check_write_type(op[-2], t_array);
+    if (r_has_type(&op[-1], t_string))
+        check_write(op[-1]);
+    else
+        check_write_type(op[-1], t_array);
+    check_write_type(*op, t_array);
+    return 0;
+}
+
+/*
+ * Enter one xref entry in the tables, as setxrefentry does when not
+ * rebuilding: an object that already has an entry keeps it.  Return 1 if
+ * the entry was dealt with, 0 if it must be left to setxrefentry.
+ */
+static int
+set_xref_entry(i_ctx_t *i_ctx_p, os_ptr ptables, ps_int num,
+               ps_int strm, ps_int loc, ps_int gen)
+{
+    ref *objects = ptables - 2, *gens = ptables - 1, *strms = ptables;
+    ref value;
+
+    if (num < 0 || num >= r_size(objects) || num >= r_size(gens) ||
+        num >= r_size(strms) || gen < 0 || gen > 65535 ||
+        (r_has_type(gens, t_string) && gen >= 255))
+        return 0;
+    if (!r_has_type(objects->value.refs + num, t_null))
+        return 1;
+    make_int(&value, strm);
+    r_set_attrs(&value, a_executable);
+    ref_assign_old(strms, strms->value.refs + num, &value, "set_xref_entry");
+    make_int(&value, loc);
+    r_set_attrs(&value, a_executable);
+    ref_assign_old(objects, objects->value.refs + num, &value, "set_xref_entry");
+    if (r_has_type(gens, t_string))
+        gens->value.bytes[num] = (byte)(gen + 1);
+    else {
+        make_int(&value, gen + 1);
+        ref_assign_old(gens, gens->value.refs + num, &value, "set_xref_entry");
+    }
+    return 1;
+}
+
+/* Parse a decimal field of a classic xref entry. */
+static bool
+xref_digits(const byte *p, int n, ps_int *pvalue)
+{
+    int64_t value = 0;
+
+    for (; n > 0; n--, p++) {
+        if (*p < '0' || *p > '9')
+            return false;
+        value = value * 10 + *p - '0';
+    }
+    if (value > MAX_PS_INT)
+        return false;
+    *pvalue = (ps_int)value;
+    return true;
+}
+
+/*
+ * <file> <obj#> <count> <Objects> <Generations> <ObjectStream>
+ *   .pdfreadxrefsection <obj#> <count>
+ * Read entries of a classic xref subsection, which must be exactly
+ * "nnnnnnnnnn ggggg n" or "... f" followed by two white space characters.
+ * Stop before the first entry that isn't like that, or that needs a
+ * warning, and return its object number and the number of entries left.
+ */
+static int
+zpdfreadxrefsection(i_ctx_t *i_ctx_p)
+{
+    os_ptr op = osp;
+    stream *s;
+    ps_int num, count, loc, gen;
+    byte entry[20];
+    uint nread;
+    gs_offset_t pos;
+    int code;
+
+    check_op(6);
+    check_read_file(i_ctx_p, s, op - 5);
+    check_type(op[-4], t_integer);
+    check_type(op[-3], t_integer);
+    code = check_xref_tables(op);
+    if (code < 0)
+        return code;
+    num = op[-4].value.intval;
+    count = op[-3].value.intval;
+    if (count < 0)
+        return_error(gs_error_rangecheck);
+    for (; count > 0; num++, count--) {
+        pos = stell(s);
+        code = sgets(s, entry, sizeof(entry), &nread);
+        if (code < 0 && code != EOFC)
+            return_error(gs_error_ioerror);
+        if (nread != sizeof(entry) ||
+            !xref_digits(entry, 10, &loc) || entry[10] != ' ' ||
+            !xref_digits(entry + 11, 5, &gen) || entry[16] != ' ' ||
+            entry[18] > ' ' || entry[19] > ' ' ||
+            (entry[17] == 'n' && (loc == 0 ||
+             !set_xref_entry(i_ctx_p, op, num, 0, loc, gen))) ||
+            (entry[17] != 'n' && entry[17] != 'f')) {
+            /* Leave this entry to the PostScript code. */
+            if (sseek(s, pos) < 0)
+                return_error(gs_error_ioerror);
+            break;
+        }
+    }
+    make_int(op - 5, num);
+    make_int(op - 4, count);
+    pop(4);
+    return 0;
+}
+
+/*
+ * <stream> <W array> <obj#> <count> <Objects> <Generations> <ObjectStream>
+ *   .pdfreadxrefstream <obj#> <count> <type> <field 2> <field 3> true
+ *   .pdfreadxrefstream false
+ * Read entries of a subsection of an xref stream (PDF 1.5).  Free,
+ * normal and compressed entries are entered in the tables.  If an entry
+ * can't be dealt with here, return it with its object number and the
+ * number of entries left after it, for xref15entryhandlers.
+ */
+static int
+zpdfreadxrefstream(i_ctx_t *i_ctx_p)
+{
+    os_ptr op = osp;
+    stream *s;
+    ps_int num, count, field[3];
+    ps_uint value;
+    int width[3];
+    ref w;
+    int i, j, c, code;
+
+    check_op(7);
+    check_read_file(i_ctx_p, s, op - 6);
+    check_read_type(op[-5], t_array);
+    check_type(op[-4], t_integer);
+    check_type(op[-3], t_integer);
+    code = check_xref_tables(op);
+    if (code < 0)
+        return code;
+    if (r_size(&op[-5]) < 3)
+        return_error(gs_error_rangecheck);
+    for (i = 0; i < 3; i++) {
+        code = array_get(imemory, &op[-5], i, &w);
+        if (code < 0)
+            return code;
+        check_type(w, t_integer);
+        if (w.value.intval < 0 || w.value.intval > 8)
+            return_error(gs_error_rangecheck);
+        width[i] = (int)w.value.intval;
+    }
+    num = op[-4].value.intval;
+    count = op[-3].value.intval;
+    for (; count > 0; num++, count--) {
+        for (i = 0; i < 3; i++) {
+            value = 0;
+            for (j = 0; j < width[i]; j++) {
+                c = sgetc(s);
+                if (c < 0)
+                    return_error(gs_error_ioerror);
+                value = (value << 8) + c;
+            }
+            if (value > MAX_PS_INT)
+                return_error(gs_error_rangecheck);
+            field[i] = (ps_int)value;
+        }
+        if (width[0] == 0)
+            field[0] = 1;	/* the default type is 1 */
+        if (field[0] == 0 ||
+            (field[0] == 1 &&
+             set_xref_entry(i_ctx_p, op, num, 0, field[1], field[2])) ||
+            (field[0] == 2 &&
+             set_xref_entry(i_ctx_p, op, num, field[1], field[2], 0)))
+            continue;
+        /* Let the PostScript code deal with it. */
+        make_int(op - 6, num);
+        make_int(op - 5, count - 1);
+        make_int(op - 4, field[0]);
+        make_int(op - 3, field[1]);
+        make_int(op - 2, field[2]);
+        make_true(op - 1);
+        pop(1);
+        return 0;
+    }
+    make_false(op - 6);
+    pop(6);
+    return 0;
+}
+
+/*
+ * Native scanner for rebuilding a damaged xref (see search_objects in
+ * pdf_rbld.ps).  That procedure reads the file a line at a time and looks
+ * for lines which start with "<obj#> <gen#> obj".  Here the file is
+ * mapped into memory and cut into chunks which are scanned in parallel,
+ * each chunk handling the lines that start in it.
+ */
+#define PDF_SCAN_MIN_CHUNK (4 * 1024 * 1024)
+#define PDF_SCAN_MAX_THREADS 16
+#define PDF_SCAN_MAX_LINE 65535	/* search_objects' working string */
+
+typedef struct pdf_scan_chunk_s {
+    const byte *base;		/* the mapped file */
+    int64_t end;		/* end of the data to scan */
+    int64_t from, to;		/* lines starting in [from, to) */
+    gs_memory_t *memory;
+    ps_int *found;		/* obj#, gen#, position triples */
+    uint count, size;		/* entries used, allocated */
+    bool failed;		/* ran out of memory */
+} pdf_scan_chunk_t;
+
+#define IS_PDF_WHITE(c) ((c) == ' ' || (c) == '\t' || (c) == '\f' || (c) == 0)
+#define IS_PDF_EOL(c) ((c) == '\n' || (c) == '\r')
+#define IS_PDF_DELIM(c)\
+  ((c) == '(' || (c) == ')' || (c) == '<' || (c) == '>' || (c) == '[' ||\
+   (c) == ']' || (c) == '{' || (c) == '}' || (c) == '/' || (c) == '%')
+
+/* Parse an unsigned integer token, return the position after it or NULL. */
+static const byte *
+pdf_scan_int(const byte *p, const byte *limit, ps_int *pvalue)
+{
+    int64_t value = 0;
+    const byte *start;
+
+    if (p < limit && *p == '+')
+        p++;
+    for (start = p; p < limit && *p >= '0' && *p <= '9'; p++) {
+        value = value * 10 + *p - '0';
+        if (value > MAX_PS_INT)
+            return NULL;
+    }
+    if (p == start ||
+        (p < limit && !IS_PDF_WHITE(*p) && !IS_PDF_EOL(*p) && !IS_PDF_DELIM(*p)))
+        return NULL;
+    *pvalue = (ps_int)value;
+    return p;
+}
+
+/* Check whether a line starts with "<obj#> <gen#> obj", as the tokens */
+/* are read by search_objects. */
+static bool
+pdf_scan_line(const byte *p, const byte *limit, ps_int *num, ps_int *gen)
+{
+    while (p < limit && IS_PDF_WHITE(*p))
+        p++;
+    p = pdf_scan_int(p, limit, num);
+    if (p == NULL)
+        return false;
+    while (p < limit && IS_PDF_WHITE(*p))
+        p++;
+    p = pdf_scan_int(p, limit, gen);
+    if (p == NULL)
+        return false;
+    while (p < limit && IS_PDF_WHITE(*p))
+        p++;
+    if (p < limit && *p == '/')
+        p++;
+    return (limit - p >= 3 && !memcmp(p, "obj", 3) &&
+            (limit - p == 3 || IS_PDF_WHITE(p[3]) || IS_PDF_EOL(p[3]) ||
+             (IS_PDF_DELIM(p[3]) && p[3] != '/')));
+}
+
+static void
+pdf_scan_add(pdf_scan_chunk_t *chunk, ps_int num, ps_int gen, ps_int pos)
+{
+    if (chunk->count == chunk->size) {
+        uint size = (chunk->size == 0 ? 1024 : chunk->size * 2);
+        ps_int *found = (ps_int *)gs_alloc_byte_array(chunk->memory, size,
+                                      3 * sizeof(ps_int), "pdf_scan_add");
+
+        if (found == NULL || size < chunk->size) {
+            gs_free_object(chunk->memory, found, "pdf_scan_add");
+            chunk->failed = true;
+            return;
+        }
+        if (chunk->count)
+            memcpy(found, chunk->found, chunk->count * 3 * sizeof(ps_int));
+        gs_free_object(chunk->memory, chunk->found, "pdf_scan_add");
+        chunk->found = found;
+        chunk->size = size;
+    }
+    chunk->found[3 * chunk->count] = num;
+    chunk->found[3 * chunk->count + 1] = gen;
+    chunk->found[3 * chunk->count + 2] = pos;
+    chunk->count++;
+}
+
+/* Scan the lines that start in one chunk. */
+static void
+pdf_scan_chunk(void *arg)
+{
+    pdf_scan_chunk_t *chunk = (pdf_scan_chunk_t *)arg;
+    const byte *base = chunk->base;
+    int64_t end = chunk->end;
+    int64_t pos = chunk->from, eol, max_line;
+    ps_int num, gen;
+
+    /* Find the first line that starts in this chunk. */
+    if (pos > 0 && base[pos - 1] != '\n' &&
+        (base[pos - 1] != '\r' || base[pos] == '\n')) {
+        while (pos < end && !IS_PDF_EOL(base[pos]))
+            pos++;
+        if (pos < end && base[pos] == '\r' && pos + 1 < end && base[pos + 1] == '\n')
+            pos++;
+        pos++;
+    }
+    /* Like search_objects, stop 20 bytes before the end. */
+    while (pos < chunk->to && (pos == 0 || end - pos >= 20) && !chunk->failed) {
+        for (eol = pos; eol < end && !IS_PDF_EOL(base[eol]); eol++)
+            DO_NOTHING;
+        /* Lines that don't fit in the working string are skipped. */
+        max_line = min(PDF_SCAN_MAX_LINE, end - pos - 10);
+        if (eol - pos <= max_line &&
+            pdf_scan_line(base + pos, base + eol, &num, &gen))
+            pdf_scan_add(chunk, num, gen, (ps_int)pos);
+        if (eol < end && base[eol] == '\r' && eol + 1 < end && base[eol + 1] == '\n')
+            eol++;
+        pos = eol + 1;
+    }
+}
+
+/*
+ * <file> <end> <nthreads> .pdfscanobjects <array> <max obj#> true
+ * <file> <end> <nthreads> .pdfscanobjects false
+ * Find the objects in the first <end> bytes of a file, using up to
+ * <nthreads> threads.  The array holds the object number, generation
+ * number and file position of each object found, in file order.  Return
+ * false if the file can't be mapped, and the caller must scan it itself.
+ */
+static int
+zpdfscanobjects(i_ctx_t *i_ctx_p)
+{
+    os_ptr op = osp;
+    stream *s;
+    gs_memory_t *mem = imemory->non_gc_memory;
+    pdf_scan_chunk_t chunk[PDF_SCAN_MAX_THREADS];
+    gp_thread_id thread[PDF_SCAN_MAX_THREADS];
+    int64_t end, total = 0;
+    ps_int max_num = -1;
+    const byte *base;
+    int nthreads, i, code = 0;
+    uint j;
+    ref found;
+    ref *pref;
+
+    check_op(3);
+    check_read_file(i_ctx_p, s, op - 2);
+    check_type(op[-1], t_integer);
+    check_type(*op, t_integer);
+    end = op[-1].value.intval;
+    if (s->file == NULL || s->file_offset != 0 || end <= 0) {
+        make_false(op - 2);
+        pop(2);
+        return 0;
+    }
+    base = gp_fmap(s->file, end);
+    if (base == NULL) {
+        make_false(op - 2);
+        pop(2);
+        return 0;
+    }
+    nthreads = (int)max(1, min(op->value.intval, PDF_SCAN_MAX_THREADS));
+    nthreads = (int)min(nthreads, max(1, end / PDF_SCAN_MIN_CHUNK));
+    for (i = 0; i < nthreads; i++) {
+        chunk[i].base = base;
+        chunk[i].end = end;
+        chunk[i].from = end * i / nthreads;
+        chunk[i].to = end * (i + 1) / nthreads;
+        chunk[i].memory = mem;
+        chunk[i].found = NULL;
+        chunk[i].count = chunk[i].size = 0;
+        chunk[i].failed = false;
+        thread[i] = NULL;
+    }
+    /* The first chunk is done by this thread, as are any whose thread */
+    /* can't be started. */
+    for (i = 1; i < nthreads; i++)
+        if (gp_thread_start(pdf_scan_chunk, &chunk[i], &thread[i]) < 0)
+            thread[i] = NULL;
+    pdf_scan_chunk(&chunk[0]);
+    for (i = 1; i < nthreads; i++) {
+        if (thread[i] != NULL)
+            gp_thread_finish(thread[i]);
+        else
+            pdf_scan_chunk(&chunk[i]);
+    }
+    gp_funmap((void *)base, end);
+    for (i = 0; i < nthreads; i++) {
+        if (chunk[i].failed)
+            code = gs_note_error(gs_error_VMerror);
+        total += chunk[i].count;
+    }
+    if (code == 0 && 3 * total > max_array_size)
+        code = gs_note_error(gs_error_limitcheck);
+    if (code == 0)
+        code = ialloc_ref_array(&found, a_all, (uint)(3 * total),
+                                "zpdfscanobjects");
+    if (code == 0) {
+        pref = found.value.refs;
+        for (i = 0; i < nthreads; i++) {
+            for (j = 0; j < 3 * chunk[i].count; j++, pref++)
+                make_int(pref, chunk[i].found[j]);
+            for (j = 0; j < chunk[i].count; j++)
+                max_num = max(max_num, chunk[i].found[3 * j]);
+        }
+    }
+    for (i = 0; i < nthreads; i++)
+        gs_free_object(mem, chunk[i].found, "zpdfscanobjects");
+    if (code < 0)
+        return code;
+    ref_assign(op - 2, &found);
+    make_int(op - 1, max_num);
+    make_true(op);
+    return 0;
+}
+
+/* ------ Object stream cache ------ */
+
+/*
+ * resolveobjectstream (pdf_base.ps) decodes a whole object stream and
+ * tokenises every object in it.  Objects resolved during a page are lost
+ * at the restore at the end of the page, and resolving one of them again
+ * would mean decoding and tokenising the whole stream again.  The cache
+ * below keeps the decoded data of recently used object streams, with a
+ * table of where each object starts and ends, so that resolveobjstmobject
+ * can tokenise just the object it wants.  The data is kept outside VM, so
+ * that it survives the restore, and the least recently used streams are
+ * dropped when the total size goes over the limit given when the cache is
+ * created.
+ */
+#define PDF_OBJSTM_HASH_SIZE 256
+
+typedef struct pdf_objstm_obj_s {
+    ps_int num;			/* object number */
+    uint index;			/* position in the stream's header */
+    uint start, end;		/* the object's data */
+} pdf_objstm_obj_t;
+
+typedef struct pdf_objstm_entry_s pdf_objstm_entry_t;
+struct pdf_objstm_entry_s {
+    ps_int num;			/* object number of the stream */
+    byte *data;			/* decoded data */
+    uint length;
+    pdf_objstm_obj_t *objs;	/* sorted by object number */
+    uint count;
+    size_t size;		/* memory used by the entry */
+    pdf_objstm_entry_t *prev, *next;	/* LRU list, most recent first */
+    pdf_objstm_entry_t *hnext;	/* hash chain */
+};
+
+typedef struct pdf_objstm_cache_s {
+    gs_memory_t *memory;	/* non-GC memory for the entries */
+    size_t max_size, size;
+    pdf_objstm_entry_t *head, *tail;
+    pdf_objstm_entry_t *hash[PDF_OBJSTM_HASH_SIZE];
+} pdf_objstm_cache_t;
+
+static void pdf_objstm_finalize(const gs_memory_t *cmem, void *vptr);
+gs_private_st_simple_final(st_pdf_objstm_cache, pdf_objstm_cache_t,
+                           "pdf_objstm_cache_t", pdf_objstm_finalize);
+
+#define PDF_OBJSTM_HASH(num) ((uint)(num) % PDF_OBJSTM_HASH_SIZE)
+
+/* Unlink an entry from the LRU list. */
+static void
+pdf_objstm_unlink(pdf_objstm_cache_t *cache, pdf_objstm_entry_t *entry)
+{
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        cache->head = entry->next;
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    else
+        cache->tail = entry->prev;
+}
+
+/* Make an entry the most recently used one. */
+static void
+pdf_objstm_link(pdf_objstm_cache_t *cache, pdf_objstm_entry_t *entry)
+{
+    entry->prev = NULL;
+    entry->next = cache->head;
+    if (cache->head)
+        cache->head->prev = entry;
+    else
+        cache->tail = entry;
+    cache->head = entry;
+}
+
+static void
+pdf_objstm_free_entry(gs_memory_t *mem, pdf_objstm_entry_t *entry)
+{
+    gs_free_object(mem, entry->objs, "pdf_objstm_free_entry(objs)");
+    gs_free_object(mem, entry->data, "pdf_objstm_free_entry(data)");
+    gs_free_object(mem, entry, "pdf_objstm_free_entry");
+}
+
+/* Remove an entry from the cache and free it. */
+static void
+pdf_objstm_remove(pdf_objstm_cache_t *cache, pdf_objstm_entry_t *entry)
+{
+    pdf_objstm_entry_t **pp = &cache->hash[PDF_OBJSTM_HASH(entry->num)];
+
+    while (*pp != entry)
+        pp = &(*pp)->hnext;
+    *pp = entry->hnext;
+    pdf_objstm_unlink(cache, entry);
+    cache->size -= entry->size;
+    pdf_objstm_free_entry(cache->memory, entry);
+}
+
+static pdf_objstm_entry_t *
+pdf_objstm_find(pdf_objstm_cache_t *cache, ps_int num)
+{
+    pdf_objstm_entry_t *entry = cache->hash[PDF_OBJSTM_HASH(num)];
+
+    while (entry != NULL && entry->num != num)
+        entry = entry->hnext;
+    return entry;
+}
+
+static void
+pdf_objstm_finalize(const gs_memory_t *cmem, void *vptr)
+{
+    pdf_objstm_cache_t *const cache = vptr;
+    (void)cmem; /* unused */
+
+    while (cache->head != NULL)
+        pdf_objstm_remove(cache, cache->head);
+}
+
+/* Order the objects by number, then by position in the header, so that */
+/* the first of several objects with the same number is found, as it is */
+/* by resolveobjectstream. */
+static int
+pdf_objstm_compare(const void *a, const void *b)
+{
+    const pdf_objstm_obj_t *pa = a, *pb = b;
+
+    if (pa->num != pb->num)
+        return (pa->num < pb->num ? -1 : 1);
+    return (pa->index < pb->index ? -1 : pa->index > pb->index ? 1 : 0);
+}
+
+/* Skip white space and comments. */
+static const byte *
+pdf_objstm_skip_white(const byte *p, const byte *limit)
+{
+    while (p < limit) {
+        if (*p == '%') {
+            while (p < limit && !IS_PDF_EOL(*p))
+                p++;
+        } else if (IS_PDF_WHITE(*p) || IS_PDF_EOL(*p))
+            p++;
+        else
+            break;
+    }
+    return p;
+}
+
+/* Find the end of a run of regular characters (a number or keyword). */
+static const byte *
+pdf_objstm_skip_regular(const byte *p, const byte *limit)
+{
+    while (p < limit && !IS_PDF_WHITE(*p) && !IS_PDF_EOL(*p) &&
+           !IS_PDF_DELIM(*p))
+        p++;
+    return p;
+}
+
+/* Check whether a run of regular characters is a number, and if so */
+/* whether it is an integer. */
+static bool
+pdf_objstm_is_number(const byte *p, const byte *end, bool *integer)
+{
+    bool digits = false, point = false;
+
+    if (p < end && (*p == '+' || *p == '-'))
+        p++;
+    for (; p < end; p++) {
+        if (*p >= '0' && *p <= '9')
+            digits = true;
+        else if (*p == '.' && !point)
+            point = true;
+        else
+            return false;
+    }
+    *integer = !point;
+    return digits;
+}
+
+static bool
+pdf_objstm_is_keyword(const byte *p, const byte *end, const char *word)
+{
+    uint len = strlen(word);
+
+    return (end - p == len && !memcmp(p, word, len));
+}
+
+/*
+ * Find the end of the PDF value starting at p, or return NULL if it isn't
+ * one that we can be sure resolveobjectstream will read the same way.
+ * At the top level, "<int> <int> R" is one value, as it is for .pdfrun.
+ */
+static const byte *
+pdf_objstm_skip_value(const byte *p, const byte *limit, int depth)
+{
+    const byte *end, *q, *r;
+    bool integer;
+    int nest;
+
+    if (p >= limit || depth > 100)
+        return NULL;
+    switch (*p) {
+    case '(':
+        for (nest = 0, p++; p < limit; p++) {
+            if (*p == '\\')
+                p++;
+            else if (*p == '(')
+                nest++;
+            else if (*p == ')' && nest-- == 0)
+                return p + 1;
+        }
+        return NULL;
+    case '<':
+        if (p + 1 < limit && p[1] == '<') {
+            for (p += 2;;) {
+                p = pdf_objstm_skip_white(p, limit);
+                if (limit - p >= 2 && p[0] == '>' && p[1] == '>')
+                    return p + 2;
+                p = pdf_objstm_skip_value(p, limit, depth + 1);
+                if (p == NULL)
+                    return NULL;
+            }
+        }
+        while (++p < limit)
+            if (*p == '>')
+                return p + 1;
+        return NULL;
+    case '[':
+        for (p++;;) {
+            p = pdf_objstm_skip_white(p, limit);
+            if (p < limit && *p == ']')
+                return p + 1;
+            p = pdf_objstm_skip_value(p, limit, depth + 1);
+            if (p == NULL)
+                return NULL;
+        }
+    case '/':
+        return pdf_objstm_skip_regular(p + 1, limit);
+    case ')': case '>': case ']': case '{': case '}': case '%':
+        return NULL;
+    }
+    end = pdf_objstm_skip_regular(p, limit);
+    if (pdf_objstm_is_number(p, end, &integer)) {
+        if (!integer || depth > 0)
+            return end;
+        /* An object reference? */
+        q = pdf_objstm_skip_white(end, limit);
+        r = pdf_objstm_skip_regular(q, limit);
+        if (r == q || !pdf_objstm_is_number(q, r, &integer) || !integer)
+            return end;
+        q = pdf_objstm_skip_white(r, limit);
+        r = pdf_objstm_skip_regular(q, limit);
+        return (pdf_objstm_is_keyword(q, r, "R") ? r : end);
+    }
+    if (pdf_objstm_is_keyword(p, end, "true") ||
+        pdf_objstm_is_keyword(p, end, "false") ||
+        pdf_objstm_is_keyword(p, end, "null") ||
+        (depth > 0 && pdf_objstm_is_keyword(p, end, "R")))
+        return end;
+    return NULL;
+}
+
+/*
+ * Parse an object stream, whose header holds <count> pairs of object
+ * number and offset from <first>.  Like resolveobjectstream, this reads
+ * the objects one after another from <first> and gives the n'th one the
+ * n'th number in the header, ignoring the offsets.  Return false if the
+ * stream is malformed, or holds anything other than plain values, or not
+ * exactly <count> of them; resolveobjectstream will then deal with it.
+ */
+static bool
+pdf_objstm_parse(pdf_objstm_entry_t *entry, ps_int first)
+{
+    const byte *p = entry->data, *limit;
+    const byte *end = entry->data + entry->length;
+    pdf_objstm_obj_t *obj = entry->objs;
+    ps_int num, offset;
+    uint i;
+
+    if (first < 0 || first > entry->length)
+        return false;
+    limit = entry->data + first;
+    for (i = 0; i < entry->count; i++, obj++) {
+        while (p < limit && (IS_PDF_WHITE(*p) || IS_PDF_EOL(*p)))
+            p++;
+        p = pdf_scan_int(p, limit, &num);
+        if (p == NULL)
+            return false;
+        while (p < limit && (IS_PDF_WHITE(*p) || IS_PDF_EOL(*p)))
+            p++;
+        p = pdf_scan_int(p, limit, &offset);
+        if (p == NULL)
+            return false;
+        obj->num = num;
+        obj->index = i;
+    }
+    p = entry->data + first;
+    for (i = 0, obj = entry->objs; ; ) {
+        p = pdf_objstm_skip_white(p, end);
+        /* resolveobjectstream reports and ignores a stray endobj */
+        limit = pdf_objstm_skip_regular(p, end);
+        if (pdf_objstm_is_keyword(p, limit, "endobj")) {
+            p = limit;
+            continue;
+        }
+        if (p == end)
+            break;
+        if (i == entry->count)
+            return false;
+        obj->start = (uint)(p - entry->data);
+        p = pdf_objstm_skip_value(p, end, 0);
+        if (p == NULL)
+            return false;
+        obj->end = (uint)(p - entry->data);
+        i++, obj++;
+    }
+    if (i != entry->count)
+        return false;
+    qsort(entry->objs, entry->count, sizeof(*entry->objs),
+          pdf_objstm_compare);
+    return true;
+}
+
+/* <maxbytes> .pdfobjstmcache <cache> */
+static int
+zpdfobjstmcache(i_ctx_t *i_ctx_p)
+{
+    os_ptr op = osp;
+    pdf_objstm_cache_t *cache;
+
+    check_type(*op, t_integer);
+    if (op->value.intval < 0)
+        return_error(gs_error_rangecheck);
+    cache = gs_alloc_struct(imemory, pdf_objstm_cache_t, &st_pdf_objstm_cache,
+                            "zpdfobjstmcache");
+    if (cache == NULL)
+        return_error(gs_error_VMerror);
+    memset(cache, 0, sizeof(*cache));
+    cache->memory = imemory->non_gc_memory;
+    cache->max_size = (size_t)op->value.intval;
+    make_astruct(op, a_readonly | icurrent_space, (byte *)cache);
+    return 0;
+}
+
+/*
+ * <cache> <strm#> <file> <N> <First> .pdfobjstmput <bool>
+ * Read the decoded data of object stream <strm#> from <file> and add it to
+ * the cache.  Return false if the stream doesn't fit in the cache, or its
+ * header can't be parsed, or the file can't be read to the end.
+ */
+static int
+zpdfobjstmput(i_ctx_t *i_ctx_p)
+{
+    os_ptr op = osp;
+    pdf_objstm_cache_t *cache;
+    pdf_objstm_entry_t *entry;
+    gs_memory_t *mem;
+    stream *s;
+    ps_int num, count;
+    uint size = 0, n;
+    byte *data;
+    int status = 0;
+
+    check_op(5);
+    check_stype(op[-4], st_pdf_objstm_cache);
+    check_type(op[-3], t_integer);
+    check_read_file(i_ctx_p, s, op - 2);
+    check_type(op[-1], t_integer);
+    check_type(*op, t_integer);
+    cache = r_ptr(op - 4, pdf_objstm_cache_t);
+    mem = cache->memory;
+    num = op[-3].value.intval;
+    count = op[-1].value.intval;
+    if (count <= 0 || count > max_uint / sizeof(pdf_objstm_obj_t) ||
+        pdf_objstm_find(cache, num) != NULL)
+        goto fail;
+    entry = (pdf_objstm_entry_t *)gs_alloc_bytes(mem, sizeof(*entry),
+                                                 "zpdfobjstmput");
+    if (entry == NULL)
+        return_error(gs_error_VMerror);
+    memset(entry, 0, sizeof(*entry));
+    entry->num = num;
+    entry->count = (uint)count;
+    /* Read the whole stream, doubling the buffer as needed. */
+    for (;;) {
+        if (entry->length == size) {
+            if (size >= cache->max_size || size > max_uint / 2)
+                break;
+            size = (size == 0 ? 4096 : size * 2);
+            if (entry->data == NULL)
+                data = gs_alloc_bytes(mem, size, "zpdfobjstmput");
+            else
+                data = gs_resize_object(mem, entry->data, size,
+                                        "zpdfobjstmput");
+            if (data == NULL) {
+                pdf_objstm_free_entry(mem, entry);
+                return_error(gs_error_VMerror);
+            }
+            entry->data = data;
+        }
+        status = sgets(s, entry->data + entry->length, size - entry->length, &n);
+        entry->length += n;
+        if (status != 0 && entry->length < size)
+            break;
+    }
+    entry->size = sizeof(*entry) + entry->length +
+        entry->count * sizeof(pdf_objstm_obj_t);
+    if (status != EOFC || entry->size > cache->max_size) {
+        pdf_objstm_free_entry(mem, entry);
+        goto fail;
+    }
+    entry->objs = (pdf_objstm_obj_t *)
+        gs_alloc_byte_array(mem, entry->count, sizeof(pdf_objstm_obj_t),
+                            "zpdfobjstmput");
+    if (entry->objs == NULL) {
+        pdf_objstm_free_entry(mem, entry);
+        return_error(gs_error_VMerror);
+    }
+    if (!pdf_objstm_parse(entry, op->value.intval)) {
+        pdf_objstm_free_entry(mem, entry);
+        goto fail;
+    }
+    while (cache->tail != NULL && cache->size + entry->size > cache->max_size)
+        pdf_objstm_remove(cache, cache->tail);
+    entry->hnext = cache->hash[PDF_OBJSTM_HASH(num)];
+    cache->hash[PDF_OBJSTM_HASH(num)] = entry;
+    pdf_objstm_link(cache, entry);
+    cache->size += entry->size;
+    make_true(op - 4);
+    pop(4);
+    return 0;
+fail:
+    make_false(op - 4);
+    pop(4);
+    return 0;
+}
+
+/*
+ * <cache> <strm#> <obj#> .pdfobjstmget <string> true
+ * <cache> <strm#> <obj#> .pdfobjstmget false
+ * Return the data of object <obj#> if object stream <strm#> is in the
+ * cache and holds it.
+ */
+static int
+zpdfobjstmget(i_ctx_t *i_ctx_p)
+{
+    os_ptr op = osp;
+    pdf_objstm_cache_t *cache;
+    pdf_objstm_entry_t *entry;
+    pdf_objstm_obj_t *obj = NULL;
+    ps_int num;
+    uint lo, hi, mid, length;
+    byte *str;
+
+    check_op(3);
+    check_stype(op[-2], st_pdf_objstm_cache);
+    check_type(op[-1], t_integer);
+    check_type(*op, t_integer);
+    cache = r_ptr(op - 2, pdf_objstm_cache_t);
+    num = op->value.intval;
+    entry = pdf_objstm_find(cache, op[-1].value.intval);
+    if (entry != NULL) {
+        /* Find the first object with this number. */
+        lo = 0, hi = entry->count;
+        while (lo < hi) {
+            mid = (lo + hi) / 2;
+            if (entry->objs[mid].num < num)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo < entry->count && entry->objs[lo].num == num)
+            obj = &entry->objs[lo];
+    }
+    if (obj == NULL) {
+        make_false(op - 2);
+        pop(2);
+        return 0;
+    }
+    if (entry != cache->head) {
+        pdf_objstm_unlink(cache, entry);
+        pdf_objstm_link(cache, entry);
+    }
+    length = obj->end - obj->start;
+    str = ialloc_string(length, "zpdfobjstmget");
+    if (str == NULL)
+        return_error(gs_error_VMerror);
+    memcpy(str, entry->data + obj->start, length);
+    make_string(op - 2, a_all | icurrent_space, length, str);
+    make_true(op - 1);
+    pop(1);
+    return 0;
+}
+
+/* ------ Parallel page rendering ------ */
+
+/*
+ * With -dPDFParallelPages=N, runpdf hands the page range to N interpreter
+ * instances, started through the gsapi interface, each running in its own
+ * thread.  The range is cut into a few chunks per instance, which the
+ * instances take in turn until none are left, so that an instance which
+ * is given quick pages doesn't sit idle at the end.  Each instance opens
+ * the file once, with the same switches as this one, and writes its own
+ * output files; the device's PageCount is set before each chunk, so that
+ * the %d in the OutputFile gives the same names as a sequential run.
+ * Several instances can only exist in a thread safe build.
+ */
+#ifdef GS_THREADSAFE
+
+#define PDF_PARALLEL_MAX_INSTANCES 64
+#define PDF_PARALLEL_CHUNKS 4	/* chunks per instance */
+
+typedef struct pdf_parallel_job_s {
+    int argc;
+    char **argv;		/* switches for the instances */
+    const char *file;		/* the PDF file */
+    ps_int first;		/* first page of the range */
+    ps_int total;		/* number of pages */
+    int nchunks, next;		/* chunks, next chunk to do */
+    int64_t page_count;		/* PageCount of the first page */
+    gx_monitor_t *lock;		/* protects next and code */
+    int code;			/* first error */
+} pdf_parallel_job_t;
+
+typedef struct pdf_parallel_worker_s {
+    pdf_parallel_job_t *job;
+    void *instance;
+} pdf_parallel_worker_t;
+
+/*
+ * Run one instance.  It opens the file once, and its runpdf takes chunks of
+ * pages with .pdfparallelchunk until there are none left.
+ */
+static void
+pdf_parallel_worker(void *arg)
+{
+    pdf_parallel_worker_t *worker = (pdf_parallel_worker_t *)arg;
+    pdf_parallel_job_t *job = worker->job;
+    gs_main_instance *minst;
+    gx_device *dev;
+    int exit_code;
+    int code = gsapi_init_with_args(worker->instance, job->argc, job->argv);
+
+    if (code >= 0) {
+        minst = get_minst_from_memory(((gs_lib_ctx_t *)worker->instance)->memory);
+        minst->pdf_parallel_worker = worker;
+        /* Start with the PageCount of this instance, as runpdfbegin */
+        /* remembers it for the whole document. */
+        dev = gs_currentdevice(minst->i_ctx_p->pgs);
+        while (dev->child != NULL)
+            dev = dev->child;
+        dev->PageCount = job->page_count;
+        code = gsapi_run_file(worker->instance, job->file, 0, &exit_code);
+    }
+    if (code == gs_error_Quit)
+        code = 0;
+    gsapi_exit(worker->instance);
+    if (code < 0) {
+        gx_monitor_enter(job->lock);
+        if (job->code == 0)
+            job->code = code;
+        gx_monitor_leave(job->lock);
+    }
+}
+
+/* Check whether a switch is one that the instances must not inherit. */
+static bool
+pdf_parallel_skip_switch(const char *arg)
+{
+    static const char *const names[] = {
+        "DEVICE", "OutputFile", "FirstPage", "LastPage", "PageList",
+        "PDFParallelPages", "BATCH", 0
+    };
+    const char *const *pname;
+    size_t len;
+
+    if (arg[1] != 'd' && arg[1] != 'D' && arg[1] != 's' && arg[1] != 'S')
+        return false;
+    len = strcspn(arg + 2, "=#");
+    for (pname = names; *pname != 0; pname++)
+        if (strlen(*pname) == len && !strncmp(arg + 2, *pname, len))
+            return true;
+    return false;
+}
+
+/*
+ * Creating or deleting an instance resets the callbacks in the core that
+ * it shares with this one, so they have to be put back afterwards.
+ */
+static void
+pdf_parallel_restore_core(gs_lib_ctx_core_t *core, const gs_lib_ctx_core_t *saved)
+{
+    core->caller_handle = saved->caller_handle;
+    core->stdin_fn = saved->stdin_fn;
+    core->stdout_fn = saved->stdout_fn;
+    core->stderr_fn = saved->stderr_fn;
+    core->poll_fn = saved->poll_fn;
+    core->custom_color_callback = saved->custom_color_callback;
+}
+
+#endif /* GS_THREADSAFE */
+
+/*
+ * <file> <outputfile> <first> <last> <count> .pdfparallelpages <bool>
+ * Render pages <first> to <last> of the PDF file named <file> with <count>
+ * instances.  Return false if the pages must be rendered by this instance:
+ * when this isn't a thread safe build, or the OutputFile doesn't name one
+ * file per page, or the instances can't be created.
+ */
+static int
+zpdfparallelpages(i_ctx_t *i_ctx_p)
+{
+    os_ptr op = osp;
+#ifdef GS_THREADSAFE
+    gs_memory_t *mem = imemory->non_gc_memory;
+    gs_main_instance *minst = get_minst_from_memory(imemory);
+    gs_lib_ctx_core_t *core = imemory->gs_lib_ctx->core;
+    gs_lib_ctx_core_t saved;
+    gx_device *dev = gs_currentdevice(igs);
+    pdf_parallel_job_t job;
+    pdf_parallel_worker_t worker[PDF_PARALLEL_MAX_INSTANCES];
+    gp_thread_id thread[PDF_PARALLEL_MAX_INSTANCES];
+    gs_parsed_file_name_t parsed;
+    const char *fmt;
+    char *file, *device, *outfile;
+    int i, n = 0, nworkers, code = 0;
+#endif
+
+    check_op(5);
+    check_read_type(op[-4], t_string);
+    check_read_type(op[-3], t_string);
+    check_type(op[-2], t_integer);
+    check_type(op[-1], t_integer);
+    check_type(*op, t_integer);
+#ifdef GS_THREADSAFE
+    /* Skip over any subclass devices, to the one that writes the pages. */
+    while (dev->child != NULL)
+        dev = dev->child;
+    job.first = op[-2].value.intval;
+    job.total = op[-1].value.intval - job.first + 1;
+    nworkers = (int)min(min(op->value.intval, job.total),
+                        PDF_PARALLEL_MAX_INSTANCES);
+    if (nworkers < 2 || job.first < 1 ||
+        gx_parse_output_file_name(&parsed, &fmt,
+                                  (const char *)op[-3].value.bytes,
+                                  r_size(op - 3), imemory) < 0 ||
+        fmt == NULL) {
+        make_false(op - 4);
+        pop(4);
+        return 0;
+    }
+    job.argv = (char **)gs_alloc_byte_array(mem, minst->num_switches + 5,
+                                            sizeof(char *), "zpdfparallelpages");
+    file = (char *)gs_alloc_bytes(mem, r_size(op - 4) + 1, "zpdfparallelpages");
+    device = (char *)gs_alloc_bytes(mem, strlen(dev->dname) + 10,
+                                    "zpdfparallelpages");
+    outfile = (char *)gs_alloc_bytes(mem, r_size(op - 3) + 14,
+                                     "zpdfparallelpages");
+    job.lock = gx_monitor_alloc(mem);
+    if (job.argv == NULL || file == NULL || device == NULL ||
+        outfile == NULL || job.lock == NULL) {
+        code = gs_note_error(gs_error_VMerror);
+        goto out;
+    }
+    memcpy(file, op[-4].value.bytes, r_size(op - 4));
+    file[r_size(op - 4)] = 0;
+    gs_sprintf(device, "-sDEVICE=%s", dev->dname);
+    strcpy(outfile, "-sOutputFile=");
+    memcpy(outfile + 13, op[-3].value.bytes, r_size(op - 3));
+    outfile[13 + r_size(op - 3)] = 0;
+    job.argc = 0;
+    job.argv[job.argc++] = (char *)"gs";	/* not used */
+    job.argv[job.argc++] = device;
+    for (i = 0; i < minst->num_switches; i++)
+        if (!pdf_parallel_skip_switch(minst->switches[i]))
+            job.argv[job.argc++] = minst->switches[i];
+    job.argv[job.argc++] = outfile;
+    job.argv[job.argc++] = (char *)"-dNOPAUSE";
+    job.argv[job.argc++] = (char *)"-dQUIET";
+    job.file = file;
+    job.nchunks = (int)min(job.total, (ps_int)nworkers * PDF_PARALLEL_CHUNKS);
+    job.next = 0;
+    job.page_count = dev->PageCount;
+    job.code = 0;
+    saved = *core;
+    for (n = 0; n < nworkers; n++) {
+        worker[n].job = &job;
+        worker[n].instance = imemory->gs_lib_ctx;
+        if (gsapi_new_instance(&worker[n].instance, saved.caller_handle) < 0)
+            break;
+        gsapi_set_arg_encoding(worker[n].instance, GS_ARG_ENCODING_UTF8);
+    }
+    pdf_parallel_restore_core(core, &saved);
+    if (n >= 2) {
+        /* The first instance runs in this thread, as do any whose thread */
+        /* can't be started. */
+        for (i = 1; i < n; i++)
+            if (gp_thread_start(pdf_parallel_worker, &worker[i], &thread[i]) < 0)
+                thread[i] = NULL;
+        pdf_parallel_worker(&worker[0]);
+        for (i = 1; i < n; i++) {
+            if (thread[i] != NULL)
+                gp_thread_finish(thread[i]);
+            else
+                pdf_parallel_worker(&worker[i]);
+        }
+        code = job.code;
+        dev->PageCount = job.page_count + job.total;
+    }
+    for (i = 0; i < n; i++)
+        gsapi_delete_instance(worker[i].instance);
+    if (n > 0)
+        pdf_parallel_restore_core(core, &saved);
+out:
+    if (job.lock != NULL)
+        gx_monitor_free(job.lock);
+    gs_free_object(mem, job.argv, "zpdfparallelpages");
+    gs_free_object(mem, file, "zpdfparallelpages");
+    gs_free_object(mem, device, "zpdfparallelpages");
+    gs_free_object(mem, outfile, "zpdfparallelpages");
+    if (code < 0)
+        return code;
+    make_bool(op - 4, n >= 2);
+    pop(4);
+    return 0;
+#else
+    emprintf(imemory,
+             "   **** Warning: -dPDFParallelPages needs a thread safe build.\n"
+             "                 Rendering the pages sequentially.\n");
+    make_false(op - 4);
+    pop(4);
+    return 0;
+#endif
+}
+
+/*
+ * - .pdfparallelchunk <first> <last> true
+ * - .pdfparallelchunk false
+ * In an instance started by .pdfparallelpages, return the next chunk of
+ * pages to render, and set the device's PageCount for its first page.
+ * Return false when there are no chunks left, one of the instances has
+ * failed, or this isn't such an instance.
+ */
+static int
+zpdfparallelchunk(i_ctx_t *i_ctx_p)
+{
+    os_ptr op = osp;
+#ifdef GS_THREADSAFE
+    gs_main_instance *minst = get_minst_from_memory(imemory);
+    pdf_parallel_worker_t *worker = minst->pdf_parallel_worker;
+    pdf_parallel_job_t *job;
+    gx_device *dev;
+    int chunk;
+
+    if (worker != NULL) {
+        job = worker->job;
+        gx_monitor_enter(job->lock);
+        chunk = (job->code < 0 ? job->nchunks : job->next++);
+        gx_monitor_leave(job->lock);
+        if (chunk < job->nchunks) {
+            push(3);
+            make_int(op - 2, job->first + job->total * chunk / job->nchunks);
+            make_int(op - 1,
+                     job->first + job->total * (chunk + 1) / job->nchunks - 1);
+            make_true(op);
+            dev = gs_currentdevice(igs);
+            while (dev->child != NULL)
+                dev = dev->child;
+            dev->PageCount = job->page_count + op[-2].value.intval - job->first;
+            return 0;
+        }
+    }
+#endif
+    push(1);
+    make_false(op);
+    return 0;
+}
+
 /* ------ Initialization procedure ------ */
 
 const op_def zpdfops_op_defs[] =
@@ -249,6 +1468,14 @@ const op_def zpdfops_op_defs[] =
     {"0.pdfinkpath", zpdfinkpath},
     {"1.pdfFormName", zpdfFormName},
     {"3.setscreenphase", zsetscreenphase},
+    {"6.pdfreadxrefsection", zpdfreadxrefsection},
+    {"7.pdfreadxrefstream", zpdfreadxrefstream},
+    {"3.pdfscanobjects", zpdfscanobjects},
+    {"1.pdfobjstmcache", zpdfobjstmcache},
+    {"5.pdfobjstmput", zpdfobjstmput},
+    {"3.pdfobjstmget", zpdfobjstmget},
+    {"5.pdfparallelpages", zpdfparallelpages},
+    {"0.pdfparallelchunk", zpdfparallelchunk},
 #ifdef HAVE_LIBIDN
     {"1.saslprep", zsaslprep},
 #endif
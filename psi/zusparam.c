@@ -471,6 +471,49 @@ set_GridFitTT(i_ctx_t *i_ctx_p, long val)
     gs_setgridfittt(ifont_dir, (uint)val);
     return 0;
 }
+static long
+current_GlyphRenderingThreads(i_ctx_t *i_ctx_p)
+{
+    return gs_currentglyphrenderingthreads(ifont_dir);
+}
+static int
+set_GlyphRenderingThreads(i_ctx_t *i_ctx_p, long val)
+{
+    gs_setglyphrenderingthreads(ifont_dir, (uint)val);
+    return 0;
+}
+
+static void
+current_glyph_cache_dir(i_ctx_t *i_ctx_p, gs_param_string * pval)
+{
+    const char *dir = gs_currentglyphcachedir(ifont_dir);
+
+    if (dir == NULL) {
+        pval->data = (const byte *)"";
+        pval->size = 0;
+        pval->persistent = true;
+    } else {
+        pval->data = (const byte *)dir;
+        pval->size = strlen(dir);
+        pval->persistent = false;
+    }
+}
+
+static int
+set_glyph_cache_dir(i_ctx_t *i_ctx_p, gs_param_string * pval)
+{
+    gs_param_string current;
+
+    /* As for ICCLinkCacheDir, files are written in this directory. */
+    if (i_ctx_p->LockFilePermissions) {
+        current_glyph_cache_dir(i_ctx_p, &current);
+        if (current.size != pval->size ||
+            memcmp(current.data, pval->data, pval->size) != 0)
+            return_error(gs_error_invalidaccess);
+        return 0;
+    }
+    return gs_setglyphcachedir(ifont_dir, pval->data, pval->size);
+}
 
 #undef ifont_dir
 
@@ -510,6 +553,29 @@ set_icc_directory(i_ctx_t *i_ctx_p, gs_param_string * pval)
     return gs_seticcdirectory(igs, pval);
 }
 
+static void
+current_icc_link_cache_dir(i_ctx_t *i_ctx_p, gs_param_string * pval)
+{
+    gs_currenticclinkcachedir(igs, pval);
+}
+
+static int
+set_icc_link_cache_dir(i_ctx_t *i_ctx_p, gs_param_string * pval)
+{
+    gs_param_string current;
+
+    /* Files are written in this directory, so once SAFER has locked */
+    /* the file permissions it can't be changed (only reset).        */
+    if (i_ctx_p->LockFilePermissions) {
+        gs_currenticclinkcachedir(igs, &current);
+        if (current.size != pval->size ||
+            memcmp(current.data, pval->data, pval->size) != 0)
+            return_error(gs_error_invalidaccess);
+        return 0;
+    }
+    return gs_seticclinkcachedir(igs, pval);
+}
+
 static void
 current_srcgtag_icc(i_ctx_t *i_ctx_p, gs_param_string * pval)
 {
@@ -598,7 +664,9 @@ static const long_param_def_t user_long_params[] =
     {"AlignToPixels", 0, 1,
      current_AlignToPixels, set_AlignToPixels},
     {"GridFitTT", 0, 3,
-     current_GridFitTT, set_GridFitTT}
+     current_GridFitTT, set_GridFitTT},
+    {"GlyphRenderingThreads", 0, 64,
+     current_GlyphRenderingThreads, set_GlyphRenderingThreads}
 };
 
 /* Note that string objects that are maintained as user params must be
@@ -620,6 +688,8 @@ static const string_param_def_t user_string_params[] =
     {"DefaultCMYKProfile", current_default_cmyk_icc, set_default_cmyk_icc},
     {"NamedProfile", current_named_icc, set_named_profile_icc},
     {"ICCProfilesDir", current_icc_directory, set_icc_directory},
+    {"ICCLinkCacheDir", current_icc_link_cache_dir, set_icc_link_cache_dir},
+    {"GlyphCacheDir", current_glyph_cache_dir, set_glyph_cache_dir},
     {"LabProfile", current_lab_icc, set_lab_icc},
     {"DeviceNProfile", current_devicen_icc, set_devicen_profile_icc},
     {"SourceObjectICC", current_srcgtag_icc, set_srcgtag_icc}
@@ -0,0 +1,565 @@
+/* Copyright (C) 2001-2019 Artifex Software, Inc.
+   All Rights Reserved.
+
+   This software is provided AS-IS with no warranty, either express or
+   implied.
+
+   This software is distributed under license and may not be copied,
+   modified or distributed except as expressly authorized under the terms
+   of the license contained in the file LICENSE in this distribution.
+
+   Refer to licensing information at http://www.artifex.com or contact
+   Artifex Software, Inc.,  1305 Grant Avenue - Suite 200, Novato,
+   CA 94945, U.S.A., +1(415)492-9861, for further information.
+*/
+
+/*
+ * blendbench.c: Time and check the 8 and 16 bit pdf14 compositing kernels.
+ *
+ * For both bit depths this times, on generated pixels:
+ *  - art_blend_pixel_8/16 for the separable blend modes,
+ *  - art_pdf_composite_pixel_alpha_8/16 (a Normal or Multiply fill
+ *    onto a group) and art_pdf_composite_knockout_8/16 (a fill in a
+ *    knockout group),
+ *  - pdf14_compose_group for an isolated group (Normal and Multiply), a
+ *    non-isolated group and a knockout group, in RGB and in CMYK.
+ * Every result is checked against the same operation done in double
+ * precision. The group tests are run twice: once with all alphas (the
+ * group alpha, and the source and backdrop alphas) below 30%, and once
+ * with alphas over the whole range and a group alpha of 1.
+ *
+ * Build the shared library first ("make so"), then compile from inside
+ * ghostpdl with:
+ * gcc -O2 -I./soobj -I./base -o blendbench ./toolbin/blendbench.c -L./sobin -lgs
+ * and run with:
+ * LD_LIBRARY_PATH=./sobin ./blendbench [-w width] [-h height] [-n reps]
+ */
+
+#include "stdio_.h"
+#include "string_.h"
+#include "math_.h"
+#include "gserrors.h"
+#include "gsmalloc.h"
+#include "gxblend.h"
+#include "gdevp14.h"
+#include <stdlib.h>
+#include <time.h>
+
+#define MAX_COLS 4
+
+static unsigned int seed = 12345;
+
+static double
+seconds(clock_t start)
+{
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* A value in [0, 1) */
+static double
+rnd(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return (double)((seed >> 8) & 0xffff) / 65536.0;
+}
+
+static int
+quant(double v, int max)
+{
+    return (int)floor(v * max + 0.5);
+}
+
+/* The separable blend functions, on additive values */
+static double
+blend_ref(gs_blend_mode_t mode, double b, double s)
+{
+    switch (mode) {
+        case BLEND_MODE_Multiply: return b * s;
+        case BLEND_MODE_Screen: return b + s - b * s;
+        case BLEND_MODE_Darken: return b < s ? b : s;
+        case BLEND_MODE_Lighten: return b > s ? b : s;
+        case BLEND_MODE_Difference: return b > s ? b - s : s - b;
+        case BLEND_MODE_Exclusion: return b + s - 2 * b * s;
+        default: return s;
+    }
+}
+
+/* Composite (cs, as) over (cb, ab) with blend mode, per section 7.2.5 of */
+/* the PDF 1.7 spec. Colors are additive. Returns the result alpha.       */
+static double
+over_ref(double *c, const double *cb, double ab, const double *cs, double as,
+         int ncols, gs_blend_mode_t mode)
+{
+    double ar = ab + as - ab * as;
+    int i;
+
+    if (as == 0)
+        return ab;
+    for (i = 0; i < ncols; i++) {
+        double mix = (1 - ab) * cs[i] + ab * blend_ref(mode, cb[i], cs[i]);
+
+        c[i] = cb[i] + (mix - cb[i]) * as / ar;
+    }
+    return ar;
+}
+
+/* Largest difference between a result and its reference, in 8 bit steps.  */
+/* Colors are compared premultiplied, as color under a tiny alpha is noise. */
+static double
+pixel_err(const double *c, double a, const double *cr, double ar, int ncols)
+{
+    double err = fabs(a - ar);
+    int i;
+
+    for (i = 0; i < ncols; i++) {
+        double e = fabs(c[i] * a - cr[i] * ar);
+
+        if (e > err)
+            err = e;
+    }
+    return err * 255;
+}
+
+/*
+ * Time art_blend_pixel_8/16 on n pixels of 4 colorants, then check
+ * every pixel against blend_ref.
+ */
+static int
+bench_blend(gs_memory_t *mem, pdf14_device *pdev, gs_blend_mode_t mode,
+            const char *name, int deep, int n, int reps)
+{
+    int max = deep ? 65535 : 255;
+    int bps = deep ? 2 : 1;
+    byte *b = gs_alloc_bytes(mem, n * MAX_COLS * bps, "blendbench");
+    byte *s = gs_alloc_bytes(mem, n * MAX_COLS * bps, "blendbench");
+    byte *d = gs_alloc_bytes(mem, n * MAX_COLS * bps, "blendbench");
+    double err = 0, t;
+    clock_t start;
+    int i, j, r;
+
+    if (b == NULL || s == NULL || d == NULL)
+        return_error(gs_error_VMerror);
+    for (i = 0; i < n * MAX_COLS; i++) {
+        if (deep) {
+            ((uint16_t *)b)[i] = quant(rnd(), max);
+            ((uint16_t *)s)[i] = quant(rnd(), max);
+        } else {
+            b[i] = quant(rnd(), max);
+            s[i] = quant(rnd(), max);
+        }
+    }
+
+    start = clock();
+    for (r = 0; r < reps; r++)
+        for (i = 0; i < n; i++) {
+            if (deep)
+                art_blend_pixel_16((uint16_t *)d + i * MAX_COLS,
+                                   (uint16_t *)b + i * MAX_COLS,
+                                   (uint16_t *)s + i * MAX_COLS,
+                                   MAX_COLS, mode, NULL, pdev);
+            else
+                art_blend_pixel_8(d + i * MAX_COLS, b + i * MAX_COLS,
+                                  s + i * MAX_COLS, MAX_COLS, mode, NULL, pdev);
+        }
+    t = seconds(start) / reps;
+
+    for (i = 0; i < n * MAX_COLS; i++) {
+        double bv, sv, dv, e;
+
+        if (deep) {
+            bv = ((uint16_t *)b)[i] / (double)max;
+            sv = ((uint16_t *)s)[i] / (double)max;
+            dv = ((uint16_t *)d)[i] / (double)max;
+        } else {
+            bv = b[i] / (double)max;
+            sv = s[i] / (double)max;
+            dv = d[i] / (double)max;
+        }
+        e = fabs(dv - blend_ref(mode, bv, sv)) * max;
+        if (e > err)
+            err = e;
+    }
+    j = err > 1.0;
+    outprintf(mem, "%2d bit blend %-10s %7.2f ms (%6.1f Mpix/s)  max err %5.2f lsb  %s\n",
+              deep ? 16 : 8, name, t * 1e3, t > 0 ? n / t / 1e6 : 0.0, err,
+              j ? "MISMATCH" : "ok");
+    gs_free_object(mem, b, "blendbench");
+    gs_free_object(mem, s, "blendbench");
+    gs_free_object(mem, d, "blendbench");
+    return j;
+}
+
+typedef enum {
+    FILL_NORMAL,
+    FILL_MULTIPLY,
+    FILL_KNOCKOUT
+} fill_kind;
+
+static const char *const fill_names[] = { "Normal", "Multiply", "knockout" };
+
+/*
+ * Time the compositing of a fill onto the group on n RGB pixels, then
+ * check against the reference. This is art_pdf_composite_pixel_alpha_8/16
+ * for an ordinary fill, and art_pdf_composite_knockout_8/16 for a fill in
+ * a knockout group, where the source alpha is the shape of an opaque fill.
+ */
+static int
+bench_fill(gs_memory_t *mem, pdf14_device *pdev, fill_kind kind, int deep,
+           int n, int reps)
+{
+    gs_blend_mode_t mode = kind == FILL_MULTIPLY ? BLEND_MODE_Multiply : BLEND_MODE_Normal;
+    int max = deep ? 65535 : 255;
+    int bps = deep ? 2 : 1;
+    /* The kernels may touch up to 4 channels past the alpha */
+    int stride = 8;
+    byte *b = gs_alloc_bytes(mem, n * stride * bps, "blendbench");
+    byte *s = gs_alloc_bytes(mem, n * stride * bps, "blendbench");
+    byte *d = gs_alloc_bytes(mem, n * stride * bps, "blendbench");
+    double err = 0, t = 0;
+    clock_t start;
+    int i, j, r;
+
+    if (b == NULL || s == NULL || d == NULL)
+        return_error(gs_error_VMerror);
+    memset(b, 0, n * stride * bps);
+    memset(s, 0, n * stride * bps);
+    for (i = 0; i < n; i++)
+        for (j = 0; j < 4; j++) {
+            if (deep) {
+                ((uint16_t *)b)[i * stride + j] = quant(rnd(), max);
+                ((uint16_t *)s)[i * stride + j] = quant(rnd(), max);
+            } else {
+                b[i * stride + j] = quant(rnd(), max);
+                s[i * stride + j] = quant(rnd(), max);
+            }
+        }
+
+    for (r = 0; r < reps; r++) {
+        memcpy(d, b, n * stride * bps);
+        start = clock();
+        for (i = 0; i < n; i++) {
+            if (kind == FILL_KNOCKOUT) {
+                if (deep)
+                    art_pdf_composite_knockout_16((uint16_t *)d + i * stride,
+                                                  (uint16_t *)s + i * stride,
+                                                  3, mode, NULL, pdev);
+                else
+                    art_pdf_composite_knockout_8(d + i * stride, s + i * stride,
+                                                 3, mode, NULL, pdev);
+            } else if (deep)
+                art_pdf_composite_pixel_alpha_16((uint16_t *)d + i * stride,
+                                                 (uint16_t *)s + i * stride,
+                                                 3, mode, 3, NULL, pdev);
+            else
+                art_pdf_composite_pixel_alpha_8(d + i * stride, s + i * stride,
+                                                3, mode, 3, NULL, pdev);
+        }
+        t += seconds(start);
+    }
+    t /= reps;
+
+    for (i = 0; i < n; i++) {
+        double cb[4], cs[4], cd[4], cr[3], ar, e;
+
+        for (j = 0; j < 4; j++) {
+            if (deep) {
+                cb[j] = ((uint16_t *)b)[i * stride + j] / (double)max;
+                cs[j] = ((uint16_t *)s)[i * stride + j] / (double)max;
+                cd[j] = ((uint16_t *)d)[i * stride + j] / (double)max;
+            } else {
+                cb[j] = b[i * stride + j] / (double)max;
+                cs[j] = s[i * stride + j] / (double)max;
+                cd[j] = d[i * stride + j] / (double)max;
+            }
+        }
+        if (kind == FILL_KNOCKOUT) {
+            /* Interpolate by the shape between the group and the fill */
+            ar = cb[3] + (1 - cb[3]) * cs[3];
+            for (j = 0; j < 3; j++)
+                cr[j] = ar == 0 ? cb[j] :
+                    (cb[j] * cb[3] * (1 - cs[3]) + cs[j] * cs[3]) / ar;
+        } else {
+            if (cb[3] == 0)
+                memcpy(cb, cs, sizeof(cb[0]) * 3);
+            ar = over_ref(cr, cb, cb[3], cs, cs[3], 3, mode);
+            if (cs[3] == 0)
+                memcpy(cr, cb, sizeof(cr));
+        }
+        e = pixel_err(cd, cd[3], cr, ar, 3);
+        if (e > err)
+            err = e;
+    }
+    j = err > (deep ? 0.1 : 2.0);
+    outprintf(mem, "%2d bit fill  %-10s %7.2f ms (%6.1f Mpix/s)  max err %5.2f lsb8 %s\n",
+              deep ? 16 : 8, fill_names[kind], t * 1e3, t > 0 ? n / t / 1e6 : 0.0, err,
+              j ? "MISMATCH" : "ok");
+    gs_free_object(mem, b, "blendbench");
+    gs_free_object(mem, s, "blendbench");
+    gs_free_object(mem, d, "blendbench");
+    return j;
+}
+
+typedef enum {
+    GROUP_ISOLATED,
+    GROUP_NONISOLATED,
+    GROUP_KNOCKOUT
+} group_kind;
+
+static const char *const kind_names[] = { "isolated", "non-isolated", "knockout" };
+
+/* Read/write plane p of pixel i of a buffer, as a value in [0, 1] */
+static double
+get_px(const pdf14_buf *buf, const byte *data, int p, int i)
+{
+    if (buf->deep)
+        return ((const uint16_t *)(data + p * buf->planestride))[i] / 65535.0;
+    return data[p * buf->planestride + i] / 255.0;
+}
+
+static void
+put_px(pdf14_buf *buf, byte *data, int p, int i, double v)
+{
+    if (buf->deep)
+        ((uint16_t *)(data + p * buf->planestride))[i] = quant(v, 65535);
+    else
+        data[p * buf->planestride + i] = quant(v, 255);
+}
+
+/*
+ * Time pdf14_compose_group popping a width x height group onto its
+ * parent, then check every pixel against over_ref. Colors in the buffers
+ * are stored as the pdf14 device stores them, so CMYK is complemented on
+ * the way in and out of the reference.
+ *
+ * For a non-isolated group the group buffer holds the group composited
+ * with the parent's backdrop, and its alpha_g plane holds the group's own
+ * alpha, so the compose has to take the backdrop out again before it
+ * applies the group alpha. For a knockout group the parent's initial
+ * backdrop is kept separately, and the group is composited with that
+ * rather than with what has been painted since.
+ */
+static int
+bench_group(gs_memory_t *mem, pdf14_device *pdev, group_kind kind,
+            gs_blend_mode_t mode, int ncols, int deep, bool low,
+            int width, int height, int reps)
+{
+    int bps = deep ? 2 : 1;
+    int npix = width * height;
+    int n_chan = ncols + 1;
+    double max_a = low ? 0.3 : 1.0;
+    double group_alpha = low ? 0.25 : 1.0;
+    bool additive = ncols < 4;
+    pdf14_buf tos, nos;
+    byte *saved, *backdrop = NULL;
+    double err = 0, t = 0, tol;
+    clock_t start;
+    int i, j, r, bad;
+
+    memset(&tos, 0, sizeof(tos));
+    memset(&nos, 0, sizeof(nos));
+    tos.rect.q.x = nos.rect.q.x = width;
+    tos.rect.q.y = nos.rect.q.y = height;
+    tos.rowstride = nos.rowstride = width * bps;
+    tos.planestride = nos.planestride = npix * bps;
+    tos.n_chan = nos.n_chan = n_chan;
+    tos.n_planes = n_chan + 1;	/* alpha_g */
+    nos.n_planes = n_chan;
+    tos.deep = nos.deep = deep;
+    tos.isolated = kind != GROUP_NONISOLATED;
+    nos.knockout = kind == GROUP_KNOCKOUT;
+    tos.alpha = quant(group_alpha, 65535);
+    tos.shape = 65535;
+    tos.blend_mode = mode;
+    tos.data = gs_alloc_bytes(mem, tos.n_planes * tos.planestride, "blendbench");
+    nos.data = gs_alloc_bytes(mem, nos.n_planes * nos.planestride, "blendbench");
+    saved = gs_alloc_bytes(mem, nos.n_planes * nos.planestride, "blendbench");
+    if (tos.data == NULL || nos.data == NULL || saved == NULL)
+        return_error(gs_error_VMerror);
+    if (kind == GROUP_KNOCKOUT) {
+        backdrop = gs_alloc_bytes(mem, nos.n_planes * nos.planestride, "blendbench");
+        if (backdrop == NULL)
+            return_error(gs_error_VMerror);
+        nos.backdrop = backdrop;
+    }
+
+    for (i = 0; i < npix; i++) {
+        double cb[MAX_COLS], cs[MAX_COLS], c[MAX_COLS], ab, as;
+
+        for (j = 0; j < ncols; j++) {
+            cb[j] = rnd();
+            cs[j] = rnd();
+        }
+        ab = rnd() * max_a;
+        as = rnd() * max_a;
+        /* Where a knockout group is empty, what it leaves depends on its */
+        /* shape, which these buffers don't have.                         */
+        if (kind == GROUP_KNOCKOUT && quant(as, deep ? 65535 : 255) == 0)
+            as = deep ? 1 / 65535.0 : 1 / 255.0;
+        for (j = 0; j < ncols; j++)
+            put_px(&nos, nos.data, j, i, additive ? cb[j] : 1 - cb[j]);
+        put_px(&nos, nos.data, ncols, i, ab);
+        if (kind == GROUP_NONISOLATED) {
+            double ag = quant(as, deep ? 65535 : 255) / (deep ? 65535.0 : 255.0);
+            double ar = over_ref(c, cb, ab, cs, ag, ncols, BLEND_MODE_Normal);
+
+            if (ag == 0)
+                memcpy(c, cb, sizeof(c));
+            for (j = 0; j < ncols; j++)
+                put_px(&tos, tos.data, j, i, additive ? c[j] : 1 - c[j]);
+            put_px(&tos, tos.data, ncols, i, ar);
+            put_px(&tos, tos.data, n_chan, i, ag);
+        } else {
+            for (j = 0; j < ncols; j++)
+                put_px(&tos, tos.data, j, i, additive ? cs[j] : 1 - cs[j]);
+            put_px(&tos, tos.data, ncols, i, as);
+        }
+    }
+    memcpy(saved, nos.data, nos.n_planes * nos.planestride);
+    if (backdrop != NULL) {
+        /* Something has been painted in the knockout group since it began */
+        memcpy(backdrop, nos.data, nos.n_planes * nos.planestride);
+        for (i = 0; i < npix; i++)
+            put_px(&nos, saved, ncols, i, rnd());
+    }
+
+    for (r = 0; r < reps; r++) {
+        memcpy(nos.data, saved, nos.n_planes * nos.planestride);
+        start = clock();
+        pdf14_compose_group(&tos, &nos, NULL, 0, width, 0, height, n_chan,
+                            additive, NULL, false, false, 0, mem,
+                            (gx_device *)pdev);
+        t += seconds(start);
+    }
+    t /= reps;
+
+    for (i = 0; i < npix; i++) {
+        const byte *base = backdrop != NULL ? backdrop : saved;
+        double cb[MAX_COLS], cs[MAX_COLS], c[MAX_COLS], cr[MAX_COLS];
+        double ab, as, a, ar, e;
+
+        for (j = 0; j < ncols; j++) {
+            cb[j] = get_px(&nos, base, j, i);
+            c[j] = get_px(&nos, nos.data, j, i);
+            if (!additive) {
+                cb[j] = 1 - cb[j];
+                c[j] = 1 - c[j];
+            }
+        }
+        ab = get_px(&nos, base, ncols, i);
+        a = get_px(&nos, nos.data, ncols, i);
+        if (kind == GROUP_NONISOLATED) {
+            /* The group's own color, before the backdrop went under it */
+            as = get_px(&tos, tos.data, n_chan, i);
+            for (j = 0; j < ncols; j++) {
+                double ct = get_px(&tos, tos.data, j, i);
+
+                if (!additive)
+                    ct = 1 - ct;
+                cs[j] = as == 0 ? ct : ct + (ct - cb[j]) * (ab / as - ab);
+            }
+        } else {
+            as = get_px(&tos, tos.data, ncols, i);
+            for (j = 0; j < ncols; j++) {
+                cs[j] = get_px(&tos, tos.data, j, i);
+                if (!additive)
+                    cs[j] = 1 - cs[j];
+            }
+        }
+        if (ab == 0)
+            memcpy(cb, cs, sizeof(cb));
+        ar = over_ref(cr, cb, ab, cs, as * tos.alpha / 65535.0, ncols, mode);
+        if (ar == ab && as * tos.alpha == 0)
+            memcpy(cr, cb, sizeof(cr));
+        e = pixel_err(c, a, cr, ar, ncols);
+        if (e > err)
+            err = e;
+    }
+    /* The 8 bit code rounds at every step; the 16 bit code is held to */
+    /* a tenth of an 8 bit step.                                        */
+    tol = deep ? 0.1 : 2.0;
+    bad = err > tol;
+    outprintf(mem, "%2d bit %-4s %-12s %-8s %s  %7.2f ms (%6.1f Mpix/s)  max err %5.2f lsb8 %s\n",
+              deep ? 16 : 8, additive ? "RGB" : "CMYK", kind_names[kind],
+              mode == BLEND_MODE_Normal ? "Normal" : "Multiply",
+              low ? "alpha<30%" : "alpha any",
+              t * 1e3, t > 0 ? npix / t / 1e6 : 0.0, err,
+              bad ? "MISMATCH" : "ok");
+
+    gs_free_object(mem, tos.data, "blendbench");
+    gs_free_object(mem, nos.data, "blendbench");
+    gs_free_object(mem, saved, "blendbench");
+    gs_free_object(mem, backdrop, "blendbench");
+    return bad;
+}
+
+int
+main(int argc, char *argv[])
+{
+    static const struct {
+        gs_blend_mode_t mode;
+        const char *name;
+    } blends[] = {
+        { BLEND_MODE_Multiply, "Multiply" },
+        { BLEND_MODE_Screen, "Screen" },
+        { BLEND_MODE_Darken, "Darken" },
+        { BLEND_MODE_Lighten, "Lighten" },
+        { BLEND_MODE_Difference, "Difference" },
+        { BLEND_MODE_Exclusion, "Exclusion" }
+    };
+    gs_memory_t *mem;
+    pdf14_device *pdev;
+    int width = 1024, height = 256, reps = 20;
+    int i, deep, kind, cols, low, code, fail = 0;
+
+    for (i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-w") == 0)
+            width = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-h") == 0)
+            height = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-n") == 0)
+            reps = atoi(argv[i + 1]);
+        else
+            break;
+    }
+    if (i < argc || width <= 0 || height <= 0 || reps <= 0) {
+        errprintf_nomem("Usage: blendbench [-w width] [-h height] [-n reps]\n");
+        return 1;
+    }
+
+    mem = gs_malloc_init();
+    if (mem == NULL)
+        return 1;
+    /* The kernels only read the shape and overprint state from the device */
+    pdev = (pdf14_device *)gs_alloc_bytes(mem, sizeof(*pdev), "blendbench");
+    if (pdev == NULL)
+        return 1;
+    memset(pdev, 0, sizeof(*pdev));
+    pdev->shape = 1.0;
+    pdev->alpha = 1.0;
+
+    for (deep = 0; deep <= 1; deep++) {
+        for (i = 0; i < countof(blends); i++) {
+            code = bench_blend(mem, pdev, blends[i].mode, blends[i].name, deep,
+                               width * height, reps);
+            fail |= code != 0;
+        }
+        for (kind = FILL_NORMAL; kind <= FILL_KNOCKOUT; kind++) {
+            code = bench_fill(mem, pdev, (fill_kind)kind, deep, width * height, reps);
+            fail |= code != 0;
+        }
+        for (cols = 3; cols <= 4; cols++)
+            for (low = 1; low >= 0; low--) {
+                for (kind = GROUP_ISOLATED; kind <= GROUP_KNOCKOUT; kind++) {
+                    code = bench_group(mem, pdev, (group_kind)kind, BLEND_MODE_Normal,
+                                       cols, deep, low, width, height, reps);
+                    fail |= code != 0;
+                }
+                code = bench_group(mem, pdev, GROUP_ISOLATED, BLEND_MODE_Multiply,
+                                   cols, deep, low, width, height, reps);
+                fail |= code != 0;
+            }
+    }
+    gs_free_object(mem, pdev, "blendbench");
+    gs_malloc_release(mem);
+    return fail;
+}
@@ -0,0 +1,135 @@
+/* Copyright (C) 2001-2019 Artifex Software, Inc.
+   All Rights Reserved.
+
+   This software is provided AS-IS with no warranty, either express or
+   implied.
+
+   This software is distributed under license and may not be copied,
+   modified or distributed except as expressly authorized under the terms
+   of the license contained in the file LICENSE in this distribution.
+
+   Refer to licensing information at http://www.artifex.com or contact
+   Artifex Software, Inc.,  1305 Grant Avenue - Suite 200, Novato,
+   CA 94945, U.S.A., +1(415)492-9861, for further information.
+*/
+
+/*
+ * chunkbench.c: Time the chunk allocator (gsmchunk.c) on a mix of
+ * allocations like that of a clist render thread.
+ *
+ * A table of live blocks is kept; each step frees a random entry and
+ * allocates a new block in its place.  Most blocks are small (paths, clip
+ * lists, device colors), a few are a couple of Kb.  After the run all the
+ * blocks are freed and gs_memory_status is printed, which should then
+ * report nothing in use.
+ *
+ * Build the shared library first ("make so"), then compile from inside
+ * ghostpdl with:
+ * gcc -O2 -I./soobj -I./base -o chunkbench ./toolbin/chunkbench.c -L./sobin -lgs
+ * and run with:
+ * LD_LIBRARY_PATH=./sobin ./chunkbench [-n steps] [-l live]
+ */
+
+#include "std.h"
+#include "gserrors.h"
+#include "gsmalloc.h"
+#include "gsmchunk.h"
+#include "gsmemory.h"
+#include "string_.h"
+#include <stdlib.h>
+#include <time.h>
+
+static uint
+next_size(unsigned int *seed)
+{
+    uint r;
+
+    *seed = *seed * 1103515245 + 12345;
+    r = (*seed >> 8) & 0xffff;
+    if (r < 0xf000)
+        return 8 + (r % 25) * 8;	/* 8 to 200 bytes */
+    return 1024 + (r % 3072);	/* the odd bigger block */
+}
+
+static int
+bench(gs_memory_t *mem, long steps, int live)
+{
+    gs_memory_t *cmem;
+    gs_memory_status_t status;
+    byte **blocks;
+    unsigned int seed = 1;
+    clock_t start;
+    double t;
+    long i;
+    int code, slot;
+
+    code = gs_memory_chunk_wrap(&cmem, mem);
+    if (code < 0)
+        return code;
+    blocks = (byte **)gs_alloc_byte_array(mem, live, sizeof(byte *), "chunkbench");
+    if (blocks == NULL) {
+        gs_memory_chunk_release(cmem);
+        return_error(gs_error_VMerror);
+    }
+    memset(blocks, 0, live * sizeof(byte *));
+
+    start = clock();
+    for (i = 0; i < steps; i++) {
+        seed = seed * 1103515245 + 12345;
+        slot = (seed >> 8) % live;
+        gs_free_object(cmem, blocks[slot], "chunkbench");
+        blocks[slot] = gs_alloc_bytes(cmem, next_size(&seed), "chunkbench");
+        if (blocks[slot] == NULL) {
+            code = gs_note_error(gs_error_VMerror);
+            break;
+        }
+        blocks[slot][0] = (byte)i;
+    }
+    t = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    gs_memory_status(cmem, &status);
+    outprintf(mem, "%ld steps, %d live: %.3f s (%.1f ns per free + alloc)\n",
+              i, live, t, i > 0 ? t * 1e9 / i : 0.0);
+    outprintf(mem, "  while running:  allocated %lu  used %lu\n",
+              (ulong)status.allocated, (ulong)status.used);
+    for (slot = 0; slot < live; slot++)
+        gs_free_object(cmem, blocks[slot], "chunkbench");
+    gs_memory_status(cmem, &status);
+    outprintf(mem, "  all freed:      allocated %lu  used %lu\n",
+              (ulong)status.allocated, (ulong)status.used);
+
+    gs_free_object(mem, blocks, "chunkbench");
+    gs_memory_chunk_release(cmem);
+    return code;
+}
+
+int
+main(int argc, char *argv[])
+{
+    gs_memory_t *mem;
+    long steps = 20000000;
+    int live = 4096;
+    int i, code;
+
+    for (i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-n") == 0)
+            steps = atol(argv[i + 1]);
+        else if (strcmp(argv[i], "-l") == 0)
+            live = atoi(argv[i + 1]);
+        else
+            break;
+    }
+    if (i < argc || steps <= 0 || live <= 0) {
+        errprintf_nomem("Usage: chunkbench [-n steps] [-l live]\n");
+        return 1;
+    }
+
+    mem = gs_malloc_init();
+    if (mem == NULL)
+        return 1;
+    code = bench(mem, steps, live);
+    if (code < 0)
+        errprintf(mem, "error %d\n", code);
+    gs_malloc_release(mem);
+    return code < 0;
+}
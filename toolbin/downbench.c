@@ -0,0 +1,208 @@
+/* Copyright (C) 2001-2019 Artifex Software, Inc.
+   All Rights Reserved.
+
+   This software is provided AS-IS with no warranty, either express or
+   implied.
+
+   This software is distributed under license and may not be copied,
+   modified or distributed except as expressly authorized under the terms
+   of the license contained in the file LICENSE in this distribution.
+
+   Refer to licensing information at http://www.artifex.com or contact
+   Artifex Software, Inc.,  1305 Grant Avenue - Suite 200, Novato,
+   CA 94945, U.S.A., +1(415)492-9861, for further information.
+*/
+
+/*
+ * downbench.c: Time the 8 bit downscaler cores on synthetic data.
+ *
+ * For each component count (grey, RGB, CMYK) and downscale factor, this
+ * fills a memory device with a generated image, then times
+ * gx_downscaler_init, the core alone (ds.down_core called on the device's
+ * own lines), and whole lines through gx_downscaler_getbits.
+ * Every output line is checked against a plain box filter.
+ *
+ * Build the shared library first ("make so"), then compile from inside
+ * ghostpdl with:
+ * gcc -O2 -I./soobj -I./base -o downbench ./toolbin/downbench.c -L./sobin -lgs
+ * and run with:
+ * LD_LIBRARY_PATH=./sobin ./downbench [-w width] [-h height] [-n reps]
+ */
+
+#include "stdio_.h"
+#include "string_.h"
+#include "gserrors.h"
+#include "gsmalloc.h"
+#include "gxdevice.h"
+#include "gxdevmem.h"
+#include "gxdownscale.h"
+#include <stdlib.h>
+#include <time.h>
+
+static double
+seconds(clock_t start)
+{
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Fill the device with something like a scanned page: smooth ramps with */
+/* some noise on top, so that no two neighbouring pixels are equal.        */
+static void
+fill_device(gx_device_memory *mdev, int bytes)
+{
+    unsigned int seed = 12345;
+    int x, y;
+
+    for (y = 0; y < mdev->height; y++) {
+        byte *p = mdev->line_ptrs[y];
+
+        for (x = 0; x < bytes; x++) {
+            seed = seed * 1103515245 + 12345;
+            p[x] = (byte)((x + y * 3) + ((seed >> 16) & 31));
+        }
+    }
+}
+
+/* Check one output line against a box filter of the device contents */
+static int
+check_line(gx_device_memory *mdev, const byte *out, int row, int factor,
+           int nc, int width)
+{
+    int div = factor * factor;
+    int x, c, xx, yy;
+
+    for (x = 0; x < width; x++) {
+        for (c = 0; c < nc; c++) {
+            int sum = 0;
+
+            for (yy = 0; yy < factor; yy++)
+                for (xx = 0; xx < factor; xx++)
+                    sum += mdev->line_ptrs[row * factor + yy][(x * factor + xx) * nc + c];
+            if (out[x * nc + c] != (sum + (div >> 1)) / div) {
+                errprintf(mdev->memory, "mismatch: %d comps, factor %d, row %d, x %d\n",
+                        nc, factor, row, x);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int
+bench(gs_memory_t *mem, int nc, int factor, int width, int height, int reps)
+{
+    gx_device_memory *mdev;
+    gx_downscaler_t ds;
+    byte *out;
+    int span = width * nc;
+    int out_height = height / factor;
+    double t_init, t_core, t_lines;
+    clock_t start;
+    int code, i, row, bad = 0;
+
+    mdev = gs_alloc_struct(mem, gx_device_memory, &st_device_memory, "downbench");
+    if (mdev == NULL)
+        return_error(gs_error_VMerror);
+    gs_make_mem_device(mdev, gdev_mem_device_for_bits(nc * 8), mem, -1, NULL);
+    gx_device_retain((gx_device *)mdev, true);
+    mdev->width = width;
+    mdev->height = height;
+    mdev->bitmap_memory = mem;
+    code = dev_proc(mdev, open_device)((gx_device *)mdev);
+    if (code < 0)
+        return code;
+    fill_device(mdev, span);
+
+    out = gs_alloc_bytes(mem, span, "downbench");
+    if (out == NULL)
+        return_error(gs_error_VMerror);
+
+    /* gx_downscaler_init (with its buffer allocations) and fin */
+    start = clock();
+    for (i = 0; i < reps * 100; i++) {
+        code = gx_downscaler_init(&ds, (gx_device *)mdev, 8, 8, nc, factor, 0, NULL, 0);
+        if (code < 0)
+            return code;
+        gx_downscaler_fin(&ds);
+    }
+    t_init = seconds(start) / (reps * 100);
+
+    code = gx_downscaler_init(&ds, (gx_device *)mdev, 8, 8, nc, factor, 0, NULL, 0);
+    if (code < 0)
+        return code;
+
+    /* The core alone, reading straight from the device's lines. Only */
+    /* cores writing to their own input change it, and this one doesn't. */
+    start = clock();
+    for (i = 0; i < reps; i++)
+        for (row = 0; row < out_height; row++)
+            ds.down_core(&ds, out, mdev->line_ptrs[row * factor], row, 0, mdev->raster);
+    t_core = seconds(start) / reps;
+
+    /* Whole lines, as a device would read them */
+    start = clock();
+    for (i = 0; i < reps; i++)
+        for (row = 0; row < out_height; row++) {
+            code = gx_downscaler_getbits(&ds, out, row);
+            if (code < 0)
+                return code;
+        }
+    t_lines = seconds(start) / reps;
+
+    for (row = 0; row < out_height && !bad; row++) {
+        code = gx_downscaler_getbits(&ds, out, row);
+        if (code < 0)
+            return code;
+        bad = check_line(mdev, out, row, factor, nc, width / factor);
+    }
+    gx_downscaler_fin(&ds);
+
+    outprintf(mem, "%d comps  factor %d  init %8.1f us  core %7.2f ms (%6.1f Mpix/s)  getbits %7.2f ms  %s\n",
+           nc, factor, t_init * 1e6, t_core * 1e3,
+           t_core > 0 ? (double)width * height / t_core / 1e6 : 0.0,
+           t_lines * 1e3, bad ? "MISMATCH" : "ok");
+
+    gs_free_object(mem, out, "downbench");
+    dev_proc(mdev, close_device)((gx_device *)mdev);
+    gs_free_object(mem, mdev, "downbench");
+    return bad;
+}
+
+int
+main(int argc, char *argv[])
+{
+    static const int comps[] = { 1, 3, 4 };
+    gs_memory_t *mem;
+    int width = 4800, height = 1200, reps = 5;
+    int i, factor, code, fail = 0;
+
+    for (i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-w") == 0)
+            width = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-h") == 0)
+            height = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-n") == 0)
+            reps = atoi(argv[i + 1]);
+        else
+            break;
+    }
+    if (i < argc || width <= 0 || height <= 0 || reps <= 0) {
+        errprintf_nomem("Usage: downbench [-w width] [-h height] [-n reps]\n");
+        return 1;
+    }
+
+    mem = gs_malloc_init();
+    if (mem == NULL)
+        return 1;
+    for (i = 0; i < countof(comps); i++)
+        for (factor = 2; factor <= 4; factor++) {
+            code = bench(mem, comps[i], factor, width, height, reps);
+            if (code != 0) {
+                if (code < 0)
+                    errprintf(mem, "error %d: %d comps, factor %d\n", code, comps[i], factor);
+                fail = 1;
+            }
+        }
+    gs_malloc_release(mem);
+    return fail;
+}
@@ -0,0 +1,198 @@
+/* Copyright (C) 2001-2019 Artifex Software, Inc.
+   All Rights Reserved.
+
+   This software is provided AS-IS with no warranty, either express or
+   implied.
+
+   This software is distributed under license and may not be copied,
+   modified or distributed except as expressly authorized under the terms
+   of the license contained in the file LICENSE in this distribution.
+
+   Refer to licensing information at http://www.artifex.com or contact
+   Artifex Software, Inc.,  1305 Grant Avenue - Suite 200, Novato,
+   CA 94945, U.S.A., +1(415)492-9861, for further information.
+*/
+
+/*
+ * htbench.c: Check and time the threshold array halftoning rows in
+ * gxht_thresh.c.
+ *
+ * gx_ht_threshold_row_levels at 1, 2 and 4 bits, and
+ * gx_ht_threshold_row_bit_sub as the downscaler calls it, are run on every
+ * width up to 300 and on one long row, over random data with plenty of
+ * 0 and 255 samples, and every output sample is checked against the plain
+ * formula.  Whichever kernels the library picks for this machine (AVX2,
+ * SSE2, NEON or C) are the ones checked, so run it on each kind of machine
+ * of interest.  Then each is timed on the long row.
+ *
+ * Build the shared library first ("make so"), then compile from inside
+ * ghostpdl with:
+ * gcc -O2 -I./soobj -I./base -o htbench ./toolbin/htbench.c -L./sobin -lgs
+ * and run with:
+ * LD_LIBRARY_PATH=./sobin ./htbench [-w width] [-n reps]
+ */
+
+#include "std.h"
+#include "gserrors.h"
+#include "gsmalloc.h"
+#include "gsmemory.h"
+#include "string_.h"
+#include <stdlib.h>
+#include <time.h>
+
+/* From gxht_thresh.h, which needs the whole image machinery */
+void gx_ht_threshold_row_bit_sub(byte *contone,  byte *threshold_strip,
+                             int contone_stride, byte *halftone,
+                             int dithered_stride, int width, int num_rows,
+                             int offset_bits);
+void gx_ht_threshold_row_levels(byte *contone, byte *thresh, byte *halftone,
+                                int width, int bpc);
+
+#define MAX_CHECK_WIDTH 300
+
+static void
+fill_random(byte *p, int n, unsigned int *seed)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        *seed = *seed * 1103515245 + 12345;
+        switch ((*seed >> 16) & 7) {
+            case 0: p[i] = 0; break;
+            case 1: p[i] = 255; break;
+            default: p[i] = (byte)(*seed >> 20);
+        }
+    }
+}
+
+/* Sample i of a row packed at bpc bits, MSB first */
+static int
+get_sample(const byte *row, int i, int bpc)
+{
+    int bit = i * bpc;
+
+    return (row[bit >> 3] >> (8 - bpc - (bit & 7))) & ((1 << bpc) - 1);
+}
+
+static int
+expected(int c, int t, int bpc)
+{
+    int v = c * ((1 << bpc) - 1) + 254 - t;
+
+    return v > 0 ? v / 255 : 0;
+}
+
+/* bpc 0 stands for gx_ht_threshold_row_bit_sub */
+static void
+run_row(byte *contone, byte *thresh, byte *out, int width, int bpc)
+{
+    if (bpc == 0)
+        gx_ht_threshold_row_bit_sub(contone, thresh, 0, out, 0, width, 1, 0);
+    else
+        gx_ht_threshold_row_levels(contone, thresh, out, width, bpc);
+}
+
+static int
+check_row(gs_memory_t *mem, byte *contone, byte *thresh, byte *out,
+          int width, int bpc)
+{
+    int i, want, got;
+
+    run_row(contone, thresh, out, width, bpc);
+    for (i = 0; i < width; i++) {
+        if (bpc == 0) {
+            want = contone[i] > thresh[i];
+            got = get_sample(out, i, 1);
+        } else {
+            want = expected(contone[i], thresh[i], bpc);
+            got = get_sample(out, i, bpc);
+        }
+        if (want != got) {
+            errprintf(mem, "mismatch: %s %d bit, width %d, x %d: contone %d thresh %d gave %d, not %d\n",
+                      bpc ? "levels" : "bit_sub", bpc ? bpc : 1, width, i,
+                      contone[i], thresh[i], got, want);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int
+bench(gs_memory_t *mem, int width, int reps)
+{
+    static const int depths[] = { 0, 1, 2, 4 };
+    byte *buf, *contone, *thresh, *out;
+    unsigned int seed = 1;
+    int span = (width + 31) & ~31;	/* row_bit_sub works in whole tiles */
+    int failed[countof(depths)];
+    int d, w, i, bad = 0;
+    clock_t start;
+    double t;
+
+    buf = gs_alloc_bytes(mem, span * 3 + 16, "htbench");
+    if (buf == NULL)
+        return_error(gs_error_VMerror);
+    /* row_bit_sub needs 16 byte aligned rows */
+    contone = buf + ((16 - ((size_t)buf & 15)) & 15);
+    thresh = contone + span;
+    out = thresh + span;
+    fill_random(contone, span, &seed);
+    fill_random(thresh, span, &seed);
+
+    for (d = 0; d < countof(depths); d++) {
+        failed[d] = 0;
+        for (w = 1; w <= MAX_CHECK_WIDTH && w <= width && !failed[d]; w++)
+            for (i = 0; i < 4 && !failed[d]; i++) {
+                fill_random(contone, w, &seed);
+                fill_random(thresh, w, &seed);
+                failed[d] = check_row(mem, contone, thresh, out, w, depths[d]);
+            }
+        if (!failed[d])
+            failed[d] = check_row(mem, contone, thresh, out, width, depths[d]);
+        bad |= failed[d];
+    }
+
+    for (d = 0; d < countof(depths); d++) {
+        start = clock();
+        for (i = 0; i < reps; i++)
+            run_row(contone, thresh, out, width, depths[d]);
+        t = (double)(clock() - start) / CLOCKS_PER_SEC / reps;
+        outprintf(mem, "%-8s %d bit  width %d: %8.2f us (%7.1f Mpix/s)  %s\n",
+                  depths[d] ? "levels" : "bit_sub", depths[d] ? depths[d] : 1,
+                  width, t * 1e6, t > 0 ? width / t / 1e6 : 0.0,
+                  failed[d] ? "MISMATCH" : "ok");
+    }
+
+    gs_free_object(mem, buf, "htbench");
+    return bad;
+}
+
+int
+main(int argc, char *argv[])
+{
+    gs_memory_t *mem;
+    int width = 9600, reps = 10000;
+    int i, code;
+
+    for (i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-w") == 0)
+            width = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-n") == 0)
+            reps = atoi(argv[i + 1]);
+        else
+            break;
+    }
+    if (i < argc || width <= 0 || reps <= 0) {
+        errprintf_nomem("Usage: htbench [-w width] [-n reps]\n");
+        return 1;
+    }
+
+    mem = gs_malloc_init();
+    if (mem == NULL)
+        return 1;
+    code = bench(mem, width, reps);
+    if (code < 0)
+        errprintf(mem, "error %d\n", code);
+    gs_malloc_release(mem);
+    return code != 0;
+}